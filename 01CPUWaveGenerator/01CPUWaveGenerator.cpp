@@ -1,75 +1,168 @@
 #include <iostream>
 #include <fstream>
-#include <cmath>
 #include <chrono>
+#include <numeric>
+#include <vector>
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#include "Backend.h"
+#include "Kernels.h"
+#include "LiveStream.h"
+#include "RenderCache.h"
+#include "SampleFormat.h"
+#include "ToneKernels.h"
+#include "WaveFile.h"
+#include "Wavetable.h"
+
+#ifdef SOUND_HAVE_GL
+#include "GLBackend.h"
+#endif
 
 using namespace std;
 
-constexpr float TWO_PI = 6.28318530718;
-
 constexpr int DURATION = 4440;                        // length in seconds
 constexpr int SAMPLE_RATE = 22050; // 44100;                  // Sample rate of the audio file
-constexpr int NUM_SAMPLES = SAMPLE_RATE * DURATION * 2; // Total number of samples in the audio file
-constexpr int BYTES_PER_SAMPLE = 2;                 // Number of bytes per sample (16-bit audio)
-constexpr short NUM_CHANNELS = 1;                   // Number of channels Mono audio
-constexpr int BYTE_RATE = SAMPLE_RATE * NUM_CHANNELS * BYTES_PER_SAMPLE;    // Byte rate
-constexpr short BLOCK_ALIGN = NUM_CHANNELS * BYTES_PER_SAMPLE;              // Block align
-constexpr short BITS_PER_SAMPLE = 16 * BYTES_PER_SAMPLE;                    // Bits per sample
-constexpr int SUBCHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE;
-
-constexpr short AUDIO_FORMAT = 1; // PCM audio
+constexpr int64_t NUM_SAMPLES = int64_t(SAMPLE_RATE) * DURATION * 2; // Total number of samples in the audio file
+constexpr short NUM_CHANNELS = 1;                   // Number of channels, 1 mono, 2 stereo, 6 for 5.1, 8 for 7.1
+constexpr float AMPLITUDE = 32760.0f / 32768.0f;    // tone peak on the float bus, full scale is 1.0
 
 constexpr int FREQUENCY = 200;                      // wave frequency
+constexpr int FREQUENCY_DIVISOR = 1;                // the tone is FREQUENCY / FREQUENCY_DIVISOR Hz, e.g. 4405 / 10 for 440.5 Hz
+
+constexpr int64_t BLOCK_SAMPLES = WAVE_BLOCK_SIZE / (sizeof(float) * NUM_CHANNELS); // frames converted and handed to the writer at a time
+
+// number of samples after which the tone repeats exactly
+int64_t tonePeriod(int64_t sampleRate, int64_t frequency, int64_t divisor)
+{
+    //sample n is at phase n * frequency / (divisor * sampleRate) cycles, so the signal repeats
+    //after the smallest n that makes that a whole number even when a single cycle isn't a whole number of samples
+    const int64_t rate = sampleRate * divisor;
+    return rate / gcd(rate, frequency);
+}
+
+int main(int argc, char* argv[]) {
+    // --format int16|int24|int32|float picks the output samples, dithered int16 by default,
+    // --live target|- streams blocks of --block frames to a FIFO or stdout as they are rendered instead of writing the file,
+    // --realtime paces them at the sample rate, --waveform plays a band-limited saw, square, triangle or pulse instead of the sine,
+    // --container riff|rf64|w64|flac picks the file, flac compresses it losslessly (int16 and int24 only)
+    SampleFormat sampleFormat = SampleFormat::Int16;
+    Waveform waveform = Waveform::Sine;
+    WaveContainer container = WaveContainer::RIFF;
+    LiveOptions live;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc && parseSampleFormat(argv[i + 1], sampleFormat)) {
+            i++;
+        } else if (strcmp(argv[i], "--waveform") == 0 && i + 1 < argc && parseWaveform(argv[i + 1], waveform)) {
+            i++;
+        } else if (strcmp(argv[i], "--container") == 0 && i + 1 < argc && parseWaveContainer(argv[i + 1], container)) {
+            i++;
+        } else if (!parseLiveOption(argc, argv, i, live)) {
+            cerr << "Usage: " << argv[0] << " [--format int16|int24|int32|float] [--waveform sine|saw|square|triangle|pulse]"
+                " [--container riff|rf64|w64|flac] [--live target|- [--block frames] [--realtime]]" << endl;
+            return 1;
+        }
+    }
+    const WaveFormat format = makeWaveFormat(sampleFormat, NUM_CHANNELS, SAMPLE_RATE);
+
+    const string filename = string("CPUoutput") + waveContainerExtension(container);
+
+    // The tone is rendered by the backend the calibration ranked fastest, the CPU kernels when nothing else takes it.
+    // Only the first start on a host pays for the calibration, it is cached. Backends don't round alike,
+    // so the render cache keys on the one that renders
+    BackendEngine engine;
+    engine.addCpuBackends();
+#ifdef SOUND_HAVE_GL
+    engine.add(createGLBackend());
+#endif
+    engine.calibrate();
+
+    // SOUND_CACHE keeps finished renders, the same job again is copied out of it instead of rendered
+    RenderCache renderCache;
+    RenderKey key("01CPUWaveGenerator");
+    key.add("kernels", kernels().name).add("backend", engine.best(BackendJob::Generate).name()).add("format", sampleFormatName(sampleFormat))
+        .add("waveform", waveformName(waveform)).add("container", waveContainerName(container)).add("duration", DURATION).add("rate", SAMPLE_RATE)
+        .add("frequency", FREQUENCY).add("divisor", FREQUENCY_DIVISOR).add("channels", NUM_CHANNELS).add("amplitude", AMPLITUDE);
+    if (!live.target) {
+        auto fetch_start = std::chrono::high_resolution_clock::now();
+        if (renderCache.fetch(key, filename.c_str())) {
+            auto fetch_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - fetch_start).count();
+            std::cout << filename << " copied from the render cache" << std::endl;
+            std::cout << "Elapsed time: " << fetch_time << " ms" << std::endl;
+            renderCache.report(std::cout);
+            return 0;
+        }
+    }
 
-
-int main() {
-    ofstream outFile("CPUoutput.wav", ios::out | ios::binary);
-    if (!outFile) {
-        cerr << "Error: could not open output file" << endl;
+    WaveWriter outFile;
+    if (!live.target && !outFile.open(filename.c_str(), format, container)) {
         return 1;
     }
 
-    // Write the WAV header
-    const int SUBCHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE;
-    const int CHUNK_SIZE = 36 + SUBCHUNK_SIZE;
-
-    outFile << "RIFF"; // Chunk ID
-    outFile.write(reinterpret_cast<const char*>(&CHUNK_SIZE), 4); // Chunk size
-    outFile << "WAVE"; // Format
-    outFile << "fmt "; // Subchunk 1 ID
-    const int Subchunk = 16;
-    outFile.write(reinterpret_cast<const char*>(&Subchunk), 4); // Subchunk 1 size
-    outFile.write(reinterpret_cast<const char*>(&AUDIO_FORMAT), 2); // Audio format
-    outFile.write(reinterpret_cast<const char*>(&NUM_CHANNELS), 2); // Number of channels
-    outFile.write(reinterpret_cast<const char*>(&SAMPLE_RATE), 4); // Sample rate
-    outFile.write(reinterpret_cast<const char*>(&BYTE_RATE), 4); // Byte rate
-    outFile.write(reinterpret_cast<const char*>(&BLOCK_ALIGN), 2); // Block align
-    outFile.write(reinterpret_cast<const char*>(&BITS_PER_SAMPLE), 2); // Bits per sample
-    outFile << "data"; // Subchunk 2 ID
-    outFile.write(reinterpret_cast<const char*>(&SUBCHUNK_SIZE), 4); // Subchunk 2 size
-
     // Get the current time
     auto start_time = std::chrono::high_resolution_clock::now();
 
-    short *buffer = new short[SAMPLE_RATE];
-
-    for(int i = 0; i < DURATION * 2; i++) {
-        // Generate and write the audio data
-        for (int j = 0; j < SAMPLE_RATE; j++) {
+    // Render one repeat of the signal interleaved on the float bus. Channel c carries harmonic c + 1
+    // of the tone so the channels can be told apart, its period divides the fundamental's so one repeat covers all
+    const int64_t period = min(tonePeriod(SAMPLE_RATE, FREQUENCY, FREQUENCY_DIVISOR), NUM_SAMPLES);
+
+    // bus amplitude, (c + 1) * FREQUENCY / FREQUENCY_DIVISOR / SAMPLE_RATE cycles per sample
+    ToneBlock tone;
+    tone.waveform = waveform;
+    tone.amplitude = AMPLITUDE;
+    tone.channels = NUM_CHANNELS;
+    for (int c = 0; c < NUM_CHANNELS; c++) {
+        tone.increment[c] = static_cast<double>(FREQUENCY) * (c + 1) / FREQUENCY_DIVISOR / SAMPLE_RATE;
+    }
 
-            const double t = static_cast<double>(j) / SAMPLE_RATE;      // time in seconds
+    // Replicate it into a block holding a whole number of repeats so consecutive blocks join seamlessly
+    const int64_t repeats = max<int64_t>(1, BLOCK_SAMPLES / period);
+    vector<float> buffer(period * repeats * NUM_CHANNELS);
+    if (!engine.generate(tone, SampleFormat::Float, buffer.data(), period, 0)) {
+        return 1;
+    }
+    for (int64_t i = 1; i < repeats; i++) {
+        copy(buffer.begin(), buffer.begin() + period * NUM_CHANNELS, buffer.begin() + i * period * NUM_CHANNELS);
+    }
 
-            const double sample = 32760 * sin(TWO_PI * FREQUENCY * t);  // 16-bit amplitude
+    const int64_t bufferFrames = period * repeats;
 
-            buffer[j] = static_cast<short>(sample);                     // convert to 16-bit integer
+    // Live: small blocks cut from the replicas wherever the stream is, wrapping back to their start
+    if (live.target) {
+        LiveStream stream(format, live.blockFrames, live.paced);
+        if (!stream.open(live.target)) {
+            return 1;
         }
-
-        outFile.write(reinterpret_cast<const char*>(buffer), SAMPLE_RATE * 2); // write to file
+        const bool ok = stream.run(NUM_SAMPLES, [&](uint64_t first, size_t n, char* block) {
+            for (size_t done = 0; done < n; ) {
+                const int64_t at = (first + done) % bufferFrames;
+                const size_t m = static_cast<size_t>(min<int64_t>(n - done, bufferFrames - at));
+                convertSamples(buffer.data() + at * NUM_CHANNELS, block + done * format.blockAlign(), m * NUM_CHANNELS, sampleFormat, (first + done) * NUM_CHANNELS);
+                done += m;
+            }
+            return true;
+        });
+        stream.report(cerr);
+        return ok ? 0 : 1;
     }
 
-    delete[] buffer;
+    // Write only replicas from now on, converted per block so the int16 dither never repeats with them
+    vector<char> converted(bufferFrames * format.blockAlign());
+    for (int64_t written = 0; written < NUM_SAMPLES; ) {
+        const int64_t n = min<int64_t>(bufferFrames, NUM_SAMPLES - written);
 
-    outFile.close();
+        convertSamples(buffer.data(), converted.data(), n * NUM_CHANNELS, sampleFormat, written * NUM_CHANNELS);
+        if (!outFile.write(converted.data(), n * format.blockAlign())) { // write to file
+            cerr << "Error: could not write " << filename << endl;
+            return 1;
+        }
+        written += n;
+    }
+
+    if (!outFile.close()) {
+        return 1;
+    }
 
     // Get the current time again
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -80,6 +173,8 @@ int main() {
     // Print the elapsed time
     std::cout << "Elapsed time: " << elapsed_time << " ms" << std::endl;
 
+    renderCache.store(key, filename.c_str());
+    renderCache.report(std::cout);
 
     return 0;
 }
\ No newline at end of file
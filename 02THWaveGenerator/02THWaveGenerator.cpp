@@ -1,97 +1,161 @@
 #include <iostream>
 #include <fstream>
-#include <cmath>
 #include <chrono>
-#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+#include <string>
 #include <vector>
 
-constexpr float TWO_PI = 6.28318530718;
+#include "Additive.h"
+#include "BlockPipeline.h"
+#include "Kernels.h"
+#include "PlanarBuffer.h"
+#include "RenderCache.h"
+#include "SampleFormat.h"
+#include "ToneKernels.h"
+#include "WaveFile.h"
+#include "Wavetable.h"
 
-const int NUM_THREADS = 8; // Number of threads to use for parallel processing
+constexpr int64_t BLOCK_SAMPLES = 1 << 20;          // frames per pipeline block, the pipeline keeps a few per thread in memory
 
 constexpr int DURATION = 4440;                        // length in seconds
 constexpr int SAMPLE_RATE = 22050; // 44100;                  // Sample rate of the audio file
-constexpr int NUM_SAMPLES = SAMPLE_RATE * DURATION * 2; // Total number of samples in the audio file
-constexpr int BYTES_PER_SAMPLE = 2;                 // Number of bytes per sample (16-bit audio)
-constexpr short NUM_CHANNELS = 1;                   // Number of channels Mono audio
-constexpr int BYTE_RATE = SAMPLE_RATE * NUM_CHANNELS * BYTES_PER_SAMPLE;    // Byte rate
-constexpr short BLOCK_ALIGN = NUM_CHANNELS * BYTES_PER_SAMPLE;              // Block align
-constexpr short BITS_PER_SAMPLE = 16 * BYTES_PER_SAMPLE;                    // Bits per sample
-constexpr int SUBCHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE;
-
-constexpr short AUDIO_FORMAT = 1; // PCM audio
+constexpr int64_t NUM_SAMPLES = int64_t(SAMPLE_RATE) * DURATION * 2; // Total number of samples in the audio file
+constexpr short NUM_CHANNELS = 1;                   // Number of channels, 1 mono, 2 stereo, 6 for 5.1, 8 for 7.1
+constexpr float AMPLITUDE = 32760.0f / 32768.0f;    // tone peak on the float bus, full scale is 1.0
 
 constexpr int FREQUENCY = 200;                      // wave frequency
 
+constexpr double PARTIALS_TOP = 0.45;               // highest partial of --partials as a fraction of the sample rate
+constexpr uint32_t PARTIALS_SEED = 2024;            // the partials' phases are random, but the same on every run
 
-int main() {
-    std::ofstream outFile("R:\THoutput.wav", std::ios::out | std::ios::binary);
-    if (!outFile) {
-        std::cerr << "Error: could not open output file" << std::endl;
-        return 1;
-    }
-
-    // Write the WAV header
-    const int SUBCHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE;
-    const int CHUNK_SIZE = 36 + SUBCHUNK_SIZE;
-
-    outFile << "RIFF"; // Chunk ID
-    outFile.write(reinterpret_cast<const char*>(&CHUNK_SIZE), 4); // Chunk size
-    outFile << "WAVE"; // Format
-    outFile << "fmt "; // Subchunk 1 ID
-    const int Subchunk = 16;
-    outFile.write(reinterpret_cast<const char*>(&Subchunk), 4); // Subchunk 1 size
-    outFile.write(reinterpret_cast<const char*>(&AUDIO_FORMAT), 2); // Audio format
-    outFile.write(reinterpret_cast<const char*>(&NUM_CHANNELS), 2); // Number of channels
-    outFile.write(reinterpret_cast<const char*>(&SAMPLE_RATE), 4); // Sample rate
-    outFile.write(reinterpret_cast<const char*>(&BYTE_RATE), 4); // Byte rate
-    outFile.write(reinterpret_cast<const char*>(&BLOCK_ALIGN), 2); // Block align
-    outFile.write(reinterpret_cast<const char*>(&BITS_PER_SAMPLE), 2); // Bits per sample
-    outFile << "data"; // Subchunk 2 ID
-    outFile.write(reinterpret_cast<const char*>(&SUBCHUNK_SIZE), 4); // Subchunk 2 size
-
-    // Get the current time
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    const int chunkSize = NUM_SAMPLES / NUM_THREADS;
-
-    short (*output)[chunkSize] = new short[NUM_THREADS][chunkSize];
-    std::vector<std::thread> threads(NUM_THREADS);
+// 'count' partials log-spaced from 'lowest' Hz to just under Nyquist, sharing AMPLITUDE between them
+OscillatorBank makePartials(size_t count, double lowest)
+{
+    OscillatorBank bank(SAMPLE_RATE);
+    bank.reserve(count);
 
-    for (int i = 0; i < NUM_THREADS; i++) {
+    std::mt19937 random(PARTIALS_SEED);
+    const double ratio = count > 1 ? std::pow(PARTIALS_TOP * SAMPLE_RATE / lowest, 1.0 / (count - 1)) : 1.0;
+    for (size_t k = 0; k < count; k++) {
+        bank.add(lowest * std::pow(ratio, double(k)), AMPLITUDE / count, random() / 4294967296.0);
+    }
+    return bank;
+}
+
+
+int main(int argc, char* argv[]) {
+    // --format int16|int24|int32|float picks the output samples, dithered int16 by default.
+    // --partials n replaces the tone with n partials of an additive synth,
+    // --waveform plays a band-limited saw, square, triangle or pulse instead of the sine,
+    // --container riff|rf64|w64|flac picks the file, flac compresses it losslessly (int16 and int24 only)
+    SampleFormat sampleFormat = SampleFormat::Int16;
+    Waveform waveform = Waveform::Sine;
+    WaveContainer container = WaveContainer::RIFF;
+    size_t numPartials = 0;
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 < argc && strcmp(argv[i], "--format") == 0 && parseSampleFormat(argv[i + 1], sampleFormat)) {
+            i++;
+        } else if (i + 1 < argc && strcmp(argv[i], "--partials") == 0 && atol(argv[i + 1]) > 0) {
+            numPartials = static_cast<size_t>(atol(argv[++i]));
+        } else if (i + 1 < argc && strcmp(argv[i], "--waveform") == 0 && parseWaveform(argv[i + 1], waveform)) {
+            i++;
+        } else if (i + 1 < argc && strcmp(argv[i], "--container") == 0 && parseWaveContainer(argv[i + 1], container)) {
+            i++;
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--format int16|int24|int32|float] [--partials n]"
+                " [--waveform sine|saw|square|triangle|pulse] [--container riff|rf64|w64|flac]" << std::endl;
+            return 1;
+        }
+    }
+    const WaveFormat format = makeWaveFormat(sampleFormat, NUM_CHANNELS, SAMPLE_RATE);
 
-        int startIndex = i * chunkSize;
-        
-        int endIndex = (i == NUM_THREADS - 1) ? NUM_SAMPLES : startIndex + chunkSize;
+    // channel c starts its partials at harmonic c + 1 of the tone
+    std::vector<OscillatorBank> banks;
+    for (int c = 0; numPartials > 0 && c < NUM_CHANNELS; c++) {
+        banks.push_back(makePartials(numPartials, double(FREQUENCY) * (c + 1)));
+    }
 
-        threads[i] = std::thread(
-            [startIndex, endIndex, chunkSize](short* output) {
+    const std::string filename = std::string("R:\\THoutput") + waveContainerExtension(container);
+
+    // SOUND_CACHE keeps finished renders, the same job again is copied out of it instead of rendered
+    RenderCache renderCache;
+    RenderKey key("02THWaveGenerator");
+    key.add("kernels", kernels().name).add("format", sampleFormatName(sampleFormat)).add("waveform", waveformName(waveform))
+        .add("partials", numPartials).add("seed", PARTIALS_SEED).add("container", waveContainerName(container))
+        .add("duration", DURATION).add("rate", SAMPLE_RATE).add("frequency", FREQUENCY).add("channels", NUM_CHANNELS).add("amplitude", AMPLITUDE);
+    auto fetch_start = std::chrono::high_resolution_clock::now();
+    if (renderCache.fetch(key, filename.c_str())) {
+        auto fetch_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - fetch_start).count();
+        std::cout << filename << " copied from the render cache" << std::endl;
+        std::cout << "Elapsed time: " << fetch_time << " ms" << std::endl;
+        renderCache.report(std::cout);
+        return 0;
+    }
 
-                for (int j = 0; j < chunkSize && j < endIndex - startIndex; j++) {
-                    
-                    const double t = static_cast<double>(j) / SAMPLE_RATE;      // time in seconds
+    WaveWriter outFile;
+    if (!outFile.open(filename.c_str(), format, container)) {
+        return 1;
+    }
 
-                    const double sample = 32760 * sin(TWO_PI * FREQUENCY * t);  // 16-bit amplitude
+    // Get the current time
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-                    output[j] = static_cast<short>(sample);                     // convert to 16-bit integer
+    const uint64_t numBlocks = (NUM_SAMPLES + BLOCK_SAMPLES - 1) / BLOCK_SAMPLES;
+
+    // the workers generate blocks anywhere ahead while this thread writes them in order
+    BlockPipeline pipeline(BLOCK_SAMPLES * format.blockAlign());
+
+    const bool written = pipeline.run(numBlocks,
+        [sampleFormat, waveform, &format, &banks](uint64_t index, char* block, size_t) {
+            const int64_t first = index * BLOCK_SAMPLES;
+            const int64_t count = std::min(BLOCK_SAMPLES, NUM_SAMPLES - first);
+
+            // channel c carries harmonic c + 1 of the tone so the channels can be told apart
+            if (banks.empty()) {
+                ToneBlock tone;
+                tone.waveform = waveform;
+                tone.amplitude = AMPLITUDE;
+                tone.channels = NUM_CHANNELS;
+                for (int c = 0; c < NUM_CHANNELS; c++) {
+                    const int64_t frequency = int64_t(FREQUENCY) * (c + 1);
+
+                    // the phase comes from the absolute sample position so the wave continues across blocks,
+                    // frequency / SAMPLE_RATE cycles per sample, reduced in integers to stay exact
+                    tone.phase[c] = static_cast<double>(first % SAMPLE_RATE * frequency % SAMPLE_RATE) / SAMPLE_RATE;
+                    tone.increment[c] = static_cast<double>(frequency) / SAMPLE_RATE;
                 }
-            },
-            output[i]
-        );
-    }
-    
-    for (int i = 0; i < NUM_THREADS; i++) {
-        threads[i].join();
-    }
 
-    
-    
-    for (int i = 0; i < NUM_THREADS; i++) {
-        outFile.write(reinterpret_cast<const char*>(output[i]), chunkSize * 2);
+                // straight into the block, by the kernel specialized for this format and channel count when
+                // there is one. The dither follows the absolute sample index
+                renderToneBlock(tone, sampleFormat, block, count, first);
+                return static_cast<size_t>(count * format.blockAlign());
+            }
+
+            // every channel's partials are rendered into its own plane on the float bus,
+            // the block already runs on a worker so the bank renders it on this thread
+            FloatPlanarBuffer planes(NUM_CHANNELS, count);
+            for (int c = 0; c < NUM_CHANNELS; c++) {
+                banks[c].render(planes.channel(c), first, count);
+            }
+
+            // then interleaved and converted into the block, the dither follows the absolute sample index
+            AlignedBuffer<float> bus(count * NUM_CHANNELS);
+            kernels().interleaveFloat(planes.planes(), bus.data(), NUM_CHANNELS, count);
+            convertSamples(bus.data(), block, count * NUM_CHANNELS, sampleFormat, first * NUM_CHANNELS);
+
+            return static_cast<size_t>(count * format.blockAlign());
+        },
+        [&outFile](uint64_t, const char* block, size_t bytes) {
+            return outFile.write(block, bytes);
+        });
+
+    if (!written || !outFile.close()) {
+        return 1;
     }
-    
-
-    outFile.close();
 
     // Get the current time again
     auto end_time = std::chrono::high_resolution_clock::now();
@@ -102,5 +166,8 @@ int main() {
     // Print the elapsed time
     std::cout << "Elapsed time: " << elapsed_time << " ms" << std::endl;
 
+    renderCache.store(key, filename.c_str());
+    renderCache.report(std::cout);
+
     return 0;
 }
\ No newline at end of file
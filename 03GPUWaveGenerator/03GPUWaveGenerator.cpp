@@ -5,44 +5,66 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <cstring>
+#include <algorithm>
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
+
+#include "FeedbackRing.h"
+#include "GLContext.h"
+#include "RenderCache.h"
+#include "WaveFile.h"
+#include "Wavetable.h"
 
 constexpr int DURATION = 4440;                        // length in seconds
 constexpr int SAMPLE_RATE = 22050; // 44100;                  // Sample rate of the audio file
 constexpr int NUM_SAMPLES = SAMPLE_RATE * DURATION * 2; // Total number of samples in the audio file
 constexpr int BYTES_PER_SAMPLE = 2;                 // Number of bytes per sample (16-bit audio)
 constexpr short NUM_CHANNELS = 1;                   // Number of channels Mono audio
-constexpr int BYTE_RATE = SAMPLE_RATE * NUM_CHANNELS * BYTES_PER_SAMPLE;    // Byte rate
-constexpr short BLOCK_ALIGN = NUM_CHANNELS * BYTES_PER_SAMPLE;              // Block align
-constexpr short BITS_PER_SAMPLE = 16 * BYTES_PER_SAMPLE;                    // Bits per sample
-constexpr int SUBCHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE;
+constexpr short BITS_PER_SAMPLE = 8 * BYTES_PER_SAMPLE;                     // Bits per sample
                   
 constexpr int FREQUENCY = 200;                      // wave frequency
+constexpr int CHUNK_SAMPLES = 1 << 20;             // samples per draw, each one read back while the next ones are computed
 
 const char* vertexShaderSource = R"(
     #version 330 core
     uniform float sample_rate;
     uniform float frequency;
     uniform int period;
+    uniform int first_point;    // of the chunk being drawn
+    uniform int table_level;    // level of the wavetable to play, -1 for the sine
+    uniform sampler2D wavetable; // a row of (value, slope) pairs per level, WAVETABLE_SIZE wide
 
     out int wave_output;
+
+    //one sample at 'u' cycles, interpolated from the band-limited table the way the CPU kernels do
+    float wave(float u)
+    {
+        const float TWO_PI = 6.28318530718;
+        if (table_level < 0) {
+            return sin(TWO_PI * u);
+        }
+
+        int size = textureSize(wavetable, 0).x;
+        float x = (u - floor(u)) * float(size);
+        int whole = int(x);
+        vec2 pair = texelFetch(wavetable, ivec2(whole & (size - 1), table_level), 0).xy;
+        return pair.x + (x - float(whole)) * pair.y;
+    }
     
     void main()
     {
-        const float TWO_PI = 6.28318530718; 
         const float MAX_AMPLITUDE = 32760; //max 16bit value to prevent distorsions
 
         //we use gl_VertexID to track time but we limit it by the period so that we avoid overflow
-        float i = float((gl_VertexID % period) * 2);
+        float i = float(((first_point + gl_VertexID) % period) * 2);
 
         //sample A  present second
         float t = i / sample_rate;                                              // time in seconds
-        int sampleA = int(MAX_AMPLITUDE * sin(TWO_PI * frequency * t)) << 16;   // 16-bit amplitude
+        int sampleA = int(MAX_AMPLITUDE * wave(frequency * t)) << 16;          // 16-bit amplitude
 
         //sample B  a second ahead
         t = (i + 1) / sample_rate;                                              // next second
-        int sampleB = int(MAX_AMPLITUDE * sin(TWO_PI * frequency * t)) ;        // 16-bit amplitude
+        int sampleB = int(MAX_AMPLITUDE * wave(frequency * t)) ;               // 16-bit amplitude
 
         wave_output = sampleA | (0x0000FFFF & sampleB); // we pack the two samples together back to the CPU
 
@@ -52,7 +74,6 @@ const char* vertexShaderSource = R"(
 int printError()
 {
     std::cout << glewGetErrorString(glGetError()) << std::endl;
-    glfwTerminate();
     exit(1);
 }
 
@@ -73,7 +94,6 @@ GLuint createShader(const char* vertexShaderSource)
     if (!success) {
         glGetShaderInfoLog(vertexShader, sizeof infoLog, NULL, infoLog);
         std::cout << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        glfwTerminate();
         return -1;
     }
 
@@ -97,7 +117,6 @@ GLuint createShader(const char* vertexShaderSource)
     if (!success) {
         glGetProgramInfoLog(shaderProgram, sizeof infoLog, NULL, infoLog);
         std::cout << "Error linking shader program:\n" << infoLog << std::endl;
-        glfwTerminate();
         return -1;
     }
 
@@ -107,64 +126,56 @@ GLuint createShader(const char* vertexShaderSource)
     return shaderProgram;
 }
 
-int saveWave(const char* filename, const char* data)
+WaveFormat waveFormat()
 {
-    // Write the merged audio data to a new file
-    std::ofstream outFile(filename, std::ios::binary);
-    if (!outFile) {
-        std::cerr << "Error: could not open output file" << std::endl;
-        return false;
-    }
-    int chunkSize = 36 + SUBCHUNK_SIZE;
-    outFile << "RIFF";                                                  // Chunk ID
-    outFile.write(reinterpret_cast<char*>(&chunkSize), 4);              // Chunk size
-    outFile << "WAVE";                                                  // Format
-    outFile << "fmt ";                                                  // Subchunk 1 ID
-    outFile.write("\x10\x00\x00\x00", 4);                               // Subchunk1Size
-    outFile.write("\x01\x00", 2);                                       // AudioFormat PCM audio
-    outFile.write(reinterpret_cast<const char*>(&NUM_CHANNELS), 2);     // Number of channels Mono audio
-    outFile.write(reinterpret_cast<const char*>(&SAMPLE_RATE), 4);      // Sample rate
-    outFile.write(reinterpret_cast<const char*>(&BYTE_RATE), 4);        // Byte rate
-    outFile.write(reinterpret_cast<const char*>(&BLOCK_ALIGN), 2);      // Block align
-    outFile.write(reinterpret_cast<const char*>(&BITS_PER_SAMPLE), 2);  // Bits per sample
-    outFile << "data";                                                  // Subchunk 2 ID
-    outFile.write(reinterpret_cast<const char*>(&SUBCHUNK_SIZE), 4);    // Subchunk 2 size
-    outFile.write(data, SUBCHUNK_SIZE);
-    outFile.close();
-
-    return true;
+    WaveFormat format;
+    format.numChannels = NUM_CHANNELS;
+    format.sampleRate = SAMPLE_RATE;
+    format.bitsPerSample = BITS_PER_SAMPLE;
+
+    return format;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
-    // Initialize GLFW and create a window
-    if (!glfwInit()) {
-        std::cout << "Failed to initialize GLFW" << std::endl;
-        return -1;
+    // --waveform plays a band-limited saw, square, triangle or pulse instead of the sine
+    Waveform waveform = Waveform::Sine;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--waveform") == 0 && i + 1 < argc && parseWaveform(argv[i + 1], waveform)) {
+            i++;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [--waveform sine|saw|square|triangle|pulse]" << std::endl;
+            return 1;
+        }
     }
 
-    //we create a minimal window
-    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLEW and create the compute shader program
-    if (glewInit() != GLEW_OK) {
-        std::cout << "Failed to initialize GLEW" << std::endl;
-        glfwTerminate();
+    // a headless context, no window or display server needed
+    GLContext context;
+    if (!context.create()) {
+        std::cout << "Failed to create a GL context" << std::endl;
         return -1;
     }
 
+    std::cout << context.platform() << std::endl;
     std::cout << glGetString(GL_VERSION) << std::endl;
     std::cout << glGetString(GL_VENDOR) << std::endl;
     std::cout << glGetString(GL_RENDERER) << std::endl;
     //std::cout << glGetString(GL_EXTENSIONS) << std::endl;
 
+    // SOUND_CACHE keeps finished renders, the same job on the same GL driver is copied out of it instead of rendered
+    RenderCache renderCache;
+    RenderKey key("03GPUWaveGenerator");
+    key.add("renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER))).add("version", reinterpret_cast<const char*>(glGetString(GL_VERSION)))
+        .add("waveform", waveformName(waveform)).add("duration", DURATION).add("rate", SAMPLE_RATE).add("frequency", FREQUENCY);
+    auto fetch_start = std::chrono::high_resolution_clock::now();
+    if (renderCache.fetch(key, "GPUoutput.wav")) {
+        auto fetch_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - fetch_start).count();
+        std::cout << "GPUoutput.wav copied from the render cache" << std::endl;
+        std::cout << "Elapsed time: " << fetch_time << " ms" << std::endl;
+        renderCache.report(std::cout);
+        return 0;
+    }
+
     GLuint shaderProgram = createShader(vertexShaderSource);
 
     glUseProgram(shaderProgram);
@@ -178,62 +189,79 @@ int main()
     GLint period = glGetUniformLocation(shaderProgram, "period");
     glUniform1i(period, SAMPLE_RATE / FREQUENCY);
 
+    GLint firstPoint = glGetUniformLocation(shaderProgram, "first_point");
+
+    // core profiles draw nothing without a vertex array, even one with no attributes
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+
+    // the other waveforms read their wavetable, one texture row per level
+    GLuint table = 0;
+    GLint tableLevel = glGetUniformLocation(shaderProgram, "table_level");
+    if (waveform == Waveform::Sine) {
+        glUniform1i(tableLevel, -1);
+    } else {
+        glGenTextures(1, &table);
+        glBindTexture(GL_TEXTURE_2D, table);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, WAVETABLE_SIZE, WAVETABLE_LEVELS, 0, GL_RG, GL_FLOAT, Wavetable::get(waveform).level(0));
+        glUniform1i(glGetUniformLocation(shaderProgram, "wavetable"), 0);
+        glUniform1i(tableLevel, static_cast<GLint>(Wavetable::levelFor(double(FREQUENCY) / SAMPLE_RATE)));
+    }
 
-    // setup a buffer for retriving the data
-    GLuint tbo;
-    glGenBuffers(1, &tbo);
-    glBindBuffer(GL_ARRAY_BUFFER, tbo);
-    glBufferData(GL_ARRAY_BUFFER, NUM_SAMPLES * BYTES_PER_SAMPLE, nullptr, GL_STATIC_READ);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo);
-
-    // Get the current time
-    auto start_time = std::chrono::high_resolution_clock::now();
-
-    //we disable the raster stage (fragment shader) as we don't need it.
-    glEnable(GL_RASTERIZER_DISCARD);
-
-    // Begin transform feedback
-    glBeginTransformFeedback(GL_POINTS);
-
-    // Draw the points
-    glDrawArrays(GL_POINTS, 0, NUM_SAMPLES/2);
-
-    // End transform feedback
-    glEndTransformFeedback();
-
-    glFlush();
 
-    //we enable back the raster stage (fragment shader)
-    glDisable(GL_RASTERIZER_DISCARD);
+    // the chunks come back through a ring of feedback buffers, mapped once when the context can
+    FeedbackRing ring;
+    if (!ring.init(CHUNK_SAMPLES * BYTES_PER_SAMPLE, context.bufferStorage())) {
+        std::cout << "Failed to create the feedback buffers" << std::endl;
+        return -1;
+    }
 
+    // written chunk by chunk as they come back, it can't be save in the in-memory drive
+    WaveWriter outFile;
+    if (!outFile.open("GPUoutput.wav", waveFormat())) {
+        return 1;
+    }
 
-    // Retrieve the transformed data from the buffer
-    short* output = new short[NUM_SAMPLES];
+    // Get the current time
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    ///short output[NUM_SAMPLES];
+    //the oldest chunk goes from its feedback buffer into the writer, which still has the one before on its way to the disk
+    auto writeOldest = [&ring, &outFile]() {
+        size_t bytes;
+        const void* chunk = ring.retire(bytes);
+        return chunk && outFile.write(chunk, bytes);
+    };
+
+    //chunk k is read back while the chunks after it are computed
+    for (int first = 0; first < NUM_SAMPLES; first += CHUNK_SAMPLES) {
+        if (ring.full() && !writeOldest()) {
+            return 1;
+        }
+
+        const int count = std::min(CHUNK_SAMPLES, NUM_SAMPLES - first);
+        glUniform1i(firstPoint, first / 2);
+        ring.draw(count / 2, size_t(count) * BYTES_PER_SAMPLE);
+    }
+    while (ring.inFlight() > 0) {
+        if (!writeOldest()) {
+            return 1;
+        }
+    }
 
-    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, NUM_SAMPLES * BYTES_PER_SAMPLE, output);
+    if (!outFile.close()) {
+        return 1;
+    }
 
     // Get the current time again
     auto end_time = std::chrono::high_resolution_clock::now();
-    /*
-    for (int i = 0; i < 10; i += 2) {
-        printf("%#04x %#04x\n", output[i], output[i + 1]);
-    }
-    */
-    
-    //saveWave("R:\GPUoutput.wav", reinterpret_cast<char*>(output)); //it can't be save in the in-memory drive
-    saveWave("GPUoutput.wav", reinterpret_cast<char*>(output));
 
     // Clean up resources
-
-    delete[] output;
-    glDeleteBuffers(1, &tbo);
+    glDeleteTextures(1, &table);
+    glDeleteVertexArrays(1, &vao);
     glDeleteProgram(shaderProgram);
-    glfwTerminate();
-
-    
-
 
     // Calculate the elapsed time
     auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
@@ -241,5 +269,8 @@ int main()
     // Print the elapsed time
     std::cout << "Elapsed time: " << elapsed_time << " ms" << std::endl;
 
+    renderCache.store(key, "GPUoutput.wav");
+    renderCache.report(std::cout);
+
     return 0;
 }
\ No newline at end of file
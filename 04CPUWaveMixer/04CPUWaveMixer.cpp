@@ -1,129 +1,277 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <cstdio>
+#include <string>
+
+#include "Backend.h"
+#include "LiveStream.h"
+#include "MappedFile.h"
+#include "Mixer.h"
+#include "Overview.h"
+#include "Resampler.h"
+#include "SampleFormat.h"
+#include "WaveFile.h"
+
+#ifdef SOUND_HAVE_GL
+#include "GLBackend.h"
+#endif
 
 using namespace std;
 
-const int SAMPLE_RATE = 44100; // sample rate in Hz
 const int BYTES_PER_SAMPLE = 2; // 16-bit audio
 
-int main() {
-    // Load the WAV files into memory
-    ifstream inFile1("output.wav", ios::binary);
-    if (!inFile1) {
-        cerr << "Error: could not open input file 1" << endl;
+// Mix straight from the input pages into the output pages, no read/write copies at all
+int mixMapped(const vector<MixTrack>& tracks, const vector<TrackReader>& inFiles, const vector<float>& gains, const WaveFormat& outFormat,
+    SampleFormat sampleFormat, WaveContainer container, uint64_t NUM_SAMPLES)
+{
+    vector<MappedFile> maps(tracks.size());
+    vector<const short*> sources;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        // The pages are mixed as they are, there is nowhere to resample or decode them on the way
+        if (inFiles[i].resampled() || inFiles[i].file().compressed()) {
+            cerr << "Error: --mmap needs every track uncompressed and at the mix rate, " << tracks[i].filename << " is not" << endl;
+            return 1;
+        }
+        if (!maps[i].open(tracks[i].filename.c_str())) {
+            return 1;
+        }
+        sources.push_back(reinterpret_cast<const short*>(maps[i].data() + inFiles[i].file().dataOffset()));
+    }
+
+    // Size the output file up front and map it too
+    const string filename = string("output3") + waveContainerExtension(container);
+    uint64_t outOffset;
+    if (!WaveWriter::preallocate(filename.c_str(), outFormat, NUM_SAMPLES * outFormat.blockAlign(), outOffset, container)) {
         return 1;
     }
-    ifstream inFile2("output2.wav", ios::binary);
-    if (!inFile2) {
-        cerr << "Error: could not open input file 2" << endl;
+    MappedFile mapOut;
+    if (!mapOut.open(filename.c_str(), MappedFile::Access::ReadWrite)) {
         return 1;
     }
 
-    // Read the WAV headers
-    inFile1.seekg(0, ios::beg);
-    inFile2.seekg(0, ios::beg);
-
-    char chunkID[4];
-    int chunkSize;
-    char format[4];
-    char subchunk1ID[4];
-    int subchunk1Size;
-    short audioFormat;
-    short numChannels;
-    int sampleRate;
-    int byteRate;
-    short blockAlign;
-    short bitsPerSample;
-    char subchunk2ID[4];
-    int subchunk2Size;
-
-    inFile1.read(chunkID, 4);
-    inFile1.read((char*)&chunkSize, 4);
-    inFile1.read(format, 4);
-    inFile1.read(subchunk1ID, 4);
-    inFile1.read((char*)&subchunk1Size, 4);
-    inFile1.read((char*)&audioFormat, 2);
-    inFile1.read((char*)&numChannels, 2);
-    inFile1.read((char*)&sampleRate, 4);
-    inFile1.read((char*)&byteRate, 4);
-    inFile1.read((char*)&blockAlign, 2);
-    inFile1.read((char*)&bitsPerSample, 2);
-    inFile1.read(subchunk2ID, 4);
-    inFile1.read((char*)&subchunk2Size, 4);
-
-    inFile2.read(chunkID, 4);
-    inFile2.read((char*)&chunkSize, 4);
-    inFile2.read(format, 4);
-    inFile2.read(subchunk1ID, 4);
-    inFile2.read((char*)&subchunk1Size, 4);
-    inFile2.read((char*)&audioFormat, 2);
-    inFile2.read((char*)&numChannels, 2);
-    inFile2.read((char*)&sampleRate, 4);
-    inFile2.read((char*)&byteRate, 4);
-    inFile2.read((char*)&blockAlign, 2);
-    inFile2.read((char*)&bitsPerSample, 2);
-    inFile2.read(subchunk2ID, 4);
-    inFile2.read((char*)&subchunk2Size, 4);
-
-    // Check that the WAV files have the same format and sample rate
-    if (audioFormat != 1 || numChannels != 1 || sampleRate != SAMPLE_RATE || bitsPerSample != 8 * BYTES_PER_SAMPLE) {
-        cerr << "Error: input files must be 16-bit mono WAV files with a sample rate of 44.1 kHz" << endl;
+    // Merge the audio data, the frames are split into channel planes a block at a time and mixed on the float bus
+    mixInterleaved(sources.data(), gains.data(), sources.size(), outFormat.numChannels, mapOut.data() + outOffset, sampleFormat, NUM_SAMPLES, nullptr);
+
+    // The dirty pages are written back before the file is reported done, a failed write shows up here and nowhere else
+    if (!mapOut.flush()) {
+        cerr << "Error: could not write output file " << filename << endl;
         return 1;
     }
 
-    // Compute the number of samples and the total file size
-    const int NUM_SAMPLES = subchunk2Size / BYTES_PER_SAMPLE;
-    const int CHUNK_SIZE = 36 + subchunk2Size;
+    // There is no writer to build the overview on the way, it is reduced from the output pages while they are still resident
+    OverviewBuilder overview;
+    if (OverviewBuilder::enabled() && overview.start(outFormat)) {
+        overview.add(mapOut.data() + outOffset, NUM_SAMPLES * outFormat.blockAlign());
+        if (!overview.write((filename + OVERVIEW_EXTENSION).c_str())) {
+            return 1;
+        }
+    }
 
-    // Merge the audio data
-    vector<short> samples1(NUM_SAMPLES);
-    vector<short> samples2(NUM_SAMPLES);
-    //inFile
+    cout << "Merged audio data written to " << filename << endl;
 
+    return 0;
+}
 
-    // Read the audio data into the buffers
-    for (int i = 0; i < NUM_SAMPLES; i++) {
-        short sample1, sample2;
-        inFile1.read((char*)&sample1, BYTES_PER_SAMPLE);
-        inFile2.read((char*)&sample2, BYTES_PER_SAMPLE);
-        samples1[i] = sample1;
-        samples2[i] = sample2;
+int main(int argc, char* argv[]) {
+    // --mmap mixes through memory mappings instead of reading the files into buffers,
+    // --stream reads, mixes and writes one block at a time so memory doesn't grow with the files,
+    // --format int16|int24|int32|float picks the output samples, dithered int16 by default,
+    // --rate hz is the mix rate, tracks at other rates are resampled on the way in (the first track's rate by default),
+    // --container riff|rf64|w64|flac picks the output file, flac compresses it losslessly (FLAC tracks are read as they are),
+    // --live target|- streams blocks of --block frames to a FIFO or stdout as they are mixed, --realtime paces them,
+    // --patch mixes again only the blocks whose tracks changed since the last --patch and writes them into the existing output,
+    // --range first:last mixes again the blocks holding frames [first, last) at the mix rate and writes them the same way
+    bool useMmap = false;
+    bool useStream = false;
+    bool usePatch = false;
+    bool useRange = false;
+    uint64_t rangeFirst = 0;
+    uint64_t rangeLast = 0;
+    SampleFormat sampleFormat = SampleFormat::Int16;
+    WaveContainer container = WaveContainer::RIFF;
+    uint32_t SAMPLE_RATE = 0;
+    LiveOptions live;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strcmp(argv[first], "--mmap") == 0) {
+            useMmap = true;
+        } else if (strcmp(argv[first], "--stream") == 0) {
+            useStream = true;
+        } else if (strcmp(argv[first], "--patch") == 0) {
+            usePatch = true;
+        } else if (strcmp(argv[first], "--range") == 0 && first + 1 < argc &&
+                   sscanf(argv[first + 1], "%" SCNu64 ":%" SCNu64, &rangeFirst, &rangeLast) == 2 && rangeFirst < rangeLast) {
+            useRange = true;
+            first++;
+        } else if (strcmp(argv[first], "--format") == 0 && first + 1 < argc && parseSampleFormat(argv[first + 1], sampleFormat)) {
+            first++;
+        } else if (strcmp(argv[first], "--rate") == 0 && first + 1 < argc && (SAMPLE_RATE = atoi(argv[first + 1])) > 0) {
+            first++;
+        } else if (strcmp(argv[first], "--container") == 0 && first + 1 < argc && parseWaveContainer(argv[first + 1], container)) {
+            first++;
+        } else if (!parseLiveOption(argc, argv, first, live)) {
+            cerr << "Error: unknown option " << argv[first] << endl;
+            return 1;
+        }
     }
 
-    // Merge the audio data
-    vector<short> mergedSamples(NUM_SAMPLES);
-    for (int i = 0; i < NUM_SAMPLES; i++) {
+    // The tracks to mix, as name.wav or name.wav@gain, the two generator outputs by default
+    vector<MixTrack> tracks;
+    if (!parseMixTracks(argc, argv, first, { "output.wav", "output2.wav" }, tracks)) {
+        return 1;
+    }
 
-        mergedSamples[i] = (samples1[i] + samples2[i]) >> 1;
-        //mergedSamples[i] = (samples1[i] + samples2[i]);
+    // Open the WAV files at the mix rate, the first one sets it unless --rate did
+    vector<TrackReader> inFiles(tracks.size());
+    vector<float> gains;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (!inFiles[i].open(tracks[i].filename.c_str(), i == 0 ? SAMPLE_RATE : inFiles[0].rate())) {
+            cerr << "Error: could not open input file " << tracks[i].filename << endl;
+            return 1;
+        }
+        gains.push_back(busGain(tracks[i].gain));
     }
+    SAMPLE_RATE = inFiles[0].rate();
 
-    // Write the merged audio data to a WAV file
-    ofstream outFile("output3.wav", ios::binary);
-    if (!outFile) {
-        cerr << "Error: could not open output file" << endl;
+    // Check that the WAV files have the same format and channel count
+    const uint16_t NUM_CHANNELS = inFiles[0].format().numChannels;
+    for (const TrackReader& inFile : inFiles) {
+        const WaveFormat& format = inFile.format();
+        if (format.audioFormat != WAVE_FORMAT_PCM || format.bitsPerSample != 8 * BYTES_PER_SAMPLE) {
+            cerr << "Error: input files must be 16-bit WAV or FLAC files" << endl;
+            return 1;
+        }
+        if (format.numChannels != NUM_CHANNELS || NUM_CHANNELS > MAX_CHANNELS) {
+            cerr << "Error: input files must all have the same number of channels, up to " << MAX_CHANNELS << endl;
+            return 1;
+        }
+    }
+
+    // Compute the number of frames at the mix rate, the shortest file decides
+    uint64_t NUM_SAMPLES = inFiles[0].numFrames();
+    for (const TrackReader& inFile : inFiles) {
+        NUM_SAMPLES = min(NUM_SAMPLES, inFile.numFrames());
+    }
+
+    const WaveFormat outFormat = makeWaveFormat(sampleFormat, NUM_CHANNELS, SAMPLE_RATE);
+    const string filename = string("output3") + waveContainerExtension(container);
+
+    // Patch the output of an earlier run in place, the render cache would only copy over all of it
+    if (usePatch || useRange) {
+        if (useMmap || useStream || live.target) {
+            cerr << "Error: --patch and --range don't go with --mmap, --stream or --live" << endl;
+            return 1;
+        }
+        if (useRange && rangeFirst >= NUM_SAMPLES) {
+            cerr << "Error: the range starts past the " << NUM_SAMPLES << " frames of the mix" << endl;
+            return 1;
+        }
+        PatchStats stats;
+        if (!patchTracks(inFiles, gains.data(), filename.c_str(), outFormat, container, NUM_SAMPLES, useRange ? rangeFirst : 0,
+                useRange ? min(rangeLast, NUM_SAMPLES) : NUM_SAMPLES, usePatch, nullptr, stats)) {
+            return 1;
+        }
+
+        cout << "Patched " << filename << ": " << stats.mixed << " of " << stats.blocks << " blocks mixed again, " << stats.read << " read"
+             << (stats.rebuilt ? " (the file held no such mix, it was written whole)" : "") << endl;
+
+        return 0;
+    }
+
+    // The buffered mix goes to the backend the calibration ranked fastest, the CPU kernels when nothing else takes it.
+    // Only the first start on a host pays for the calibration, it is cached
+    const bool buffered = !useMmap && !useStream && !live.target;
+    BackendEngine engine;
+    if (buffered) {
+        engine.addCpuBackends();
+#ifdef SOUND_HAVE_GL
+        engine.add(createGLBackend());
+#endif
+        engine.calibrate();
+    }
+
+    // SOUND_CACHE keeps finished mixes, the same tracks mixed again by any of the modes here or by 05 are copied out of it.
+    // The CPU backends give the bits the other modes give, any other backend rounds its own way and gets a key of its own
+    RenderCache renderCache;
+    RenderKey key("mix");
+    const bool keyed = !live.target && renderCache.enabled() && addMixKey(key, tracks, SAMPLE_RATE, sampleFormat, container);
+    if (keyed && buffered && !dynamic_cast<CpuBackend*>(&engine.best(BackendJob::Mix))) {
+        key.add("backend", engine.best(BackendJob::Mix).name());
+    }
+    if (keyed && renderCache.fetch(key, filename.c_str())) {
+        cout << "Merged audio data copied from the render cache to " << filename << endl;
+        renderCache.report(cout);
+        return 0;
+    }
+    auto store = [&]() {
+        if (keyed) {
+            renderCache.store(key, filename.c_str());
+            renderCache.report(cout);
+        }
+        return 0;
+    };
+
+    if (live.target) {
+        LiveStream stream(outFormat, live.blockFrames, live.paced);
+        if (!stream.open(live.target)) {
+            return 1;
+        }
+        const bool ok = streamTracksLive(inFiles, gains.data(), stream, sampleFormat, NUM_SAMPLES);
+        stream.report(cerr);
+        return ok ? 0 : 1;
+    }
+
+    if (useMmap) {
+        if (mixMapped(tracks, inFiles, gains, outFormat, sampleFormat, container, NUM_SAMPLES) != 0) {
+            return 1;
+        }
+        return store();
+    }
+
+    if (useStream) {
+        WaveWriter outFile;
+        if (!outFile.open(filename.c_str(), outFormat, container) || !streamTracks(inFiles, gains.data(), outFile, NUM_SAMPLES, nullptr) || !outFile.close()) {
+            return 1;
+        }
+
+        cout << "Merged audio data written to " << filename << endl;
+
+        return store();
+    }
+
+    // Read the audio data into the buffers, one plane per channel, resampled where needed
+    vector<PlanarBuffer> samples(inFiles.size());
+    for (size_t i = 0; i < inFiles.size(); i++) {
+        samples[i].allocate(NUM_CHANNELS, NUM_SAMPLES);
+        if (inFiles[i].readPlanar(samples[i], NUM_SAMPLES) != NUM_SAMPLES) {
+            cerr << "Error: could not read input file " << tracks[i].filename << endl;
+            return 1;
+        }
+    }
+
+    // Merge the audio data channel by channel on the float bus
+    FloatPlanarBuffer mergedSamples(NUM_CHANNELS, NUM_SAMPLES);
+    vector<const short*> sources(samples.size());
+    for (size_t c = 0; c < NUM_CHANNELS; c++) {
+        for (size_t i = 0; i < samples.size(); i++) {
+            sources[i] = samples[i].channel(c);
+        }
+        if (!engine.mix(sources.data(), gains.data(), sources.size(), SampleFormat::Float, mergedSamples.channel(c), NUM_SAMPLES, 0)) {
+            return 1;
+        }
+    }
+
+    // Write the merged audio data to a WAV file, interleaving and converting it on the way out
+    WaveWriter outFile;
+    if (!outFile.open(filename.c_str(), outFormat, container) || !outFile.writePlanar(mergedSamples, NUM_SAMPLES) || !outFile.close()) {
         return 1;
     }
-    outFile.write("RIFF", 4);
-    outFile.write((char*)&CHUNK_SIZE, 4);
-    outFile.write("WAVE", 4);
-    outFile.write("fmt ", 4);
-    outFile.write((char*)&subchunk1Size, 4);
-    outFile.write((char*)&audioFormat, 2);
-    outFile.write((char*)&numChannels, 2);
-    outFile.write((char*)&SAMPLE_RATE, 4);
-    outFile.write((char*)&byteRate, 4);
-    outFile.write((char*)&blockAlign, 2);
-    outFile.write((char*)&bitsPerSample, 2);
-    outFile.write("data", 4);
-    outFile.write((char*)&subchunk2Size, 4);
-    for (int i = 0; i < NUM_SAMPLES; i++) {
-        outFile.write((char*)&mergedSamples[i], BYTES_PER_SAMPLE);
-    }
-    outFile.close();
-
-    cout << "Merged audio data written to output.wav" << endl;
 
-    return 0;
+    cout << "Merged audio data written to " << filename << endl;
+
+    return store();
 }
\ No newline at end of file
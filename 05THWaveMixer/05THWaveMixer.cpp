@@ -1,76 +1,120 @@
 #include <iostream>
-#include <fstream>
 #include <vector>
-#include <thread>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "Mixer.h"
+#include "Resampler.h"
+#include "SampleFormat.h"
+#include "ThreadPool.h"
+#include "WaveFile.h"
 
 using namespace std;
 
-const int NUM_SAMPLES = 44100; // Total number of samples in the audio file
 const int BYTES_PER_SAMPLE = 2; // Number of bytes per sample (16-bit audio)
-const int CHUNK_SIZE = NUM_SAMPLES * BYTES_PER_SAMPLE + 36; // Size of the data chunk in the WAV file
-const int SAMPLE_RATE = 44100; // Sample rate of the audio file
-const int NUM_THREADS = 4; // Number of threads to use for parallel processing
 
-void mergeBuffers(const vector<short>& buffer1, const vector<short>& buffer2, vector<short>& mergedBuffer, int startIndex, int endIndex)
+int main(int argc, char* argv[])
 {
-    for (int i = startIndex; i < endIndex; i++) {
-        mergedBuffer[i] = buffer1[i] + buffer2[i];
+    // --stream keeps only a ring of blocks in memory instead of the whole files,
+    // --format int16|int24|int32|float picks the output samples, dithered int16 by default,
+    // --rate hz is the mix rate, tracks at other rates are resampled on the way in (the first track's rate by default),
+    // --container riff|rf64|w64|flac picks the output file, flac compresses it losslessly (FLAC tracks are read as they are)
+    bool useStream = false;
+    SampleFormat sampleFormat = SampleFormat::Int16;
+    WaveContainer container = WaveContainer::RIFF;
+    uint32_t SAMPLE_RATE = 0;
+    int first = 1;
+    for (; first < argc && strncmp(argv[first], "--", 2) == 0; first++) {
+        if (strcmp(argv[first], "--stream") == 0) {
+            useStream = true;
+        } else if (strcmp(argv[first], "--format") == 0 && first + 1 < argc && parseSampleFormat(argv[first + 1], sampleFormat)) {
+            first++;
+        } else if (strcmp(argv[first], "--rate") == 0 && first + 1 < argc && (SAMPLE_RATE = atoi(argv[first + 1])) > 0) {
+            first++;
+        } else if (strcmp(argv[first], "--container") == 0 && first + 1 < argc && parseWaveContainer(argv[first + 1], container)) {
+            first++;
+        } else {
+            cerr << "Error: unknown option " << argv[first] << endl;
+            return 1;
+        }
     }
-}
 
-int main()
-{
-    // Read the audio data into the buffers
-    ifstream inFile1("output.wav", ios::binary);
-    ifstream inFile2("output2.wav", ios::binary);
-    if (!inFile1 || !inFile2) {
-        cerr << "Error: could not open input file" << endl;
+    // The tracks to mix, as name.wav or name.wav@gain, the two generator outputs by default
+    vector<MixTrack> tracks;
+    if (!parseMixTracks(argc, argv, first, { "output.wav", "output2.wav" }, tracks)) {
         return 1;
     }
-    inFile1.ignore(44); // Ignore the WAV header
-    inFile2.ignore(44); // Ignore the WAV header
-    vector<short> buffer1(NUM_SAMPLES);
-    vector<short> buffer2(NUM_SAMPLES);
-    inFile1.read((char*)&buffer1[0], NUM_SAMPLES * BYTES_PER_SAMPLE);
-    inFile2.read((char*)&buffer2[0], NUM_SAMPLES * BYTES_PER_SAMPLE);
 
-    // Merge the audio data using multiple threads
-    vector<short> mergedBuffer(NUM_SAMPLES);
-    vector<thread> threads(NUM_THREADS);
-    int chunkSize = NUM_SAMPLES / NUM_THREADS;
-    for (int i = 0; i < NUM_THREADS; i++) {
-        int startIndex = i * chunkSize;
-        int endIndex = (i == NUM_THREADS - 1) ? NUM_SAMPLES : startIndex + chunkSize;
-        threads[i] = thread(mergeBuffers, ref(buffer1), ref(buffer2), ref(mergedBuffer), startIndex, endIndex);
+    // Read the audio data into the buffers at the mix rate, the first file sets it unless --rate did
+    vector<TrackReader> inFiles(tracks.size());
+    vector<float> gains;
+    size_t NUM_SAMPLES = SIZE_MAX;
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (!inFiles[i].open(tracks[i].filename.c_str(), i == 0 ? SAMPLE_RATE : inFiles[0].rate())) {
+            cerr << "Error: could not open input file " << tracks[i].filename << endl;
+            return 1;
+        }
+        if (inFiles[i].format().audioFormat != WAVE_FORMAT_PCM || inFiles[i].format().bitsPerSample != 8 * BYTES_PER_SAMPLE) {
+            cerr << "Error: input files must be 16-bit WAV or FLAC files" << endl;
+            return 1;
+        }
+        if (inFiles[i].format().numChannels != inFiles[0].format().numChannels || inFiles[i].format().numChannels > MAX_CHANNELS) {
+            cerr << "Error: input files must all have the same number of channels, up to " << MAX_CHANNELS << endl;
+            return 1;
+        }
+        NUM_SAMPLES = min<size_t>(NUM_SAMPLES, inFiles[i].numFrames());
+        gains.push_back(busGain(tracks[i].gain));
     }
-    for (int i = 0; i < NUM_THREADS; i++) {
-        threads[i].join();
+
+    const uint16_t NUM_CHANNELS = inFiles[0].format().numChannels;
+    const WaveFormat outFormat = makeWaveFormat(sampleFormat, NUM_CHANNELS, inFiles[0].rate());
+    const string filename = string("output3") + waveContainerExtension(container);
+
+    // SOUND_CACHE keeps finished mixes, the same tracks mixed again here or by 04 are copied out of it
+    RenderCache renderCache;
+    RenderKey key("mix");
+    const bool keyed = renderCache.enabled() && addMixKey(key, tracks, inFiles[0].rate(), sampleFormat, container);
+    if (keyed && renderCache.fetch(key, filename.c_str())) {
+        cout << "Merged audio data copied from the render cache to " << filename << endl;
+        renderCache.report(cout);
+        return 0;
     }
+    auto store = [&]() {
+        if (keyed) {
+            renderCache.store(key, filename.c_str());
+            renderCache.report(cout);
+        }
+        return 0;
+    };
 
-    // Write the merged audio data to a WAV file
-    ofstream outFile("output3.wav", ios::binary);
-    if (!outFile) {
-        cerr << "Error: could not open output file" << endl;
-        return 1;
+    if (useStream) {
+        WaveWriter outFile;
+        if (!outFile.open(filename.c_str(), outFormat, container) || !streamTracks(inFiles, gains.data(), outFile, NUM_SAMPLES, &ThreadPool::shared()) || !outFile.close()) {
+            return 1;
+        }
+        return store();
     }
-    outFile.write("RIFF", 4);
-    outFile.write((char*)&CHUNK_SIZE, 4);
-    outFile.write("WAVE", 4);
-    outFile.write("fmt ", 4);
-    outFile.write("\x10\0\0\0", 4); // Subchunk1Size (16 bytes)
-    outFile.write("\x01\0", 2); // AudioFormat (PCM)
-    outFile.write("\x01\0", 2); // NumChannels (1)
-    outFile.write((char*)&SAMPLE_RATE, 4);
-    const int ByteRate = SAMPLE_RATE * BYTES_PER_SAMPLE;
-    outFile.write((char*)&ByteRate, 4); // ByteRate
-    outFile.write("\x02\0", 2); // BlockAlign (2 bytes per sample)
-    outFile.write("\x10\0", 2); // BitsPerSample (
 
-    outFile.write("data", 4);
+    vector<PlanarBuffer> buffers(tracks.size());
+    for (size_t i = 0; i < tracks.size(); i++) {
+        buffers[i].allocate(NUM_CHANNELS, NUM_SAMPLES);
+        if (inFiles[i].readPlanar(buffers[i], NUM_SAMPLES) != NUM_SAMPLES) {
+            cerr << "Error: could not read input file " << tracks[i].filename << endl;
+            return 1;
+        }
+    }
+
+    // Merge the audio data on the shared thread pool, one channel plane after the other on the float bus
+    FloatPlanarBuffer mergedBuffer(NUM_CHANNELS, NUM_SAMPLES);
+    mixPlanar(buffers, gains.data(), mergedBuffer, NUM_SAMPLES, &ThreadPool::shared());
 
-    const int Subchunk2Size = NUM_SAMPLES * BYTES_PER_SAMPLE;
-    outFile.write((char*)&Subchunk2Size, 4); // Subchunk2Size
-    outFile.write((char*)&mergedBuffer[0], NUM_SAMPLES * BYTES_PER_SAMPLE);
+    // Write the merged audio data to a WAV file
+    WaveWriter outFile;
+    if (!outFile.open(filename.c_str(), outFormat, container) || !outFile.writePlanar(mergedBuffer, NUM_SAMPLES) || !outFile.close()) {
+        return 1;
+    }
 
-    return 0;
+    return store();
 }
\ No newline at end of file
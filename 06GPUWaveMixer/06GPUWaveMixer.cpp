@@ -5,12 +5,17 @@
 #include <vector>
 #include <string>
 #include <chrono>
+#include <algorithm>
 #include <GL/glew.h>
-#include <GLFW/glfw3.h>
 
-constexpr int NUM_SAMPLES = 195804000; // Total number of samples in the audio file
+#include "FeedbackRing.h"
+#include "GLContext.h"
+#include "RenderCache.h"
+#include "Resampler.h"
+#include "WaveFile.h"
+
 constexpr int BYTES_PER_SAMPLE = 2; // Number of bytes per sample (16-bit audio)
-constexpr int SAMPLE_RATE = 22050; // Sample rate of the audio file
+constexpr int BLOCK_SAMPLES = 1 << 20; // Samples mixed per draw, even so every point gets a whole pair
 
 const char* vertexShaderSource = R"(
     #version 330 core
@@ -36,31 +41,23 @@ const char* vertexShaderSource = R"(
 int printError()
 {
     std::cout << glewGetErrorString(glGetError()) << std::endl;
-    glfwTerminate();
     exit(1);
 }
 
-// Read the audio data into the buffers
-std::vector<short> buffer1(NUM_SAMPLES);
-std::vector<short> buffer2(NUM_SAMPLES);
-std::vector<short> pMergedBuffer(NUM_SAMPLES);
-
 GLint success;
 GLchar infoLog[512];
 
-bool loadWav(const char* filename, std::vector<short>& buffer)
+bool openWav(const char* filename, TrackReader& file, uint32_t rate)
 {
-    std::ifstream inFile(filename, std::ios::binary);
-
-    //if any of the files isn't present...
-    if (!inFile) {
-        std::cerr << "Error: could not open input file" << std::endl;
+    //if the file isn't present... a file at another rate than the mix is resampled as it is read
+    if (!file.open(filename, rate)) {
         return false;
     }
-    inFile.ignore(44); // Ignore the WAV header
-    inFile.read(reinterpret_cast<char *>(buffer.data()), NUM_SAMPLES * BYTES_PER_SAMPLE);
 
-    inFile.close();
+    if (file.format().bitsPerSample != 8 * BYTES_PER_SAMPLE || file.format().numChannels != 1) {
+        std::cerr << "Error: " << filename << " is not a 16-bit mono WAV file" << std::endl;
+        return false;
+    }
 
     return true;
 }
@@ -79,7 +76,6 @@ GLuint createShader(const char* vertexShaderSource)
     if (!success) {
         glGetShaderInfoLog(vertexShader, sizeof infoLog, NULL, infoLog);
         std::cout << "Vertex shader compilation failed:\n" << infoLog << std::endl;
-        glfwTerminate();
         return -1;
     }
 
@@ -103,7 +99,6 @@ GLuint createShader(const char* vertexShaderSource)
     if (!success) {
         glGetProgramInfoLog(shaderProgram, sizeof infoLog, NULL, infoLog);
         std::cout << "Error linking shader program:\n" << infoLog << std::endl;
-        glfwTerminate();
         return -1;
     }
 
@@ -113,12 +108,13 @@ GLuint createShader(const char* vertexShaderSource)
     return shaderProgram;
 }
 
-GLuint createBuffer(GLuint shaderProgram, const void* data, const char* attribName) {
+GLuint createBuffer(GLuint shaderProgram, const char* attribName) {
     GLuint waveHandle;
 
+    //one block, refilled for every draw
     glGenBuffers(1, &waveHandle);
     glBindBuffer(GL_ARRAY_BUFFER, waveHandle);
-    glBufferData(GL_ARRAY_BUFFER, NUM_SAMPLES * BYTES_PER_SAMPLE, data, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, BLOCK_SAMPLES * BYTES_PER_SAMPLE, nullptr, GL_STREAM_DRAW);
 
     GLint inputAttrib = glGetAttribLocation(shaderProgram, attribName);
     glEnableVertexAttribArray(inputAttrib);
@@ -134,67 +130,27 @@ GLuint createBuffer(GLuint shaderProgram, const void* data, const char* attribNa
     return waveHandle;
 }
 
-int saveWave(const char* filename, const char* data, size_t dataSize)
+// Upload one block of each input, pad an odd block with a silent sample so the last point has its pair
+void uploadBlock(GLuint waveHandle, TrackReader& file, PlanarBuffer& block, size_t count)
 {
-    // Write the merged audio data to a new file
-    std::ofstream outFile(filename, std::ios::binary);
-    if (!outFile) {
-        std::cerr << "Error: could not open output file" << std::endl;
-        return false;
-    }
-    int chunkSize = 36 + dataSize;
-    outFile.write("RIFF", 4);
-    outFile.write(reinterpret_cast<char *>(&chunkSize), 4);
-    outFile.write("WAVE", 4);
-    outFile.write("fmt ", 4);
-    outFile.write("\x10\x00\x00\x00", 4); // Subchunk1Size
-    outFile.write("\x01\x00", 2); // AudioFormat
-
-    const short NUM_CHANNELS = 1; // Mono audio
-    outFile.write(reinterpret_cast<const char*>(&NUM_CHANNELS), 2);
-    outFile.write(reinterpret_cast<const char*>(&SAMPLE_RATE), 4);
-
-    const int BYTE_RATE = SAMPLE_RATE * NUM_CHANNELS * BYTES_PER_SAMPLE; // Byte rate
-    outFile.write(reinterpret_cast<const char*>(&BYTE_RATE), 4);
-
-    const short BLOCK_ALIGN = NUM_CHANNELS * BYTES_PER_SAMPLE; // Block align
-    outFile.write(reinterpret_cast<const char*>(&BLOCK_ALIGN), 2);
-
-    const short BITS_PER_SAMPLE = 16 * BYTES_PER_SAMPLE; // Bits per sample
-    outFile.write(reinterpret_cast<const char*>(&BITS_PER_SAMPLE), 2);
-    outFile.write("data", 4);
-    outFile.write(reinterpret_cast<const char*>(&dataSize), 4);
-    outFile.write(data, dataSize);
-    outFile.close();
+    file.readPlanar(block, count);
+    block.channel(0)[count] = 0;
 
-    return true;
+    glBindBuffer(GL_ARRAY_BUFFER, waveHandle);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, (count + 1) / 2 * 2 * BYTES_PER_SAMPLE, block.channel(0));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 int main()
 {
-    // Initialize GLFW and create a window
-    if (!glfwInit()) {
-        std::cout << "Failed to initialize GLFW" << std::endl;
-        return -1;
-    }
-        
-    //we create a minimal window
-    GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
-    if (!window) {
-        glfwTerminate();
-        return -1;
-    }
-
-    // Make the window's context current
-    glfwMakeContextCurrent(window);
-
-    // Initialize GLEW and create the compute shader program
-    if (glewInit() != GLEW_OK) {
-        std::cout << "Failed to initialize GLEW" << std::endl;
-        glfwTerminate();
+    // a headless context, no window or display server needed
+    GLContext context;
+    if (!context.create()) {
+        std::cout << "Failed to create a GL context" << std::endl;
         return -1;
     }
 
+    std::cout << context.platform() << std::endl;
     std::cout << glGetString(GL_VERSION) << std::endl;
     std::cout << glGetString(GL_VENDOR) << std::endl;
     std::cout << glGetString(GL_RENDERER) << std::endl;
@@ -205,50 +161,90 @@ int main()
     glUseProgram(shaderProgram);
 
     //if any of the files aren't present...
-    if (!loadWav("output.wav", buffer1) 
-        || !loadWav("output2.wav", buffer2)) {
+    //the first file sets the mix rate
+    TrackReader inFile1, inFile2;
+    if (!openWav("output.wav", inFile1, 0)
+        || !openWav("output2.wav", inFile2, inFile1.rate())) {
 
         std::cerr << "Error: could not open input file" << std::endl;
         return 1;
     }
+    const uint64_t NUM_SAMPLES = std::min(inFile1.numFrames(), inFile2.numFrames());
+
+    // SOUND_CACHE keeps finished mixes, the same two inputs mixed again on the same GL driver are copied out of it
+    RenderCache renderCache;
+    RenderKey key("06GPUWaveMixer");
+    key.add("renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER))).add("version", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    const bool keyed = renderCache.enabled() && key.addFile("track", "output.wav") && key.addFile("track", "output2.wav");
+    auto fetch_start = std::chrono::high_resolution_clock::now();
+    if (keyed && renderCache.fetch(key, "output3.wav")) {
+        auto fetch_time = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - fetch_start).count();
+        std::cout << "output3.wav copied from the render cache" << std::endl;
+        std::cout << "Elapsed time: " << fetch_time << " ms" << std::endl;
+        renderCache.report(std::cout);
+        return 0;
+    }
 
-    // Allocate and initialize the buffers on the GPU
-    GLuint wave1Handle = createBuffer(shaderProgram, &buffer1[0], "wave1");
-    GLuint wave2Handle = createBuffer(shaderProgram, &buffer2[0], "wave2");
+    WaveWriter outFile;
+    if (!outFile.open("output3.wav", inFile1.format())) {
+        return 1;
+    }
 
-    // setup a buffer for retriving 
-    GLuint tbo;
-    glGenBuffers(1, &tbo);
-    glBindBuffer(GL_ARRAY_BUFFER, tbo);
-    glBufferData(GL_ARRAY_BUFFER, NUM_SAMPLES * BYTES_PER_SAMPLE, nullptr, GL_STATIC_READ);
-    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, tbo);
+    // core profiles keep the attribute setup in a vertex array
+    GLuint vao;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
 
-    // Get the current time
-    auto start_time = std::chrono::high_resolution_clock::now();
+    // Allocate the block buffers on the GPU, they are reused for the whole file
+    GLuint wave1Handle = createBuffer(shaderProgram, "wave1");
+    GLuint wave2Handle = createBuffer(shaderProgram, "wave2");
 
-    //we disable the raster stage (fragment shader) as we don't need it.
-    glEnable(GL_RASTERIZER_DISCARD);
+    // the mix comes back through a ring of feedback buffers, mapped once when the context can
+    FeedbackRing ring;
+    if (!ring.init(BLOCK_SAMPLES * BYTES_PER_SAMPLE, context.bufferStorage())) {
+        std::cout << "Failed to create the feedback buffers" << std::endl;
+        return 1;
+    }
 
-    // Begin transform feedback
-    glBeginTransformFeedback(GL_POINTS);
+    // The only host memory: one block per input, the mix is written out of the feedback buffers
+    PlanarBuffer buffer1(1, BLOCK_SAMPLES + 1);
+    PlanarBuffer buffer2(1, BLOCK_SAMPLES + 1);
+
+    // Get the current time
+    auto start_time = std::chrono::high_resolution_clock::now();
 
-    // Draw the points
-    glDrawArrays(GL_POINTS, 0, NUM_SAMPLES/2);
+    //the oldest block goes from its feedback buffer into the writer, which still has the one before on its way to the disk
+    auto writeOldest = [&ring, &outFile]() {
+        size_t bytes;
+        const void* block = ring.retire(bytes);
+        return block && outFile.write(block, bytes);
+    };
 
-    // End transform feedback
-    glEndTransformFeedback();
+    //block k is read back while the blocks after it are mixed
+    for (uint64_t first = 0; first < NUM_SAMPLES; first += BLOCK_SAMPLES) {
+        const size_t count = static_cast<size_t>(std::min<uint64_t>(BLOCK_SAMPLES, NUM_SAMPLES - first));
 
-    glFlush();
+        if (ring.full() && !writeOldest()) {
+            return 1;
+        }
 
-    //we enable back the raster stage (fragment shader)
-    glDisable(GL_RASTERIZER_DISCARD);
+        uploadBlock(wave1Handle, inFile1, buffer1, count);
+        uploadBlock(wave2Handle, inFile2, buffer2, count);
 
-    glGetBufferSubData(GL_TRANSFORM_FEEDBACK_BUFFER, 0, NUM_SAMPLES * BYTES_PER_SAMPLE, &pMergedBuffer[0]);
+        ring.draw(static_cast<GLsizei>((count + 1) / 2), count * BYTES_PER_SAMPLE);
+    }
+    while (ring.inFlight() > 0) {
+        if (!writeOldest()) {
+            return 1;
+        }
+    }
 
     // Get the current time again
     auto end_time = std::chrono::high_resolution_clock::now();
 
-    saveWave("output3.wav", reinterpret_cast<char*>(pMergedBuffer.data()), NUM_SAMPLES * BYTES_PER_SAMPLE);
+    if (!outFile.close()) {
+        return 1;
+    }
 
     // Calculate the elapsed time
     auto elapsed_time = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
@@ -256,17 +252,16 @@ int main()
     // Print the elapsed time
     std::cout << "Elapsed time: " << elapsed_time << " ms" << std::endl;
 
-    // Clean up resources
-    
+    if (keyed) {
+        renderCache.store(key, "output3.wav");
+        renderCache.report(std::cout);
+    }
 
-    buffer1.clear();
-    buffer2.clear();
-    pMergedBuffer.clear();
-    glDeleteBuffers(1, &tbo);
+    // Clean up resources
     glDeleteBuffers(1, &wave2Handle);
     glDeleteBuffers(1, &wave1Handle);
+    glDeleteVertexArrays(1, &vao);
     glDeleteProgram(shaderProgram);
-    glfwTerminate();
 
     return 0;
 }
\ No newline at end of file
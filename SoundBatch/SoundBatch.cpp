@@ -0,0 +1,628 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <cstdio>
+
+#include "AlignedBuffer.h"
+#include "FlacFile.h"
+#include "Kernels.h"
+#include "Mixer.h"
+#include "RenderCache.h"
+#include "Resampler.h"
+#include "SampleFormat.h"
+#include "ThreadPool.h"
+#include "ToneKernels.h"
+#include "WaveFile.h"
+#include "Wavetable.h"
+
+// Runs a manifest of generate and mix jobs in one process. Each job runs start to end on one worker of the pool,
+// many of them at once, so a queue of small jobs keeps every core busy without a process per job. A job starts
+// once its buffers fit the memory budget next to those of the running jobs and, if it streams tracks from disk,
+// once fewer than the I/O limit of those are running. Of the jobs that can start, the kind fewer are running of
+// goes first, so mixes waiting on the disk overlap generators busy on the cores.
+//
+// The manifest has one job per line, '#' starts a comment:
+//
+//   generate out.wav [--waveform w] [--format f] [--rate hz] [--seconds s] [--frequency hz] [--channels n] [--container c]
+//   mix out.wav [--format f] [--rate hz] [--container c] track.wav[@gain] ...
+//
+// with the options of 02 and 05. Channel c of a generated tone plays harmonic c + 1 of its frequency, as in 02.
+// A mix streams its tracks block by block, as 05 --stream does on a single thread. With SOUND_CACHE set both
+// kinds go through the render cache, the mixes under the same keys as 04 and 05.
+
+constexpr size_t BATCH_BLOCK_FRAMES = 1 << 16;      // frames a generate job renders and writes at a time
+constexpr uint64_t BATCH_MEMORY_BUDGET = 1ull << 30; // bytes of job buffers alive at once unless --memory says otherwise
+constexpr size_t BATCH_IO_JOBS = 2;                 // mixes streaming from disk at once unless --io says otherwise
+constexpr uint32_t SAMPLE_RATE = 44100;             // of generate jobs without --rate
+constexpr double FREQUENCY = 200;                   // of generate jobs without --frequency
+constexpr float AMPLITUDE = 32760.0f / 32768.0f;    // tone peak on the float bus, as 02
+
+using Clock = std::chrono::steady_clock;
+
+enum class JobKind
+{
+    Generate,
+    Mix
+};
+
+struct BatchJob
+{
+    size_t line = 0;                                // in the manifest
+    JobKind kind = JobKind::Generate;
+    std::string output;
+    SampleFormat format = SampleFormat::Int16;
+    WaveContainer container = WaveContainer::RIFF;
+    uint32_t rate = 0;                              // 0 = SAMPLE_RATE for a tone, the first track's rate for a mix
+    double seconds = 60;
+    double frequency = FREQUENCY;
+    Waveform waveform = Waveform::Sine;
+    uint16_t channels = 1;                          // of the tracks for a mix
+    std::vector<MixTrack> tracks;
+    std::vector<size_t> after;                      // earlier jobs writing its tracks
+    uint64_t memory = 0;                            // what jobMemory estimates it holds while it runs
+    bool io = false;                                // waits on the disk more than it computes
+};
+
+struct JobResult
+{
+    bool ok = false;
+    bool cached = false;
+    bool skipped = false;                           // a job writing one of its tracks failed
+    uint64_t samples = 0;                           // written, every channel counted
+    uint64_t bytesRead = 0;
+    uint64_t bytesWritten = 0;
+    double audioSeconds = 0;
+    double seconds = 0;
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+// manifest
+
+// the buffers that grow with a job: the writer's blocks, and for a mix every track's read-ahead and planes with
+// the mixed planes and the bus they are converted through. What else a job holds is small next to them
+uint64_t jobMemory(const BatchJob& job)
+{
+    uint64_t bytes = WAVE_QUEUE_BLOCKS * WAVE_BLOCK_SIZE;
+    if (job.container == WaveContainer::FLAC) {
+        bytes += uint64_t(FLAC_BATCH_BLOCKS) * FLAC_BLOCK_FRAMES * job.channels * 2 * sizeof(int32_t);
+    }
+
+    if (job.kind == JobKind::Generate) {
+        return bytes + BATCH_BLOCK_FRAMES * makeWaveFormat(job.format, job.channels, 0).blockAlign();
+    }
+    bytes += job.tracks.size() * (WAVE_QUEUE_BLOCKS * WAVE_BLOCK_SIZE + MIX_STREAM_BLOCK_SAMPLES * job.channels * sizeof(short));
+    return bytes + 2 * MIX_STREAM_BLOCK_SAMPLES * job.channels * sizeof(float);
+}
+
+bool parseJob(const std::string& text, size_t line, BatchJob& job)
+{
+    std::istringstream stream(text);
+    std::vector<std::string> words;
+    for (std::string word; stream >> word;) {
+        words.push_back(word);
+    }
+
+    job.line = line;
+    if (words[0] == "mix") {
+        job.kind = JobKind::Mix;
+        job.io = true;
+    } else if (words[0] != "generate") {
+        std::cerr << "Error: line " << line << ": unknown job " << words[0] << ", generate or mix" << std::endl;
+        return false;
+    }
+
+    //options anywhere on the line, the first other word is the output and the rest are tracks
+    std::vector<std::string> files;
+    for (size_t i = 1; i < words.size(); i++) {
+        const std::string& option = words[i];
+        if (option.compare(0, 2, "--") != 0) {
+            files.push_back(option);
+            continue;
+        }
+
+        const char* value = ++i < words.size() ? words[i].c_str() : "";
+        const bool tone = job.kind == JobKind::Generate;
+        bool ok = false;
+        if (option == "--format") {
+            ok = parseSampleFormat(value, job.format);
+        } else if (option == "--container") {
+            ok = parseWaveContainer(value, job.container);
+        } else if (option == "--rate") {
+            ok = atoi(value) > 0;
+            job.rate = static_cast<uint32_t>(atoi(value));
+        } else if (option == "--seconds" && tone) {
+            ok = (job.seconds = atof(value)) > 0;
+        } else if (option == "--frequency" && tone) {
+            ok = (job.frequency = atof(value)) > 0;
+        } else if (option == "--waveform" && tone) {
+            ok = parseWaveform(value, job.waveform);
+        } else if (option == "--channels" && tone) {
+            ok = atoi(value) > 0 && atoi(value) <= int(MAX_CHANNELS);
+            job.channels = static_cast<uint16_t>(atoi(value));
+        }
+        if (!ok) {
+            std::cerr << "Error: line " << line << ": bad option " << option << " " << value << std::endl;
+            return false;
+        }
+    }
+
+    if (files.empty()) {
+        std::cerr << "Error: line " << line << ": no output file" << std::endl;
+        return false;
+    }
+    job.output = files[0];
+
+    if (job.kind == JobKind::Generate) {
+        if (files.size() > 1) {
+            std::cerr << "Error: line " << line << ": a generate job takes no tracks" << std::endl;
+            return false;
+        }
+        job.rate = job.rate ? job.rate : SAMPLE_RATE;
+        return true;
+    }
+
+    std::vector<char*> argv;
+    for (size_t i = 1; i < files.size(); i++) {
+        argv.push_back(&files[i][0]);
+    }
+    if (argv.empty()) {
+        std::cerr << "Error: line " << line << ": a mix needs tracks" << std::endl;
+        return false;
+    }
+    return parseMixTracks(static_cast<int>(argv.size()), argv.data(), 0, {}, job.tracks);
+}
+
+// a mix waits for the earlier jobs that write its tracks, and takes its channel count from the first track's job.
+// Tracks no job writes have to be there already, a missing one is found before anything runs
+bool resolveTracks(const std::vector<BatchJob>& jobs, BatchJob& job)
+{
+    namespace fs = std::filesystem;
+
+    for (size_t t = 0; t < job.tracks.size(); t++) {
+        const fs::path track = fs::path(job.tracks[t].filename).lexically_normal();
+        size_t writer = jobs.size();
+        for (size_t j = jobs.size(); j-- > 0;) {
+            if (fs::path(jobs[j].output).lexically_normal() == track) {
+                writer = j;
+                break;
+            }
+        }
+
+        if (writer < jobs.size()) {
+            job.after.push_back(writer);
+            job.channels = t == 0 ? jobs[writer].channels : job.channels;
+            continue;
+        }
+
+        WaveReader probe;
+        if (!probe.open(job.tracks[t].filename.c_str())) {
+            std::cerr << "Error: line " << job.line << ": could not open input file " << job.tracks[t].filename << std::endl;
+            return false;
+        }
+        job.channels = t == 0 ? probe.format().numChannels : job.channels;
+    }
+    return true;
+}
+
+bool loadManifest(const char* filename, std::vector<BatchJob>& jobs)
+{
+    std::ifstream in(filename);
+    if (!in) {
+        std::cerr << "Error: could not open manifest " << filename << std::endl;
+        return false;
+    }
+
+    std::string text;
+    for (size_t line = 1; std::getline(in, text); line++) {
+        text = text.substr(0, text.find('#'));
+        if (text.find_first_not_of(" \t\r") == std::string::npos) {
+            continue;
+        }
+        BatchJob job;
+        if (!parseJob(text, line, job) || (job.kind == JobKind::Mix && !resolveTracks(jobs, job))) {
+            return false;
+        }
+        job.memory = jobMemory(job);
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// jobs
+
+bool runGenerate(const BatchJob& job, JobResult& result)
+{
+    const uint64_t frames = static_cast<uint64_t>(std::llround(job.seconds * job.rate));
+    const WaveFormat format = makeWaveFormat(job.format, job.channels, job.rate);
+    result.samples = frames * job.channels;
+    result.audioSeconds = double(frames) / job.rate;
+
+    RenderCache renderCache;
+    RenderKey key("batch-tone");
+    key.add("kernels", kernels().name).add("waveform", waveformName(job.waveform)).add("frequency", job.frequency).add("rate", job.rate).add("frames", frames)
+        .add("channels", job.channels).add("amplitude", double(AMPLITUDE)).add("format", sampleFormatName(job.format))
+        .add("container", waveContainerName(job.container));
+    if (renderCache.fetch(key, job.output.c_str())) {
+        result.cached = true;
+        return true;
+    }
+
+    WaveWriter out;
+    if (!out.open(job.output.c_str(), format, job.container)) {
+        std::cerr << "Error: could not create " << job.output << std::endl;
+        return false;
+    }
+
+    ToneBlock tone;
+    tone.waveform = job.waveform;
+    tone.amplitude = AMPLITUDE;
+    tone.channels = job.channels;
+    for (size_t c = 0; c < job.channels; c++) {
+        tone.increment[c] = job.frequency * (c + 1) / job.rate;
+    }
+
+    AlignedBuffer<char> block(BATCH_BLOCK_FRAMES * format.blockAlign());
+    for (uint64_t first = 0; first < frames; first += BATCH_BLOCK_FRAMES) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(BATCH_BLOCK_FRAMES, frames - first));
+
+        //the phase from the absolute frame so the wave continues across blocks, exact for whole frequencies
+        for (size_t c = 0; c < job.channels; c++) {
+            tone.phase[c] = std::fmod(double(first) * job.frequency * (c + 1), double(job.rate)) / job.rate;
+        }
+        renderToneBlock(tone, job.format, block.data(), n, first);
+        if (!out.write(block.data(), n * format.blockAlign())) {
+            return false;
+        }
+    }
+    if (!out.close()) {
+        return false;
+    }
+
+    renderCache.store(key, job.output.c_str());
+    return true;
+}
+
+bool runMix(const BatchJob& job, JobResult& result)
+{
+    std::vector<TrackReader> inputs(job.tracks.size());
+    std::vector<float> gains;
+    uint64_t frames = UINT64_MAX;
+    for (size_t t = 0; t < inputs.size(); t++) {
+        if (!inputs[t].open(job.tracks[t].filename.c_str(), t == 0 ? job.rate : inputs[0].rate())) {
+            std::cerr << "Error: could not open input file " << job.tracks[t].filename << std::endl;
+            return false;
+        }
+        if (inputs[t].format().bitsPerSample != 16 || inputs[t].format().numChannels != job.channels || job.channels > MAX_CHANNELS) {
+            std::cerr << "Error: the tracks of " << job.output << " must be 16-bit with the same number of channels, up to "
+                << MAX_CHANNELS << std::endl;
+            return false;
+        }
+        frames = std::min(frames, inputs[t].numFrames());
+        gains.push_back(busGain(job.tracks[t].gain));
+    }
+
+    const uint32_t rate = inputs[0].rate();
+    result.samples = frames * job.channels;
+    result.audioSeconds = double(frames) / rate;
+
+    RenderCache renderCache;
+    RenderKey key("mix");
+    const bool keyed = renderCache.enabled() && addMixKey(key, job.tracks, rate, job.format, job.container);
+    if (keyed && renderCache.fetch(key, job.output.c_str())) {
+        result.cached = true;
+        return true;
+    }
+
+    //on this worker alone, the other workers run other jobs
+    WaveWriter out;
+    if (!out.open(job.output.c_str(), makeWaveFormat(job.format, job.channels, rate), job.container) ||
+        !streamTracks(inputs, gains.data(), out, frames, nullptr) || !out.close()) {
+        return false;
+    }
+    for (const TrackReader& input : inputs) {
+        result.bytesRead += input.file().position();
+    }
+
+    if (keyed) {
+        renderCache.store(key, job.output.c_str());
+    }
+    return true;
+}
+
+void runJob(const BatchJob& job, JobResult& result)
+{
+    const Clock::time_point start = Clock::now();
+    result.ok = job.kind == JobKind::Generate ? runGenerate(job, result) : runMix(job, result);
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::error_code error;
+    result.bytesWritten = result.ok ? std::filesystem::file_size(job.output, error) : 0;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// scheduling and reports
+
+const char* jobKindName(JobKind kind)
+{
+    return kind == JobKind::Mix ? "mix" : "generate";
+}
+
+void printJob(size_t index, const BatchJob& job, const JobResult& result)
+{
+    std::cout << "Job " << index + 1 << " (line " << job.line << ") " << jobKindName(job.kind) << " " << job.output;
+    if (!result.ok) {
+        std::cout << (result.skipped ? ": skipped, a job writing its tracks failed" : ": failed") << std::endl;
+        return;
+    }
+
+    char text[160];
+    snprintf(text, sizeof text, ": %.1f s of audio in %.3f s, %.1fx real time, %.1f Msamples/s, %.1f MB/s", result.audioSeconds,
+        result.seconds, result.audioSeconds / result.seconds, result.samples / result.seconds / 1e6,
+        (result.bytesRead + result.bytesWritten) / result.seconds / 1e6);
+    std::cout << text << (result.cached ? ", from the render cache" : "") << std::endl;
+}
+
+// runs 'jobs' on 'pool' in manifest order as far as their tracks, the budget and the I/O limit let them, each one
+// printed as it finishes. A job over the budget on its own still runs, once nothing else is running, and a job
+// whose tracks failed is skipped. Returns the memory the running jobs held at most
+uint64_t runBatch(const std::vector<BatchJob>& jobs, ThreadPool& pool, uint64_t budget, size_t ioLimit, std::vector<JobResult>& results)
+{
+    std::mutex mutex;
+    std::condition_variable finished;
+    std::vector<bool> started(jobs.size(), false);
+    std::vector<bool> complete(jobs.size(), false);
+    size_t done = 0;
+    size_t running = 0;
+    size_t runningIo = 0;
+    uint64_t memory = 0;
+    uint64_t peak = 0;
+
+    //the first job that can start, of the kind fewer are running of if one of those can
+    auto pick = [&]() {
+        const bool preferIo = runningIo * 2 < running;
+        size_t fallback = jobs.size();
+        for (size_t j = 0; j < jobs.size(); j++) {
+            const bool ready = std::all_of(jobs[j].after.begin(), jobs[j].after.end(), [&](size_t a) { return complete[a]; });
+            const bool fits = (memory + jobs[j].memory <= budget || running == 0) && (!jobs[j].io || runningIo < ioLimit);
+            if (started[j] || !ready || !fits) {
+                continue;
+            }
+            if (jobs[j].io == preferIo) {
+                return j;
+            }
+            fallback = std::min(fallback, j);
+        }
+        return fallback;
+    };
+
+    //jobs whose tracks failed end without running, in turn their own dependents
+    auto skip = [&]() {
+        for (size_t j = 0; j < jobs.size(); j++) {
+            const bool failed = std::any_of(jobs[j].after.begin(), jobs[j].after.end(), [&](size_t a) { return complete[a] && !results[a].ok; });
+            if (!started[j] && failed) {
+                started[j] = true;
+                complete[j] = true;
+                results[j].skipped = true;
+                done++;
+                printJob(j, jobs[j], results[j]);
+            }
+        }
+    };
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+        skip();
+        for (size_t j; running < pool.size() && (j = pick()) < jobs.size();) {
+            started[j] = true;
+            running++;
+            runningIo += jobs[j].io;
+            memory += jobs[j].memory;
+            peak = std::max(peak, memory);
+
+            pool.submit([&, j]() {
+                JobResult result;
+                runJob(jobs[j], result);
+
+                std::lock_guard<std::mutex> guard(mutex);
+                results[j] = result;
+                complete[j] = true;
+                running--;
+                runningIo -= jobs[j].io;
+                memory -= jobs[j].memory;
+                done++;
+                printJob(j, jobs[j], result);
+                finished.notify_one();
+            });
+        }
+
+        if (done == jobs.size()) {
+            return peak;
+        }
+        const size_t seen = done;
+        finished.wait(lock, [&]() { return done != seen; });
+    }
+}
+
+// amount / seconds, 0 for what took no time (a job that was skipped or failed before it ran), JSON has no NaN
+double perSecond(double amount, double seconds)
+{
+    return seconds > 0.0 ? amount / seconds : 0.0;
+}
+
+// 's' as a JSON string
+std::string jsonString(const std::string& s)
+{
+    std::string quoted = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+bool writeReport(const char* filename, const std::vector<BatchJob>& jobs, const std::vector<JobResult>& results, double seconds,
+    unsigned workers, uint64_t peakMemory)
+{
+    std::ofstream out(filename);
+    out << "{\"jobs\": [";
+    JobResult total;
+    double busy = 0;
+    size_t failed = 0;
+    for (size_t j = 0; j < jobs.size(); j++) {
+        const JobResult& result = results[j];
+        out << (j ? ",\n  " : "\n  ") << "{"
+            << "\"line\": " << jobs[j].line << ", "
+            << "\"kind\": \"" << jobKindName(jobs[j].kind) << "\", "
+            << "\"output\": " << jsonString(jobs[j].output) << ", "
+            << "\"ok\": " << (result.ok ? "true" : "false") << ", "
+            << "\"cached\": " << (result.cached ? "true" : "false") << ", "
+            << "\"memory\": " << jobs[j].memory << ", "
+            << "\"seconds\": " << result.seconds << ", "
+            << "\"audio_seconds\": " << result.audioSeconds << ", "
+            << "\"samples\": " << result.samples << ", "
+            << "\"bytes_read\": " << result.bytesRead << ", "
+            << "\"bytes_written\": " << result.bytesWritten << ", "
+            << "\"samples_per_second\": " << perSecond(double(result.samples), result.seconds) << "}";
+        total.samples += result.samples;
+        total.bytesRead += result.bytesRead;
+        total.bytesWritten += result.bytesWritten;
+        total.audioSeconds += result.audioSeconds;
+        busy += result.seconds;
+        failed += !result.ok;
+    }
+    out << "\n],\n\"total\": {"
+        << "\"jobs\": " << jobs.size() << ", "
+        << "\"failed\": " << failed << ", "
+        << "\"workers\": " << workers << ", "
+        << "\"seconds\": " << seconds << ", "
+        << "\"busy_seconds\": " << busy << ", "
+        << "\"audio_seconds\": " << total.audioSeconds << ", "
+        << "\"samples\": " << total.samples << ", "
+        << "\"bytes_read\": " << total.bytesRead << ", "
+        << "\"bytes_written\": " << total.bytesWritten << ", "
+        << "\"samples_per_second\": " << perSecond(double(total.samples), seconds) << ", "
+        << "\"gb_per_second\": " << perSecond(double(total.bytesRead + total.bytesWritten), seconds) / 1e9 << ", "
+        << "\"peak_memory\": " << peakMemory << "}}" << std::endl;
+    return static_cast<bool>(out);
+}
+
+// a byte count, with a K, M or G suffix
+bool parseBytes(const char* text, uint64_t& bytes)
+{
+    char* end;
+    const double value = strtod(text, &end);
+    const char unit = static_cast<char>(toupper(static_cast<unsigned char>(*end)));
+    const double scale = unit == 'K' ? 1 << 10 : unit == 'M' ? 1 << 20 : unit == 'G' ? 1 << 30 : 1;
+    bytes = static_cast<uint64_t>(value * scale);
+    return end != text && value > 0;
+}
+
+void printUsage()
+{
+    std::cerr << "usage: sound_batch [--memory bytes] [--io n] [--threads n] [--report file.json] manifest\n"
+                 "--memory is the budget of job buffers (1G by default, K, M and G suffixes), --io the mixes\n"
+                 "streaming from disk at once (" << BATCH_IO_JOBS << " by default), --threads the workers (the shared pool,\n"
+                 "one per hardware thread, by default). Manifest lines are\n"
+                 "  generate out.wav [--waveform w] [--format f] [--rate hz] [--seconds s] [--frequency hz] [--channels n] [--container c]\n"
+                 "  mix out.wav [--format f] [--rate hz] [--container c] track.wav[@gain] ..." << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    uint64_t budget = BATCH_MEMORY_BUDGET;
+    size_t ioLimit = BATCH_IO_JOBS;
+    unsigned threads = 0;
+    const char* report = nullptr;
+    const char* manifest = nullptr;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : "";
+        bool ok = true;
+        if (strcmp(argv[i], "--memory") == 0) {
+            ok = parseBytes(value, budget);
+        } else if (strcmp(argv[i], "--io") == 0) {
+            ok = atoi(value) > 0;
+            ioLimit = static_cast<size_t>(atoi(value));
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            ok = atoi(value) > 0;
+            threads = static_cast<unsigned>(atoi(value));
+        } else if (strcmp(argv[i], "--report") == 0) {
+            ok = *value != '\0';
+            report = value;
+        } else if (!manifest && strncmp(argv[i], "--", 2) != 0) {
+            manifest = argv[i];
+            continue;
+        } else {
+            ok = false;
+        }
+        if (!ok) {
+            printUsage();
+            return 1;
+        }
+        i++;
+    }
+    if (!manifest) {
+        printUsage();
+        return 1;
+    }
+
+    std::vector<BatchJob> jobs;
+    if (!loadManifest(manifest, jobs)) {
+        return 1;
+    }
+
+    std::unique_ptr<ThreadPool> ownPool;
+    if (threads) {
+        ownPool = std::make_unique<ThreadPool>(threads);
+    }
+    ThreadPool& pool = ownPool ? *ownPool : ThreadPool::shared();
+
+    const Clock::time_point start = Clock::now();
+    std::vector<JobResult> results(jobs.size());
+    const uint64_t peakMemory = runBatch(jobs, pool, budget, ioLimit, results);
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    JobResult total;
+    double busy = 0;
+    size_t failed = 0;
+    size_t cached = 0;
+    for (const JobResult& result : results) {
+        total.samples += result.samples;
+        total.bytesRead += result.bytesRead;
+        total.bytesWritten += result.bytesWritten;
+        total.audioSeconds += result.audioSeconds;
+        busy += result.seconds;
+        failed += !result.ok;
+        cached += result.cached;
+    }
+
+    char text[320];
+    snprintf(text, sizeof text, "Batch: %zu jobs (%zu failed, %zu from the render cache) in %.3f s on %u workers, %.1f s of audio, "
+        "%.1f Msamples/s, %.1f MB/s, %.2f workers busy on average, at most %llu of %llu MB of buffers",
+        jobs.size(), failed, cached, seconds, pool.size(), total.audioSeconds, total.samples / seconds / 1e6,
+        (total.bytesRead + total.bytesWritten) / seconds / 1e6, busy / seconds,
+        static_cast<unsigned long long>(peakMemory >> 20), static_cast<unsigned long long>(budget >> 20));
+    std::cout << text << std::endl;
+    RenderCache().report(std::cout);
+
+    if (report && !writeReport(report, jobs, results, seconds, pool.size(), peakMemory)) {
+        std::cerr << "Error: could not write " << report << std::endl;
+        return 1;
+    }
+
+    return failed ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,653 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <numeric>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <cmath>
+#include <random>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define PSAPI_VERSION 2
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "Additive.h"
+#include "Backend.h"
+#include "BlockPipeline.h"
+#include "Kernels.h"
+#include "Mixer.h"
+#include "Profiler.h"
+#include "SampleFormat.h"
+#include "ThreadPool.h"
+#include "WaveFile.h"
+#include "Wavetable.h"
+
+#ifdef SOUND_HAVE_GL
+#include "GLBackend.h"
+#endif
+
+// Runs every generator and mixer variant under the same clock: the timed region is the whole render
+// of 'duration' seconds into a sink (a WAV file with --output, otherwise discarded), and each block's
+// latency is the time its samples took to compute. One JSON object per run goes to stdout, with --profile
+// the stage totals of that run in it.
+
+constexpr int BYTES_PER_SAMPLE = 2;                 // 16-bit mono everywhere but the bus variant
+constexpr int FREQUENCY = 200;                      // generated tone
+constexpr float AMPLITUDE = 32760;
+constexpr size_t MIX_SOURCE_SAMPLES = 1 << 22;      // mixer inputs are this long and loop, so inputs don't grow with the duration
+constexpr double PARTIALS_TOP = 0.45;               // highest additive partial as a fraction of the sample rate
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchConfig
+{
+    std::string variant;
+    int duration;                                   // seconds
+    int sampleRate;
+    unsigned threads;
+    size_t blockSamples;
+    size_t tracks;                                  // mixer inputs
+    size_t partials;                                // gen-additive oscillators
+    Waveform waveform;                              // what the other generators play
+    SampleFormat format;                            // what mix-bus converts its float bus to
+    std::string output;                             // directory for the WAV files, empty = discard
+    WaveContainer container;                        // what those files are, FLAC encodes inside the timed region
+};
+
+struct BenchResult
+{
+    uint64_t samples = 0;
+    uint64_t bytes = 0;                             // read + written by the variant, what GB/s is computed from
+    double seconds = 0;
+    std::vector<double> blockMs;
+    std::string backend;                            // what the engine variants ran on
+    std::string profile;                            // Profiler summary of the timed region, with --profile
+};
+
+// ---------------------------------------------------------------------------------------------------------------------
+// process memory
+
+// resets the high-water mark where the OS allows it so every run reports its own peak
+void resetPeakRss()
+{
+#ifdef __linux__
+    std::ofstream("/proc/self/clear_refs") << "5";
+#endif
+}
+
+uint64_t peakRssKB()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters);
+    return counters.PeakWorkingSetSize / 1024;
+#else
+#ifdef __linux__
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line)) {
+        if (line.compare(0, 6, "VmHWM:") == 0) {
+            return std::strtoull(line.c_str() + 6, nullptr, 10);
+        }
+    }
+#endif
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// sink and timing helpers
+
+// the sample format a variant writes
+SampleFormat outputFormat(const BenchConfig& config)
+{
+    return config.variant == "mix-bus" ? config.format : SampleFormat::Int16;
+}
+
+class Sink
+{
+public:
+    bool open(const BenchConfig& config)
+    {
+        if (config.output.empty()) {
+            return true;
+        }
+
+        const WaveFormat format = makeWaveFormat(outputFormat(config), 1, config.sampleRate);
+        const std::string filename = config.output + "/" + config.variant + waveContainerExtension(config.container);
+        toFile_ = file_.open(filename.c_str(), format, config.container);
+        return toFile_;
+    }
+
+    bool write(const void* data, size_t bytes)
+    {
+        written_ += bytes;
+        return !toFile_ || file_.write(data, bytes);
+    }
+
+    bool close() { return !toFile_ || file_.close(); }
+
+    uint64_t written() const { return written_; }
+
+private:
+    WaveWriter file_;
+    bool toFile_ = false;
+    uint64_t written_ = 0;
+};
+
+double msSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+double percentile(std::vector<double> values, double p)
+{
+    if (values.empty()) {
+        return 0;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t rank = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[rank];
+}
+
+// phase of sample 'first' of the tone, reduced in integers to stay exact like 02 does
+double tonePhase(uint64_t first, int sampleRate)
+{
+    return static_cast<double>(first % sampleRate * FREQUENCY % sampleRate) / sampleRate;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// generators
+
+// one thread, every block computed with the sine or wavetable kernel
+bool genCpu(const BenchConfig& config, uint64_t numSamples, Sink& sink, BenchResult& result)
+{
+    std::vector<short> block(config.blockSamples);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        generateWaveform(config.waveform, block.data(), n, tonePhase(first, config.sampleRate), static_cast<double>(FREQUENCY) / config.sampleRate, AMPLITUDE);
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// what 01 does: one exact repeat of the tone rendered once, then replicas
+bool genReplica(const BenchConfig& config, uint64_t numSamples, Sink& sink, BenchResult& result)
+{
+    const uint64_t period = std::min<uint64_t>(config.sampleRate / std::gcd(config.sampleRate, FREQUENCY), numSamples);
+    std::vector<short> cache(period);
+    generateWaveform(config.waveform, cache.data(), period, 0.0, static_cast<double>(FREQUENCY) / config.sampleRate, AMPLITUDE);
+
+    const uint64_t repeats = std::max<uint64_t>(1, config.blockSamples / period);
+    std::vector<short> block(period * repeats);
+
+    for (uint64_t first = 0; first < numSamples; first += block.size()) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(block.size(), numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        for (uint64_t i = 0; i < repeats; i++) {
+            std::copy(cache.begin(), cache.end(), block.begin() + i * period);
+        }
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// what 02 does: blocks generated on the pool and written in order
+bool genPool(const BenchConfig& config, uint64_t numSamples, Sink& sink, BenchResult& result, ThreadPool& pool)
+{
+    const uint64_t numBlocks = (numSamples + config.blockSamples - 1) / config.blockSamples;
+    result.blockMs.resize(numBlocks);
+
+    BlockPipeline pipeline(config.blockSamples * BYTES_PER_SAMPLE, 0, pool);
+    return pipeline.run(numBlocks,
+        [&](uint64_t index, char* block, size_t) {
+            const uint64_t first = index * config.blockSamples;
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+            const Clock::time_point start = Clock::now();
+            generateWaveform(config.waveform, reinterpret_cast<short*>(block), n, tonePhase(first, config.sampleRate), static_cast<double>(FREQUENCY) / config.sampleRate, AMPLITUDE);
+            result.blockMs[index] = msSince(start);
+
+            return n * BYTES_PER_SAMPLE;
+        },
+        [&sink](uint64_t, const char* block, size_t bytes) {
+            return sink.write(block, bytes);
+        });
+}
+
+// what 02 --partials does: 'partials' oscillators log-spaced from the tone to just under Nyquist with fixed random phases
+OscillatorBank makePartials(const BenchConfig& config)
+{
+    OscillatorBank bank(config.sampleRate);
+    bank.reserve(config.partials);
+
+    std::mt19937 random(config.partials);
+    const double ratio = config.partials > 1 ? std::pow(PARTIALS_TOP * config.sampleRate / FREQUENCY, 1.0 / (config.partials - 1)) : 1.0;
+    for (size_t k = 0; k < config.partials; k++) {
+        bank.add(FREQUENCY * std::pow(ratio, double(k)), 1.0f / config.partials, random() / 4294967296.0);
+    }
+    return bank;
+}
+
+// the oscillator bank renders every block on the pool, split by time or by oscillators as it sees fit
+bool genAdditive(const BenchConfig& config, const OscillatorBank& bank, uint64_t numSamples, Sink& sink, BenchResult& result, ThreadPool& pool)
+{
+    std::vector<float> bus(config.blockSamples);
+    std::vector<short> block(config.blockSamples);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        bank.render(bus.data(), first, n, &pool);
+        convertSamples(bus.data(), block.data(), n, SampleFormat::Int16, first);
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// mixers
+
+// 'tracks' looping inputs at different pitches, a multiple of the block size long so no block wraps
+std::vector<std::vector<short>> makeTracks(const BenchConfig& config)
+{
+    const size_t length = (std::max(MIX_SOURCE_SAMPLES, config.blockSamples) + config.blockSamples - 1) / config.blockSamples * config.blockSamples;
+
+    std::vector<std::vector<short>> tracks(config.tracks);
+    for (size_t t = 0; t < tracks.size(); t++) {
+        tracks[t].resize(length);
+        kernels().sineInt16(tracks[t].data(), length, 0.0, static_cast<double>(FREQUENCY * (t + 1)) / config.sampleRate, AMPLITUDE);
+    }
+    return tracks;
+}
+
+// sources of the block starting at 'first'
+void trackBlock(const std::vector<std::vector<short>>& tracks, uint64_t first, std::vector<const short*>& sources)
+{
+    sources.resize(tracks.size());
+    for (size_t t = 0; t < tracks.size(); t++) {
+        sources[t] = tracks[t].data() + first % tracks[t].size();
+    }
+}
+
+// each block mixed on this thread, spread over the pool by mixTracks itself when 'inner' is set
+bool mixBlocks(const BenchConfig& config, const std::vector<std::vector<short>>& tracks, uint64_t numSamples, Sink& sink, BenchResult& result, ThreadPool* inner)
+{
+    const std::vector<short> gains(tracks.size(), mixGain(1.0 / tracks.size()));
+    std::vector<const short*> sources;
+    std::vector<short> block(config.blockSamples);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        trackBlock(tracks, first, sources);
+        mixTracks(sources.data(), gains.data(), tracks.size(), block.data(), n, inner);
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// each block mixed on the float bus and converted to the --format samples, what 04 does
+bool mixBusBlocks(const BenchConfig& config, const std::vector<std::vector<short>>& tracks, uint64_t numSamples, Sink& sink, BenchResult& result)
+{
+    const std::vector<float> gains(tracks.size(), busGain(1.0 / tracks.size()));
+    const size_t sampleSize = makeWaveFormat(config.format, 1, config.sampleRate).blockAlign();
+    std::vector<const short*> sources;
+    std::vector<float> bus(config.blockSamples);
+    std::vector<char> block(config.blockSamples * sampleSize);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        trackBlock(tracks, first, sources);
+        mixBus(sources.data(), gains.data(), tracks.size(), bus.data(), n, nullptr);
+        convertSamples(bus.data(), block.data(), n, config.format, first);
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * sampleSize)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whole blocks mixed on the workers and written in order, what 05 --stream does
+bool mixPool(const BenchConfig& config, const std::vector<std::vector<short>>& tracks, uint64_t numSamples, Sink& sink, BenchResult& result, ThreadPool& pool)
+{
+    const std::vector<short> gains(tracks.size(), mixGain(1.0 / tracks.size()));
+    const uint64_t numBlocks = (numSamples + config.blockSamples - 1) / config.blockSamples;
+    result.blockMs.resize(numBlocks);
+
+    BlockPipeline pipeline(config.blockSamples * BYTES_PER_SAMPLE, 0, pool);
+    return pipeline.run(numBlocks,
+        [&](uint64_t index, char* block, size_t) {
+            const uint64_t first = index * config.blockSamples;
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+            const Clock::time_point start = Clock::now();
+            std::vector<const short*> sources;
+            trackBlock(tracks, first, sources);
+            mixTracks(sources.data(), gains.data(), tracks.size(), reinterpret_cast<short*>(block), n, nullptr);
+            result.blockMs[index] = msSince(start);
+
+            return n * BYTES_PER_SAMPLE;
+        },
+        [&sink](uint64_t, const char* block, size_t bytes) {
+            return sink.write(block, bytes);
+        });
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// engine
+
+// every block goes to the backend the calibration ranked fastest for the job
+bool genEngine(const BenchConfig& config, uint64_t numSamples, Sink& sink, BenchResult& result, BackendEngine& engine)
+{
+    std::vector<short> block(config.blockSamples);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        if (!engine.generate(block.data(), n, tonePhase(first, config.sampleRate), static_cast<double>(FREQUENCY) / config.sampleRate, AMPLITUDE,
+                config.waveform)) {
+            return false;
+        }
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool mixEngine(const BenchConfig& config, const std::vector<std::vector<short>>& tracks, uint64_t numSamples, Sink& sink, BenchResult& result, BackendEngine& engine)
+{
+    const std::vector<short> gains(tracks.size(), mixGain(1.0 / tracks.size()));
+    std::vector<const short*> sources;
+    std::vector<short> block(config.blockSamples);
+
+    for (uint64_t first = 0; first < numSamples; first += config.blockSamples) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(config.blockSamples, numSamples - first));
+
+        const Clock::time_point start = Clock::now();
+        trackBlock(tracks, first, sources);
+        if (!engine.mix(sources.data(), gains.data(), tracks.size(), block.data(), n)) {
+            return false;
+        }
+        result.blockMs.push_back(msSince(start));
+
+        if (!sink.write(block.data(), n * BYTES_PER_SAMPLE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+const char* const VARIANTS[] = { "gen-cpu", "gen-replica", "gen-pool", "mix-cpu", "mix-tree", "mix-pool", "mix-bus", "gen-engine", "mix-engine", "gen-additive" };
+
+bool runVariant(const BenchConfig& config, BenchResult& result)
+{
+    const uint64_t numSamples = uint64_t(config.sampleRate) * config.duration;
+    const bool mixer = config.variant.compare(0, 4, "mix-") == 0;
+
+    //the pool and the mixer inputs are built before the clock starts, that isn't what we measure
+    ThreadPool pool(config.threads);
+    const std::vector<std::vector<short>> tracks = mixer ? makeTracks(config) : std::vector<std::vector<short>>();
+    const OscillatorBank bank = config.variant == "gen-additive" ? makePartials(config) : OscillatorBank(config.sampleRate);
+
+    //so is the engine's calibration, which only really runs the first time thanks to its cache
+    BackendEngine engine;
+    if (config.variant.size() > 7 && config.variant.compare(config.variant.size() - 7, 7, "-engine") == 0) {
+        engine.addCpuBackends(pool);
+#ifdef SOUND_HAVE_GL
+        engine.add(createGLBackend());
+#endif
+        engine.calibrate();
+        result.backend = engine.best(mixer ? BackendJob::Mix : BackendJob::Generate).name();
+    }
+    Sink sink;
+    if (!sink.open(config)) {
+        return false;
+    }
+
+    //the stages of this run only, the setup above is left out
+    if (Profiler::enabled()) {
+        Profiler::reset();
+    }
+
+    const Clock::time_point start = Clock::now();
+    bool ok;
+    if (config.variant == "gen-cpu") {
+        ok = genCpu(config, numSamples, sink, result);
+    } else if (config.variant == "gen-replica") {
+        ok = genReplica(config, numSamples, sink, result);
+    } else if (config.variant == "gen-pool") {
+        ok = genPool(config, numSamples, sink, result, pool);
+    } else if (config.variant == "mix-cpu") {
+        ok = mixBlocks(config, tracks, numSamples, sink, result, nullptr);
+    } else if (config.variant == "mix-tree") {
+        ok = mixBlocks(config, tracks, numSamples, sink, result, &pool);
+    } else if (config.variant == "mix-pool") {
+        ok = mixPool(config, tracks, numSamples, sink, result, pool);
+    } else if (config.variant == "mix-bus") {
+        ok = mixBusBlocks(config, tracks, numSamples, sink, result);
+    } else if (config.variant == "gen-engine") {
+        ok = genEngine(config, numSamples, sink, result, engine);
+    } else if (config.variant == "mix-engine") {
+        ok = mixEngine(config, tracks, numSamples, sink, result, engine);
+    } else if (config.variant == "gen-additive") {
+        ok = genAdditive(config, bank, numSamples, sink, result, pool);
+    } else {
+        std::cerr << "Error: unknown variant " << config.variant << std::endl;
+        return false;
+    }
+    ok = sink.close() && ok;
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    if (Profiler::enabled()) {
+        std::ostringstream profile;
+        Profiler::writeSummary(profile, false);
+        result.profile = profile.str();
+    }
+
+    result.samples = numSamples;
+    result.bytes = sink.written() + (mixer ? numSamples * BYTES_PER_SAMPLE * config.tracks : 0);
+    return ok;
+}
+
+void printResult(const BenchConfig& config, const BenchResult& result, uint64_t peakRss, bool first)
+{
+    std::cout << (first ? "[\n" : ",\n") << "  {"
+        << "\"variant\": \"" << config.variant << "\", "
+        << "\"kernels\": \"" << kernels().name << "\", "
+        << "\"backend\": \"" << result.backend << "\", "
+        << "\"format\": \"" << sampleFormatName(outputFormat(config)) << "\", "
+        << "\"duration\": " << config.duration << ", "
+        << "\"sample_rate\": " << config.sampleRate << ", "
+        << "\"threads\": " << config.threads << ", "
+        << "\"block_samples\": " << config.blockSamples << ", "
+        << "\"tracks\": " << (config.variant.compare(0, 4, "mix-") == 0 ? config.tracks : 0) << ", "
+        << "\"partials\": " << (config.variant == "gen-additive" ? config.partials : 0) << ", "
+        << "\"waveform\": \"" << waveformName(config.waveform) << "\", "
+        << "\"container\": \"" << (config.output.empty() ? "none" : waveContainerName(config.container)) << "\", "
+        << "\"samples\": " << result.samples << ", "
+        << "\"seconds\": " << result.seconds << ", "
+        << "\"samples_per_second\": " << result.samples / result.seconds << ", "
+        << "\"gb_per_second\": " << result.bytes / result.seconds / 1e9 << ", "
+        << "\"block_p50_ms\": " << percentile(result.blockMs, 0.50) << ", "
+        << "\"block_p99_ms\": " << percentile(result.blockMs, 0.99) << ", "
+        << "\"peak_rss_kb\": " << peakRss;
+    if (!result.profile.empty()) {
+        std::cout << ", \"profile\": " << result.profile;
+    }
+    std::cout << "}";
+}
+
+// comma separated list of numbers or names
+template <typename T>
+std::vector<T> parseList(const char* text)
+{
+    std::vector<T> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        std::stringstream parse(item);
+        T value;
+        if (parse >> value) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+void printUsage()
+{
+    std::cerr << "usage: sound_bench [--variants a,b] [--durations s,s] [--rates hz,hz] [--threads n,n] [--blocks n,n]\n"
+                 "                   [--tracks n] [--partials n] [--waveform sine|saw|square|triangle|pulse]\n"
+                 "                   [--format int16|int24|int32|float] [--repeat n] [--output dir]\n"
+                 "                   [--container riff|rf64|w64|flac] [--profile time|counters]\n"
+                 "variants:";
+    for (const char* variant : VARIANTS) {
+        std::cerr << " " << variant;
+    }
+    std::cerr << "\nthreads 0 = one per hardware thread, SOUND_KERNELS picks the instruction set,\n"
+                 "SOUND_BACKEND the backend the engine variants prefer, --profile counters adds the hardware\n"
+                 "counters the host exposes to the stage times" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<std::string> variants(std::begin(VARIANTS), std::end(VARIANTS));
+    std::vector<int> durations = { 10, 60 };
+    std::vector<int> rates = { 22050, 44100 };
+    std::vector<unsigned> threads = { 1, 0 };
+    std::vector<size_t> blocks = { 1 << 16, 1 << 20 };
+    size_t tracks = 2;
+    size_t partials = 1024;
+    Waveform waveform = Waveform::Sine;
+    SampleFormat format = SampleFormat::Int16;
+    int repeat = 1;
+    std::string output;
+    WaveContainer container = WaveContainer::RIFF;
+
+    for (int i = 1; i < argc; i++) {
+        const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+        if (!value) {
+            printUsage();
+            return 1;
+        }
+
+        if (strcmp(argv[i], "--variants") == 0) {
+            variants = parseList<std::string>(value);
+        } else if (strcmp(argv[i], "--durations") == 0) {
+            durations = parseList<int>(value);
+        } else if (strcmp(argv[i], "--rates") == 0) {
+            rates = parseList<int>(value);
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            threads = parseList<unsigned>(value);
+        } else if (strcmp(argv[i], "--blocks") == 0) {
+            blocks = parseList<size_t>(value);
+        } else if (strcmp(argv[i], "--tracks") == 0) {
+            tracks = std::max<size_t>(1, std::strtoul(value, nullptr, 10));
+        } else if (strcmp(argv[i], "--partials") == 0) {
+            partials = std::max<size_t>(1, std::strtoul(value, nullptr, 10));
+        } else if (strcmp(argv[i], "--waveform") == 0) {
+            if (!parseWaveform(value, waveform)) {
+                printUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--format") == 0) {
+            if (!parseSampleFormat(value, format)) {
+                printUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--repeat") == 0) {
+            repeat = std::max(1, std::atoi(value));
+        } else if (strcmp(argv[i], "--output") == 0) {
+            output = value;
+        } else if (strcmp(argv[i], "--container") == 0) {
+            if (!parseWaveContainer(value, container)) {
+                printUsage();
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--profile") == 0) {
+            if (strcmp(value, "time") != 0 && strcmp(value, "counters") != 0) {
+                printUsage();
+                return 1;
+            }
+            Profiler::enable(strcmp(value, "counters") == 0);
+        } else {
+            printUsage();
+            return 1;
+        }
+        i++;
+    }
+
+    bool first = true;
+    for (const std::string& variant : variants) {
+        for (int duration : durations) {
+            for (int rate : rates) {
+                for (unsigned numThreads : threads) {
+                    for (size_t blockSamples : blocks) {
+                        BenchConfig config = { variant, duration, rate, numThreads, std::max<size_t>(blockSamples, 1), tracks, partials, waveform, format, output, container };
+                        if (config.threads == 0) {
+                            config.threads = std::max(1u, std::thread::hardware_concurrency());
+                        }
+
+                        for (int r = 0; r < repeat; r++) {
+                            resetPeakRss();
+                            BenchResult result;
+                            if (!runVariant(config, result)) {
+                                return 1;
+                            }
+                            printResult(config, result, peakRssKB(), first);
+                            first = false;
+                        }
+                    }
+                }
+            }
+        }
+    }
+    std::cout << (first ? "[]" : "\n]") << std::endl;
+
+    return 0;
+}
\ No newline at end of file
@@ -0,0 +1,106 @@
+#include "Additive.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "Kernels.h"
+#include "Profiler.h"
+
+namespace
+{
+    void addPlane(const float* src, float* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] += src[i];
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// OscillatorBank
+
+OscillatorBank::OscillatorBank(uint32_t sampleRate)
+    : sampleRate_(sampleRate)
+{
+}
+
+void OscillatorBank::reserve(size_t numOscillators)
+{
+    phase_.reserve(numOscillators);
+    increment_.reserve(numOscillators);
+    amplitude_.reserve(numOscillators);
+}
+
+void OscillatorBank::add(double frequency, float amplitude, double phase)
+{
+    phase_.push_back(phase - std::floor(phase));
+    increment_.push_back(frequency / sampleRate_);
+    amplitude_.push_back(amplitude);
+}
+
+void OscillatorBank::renderGroup(float* dst, uint64_t first, size_t frames, size_t group, std::vector<double>& phases) const
+{
+    const size_t begin = group * ADDITIVE_GROUP_OSCILLATORS;
+    const size_t count = std::min(size() - begin, ADDITIVE_GROUP_OSCILLATORS);
+    phases.resize(count);
+
+    for (size_t block = 0; block < frames; block += ADDITIVE_BLOCK_FRAMES) {
+        const size_t n = std::min(frames - block, ADDITIVE_BLOCK_FRAMES);
+
+        //the phasors start over from the exact phase of every block
+        const double frame = static_cast<double>(first + block);
+        for (size_t k = 0; k < count; k++) {
+            const double p = phase_[begin + k] + frame * increment_[begin + k];
+            phases[k] = p - std::floor(p);
+        }
+
+        std::fill(dst + block, dst + block + n, 0.0f);
+        kernels().additiveFloat(dst + block, n, phases.data(), increment_.data() + begin, amplitude_.data() + begin, count);
+    }
+}
+
+void OscillatorBank::render(float* dst, uint64_t first, size_t frames, ThreadPool* pool) const
+{
+    const size_t groups = numGroups();
+    const uint64_t numBlocks = (frames + ADDITIVE_BLOCK_FRAMES - 1) / ADDITIVE_BLOCK_FRAMES;
+
+    //enough time blocks for every worker: each block sums the whole bank, one group at a time
+    if (!pool || numBlocks >= pool->size() || groups < 2) {
+        auto renderBlocks = [this, dst, first, groups](uint64_t begin, uint64_t end) {
+            ScopedStage stage(Stage::Generate);
+            std::vector<float> partial(ADDITIVE_BLOCK_FRAMES);
+            std::vector<double> phases;
+            for (uint64_t block = begin; block < end; block += ADDITIVE_BLOCK_FRAMES) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(ADDITIVE_BLOCK_FRAMES, end - block));
+                std::fill(dst + block, dst + block + n, 0.0f);
+                for (size_t g = 0; g < groups; g++) {
+                    renderGroup(partial.data(), first + block, n, g, phases);
+                    addPlane(partial.data(), dst + block, n);
+                }
+            }
+        };
+
+        if (pool) {
+            pool->parallelFor(0, frames, ADDITIVE_BLOCK_FRAMES, renderBlocks);
+        } else {
+            renderBlocks(0, frames);
+        }
+        return;
+    }
+
+    //a short render of a big bank: the groups run in parallel into their own partials, joined in order afterwards
+    std::vector<float> partials(groups * frames);
+    pool->parallelFor(0, groups, 1, [&](uint64_t begin, uint64_t end) {
+        ScopedStage stage(Stage::Generate);
+        std::vector<double> phases;
+        for (uint64_t g = begin; g < end; g++) {
+            renderGroup(partials.data() + g * frames, first, frames, static_cast<size_t>(g), phases);
+        }
+    });
+
+    ScopedStage stage(Stage::Generate);
+    std::fill(dst, dst + frames, 0.0f);
+    for (size_t g = 0; g < groups; g++) {
+        addPlane(partials.data() + g * frames, dst, frames);
+    }
+}
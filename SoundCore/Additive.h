@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "ThreadPool.h"
+
+constexpr size_t ADDITIVE_BLOCK_FRAMES = 1024;      // frames one kernel call renders from freshly wrapped phases
+constexpr size_t ADDITIVE_GROUP_OSCILLATORS = 512;  // oscillators summed into one partial, the unit of an oscillator split
+
+// bank of sine oscillators for additive synthesis, thousands of partials with their own frequency, amplitude and
+// phase. The bank is kept as structure of arrays so KernelTable::additiveFloat runs it in SIMD batches straight
+// from the arrays. Every ADDITIVE_BLOCK_FRAMES the phases are recomputed in double from the absolute frame, so the
+// result doesn't drift with the length of the signal and any range can be rendered on its own
+class OscillatorBank
+{
+public:
+    explicit OscillatorBank(uint32_t sampleRate);
+
+    void reserve(size_t numOscillators);
+
+    // frequency in Hz, phase in cycles at frame 0
+    void add(double frequency, float amplitude, double phase = 0.0);
+
+    size_t size() const { return amplitude_.size(); }
+    uint32_t sampleRate() const { return sampleRate_; }
+
+    // dst[i] = the sum of all oscillators at frame first + i, for i in [0, frames).
+    // With a pool the time blocks are split across the workers when there are enough of them, otherwise a
+    // short render of a big bank is split by groups of ADDITIVE_GROUP_OSCILLATORS into partial sums. The
+    // partials are added in the same order either way, so the samples don't depend on the pool
+    void render(float* dst, uint64_t first, size_t frames, ThreadPool* pool = nullptr) const;
+
+private:
+    // dst[i] = the sum of oscillator group 'group' at frame first + i, 'phases' is scratch for the group
+    void renderGroup(float* dst, uint64_t first, size_t frames, size_t group, std::vector<double>& phases) const;
+
+    size_t numGroups() const { return (size() + ADDITIVE_GROUP_OSCILLATORS - 1) / ADDITIVE_GROUP_OSCILLATORS; }
+
+    uint32_t sampleRate_;
+    std::vector<double> phase_;                     // cycles at frame 0
+    std::vector<double> increment_;                 // cycles per frame
+    std::vector<float> amplitude_;
+};
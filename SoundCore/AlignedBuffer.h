@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+constexpr size_t BUFFER_ALIGNMENT = 4096;           // page aligned so the blocks also suit O_DIRECT and SIMD loads
+
+// owning, non-copyable block of memory aligned to BUFFER_ALIGNMENT
+template <typename T>
+class AlignedBuffer
+{
+public:
+    AlignedBuffer() = default;
+
+    explicit AlignedBuffer(size_t count) { allocate(count); }
+
+    ~AlignedBuffer() { release(); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    AlignedBuffer(AlignedBuffer&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)), size_(std::exchange(other.size_, 0)) {}
+
+    AlignedBuffer& operator=(AlignedBuffer&& other) noexcept
+    {
+        if (this != &other) {
+            release();
+            data_ = std::exchange(other.data_, nullptr);
+            size_ = std::exchange(other.size_, 0);
+        }
+        return *this;
+    }
+
+    void allocate(size_t count)
+    {
+        release();
+
+        //we round the size up so the allocation is a whole number of aligned blocks
+        size_t bytes = (count * sizeof(T) + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+        if (bytes == 0) {
+            return;
+        }
+
+#ifdef _WIN32
+        data_ = static_cast<T*>(_aligned_malloc(bytes, BUFFER_ALIGNMENT));
+#else
+        void* p = nullptr;
+        data_ = posix_memalign(&p, BUFFER_ALIGNMENT, bytes) == 0 ? static_cast<T*>(p) : nullptr;
+#endif
+        if (!data_) {
+            throw std::bad_alloc();
+        }
+        size_ = count;
+    }
+
+    void release()
+    {
+#ifdef _WIN32
+        _aligned_free(data_);
+#else
+        free(data_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    T* data() { return data_; }
+    const T* data() const { return data_; }
+    size_t size() const { return size_; }
+    size_t bytes() const { return size_ * sizeof(T); }
+
+    T& operator[](size_t i) { return data_[i]; }
+    const T& operator[](size_t i) const { return data_[i]; }
+
+    T* begin() { return data_; }
+    T* end() { return data_ + size_; }
+
+private:
+    T* data_ = nullptr;
+    size_t size_ = 0;
+};
@@ -0,0 +1,579 @@
+#include "AsyncFile.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define SOUND_HAVE_IO_URING
+#endif
+#endif
+#endif
+
+class AsyncFile::Engine
+{
+public:
+    struct Request
+    {
+        bool write;
+        void* buffer;
+        size_t bytes;
+        uint64_t offset;
+        uint64_t tag;
+    };
+
+    virtual ~Engine() = default;
+
+    virtual const char* name() const = 0;
+    virtual void queue(const Request& request) = 0;
+    virtual bool submit() = 0;
+    virtual bool wait(uint64_t& tag, int64_t& result) = 0;
+};
+
+namespace
+{
+    using Request = AsyncFile::Engine::Request;
+
+    //what SOUND_IO asks for, "threads" and/or "buffered"
+    bool ioOption(const char* option)
+    {
+        const char* env = std::getenv("SOUND_IO");
+        return env && strstr(env, option) != nullptr;
+    }
+
+#ifdef _WIN32
+    using Handle = HANDLE;
+
+    //a positioned transfer on a synchronous handle, the OVERLAPPED only carries the offset
+    int64_t transfer(Handle file, const Request& request)
+    {
+        size_t done = 0;
+        while (done < request.bytes) {
+            OVERLAPPED at = {};
+            const uint64_t offset = request.offset + done;
+            at.Offset = static_cast<DWORD>(offset);
+            at.OffsetHigh = static_cast<DWORD>(offset >> 32);
+            const DWORD n = static_cast<DWORD>(std::min<size_t>(request.bytes - done, 1u << 30));
+            char* p = static_cast<char*>(request.buffer) + done;
+
+            DWORD moved = 0;
+            const BOOL ok = request.write ? WriteFile(file, p, n, &moved, &at) : ReadFile(file, p, n, &moved, &at);
+            if (!ok) {
+                if (GetLastError() == ERROR_HANDLE_EOF) {
+                    break;
+                }
+                return -static_cast<int64_t>(GetLastError());
+            }
+            if (moved == 0) {
+                break;
+            }
+            done += moved;
+        }
+        return static_cast<int64_t>(done);
+    }
+#else
+    using Handle = int;
+
+    //pread/pwrite until the whole request moved, a short count only at the end of the file
+    int64_t transfer(Handle fd, const Request& request)
+    {
+        size_t done = 0;
+        while (done < request.bytes) {
+            char* p = static_cast<char*>(request.buffer) + done;
+            const off_t offset = static_cast<off_t>(request.offset + done);
+            const ssize_t n = request.write ? pwrite(fd, p, request.bytes - done, offset) : pread(fd, p, request.bytes - done, offset);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return -errno;
+            }
+            if (n == 0) {
+                break;
+            }
+            done += static_cast<size_t>(n);
+        }
+        return static_cast<int64_t>(done);
+    }
+#endif
+
+    // -----------------------------------------------------------------------------------------------------------------
+    // ThreadEngine
+
+    //a few workers taking requests off a shared queue, each one a blocking positioned transfer
+    class ThreadEngine : public AsyncFile::Engine
+    {
+    public:
+        ThreadEngine(Handle file, size_t depth)
+            : file_(file)
+        {
+            const size_t workers = std::min<size_t>(std::max<size_t>(depth, 1), ASYNC_MAX_THREADS);
+            for (size_t i = 0; i < workers; i++) {
+                threads_.emplace_back(&ThreadEngine::workerLoop, this);
+            }
+        }
+
+        ~ThreadEngine() override
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                stop_ = true;
+            }
+            work_.notify_all();
+            for (std::thread& thread : threads_) {
+                thread.join();
+            }
+        }
+
+        const char* name() const override { return "threads"; }
+
+        void queue(const Request& request) override
+        {
+            queued_.push_back(request);
+        }
+
+        bool submit() override
+        {
+            if (queued_.empty()) {
+                return true;
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                pending_.insert(pending_.end(), queued_.begin(), queued_.end());
+            }
+            queued_.clear();
+            work_.notify_all();
+            return true;
+        }
+
+        bool wait(uint64_t& tag, int64_t& result) override
+        {
+            submit();
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            done_.wait(lock, [this] { return !completed_.empty(); });
+            tag = completed_.front().first;
+            result = completed_.front().second;
+            completed_.pop_front();
+            return true;
+        }
+
+    private:
+        void workerLoop()
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            for (;;) {
+                work_.wait(lock, [this] { return stop_ || !pending_.empty(); });
+                if (pending_.empty()) {
+                    return;
+                }
+                const Request request = pending_.front();
+                pending_.pop_front();
+
+                lock.unlock();
+                const int64_t result = transfer(file_, request);
+                lock.lock();
+
+                completed_.emplace_back(request.tag, result);
+                done_.notify_one();
+            }
+        }
+
+        Handle file_;
+        std::vector<Request> queued_;               // only touched by the owner's thread
+        std::deque<Request> pending_;
+        std::deque<std::pair<uint64_t, int64_t>> completed_;
+        std::mutex mutex_;
+        std::condition_variable work_;
+        std::condition_variable done_;
+        std::vector<std::thread> threads_;
+        bool stop_ = false;
+    };
+
+#ifdef SOUND_HAVE_IO_URING
+    // -----------------------------------------------------------------------------------------------------------------
+    // UringEngine
+
+    int uringSetup(unsigned entries, io_uring_params* params)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+    }
+
+    int uringEnter(int ring, unsigned toSubmit, unsigned minComplete, unsigned flags)
+    {
+        return static_cast<int>(syscall(__NR_io_uring_enter, ring, toSubmit, minComplete, flags, nullptr, 0));
+    }
+
+    //the submission and completion rings shared with the kernel. We are their only user: our side of each ring
+    //(the sq tail, the cq head) is plain memory, the kernel's side is read with acquire and ours published with release
+    class UringEngine : public AsyncFile::Engine
+    {
+    public:
+        UringEngine(int fd, size_t depth)
+            : fd_(fd)
+        {
+            //twice the depth, so a slot and its iovec are only reused once the request that had them is long done
+            unsigned entries = 1;
+            while (entries < 2 * depth) {
+                entries <<= 1;
+            }
+
+            io_uring_params params;
+            memset(&params, 0, sizeof params);
+            ring_ = uringSetup(entries, &params);
+            if (ring_ < 0) {
+                return;
+            }
+
+            sqSize_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqSize_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+            const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+            if (single) {
+                sqSize_ = cqSize_ = std::max(sqSize_, cqSize_);
+            }
+
+            sq_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQ_RING);
+            cq_ = single ? sq_ : mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_CQ_RING);
+            sqesSize_ = params.sq_entries * sizeof(io_uring_sqe);
+            void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_, IORING_OFF_SQES);
+            if (sq_ == MAP_FAILED || cq_ == MAP_FAILED || sqes == MAP_FAILED) {
+                sq_ = sq_ == MAP_FAILED ? nullptr : sq_;
+                cq_ = cq_ == MAP_FAILED ? nullptr : cq_;
+                sqes_ = sqes == MAP_FAILED ? nullptr : static_cast<io_uring_sqe*>(sqes);
+                release();
+                return;
+            }
+            sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+            char* sq = static_cast<char*>(sq_);
+            sqTail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+            sqMask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+            sqArray_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+            char* cq = static_cast<char*>(cq_);
+            cqHead_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+            cqTail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+            cqMask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+            cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+            iovecs_.resize(params.sq_entries);
+        }
+
+        ~UringEngine() override { release(); }
+
+        bool ready() const { return ring_ >= 0; }
+
+        const char* name() const override { return "io_uring"; }
+
+        void queue(const Request& request) override
+        {
+            //readv/writev rather than read/write so kernels before 5.6 take them too
+            const unsigned tail = *sqTail_;
+            const unsigned index = tail & sqMask_;
+            iovecs_[index].iov_base = request.buffer;
+            iovecs_[index].iov_len = request.bytes;
+
+            io_uring_sqe& sqe = sqes_[index];
+            memset(&sqe, 0, sizeof sqe);
+            sqe.opcode = request.write ? IORING_OP_WRITEV : IORING_OP_READV;
+            sqe.fd = fd_;
+            sqe.off = request.offset;
+            sqe.addr = reinterpret_cast<uint64_t>(&iovecs_[index]);
+            sqe.len = 1;
+            sqe.user_data = request.tag;
+
+            sqArray_[index] = index;
+            __atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+            queued_++;
+        }
+
+        bool submit() override
+        {
+            while (queued_ > 0) {
+                const int n = uringEnter(ring_, queued_, 0, 0);
+                if (n < 0) {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        continue;
+                    }
+                    std::cerr << "Error: io_uring submission failed (" << strerror(errno) << ")" << std::endl;
+                    return false;
+                }
+                queued_ -= static_cast<unsigned>(n);
+            }
+            return true;
+        }
+
+        bool wait(uint64_t& tag, int64_t& result) override
+        {
+            for (;;) {
+                const unsigned head = *cqHead_;
+                if (head != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+                    const io_uring_cqe& cqe = cqes_[head & cqMask_];
+                    tag = cqe.user_data;
+                    result = cqe.res;
+                    __atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+                    return true;
+                }
+
+                //submits whatever is still queued and sleeps until something completes
+                const int n = uringEnter(ring_, queued_, 1, IORING_ENTER_GETEVENTS);
+                if (n < 0) {
+                    if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                        continue;
+                    }
+                    std::cerr << "Error: io_uring wait failed (" << strerror(errno) << ")" << std::endl;
+                    return false;
+                }
+                queued_ -= static_cast<unsigned>(n);
+            }
+        }
+
+    private:
+        void release()
+        {
+            if (sqes_) {
+                munmap(sqes_, sqesSize_);
+            }
+            if (cq_ && cq_ != sq_) {
+                munmap(cq_, cqSize_);
+            }
+            if (sq_) {
+                munmap(sq_, sqSize_);
+            }
+            if (ring_ >= 0) {
+                ::close(ring_);
+            }
+            sqes_ = nullptr;
+            sq_ = cq_ = nullptr;
+            ring_ = -1;
+        }
+
+        int fd_;
+        int ring_ = -1;
+        void* sq_ = nullptr;
+        void* cq_ = nullptr;
+        size_t sqSize_ = 0;
+        size_t cqSize_ = 0;
+        size_t sqesSize_ = 0;
+        io_uring_sqe* sqes_ = nullptr;
+        io_uring_cqe* cqes_ = nullptr;
+        unsigned* sqTail_ = nullptr;
+        unsigned* sqArray_ = nullptr;
+        unsigned* cqHead_ = nullptr;
+        unsigned* cqTail_ = nullptr;
+        unsigned sqMask_ = 0;
+        unsigned cqMask_ = 0;
+        unsigned queued_ = 0;                       // in the ring but not handed to the kernel yet
+        std::vector<iovec> iovecs_;                 // one per submission slot
+    };
+#endif
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// AsyncFile
+
+AsyncFile::AsyncFile() = default;
+
+AsyncFile::~AsyncFile()
+{
+    close();
+}
+
+const char* AsyncFile::engine() const
+{
+    return engine_ ? engine_->name() : "";
+}
+
+#ifdef _WIN32
+
+bool AsyncFile::open(const char* filename, Access access, size_t depth)
+{
+    close();
+
+    const bool write = access != Access::Read;
+    const DWORD desired = write ? GENERIC_WRITE : GENERIC_READ;
+    const DWORD disposition = access == Access::Write ? CREATE_ALWAYS : OPEN_EXISTING;
+
+    direct_ = access != Access::Update && !ioOption("buffered");
+    file_ = CreateFileA(filename, desired, FILE_SHARE_READ, nullptr, disposition, direct_ ? FILE_FLAG_NO_BUFFERING : FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE && direct_) {
+        direct_ = false;
+        file_ = CreateFileA(filename, desired, FILE_SHARE_READ, nullptr, disposition, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    }
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        std::cerr << "Error: could not open " << filename << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<uint64_t>(size.QuadPart);
+
+    depth_ = std::max<size_t>(depth, 1);
+    engine_.reset(new ThreadEngine(file_, depth_));
+    return true;
+}
+
+bool AsyncFile::truncate(uint64_t size)
+{
+    LARGE_INTEGER end;
+    end.QuadPart = static_cast<LONGLONG>(size);
+    return file_ && SetFilePointerEx(file_, end, nullptr, FILE_BEGIN) && SetEndOfFile(file_);
+}
+
+//NTFS allocates what SetEndOfFile extends a file to, only sparse files are left with holes
+bool AsyncFile::reserve(uint64_t size)
+{
+    return truncate(size);
+}
+
+#else
+
+bool AsyncFile::open(const char* filename, Access access, size_t depth)
+{
+    close();
+
+    const int flags = (access == Access::Write ? O_WRONLY | O_CREAT | O_TRUNC : access == Access::Update ? O_WRONLY : O_RDONLY) | O_CLOEXEC;
+
+    //filesystems without direct I/O (tmpfs on older kernels) refuse the flag, those get the page cache
+    direct_ = false;
+#ifdef O_DIRECT
+    if (access != Access::Update && !ioOption("buffered")) {
+        fd_ = ::open(filename, flags | O_DIRECT, 0644);
+        direct_ = fd_ >= 0;
+    }
+#endif
+    if (fd_ < 0) {
+        fd_ = ::open(filename, flags, 0644);
+    }
+    if (fd_ < 0) {
+        std::cerr << "Error: could not open " << filename << " (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+    direct_ = access != Access::Update && !ioOption("buffered") && fcntl(fd_, F_NOCACHE, 1) == 0;
+#endif
+
+    struct stat info;
+    size_ = fstat(fd_, &info) == 0 ? static_cast<uint64_t>(info.st_size) : 0;
+
+    depth_ = std::max<size_t>(depth, 1);
+#ifdef SOUND_HAVE_IO_URING
+    if (!ioOption("threads")) {
+        std::unique_ptr<UringEngine> uring(new UringEngine(fd_, depth_));
+        if (uring->ready()) {
+            engine_ = std::move(uring);
+        }
+    }
+#endif
+    if (!engine_) {
+        engine_.reset(new ThreadEngine(fd_, depth_));
+    }
+    return true;
+}
+
+bool AsyncFile::truncate(uint64_t size)
+{
+    return fd_ >= 0 && ftruncate(fd_, static_cast<off_t>(size)) == 0;
+}
+
+bool AsyncFile::reserve(uint64_t size)
+{
+    if (fd_ < 0) {
+        return false;
+    }
+#ifdef __linux__
+    //a full disk fails here and not later, filesystems without fallocate get the sparse length
+    const int error = posix_fallocate(fd_, 0, static_cast<off_t>(size));
+    if (error != 0 && error != EOPNOTSUPP && error != EINVAL) {
+        std::cerr << "Error: could not reserve " << size << " bytes on disk (" << strerror(error) << ")" << std::endl;
+        return false;
+    }
+#endif
+    //the length may already be past 'size', the first page went out whole
+    return truncate(size);
+}
+
+#endif
+
+void AsyncFile::close()
+{
+    uint64_t tag;
+    int64_t result;
+    while (inFlight_ > 0 && wait(tag, result)) {
+    }
+    engine_.reset();
+    inFlight_ = 0;
+
+#ifdef _WIN32
+    if (file_) {
+        CloseHandle(file_);
+    }
+    file_ = nullptr;
+#else
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    fd_ = -1;
+#endif
+    size_ = 0;
+}
+
+bool AsyncFile::queueRead(void* buffer, size_t bytes, uint64_t offset, uint64_t tag)
+{
+    if (!engine_ || inFlight_ >= depth_) {
+        return false;
+    }
+    engine_->queue({ false, buffer, bytes, offset, tag });
+    inFlight_++;
+    return true;
+}
+
+bool AsyncFile::queueWrite(const void* buffer, size_t bytes, uint64_t offset, uint64_t tag)
+{
+    if (!engine_ || inFlight_ >= depth_) {
+        return false;
+    }
+    //the buffer is only read from, the request type is shared with reads
+    engine_->queue({ true, const_cast<void*>(buffer), bytes, offset, tag });
+    inFlight_++;
+    return true;
+}
+
+bool AsyncFile::submit()
+{
+    return engine_ && engine_->submit();
+}
+
+bool AsyncFile::wait(uint64_t& tag, int64_t& result)
+{
+    if (!engine_ || inFlight_ == 0 || !engine_->wait(tag, result)) {
+        return false;
+    }
+    inFlight_--;
+    return true;
+}
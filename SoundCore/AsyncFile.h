@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include "AlignedBuffer.h"
+
+constexpr size_t ASYNC_DEFAULT_DEPTH = 4;           // requests in flight per file unless open() is told otherwise
+constexpr unsigned ASYNC_MAX_THREADS = 4;           // workers of the fallback engine per file
+
+// positioned reads and writes that complete in the background while the caller computes. On Linux requests
+// go through an io_uring (raw syscalls, no liburing), where the kernel has none or refuses it (old kernels,
+// seccomp) and on other systems through a few threads doing pread/pwrite. SOUND_IO=threads forces the
+// fallback and SOUND_IO=buffered turns direct I/O off, both can be given separated by a comma.
+// Files are opened for direct I/O (O_DIRECT, FILE_FLAG_NO_BUFFERING) where the filesystem allows it, so
+// large transfers skip the page cache. Buffers, sizes and offsets then have to be multiples of
+// BUFFER_ALIGNMENT, which AlignedBuffer blocks are; a file whose length isn't gets truncate() at the end
+class AsyncFile
+{
+public:
+    enum class Access
+    {
+        Read,
+        Write,          // creates the file or empties an existing one
+        Update          // writes into an existing file as it is, through the page cache since writes may land anywhere
+    };
+
+    AsyncFile();
+    ~AsyncFile();
+
+    AsyncFile(const AsyncFile&) = delete;
+    AsyncFile& operator=(const AsyncFile&) = delete;
+
+    // at most 'depth' requests may be in flight at once
+    bool open(const char* filename, Access access, size_t depth = ASYNC_DEFAULT_DEPTH);
+
+    // waits for the requests still in flight, their completions are dropped
+    void close();
+
+    bool isOpen() const { return engine_ != nullptr; }
+    bool direct() const { return direct_; }
+    const char* engine() const;                     // "io_uring" or "threads"
+    uint64_t size() const { return size_; }         // length when opened
+    size_t depth() const { return depth_; }
+    size_t inFlight() const { return inFlight_; }   // queued or submitted and not waited for
+
+    // queues a transfer of 'bytes' at file offset 'offset' into or out of 'buffer', which has to stay untouched until
+    // wait() returns 'tag'. Nothing reaches the kernel before submit() or wait(), so several can go in one call.
+    // False when 'depth' requests are already in flight
+    bool queueRead(void* buffer, size_t bytes, uint64_t offset, uint64_t tag);
+    bool queueWrite(const void* buffer, size_t bytes, uint64_t offset, uint64_t tag);
+
+    // hands everything queued to the kernel (or the workers) in one go
+    bool submit();
+
+    // blocks until a request completes and returns its tag with the bytes it moved, or -errno.
+    // False if nothing is in flight
+    bool wait(uint64_t& tag, int64_t& result);
+
+    // sets the file length, for direct writes that had to round the last block up
+    bool truncate(uint64_t size);
+
+    // sets the file length like truncate() and reserves its blocks on disk, so writes through a mapping can't
+    // find the disk full later. Where the filesystem can't reserve it is a plain truncate()
+    bool reserve(uint64_t size);
+
+    class Engine;
+
+private:
+    std::unique_ptr<Engine> engine_;
+    bool direct_ = false;
+    uint64_t size_ = 0;
+    size_t depth_ = 0;
+    size_t inFlight_ = 0;
+#ifdef _WIN32
+    void* file_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
@@ -0,0 +1,313 @@
+#include "Backend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#include "AlignedBuffer.h"
+#include "Kernels.h"
+#include "Mixer.h"
+
+namespace
+{
+    constexpr uint64_t GENERATE_GRAIN = 1 << 16;    // samples per pool task when generating
+
+    //fastest of CALIBRATION_RUNS runs of 'job' after a warm-up, in samples per second, 0 if the job was declined
+    template <typename Job>
+    double timeJob(uint64_t samples, Job job)
+    {
+        if (!job()) {
+            return 0;
+        }
+
+        double best = 0;
+        for (int run = 0; run < CALIBRATION_RUNS; run++) {
+            const auto start = std::chrono::steady_clock::now();
+            job();
+            const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            best = std::max(best, samples / std::max(seconds, 1e-9));
+        }
+        return best;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// CpuBackend
+
+CpuBackend::CpuBackend(ThreadPool* pool)
+    : pool_(pool)
+{
+}
+
+bool CpuBackend::generate(Waveform waveform, short* dst, uint64_t count, double phase, double increment, float amplitude)
+{
+    if (!pool_) {
+        generateWaveform(waveform, dst, count, phase, increment, amplitude);
+        return true;
+    }
+
+    pool_->parallelFor(0, count, GENERATE_GRAIN, [=](uint64_t begin, uint64_t end) {
+        const double start = phase + begin * increment;
+        generateWaveform(waveform, dst + begin, end - begin, start - std::floor(start), increment, amplitude);
+    });
+    return true;
+}
+
+bool CpuBackend::mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count)
+{
+    mixTracks(sources, gains, numTracks, dst, count, pool_);
+    return true;
+}
+
+bool CpuBackend::generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position)
+{
+    const size_t frameSize = tone.channels * makeWaveFormat(format, 1, 0).blockAlign();
+
+    //every task starts its channels at their own phase, wrapped as the renderers expect
+    auto render = [=, &tone](uint64_t begin, uint64_t end) {
+        ToneBlock part = tone;
+        for (size_t c = 0; c < tone.channels; c++) {
+            const double start = tone.phase[c] + begin * tone.increment[c];
+            part.phase[c] = start - std::floor(start);
+        }
+        renderToneBlock(part, format, static_cast<char*>(dst) + begin * frameSize, static_cast<size_t>(end - begin), position + begin);
+    };
+
+    if (pool_) {
+        pool_->parallelFor(0, frames, GENERATE_GRAIN, render);
+    } else {
+        render(0, frames);
+    }
+    return true;
+}
+
+bool CpuBackend::mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+    uint64_t position)
+{
+    //the float bus is the output, nothing to convert
+    if (format == SampleFormat::Float) {
+        mixBus(sources, gains, numTracks, static_cast<float*>(dst), count, pool_);
+        return true;
+    }
+
+    const size_t sampleSize = makeWaveFormat(format, 1, 0).blockAlign();
+    auto mixBlocks = [=](uint64_t begin, uint64_t end) {
+        std::vector<const short*> blockSources(numTracks);
+        AlignedBuffer<float> bus(MIX_BLOCK_SAMPLES);
+        for (uint64_t block = begin; block < end; block += MIX_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_BLOCK_SAMPLES, end - block));
+            for (size_t t = 0; t < numTracks; t++) {
+                blockSources[t] = sources[t] + block;
+            }
+            mixBus(blockSources.data(), gains, numTracks, bus.data(), n, nullptr);
+            convertSamples(bus.data(), static_cast<char*>(dst) + block * sampleSize, n, format, position + block);
+        }
+    };
+
+    if (pool_) {
+        pool_->parallelFor(0, count, MIX_BLOCK_SAMPLES, mixBlocks);
+    } else {
+        mixBlocks(0, count);
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// BackendEngine
+
+void BackendEngine::add(std::unique_ptr<Backend> backend)
+{
+    if (backend) {
+        entries_.push_back({ std::move(backend) });
+        rank();
+    }
+}
+
+void BackendEngine::addCpuBackends(ThreadPool& pool)
+{
+    add(std::make_unique<CpuBackend>());
+    add(std::make_unique<CpuBackend>(&pool));
+}
+
+void BackendEngine::calibrate(const char* cacheFile)
+{
+    const char* env = std::getenv("SOUND_BACKEND_CACHE");
+    const std::string filename = cacheFile ? cacheFile : env ? env : BACKEND_CACHE_FILE;
+
+    if (!loadCache(filename)) {
+        for (Entry& entry : entries_) {
+            measure(entry);
+        }
+        saveCache(filename);
+    }
+    rank();
+}
+
+void BackendEngine::measure(Entry& entry) const
+{
+    std::vector<short> output(CALIBRATION_SAMPLES);
+    entry.generateRate = timeJob(CALIBRATION_SAMPLES, [&] {
+        return entry.backend->generate(Waveform::Sine, output.data(), CALIBRATION_SAMPLES, 0.0, 200.0 / 44100, 32760);
+    });
+
+    std::vector<std::vector<short>> tracks(CALIBRATION_TRACKS, std::vector<short>(CALIBRATION_SAMPLES));
+    std::vector<const short*> sources;
+    for (size_t t = 0; t < tracks.size(); t++) {
+        kernels().sineInt16(tracks[t].data(), CALIBRATION_SAMPLES, 0.0, 100.0 * (t + 1) / 44100, 32760);
+        sources.push_back(tracks[t].data());
+    }
+    const std::vector<short> gains(CALIBRATION_TRACKS, mixGain(1.0 / CALIBRATION_TRACKS));
+    entry.mixRate = timeJob(CALIBRATION_SAMPLES, [&] {
+        return entry.backend->mix(sources.data(), gains.data(), sources.size(), output.data(), CALIBRATION_SAMPLES);
+    });
+}
+
+// cache lines are "kernels <table>" and then "<backend> <generate rate> <mix rate>" per backend
+bool BackendEngine::loadCache(const std::string& filename)
+{
+    std::ifstream file(filename);
+    std::string line, key, table;
+    if (!std::getline(file, line) || !(std::istringstream(line) >> key >> table) || key != "kernels" || table != kernels().name) {
+        return false;
+    }
+
+    std::vector<std::pair<double, double>> rates(entries_.size());
+    std::vector<bool> found(entries_.size(), false);
+    size_t lines = 0;
+    while (std::getline(file, line)) {
+        std::istringstream fields(line);
+        std::string name;
+        double generateRate, mixRate;
+        if (!(fields >> name >> generateRate >> mixRate)) {
+            return false;
+        }
+        lines++;
+
+        for (size_t i = 0; i < entries_.size(); i++) {
+            if (name == entries_[i].backend->name()) {
+                rates[i] = { generateRate, mixRate };
+                found[i] = true;
+            }
+        }
+    }
+
+    //a backend was added or removed since the cache was written, time them all again
+    if (lines != entries_.size() || std::find(found.begin(), found.end(), false) != found.end()) {
+        return false;
+    }
+
+    for (size_t i = 0; i < entries_.size(); i++) {
+        entries_[i].generateRate = rates[i].first;
+        entries_[i].mixRate = rates[i].second;
+    }
+    return true;
+}
+
+void BackendEngine::saveCache(const std::string& filename) const
+{
+    std::ofstream file(filename);
+    if (!file) {
+        std::cerr << "Error: could not write the backend cache " << filename << std::endl;
+        return;
+    }
+
+    file << "kernels " << kernels().name << "\n";
+    for (const Entry& entry : entries_) {
+        file << entry.backend->name() << " " << entry.generateRate << " " << entry.mixRate << "\n";
+    }
+}
+
+void BackendEngine::rank()
+{
+    const char* forced = std::getenv("SOUND_BACKEND");
+
+    auto order = [this, forced](double Entry::*rate) {
+        std::vector<const Entry*> sorted;
+        for (const Entry& entry : entries_) {
+            sorted.push_back(&entry);
+        }
+        //fastest first, a forced backend ahead of everything, ties keep the order backends were added in
+        std::stable_sort(sorted.begin(), sorted.end(), [forced, rate](const Entry* a, const Entry* b) {
+            const bool aForced = forced && strcmp(a->backend->name(), forced) == 0;
+            const bool bForced = forced && strcmp(b->backend->name(), forced) == 0;
+            if (aForced != bForced) {
+                return aForced;
+            }
+            return a->*rate > b->*rate;
+        });
+
+        std::vector<Backend*> backends;
+        for (const Entry* entry : sorted) {
+            backends.push_back(entry->backend.get());
+        }
+        return backends;
+    };
+
+    generateOrder_ = order(&Entry::generateRate);
+    mixOrder_ = order(&Entry::mixRate);
+}
+
+bool BackendEngine::generate(short* dst, uint64_t count, double phase, double increment, float amplitude, Waveform waveform)
+{
+    for (Backend* backend : generateOrder_) {
+        if (backend->generate(waveform, dst, count, phase, increment, amplitude)) {
+            return true;
+        }
+    }
+    std::cerr << "Error: no backend could generate the block" << std::endl;
+    return false;
+}
+
+bool BackendEngine::mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count)
+{
+    for (Backend* backend : mixOrder_) {
+        if (backend->mix(sources, gains, numTracks, dst, count)) {
+            return true;
+        }
+    }
+    std::cerr << "Error: no backend could mix the block" << std::endl;
+    return false;
+}
+
+bool BackendEngine::generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position)
+{
+    for (Backend* backend : generateOrder_) {
+        if (backend->generate(tone, format, dst, frames, position)) {
+            return true;
+        }
+    }
+    std::cerr << "Error: no backend could generate the block" << std::endl;
+    return false;
+}
+
+bool BackendEngine::mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+    uint64_t position)
+{
+    for (Backend* backend : mixOrder_) {
+        if (backend->mix(sources, gains, numTracks, format, dst, count, position)) {
+            return true;
+        }
+    }
+    std::cerr << "Error: no backend could mix the block" << std::endl;
+    return false;
+}
+
+Backend& BackendEngine::best(BackendJob job)
+{
+    return *ranking(job).front();
+}
+
+double BackendEngine::rate(const Backend& backend, BackendJob job) const
+{
+    for (const Entry& entry : entries_) {
+        if (entry.backend.get() == &backend) {
+            return job == BackendJob::Generate ? entry.generateRate : entry.mixRate;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "SampleFormat.h"
+#include "ThreadPool.h"
+#include "ToneKernels.h"
+#include "Wavetable.h"
+
+constexpr uint64_t CALIBRATION_SAMPLES = 1 << 21;  // samples per calibration job, long enough to amortise a GPU round trip
+constexpr size_t CALIBRATION_TRACKS = 4;            // tracks in the calibration mix
+constexpr int CALIBRATION_RUNS = 3;                 // timed runs per job after a warm-up, the best one counts
+constexpr const char* BACKEND_CACHE_FILE = "sound_backends.cache"; // default calibration cache, SOUND_BACKEND_CACHE overrides
+
+// one way of computing blocks. Backends may be tied to the thread that created them (a GL context is),
+// so a backend is only ever called from that thread
+class Backend
+{
+public:
+    virtual ~Backend() = default;
+
+    virtual const char* name() const = 0;
+
+    // dst[i] = amplitude * waveform at phase + i * increment cycles truncated to 16 bits, as generateWaveform.
+    // False if this backend can't take the job
+    virtual bool generate(Waveform waveform, short* dst, uint64_t count, double phase, double increment, float amplitude) = 0;
+
+    // dst[i] = sum of gains[k] * sources[k][i] saturated to 16 bits with Q12 gains, as mixTracks.
+    // False if this backend can't take the job
+    virtual bool mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count) = 0;
+
+    // 'frames' interleaved frames of 'tone' on the float bus converted to 'format', as renderToneBlock. 'position' is
+    // the index of the first frame in the stream, the int16 dither follows it. False if this backend can't take the job
+    virtual bool generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position) = 0;
+
+    // dst[i] = sum of gains[k] * sources[k][i] on the float bus converted to 'format', with gains from busGain, as mixBus
+    // and convertSamples. 'position' is the index of dst[0] in the stream for the dither. False if this backend can't take the job
+    virtual bool mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+        uint64_t position) = 0;
+};
+
+// the SIMD kernels on the calling thread, or spread over 'pool' when there is one
+class CpuBackend : public Backend
+{
+public:
+    explicit CpuBackend(ThreadPool* pool = nullptr);
+
+    const char* name() const override { return pool_ ? "threads" : "cpu"; }
+
+    bool generate(Waveform waveform, short* dst, uint64_t count, double phase, double increment, float amplitude) override;
+    bool mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count) override;
+    bool generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position) override;
+    bool mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+        uint64_t position) override;
+
+private:
+    ThreadPool* pool_;
+};
+
+enum class BackendJob { Generate, Mix };
+
+// owns the available backends and sends each job to the fastest one, falling back down the ranking
+// when a backend declines. The ranking comes from a short calibration run that is cached on disk
+// per set of backends and kernel table, so only the first start on a host pays for it. The bus jobs go down the
+// same rankings as the 16-bit ones. Like the backends it is only called from the thread that built it
+class BackendEngine
+{
+public:
+    void add(std::unique_ptr<Backend> backend);
+
+    // the "cpu" and "threads" backends, the fallback every host has
+    void addCpuBackends(ThreadPool& pool = ThreadPool::shared());
+
+    // times every backend unless the cache already holds timings for exactly this set.
+    // SOUND_BACKEND=name puts that backend first whatever the timings say
+    void calibrate(const char* cacheFile = nullptr);
+
+    bool generate(short* dst, uint64_t count, double phase, double increment, float amplitude, Waveform waveform = Waveform::Sine);
+    bool mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count);
+    bool generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position);
+    bool mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+        uint64_t position);
+
+    // the backend a job of this kind goes to first
+    Backend& best(BackendJob job);
+
+    // calibrated rate in samples per second, 0 if the backend declined the calibration job
+    double rate(const Backend& backend, BackendJob job) const;
+
+    const std::vector<Backend*>& ranking(BackendJob job) const { return job == BackendJob::Generate ? generateOrder_ : mixOrder_; }
+
+private:
+    struct Entry
+    {
+        std::unique_ptr<Backend> backend;
+        double generateRate = 0;
+        double mixRate = 0;
+    };
+
+    bool loadCache(const std::string& filename);
+    void saveCache(const std::string& filename) const;
+    void measure(Entry& entry) const;
+    void rank();
+
+    std::vector<Entry> entries_;
+    std::vector<Backend*> generateOrder_;
+    std::vector<Backend*> mixOrder_;
+};
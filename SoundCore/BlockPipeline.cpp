@@ -0,0 +1,63 @@
+#include "BlockPipeline.h"
+
+BlockPipeline::BlockPipeline(size_t blockBytes, size_t depth, ThreadPool& pool)
+    : pool_(pool)
+{
+    if (depth == 0) {
+        depth = 2 * pool.size() + 2;
+    }
+
+    slots_.resize(depth);
+    for (Slot& slot : slots_) {
+        slot.buffer.allocate(blockBytes);
+    }
+}
+
+void BlockPipeline::schedule(uint64_t index, const Produce& produce)
+{
+    Slot& slot = slots_[index % slots_.size()];
+    slot.index = index;
+    slot.ready = false;
+    inFlight_++;
+
+    pool_.submit([this, &slot, &produce, index] {
+        const size_t bytes = produce(index, slot.buffer.data(), slot.buffer.size());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        slot.bytes = bytes;
+        slot.ready = true;
+        inFlight_--;
+        readyChanged_.notify_all();
+    });
+}
+
+bool BlockPipeline::run(uint64_t numBlocks, const Produce& produce, const Consume& consume)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    //prime every slot
+    for (uint64_t i = 0; i < numBlocks && i < slots_.size(); i++) {
+        schedule(i, produce);
+    }
+
+    bool ok = true;
+    for (uint64_t i = 0; i < numBlocks && ok; i++) {
+        Slot& slot = slots_[i % slots_.size()];
+        readyChanged_.wait(lock, [&slot, i] { return slot.ready && slot.index == i; });
+
+        //consume without the lock so producers can keep publishing
+        lock.unlock();
+        ok = consume(i, slot.buffer.data(), slot.bytes);
+        lock.lock();
+
+        //the slot is free again, it takes the block 'depth' places ahead
+        if (ok && i + slots_.size() < numBlocks) {
+            schedule(i + slots_.size(), produce);
+        }
+    }
+
+    //producers still running reference the slots, let them finish before we go
+    readyChanged_.wait(lock, [this] { return inFlight_ == 0; });
+
+    return ok;
+}
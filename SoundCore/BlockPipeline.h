@@ -0,0 +1,50 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "ThreadPool.h"
+
+// bounded producer/consumer over numbered blocks: the pool fills blocks in any order,
+// the calling thread drains them strictly in order. Only 'depth' blocks exist at any time,
+// so memory stays constant however long the signal is, and compute overlaps the consumer's I/O
+class BlockPipeline
+{
+public:
+    // fills block 'index', returns the bytes it produced
+    using Produce = std::function<size_t(uint64_t index, char* block, size_t capacity)>;
+
+    // takes block 'index', returns false to stop the pipeline
+    using Consume = std::function<bool(uint64_t index, const char* block, size_t bytes)>;
+
+    // 0 depth = two blocks per pool thread plus two, enough to keep every worker busy while one block is written
+    BlockPipeline(size_t blockBytes, size_t depth = 0, ThreadPool& pool = ThreadPool::shared());
+
+    // false if consume stopped early
+    bool run(uint64_t numBlocks, const Produce& produce, const Consume& consume);
+
+    // block i is produced into slot i % depth() and nothing else touches that slot until it is consumed,
+    // so producers can keep their scratch per slot the same way
+    size_t depth() const { return slots_.size(); }
+
+private:
+    struct Slot
+    {
+        AlignedBuffer<char> buffer;
+        size_t bytes = 0;
+        uint64_t index = 0;
+        bool ready = false;
+    };
+
+    void schedule(uint64_t index, const Produce& produce);
+
+    ThreadPool& pool_;
+    std::vector<Slot> slots_;
+    std::mutex mutex_;
+    std::condition_variable readyChanged_;
+    size_t inFlight_ = 0;
+};
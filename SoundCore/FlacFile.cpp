@@ -0,0 +1,1375 @@
+#include "FlacFile.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "ThreadPool.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace
+{
+    constexpr uint64_t SEEK_PLACEHOLDER = ~0ull;    // sample number of an unused seek table entry
+    constexpr size_t STREAMINFO_SIZE = 34;
+    constexpr size_t SEEK_POINT_SIZE = 18;
+    constexpr size_t MAX_HEADER_SIZE = 16;          // sync, codes, the longest coded number, block size, rate and CRC-8
+    constexpr size_t MIN_LPC_FRAMES = 32;           // shorter blocks only try the fixed predictors
+    constexpr unsigned MAX_RICE_PARAMETER = 30;
+    constexpr double TUKEY_TAPER = 0.5;             // fraction of the block the LPC analysis window tapers over
+    constexpr size_t AUTOC_LANES = 8;               // float partial sums per lag of the autocorrelation
+    constexpr size_t AUTOC_SPAN = 512;              // samples they sum before going into the double total
+
+    enum ChannelAssignment
+    {
+        LEFT_SIDE = 8,
+        SIDE_RIGHT = 9,
+        MID_SIDE = 10
+    };
+
+    unsigned leadingZeros(uint64_t v)
+    {
+#ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse64(&index, v);
+        return 63 - index;
+#else
+        return __builtin_clzll(v);
+#endif
+    }
+
+    uint32_t mask(unsigned bits) { return bits >= 32 ? ~0u : (1u << bits) - 1; }
+
+    uint32_t fold(int64_t v) { return static_cast<uint32_t>((v << 1) ^ (v >> 63)); }
+    uint32_t fold32(int32_t v) { return static_cast<uint32_t>(v) << 1 ^ static_cast<uint32_t>(v >> 31); }
+    int32_t unfold(uint32_t v) { return static_cast<int32_t>(v >> 1) ^ -static_cast<int32_t>(v & 1); }
+
+    uint8_t crc8(const unsigned char* p, size_t bytes)
+    {
+        static const auto table = [] {
+            std::vector<uint8_t> t(256);
+            for (unsigned i = 0; i < 256; i++) {
+                unsigned crc = i;
+                for (int b = 0; b < 8; b++) {
+                    crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+                }
+                t[i] = static_cast<uint8_t>(crc);
+            }
+            return t;
+        }();
+
+        uint8_t crc = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            crc = table[crc ^ p[i]];
+        }
+        return crc;
+    }
+
+    //eight bytes per step: table[k] holds the crc of a byte followed by k zero bytes
+    uint16_t crc16(const unsigned char* p, size_t bytes)
+    {
+        static const auto table = [] {
+            std::vector<std::array<uint16_t, 256>> t(8);
+            for (unsigned i = 0; i < 256; i++) {
+                unsigned crc = i << 8;
+                for (int b = 0; b < 8; b++) {
+                    crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+                }
+                t[0][i] = static_cast<uint16_t>(crc);
+            }
+            for (size_t k = 1; k < t.size(); k++) {
+                for (unsigned i = 0; i < 256; i++) {
+                    t[k][i] = static_cast<uint16_t>(t[k - 1][i] << 8) ^ t[0][t[k - 1][i] >> 8];
+                }
+            }
+            return t;
+        }();
+
+        uint16_t crc = 0;
+        for (; bytes >= 8; bytes -= 8, p += 8) {
+            crc = table[7][(crc >> 8) ^ p[0]] ^ table[6][(crc & 0xFF) ^ p[1]] ^ table[5][p[2]] ^ table[4][p[3]] ^
+                  table[3][p[4]] ^ table[2][p[5]] ^ table[1][p[6]] ^ table[0][p[7]];
+        }
+        for (size_t i = 0; i < bytes; i++) {
+            crc = static_cast<uint16_t>(crc << 8) ^ table[0][(crc >> 8) ^ p[i]];
+        }
+        return crc;
+    }
+
+    //msb first, handed out 32 bits at a time
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(unsigned char* dst) : p_(dst) {}
+
+        // up to 32 bits, 'value' must fit them
+        void put(uint32_t value, unsigned bits)
+        {
+            acc_ = acc_ << bits | value;
+            count_ += bits;
+            if (count_ >= 32) {
+                count_ -= 32;
+                const uint32_t out = static_cast<uint32_t>(acc_ >> count_);
+                p_[0] = static_cast<unsigned char>(out >> 24);
+                p_[1] = static_cast<unsigned char>(out >> 16);
+                p_[2] = static_cast<unsigned char>(out >> 8);
+                p_[3] = static_cast<unsigned char>(out);
+                p_ += 4;
+            }
+        }
+
+        void putSigned(int32_t value, unsigned bits) { put(static_cast<uint32_t>(value) & mask(bits), bits); }
+
+        // a folded residual as quotient in unary and 'k' low bits
+        void putRice(uint32_t value, unsigned k)
+        {
+            uint32_t q = value >> k;
+            const uint32_t low = (1u << k) | (value & mask(k));
+            if (q + k < 32) {
+                put(low, q + k + 1);
+                return;
+            }
+            for (; q >= 32; q -= 32) {
+                put(0, 32);
+            }
+            put(0, q);
+            put(low, k + 1);
+        }
+
+        // pads to a byte with zeros and returns the end of the output
+        unsigned char* finish()
+        {
+            put(0, (8 - count_ % 8) % 8);
+            while (count_ >= 8) {
+                count_ -= 8;
+                *p_++ = static_cast<unsigned char>(acc_ >> count_);
+            }
+            return p_;
+        }
+
+    private:
+        unsigned char* p_;
+        uint64_t acc_ = 0;
+        unsigned count_ = 0;
+    };
+
+    //msb first from a bounded buffer, running past the end reads zeros and sets overrun()
+    class BitReader
+    {
+    public:
+        BitReader(const unsigned char* src, size_t bytes) : start_(src), p_(src), end_(src + bytes) {}
+
+        // up to 32 bits
+        uint32_t get(unsigned bits)
+        {
+            if (bits == 0) {
+                return 0;
+            }
+            if (count_ < bits) {
+                refill();
+                if (count_ < bits) {
+                    overrun_ = true;
+                    return 0;
+                }
+            }
+            const uint32_t v = static_cast<uint32_t>(acc_ >> (64 - bits));
+            acc_ <<= bits;
+            count_ -= bits;
+            return v;
+        }
+
+        int32_t getSigned(unsigned bits)
+        {
+            if (bits == 0) {
+                return 0;
+            }
+            return static_cast<int32_t>(get(bits) << (32 - bits)) >> (32 - bits);
+        }
+
+        // zeros up to the next one, which is consumed too
+        uint32_t getUnary()
+        {
+            uint32_t zeros = 0;
+            for (;;) {
+                if (count_ == 0) {
+                    refill();
+                    if (count_ == 0) {
+                        overrun_ = true;
+                        return 0;
+                    }
+                }
+                //the bits below count_ are always zero, so an empty accumulator means only zeros are left in it
+                if (acc_ == 0) {
+                    zeros += count_;
+                    count_ = 0;
+                    continue;
+                }
+                const unsigned z = leadingZeros(acc_);
+                acc_ = z < 63 ? acc_ << (z + 1) : 0;
+                count_ -= z + 1;
+                return zeros + z;
+            }
+        }
+
+        void align() { get(count_ % 8); }
+
+        // bytes consumed, once aligned
+        size_t position() const { return static_cast<size_t>(p_ - start_) - count_ / 8; }
+        bool overrun() const { return overrun_; }
+
+    private:
+        void refill()
+        {
+            while (count_ <= 56 && p_ < end_) {
+                acc_ |= static_cast<uint64_t>(*p_++) << (56 - count_);
+                count_ += 8;
+            }
+        }
+
+        const unsigned char* start_;
+        const unsigned char* p_;
+        const unsigned char* end_;
+        uint64_t acc_ = 0;
+        unsigned count_ = 0;
+        bool overrun_ = false;
+    };
+
+    unsigned char* putBE(unsigned char* p, uint64_t v, size_t bytes)
+    {
+        for (size_t i = 0; i < bytes; i++) {
+            p[i] = static_cast<unsigned char>(v >> (8 * (bytes - 1 - i)));
+        }
+        return p + bytes;
+    }
+
+    uint64_t getBE(const unsigned char* p, size_t bytes)
+    {
+        uint64_t v = 0;
+        for (size_t i = 0; i < bytes; i++) {
+            v = v << 8 | p[i];
+        }
+        return v;
+    }
+
+    //frame and sample numbers in the frame header are coded like UTF-8, stretched to 36 bits
+    unsigned char* putCodedNumber(unsigned char* p, uint64_t v)
+    {
+        if (v < 0x80) {
+            *p++ = static_cast<unsigned char>(v);
+            return p;
+        }
+        size_t bytes = 2;
+        while (bytes < 7 && v >= (1ull << (5 * bytes + 1))) {
+            bytes++;
+        }
+        *p++ = static_cast<unsigned char>((0xFF00 >> bytes) | (v >> (6 * (bytes - 1))));
+        for (size_t i = bytes - 1; i-- > 0; ) {
+            *p++ = static_cast<unsigned char>(0x80 | ((v >> (6 * i)) & 0x3F));
+        }
+        return p;
+    }
+
+    const unsigned char* getCodedNumber(const unsigned char* p, const unsigned char* end, uint64_t& v)
+    {
+        if (p >= end) {
+            return nullptr;
+        }
+        unsigned bytes = 0;
+        while (bytes < 8 && (*p & (0x80 >> bytes))) {
+            bytes++;
+        }
+        if (bytes == 1 || bytes > 7 || end - p < std::max<ptrdiff_t>(bytes, 1)) {
+            return nullptr;
+        }
+        if (bytes == 0) {
+            v = *p;
+            return p + 1;
+        }
+        v = *p++ & (0x7F >> bytes);
+        for (unsigned i = 1; i < bytes; i++, p++) {
+            if ((*p & 0xC0) != 0x80) {
+                return nullptr;
+            }
+            v = v << 6 | (*p & 0x3F);
+        }
+        return p;
+    }
+
+    //the header codes for the usual rates and sizes, anything else comes from STREAMINFO
+    unsigned rateCode(uint32_t rate)
+    {
+        switch (rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0;
+        }
+    }
+
+    unsigned sampleSizeCode(unsigned bits)
+    {
+        switch (bits) {
+        case 8: return 1;
+        case 16: return 4;
+        case 24: return 6;
+        default: return 0;
+        }
+    }
+
+    //the per-partition Rice parameters of a residual, with the cost in bits they were picked for
+    struct RicePlan
+    {
+        unsigned order = 0;
+        bool wide = false;                          // 5-bit parameters, for residuals past 14 bits per sample
+        uint8_t parameters[1 << FLAC_MAX_PARTITION_ORDER] = {};
+        uint64_t bits = UINT64_MAX;
+    };
+
+    //the best parameter for 'count' folded values adding up to 'sum' and what it costs them,
+    //sum >> k bounds the unary parts from above so the plan never underestimates
+    unsigned riceParameter(uint64_t sum, uint64_t count, uint64_t& bits)
+    {
+        if (count == 0) {
+            bits = 0;
+            return 0;
+        }
+        unsigned k = 0;
+        while (k < MAX_RICE_PARAMETER && (count << (k + 1)) <= sum) {
+            k++;
+        }
+        bits = count * (k + 1) + (sum >> k);
+        if (k > 0 && count * k + (sum >> (k - 1)) < bits) {
+            bits = count * k + (sum >> (k - 1));
+            k--;
+        }
+        return k;
+    }
+
+    //finds the partition order and parameters that code residual[predictor, n) in the fewest bits. The partition
+    //sums are taken once at the finest order and added up pairwise for the coarser ones
+    RicePlan planResidual(const uint32_t* residual, size_t n, unsigned predictor)
+    {
+        unsigned maxOrder = 0;
+        while (maxOrder < FLAC_MAX_PARTITION_ORDER && n % (size_t(2) << maxOrder) == 0 && (n >> (maxOrder + 1)) > predictor) {
+            maxOrder++;
+        }
+
+        uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+        const size_t length = n >> maxOrder;
+        for (size_t p = 0; p < (size_t(1) << maxOrder); p++) {
+            uint64_t sum = 0;
+            for (size_t i = std::max<size_t>(p * length, predictor); i < (p + 1) * length; i++) {
+                sum += residual[i];
+            }
+            sums[p] = sum;
+        }
+
+        RicePlan best;
+        for (int order = maxOrder; order >= 0; order--) {
+            const size_t parts = size_t(1) << order;
+            RicePlan plan;
+            plan.order = order;
+            plan.bits = 2 + 4;
+            for (size_t p = 0; p < parts; p++) {
+                const uint64_t count = (n >> order) - (p == 0 ? predictor : 0);
+                uint64_t bits;
+                plan.parameters[p] = static_cast<uint8_t>(riceParameter(sums[p], count, bits));
+                plan.wide = plan.wide || plan.parameters[p] > 14;
+                plan.bits += bits;
+            }
+            plan.bits += parts * (plan.wide ? 5 : 4);
+            if (plan.bits < best.bits) {
+                best = plan;
+            }
+
+            for (size_t p = 0; p < parts / 2; p++) {
+                sums[p] = sums[2 * p] + sums[2 * p + 1];
+            }
+        }
+        return best;
+    }
+
+    void writeResidual(BitWriter& out, const uint32_t* residual, size_t n, unsigned predictor, const RicePlan& plan)
+    {
+        out.put(plan.wide ? 1 : 0, 2);
+        out.put(plan.order, 4);
+        const size_t length = n >> plan.order;
+        for (size_t p = 0; p < (size_t(1) << plan.order); p++) {
+            const unsigned k = plan.parameters[p];
+            out.put(k, plan.wide ? 5 : 4);
+            for (size_t i = std::max<size_t>(p * length, predictor); i < (p + 1) * length; i++) {
+                out.putRice(residual[i], k);
+            }
+        }
+    }
+
+    //the analysis window, cached for full blocks
+    void tukeyWindow(float* w, size_t n)
+    {
+        const size_t taper = std::max<size_t>(1, static_cast<size_t>(TUKEY_TAPER / 2 * n));
+        for (size_t i = 0; i < n; i++) {
+            const size_t edge = std::min(i, n - 1 - i);
+            w[i] = edge >= taper ? 1.0f : static_cast<float>(0.5 - 0.5 * std::cos(3.14159265358979323846 * edge / taper));
+        }
+    }
+
+    const float* blockWindow()
+    {
+        static const std::vector<float> window = [] {
+            std::vector<float> w(FLAC_BLOCK_FRAMES);
+            tukeyWindow(w.data(), w.size());
+            return w;
+        }();
+        return window.data();
+    }
+
+    struct EncodeScratch
+    {
+        std::vector<int32_t> planes;                // the channels, then side and mid for stereo
+        std::vector<uint32_t> fixed;                // folded residual of the best fixed predictor
+        std::vector<uint32_t> lpc;                  // and of the LPC one
+        std::vector<float> windowed;
+        std::vector<float> window;                  // for short blocks
+    };
+
+    //sum of |residual| of the fixed predictors of orders 0 to 4, from sample 4 on. Samples are at most 25 bits
+    //(the side of 24-bit stereo), so even the fourth difference fits 32 bits, and so do the sums over spans short
+    //enough for 'bitsPerSample'. The loop over a span vectorizes
+    unsigned bestFixedOrder(const int32_t* x, size_t n, unsigned bitsPerSample, uint64_t& sum)
+    {
+        const size_t span = size_t(1) << (29 - std::min(bitsPerSample, 25u));
+        uint64_t sums[5] = {};
+        for (size_t begin = 4; begin < n; begin += span) {
+            const size_t end = std::min(n, begin + span);
+            uint32_t partial[5] = {};
+            for (size_t i = begin; i < end; i++) {
+                const int32_t e0 = x[i];
+                const int32_t e1 = e0 - x[i - 1];
+                const int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+                const int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+                const int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+                partial[0] += static_cast<uint32_t>(e0 < 0 ? -e0 : e0);
+                partial[1] += static_cast<uint32_t>(e1 < 0 ? -e1 : e1);
+                partial[2] += static_cast<uint32_t>(e2 < 0 ? -e2 : e2);
+                partial[3] += static_cast<uint32_t>(e3 < 0 ? -e3 : e3);
+                partial[4] += static_cast<uint32_t>(e4 < 0 ? -e4 : e4);
+            }
+            for (size_t order = 0; order < 5; order++) {
+                sums[order] += partial[order];
+            }
+        }
+        const unsigned orders = n > 4 ? 5 : 1;
+        unsigned best = 0;
+        for (unsigned order = 1; order < orders; order++) {
+            if (sums[order] < sums[best]) {
+                best = order;
+            }
+        }
+        sum = sums[best];
+        return best;
+    }
+
+    //rough bits a channel takes with its best fixed predictor, to pick the stereo decorrelation
+    uint64_t estimateBits(const int32_t* x, size_t n, unsigned bitsPerSample)
+    {
+        uint64_t sum;
+        bestFixedOrder(x, n, bitsPerSample, sum);
+        uint64_t bits;
+        riceParameter(2 * sum, n, bits);
+        return bits;
+    }
+
+    //one loop per order so each one vectorizes, 32 bits suffice as in bestFixedOrder
+    void fixedResidual(const int32_t* x, size_t n, unsigned order, uint32_t* residual)
+    {
+        switch (order) {
+        case 0:
+            for (size_t i = 0; i < n; i++) {
+                residual[i] = fold32(x[i]);
+            }
+            break;
+        case 1:
+            for (size_t i = 1; i < n; i++) {
+                residual[i] = fold32(x[i] - x[i - 1]);
+            }
+            break;
+        case 2:
+            for (size_t i = 2; i < n; i++) {
+                residual[i] = fold32(x[i] - 2 * x[i - 1] + x[i - 2]);
+            }
+            break;
+        case 3:
+            for (size_t i = 3; i < n; i++) {
+                residual[i] = fold32(x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3]);
+            }
+            break;
+        default:
+            for (size_t i = 4; i < n; i++) {
+                residual[i] = fold32(x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4]);
+            }
+            break;
+        }
+    }
+
+    struct LpcPredictor
+    {
+        unsigned order = 0;
+        int shift = 0;
+        int32_t coefficients[FLAC_MAX_LPC_ORDER] = {};
+    };
+
+    //Levinson-Durbin on the autocorrelation of the windowed block gives the predictors of every order with their
+    //error, the order is picked by the bits that error predicts and its coefficients quantized to FLAC_LPC_PRECISION
+    bool analyzeLpc(const int32_t* x, size_t n, unsigned bitsPerSample, EncodeScratch& scratch, LpcPredictor& predictor)
+    {
+        const unsigned maxOrder = FLAC_MAX_LPC_ORDER;
+        const float* window = blockWindow();
+        if (n != FLAC_BLOCK_FRAMES) {
+            scratch.window.resize(n);
+            tukeyWindow(scratch.window.data(), n);
+            window = scratch.window.data();
+        }
+
+        scratch.windowed.resize(n);
+        float* w = scratch.windowed.data();
+        for (size_t i = 0; i < n; i++) {
+            w[i] = static_cast<float>(x[i]) * window[i];
+        }
+
+        //per lag AUTOC_LANES float partial sums the compiler turns into vector registers, added up in double
+        //every AUTOC_SPAN samples so the float sums stay short
+        double autoc[maxOrder + 1] = {};
+        for (size_t lag = 0; lag <= maxOrder; lag++) {
+            for (size_t begin = lag; begin < n; begin += AUTOC_SPAN) {
+                const size_t end = std::min(n, begin + AUTOC_SPAN);
+                float lanes[AUTOC_LANES] = {};
+                size_t i = begin;
+                for (; i + AUTOC_LANES <= end; i += AUTOC_LANES) {
+                    for (size_t l = 0; l < AUTOC_LANES; l++) {
+                        lanes[l] += w[i + l] * w[i + l - lag];
+                    }
+                }
+                double total = 0.0;
+                for (; i < end; i++) {
+                    total += double(w[i]) * w[i - lag];
+                }
+                for (size_t l = 0; l < AUTOC_LANES; l++) {
+                    total += lanes[l];
+                }
+                autoc[lag] += total;
+            }
+        }
+        if (autoc[0] <= 0.0) {
+            return false;
+        }
+
+        double lpc[maxOrder] = {};
+        double coefficients[maxOrder][maxOrder] = {};
+        double error = autoc[0];
+        unsigned bestOrder = 0;
+        double bestBits = 0.0;
+        for (unsigned i = 0; i < maxOrder; i++) {
+            double r = -autoc[i + 1];
+            for (unsigned j = 0; j < i; j++) {
+                r -= lpc[j] * autoc[i - j];
+            }
+            r /= error;
+
+            lpc[i] = r;
+            unsigned j = 0;
+            for (; j < i / 2; j++) {
+                const double tmp = lpc[j];
+                lpc[j] += r * lpc[i - 1 - j];
+                lpc[i - 1 - j] += r * tmp;
+            }
+            if (i & 1) {
+                lpc[j] += lpc[j] * r;
+            }
+            error *= 1.0 - r * r;
+
+            for (j = 0; j <= i; j++) {
+                coefficients[i][j] = -lpc[j];
+            }
+
+            //expected bits per residual sample from the prediction error, plus what the predictor itself takes
+            const unsigned order = i + 1;
+            const double perSample = error > 0.0 ? std::max(0.0, 0.5 * std::log2(0.5 * error / n)) : 0.0;
+            const double bits = perSample * (n - order) + order * double(FLAC_LPC_PRECISION + bitsPerSample);
+            if (bestOrder == 0 || bits < bestBits) {
+                bestOrder = order;
+                bestBits = bits;
+            }
+            if (error <= 0.0) {
+                break;
+            }
+        }
+
+        //quantize with the rounding error carried forward, the shift is the one that fills the precision
+        const double* c = coefficients[bestOrder - 1];
+        double cmax = 0.0;
+        for (unsigned i = 0; i < bestOrder; i++) {
+            cmax = std::max(cmax, std::fabs(c[i]));
+        }
+        if (!(cmax > 0.0)) {
+            return false;
+        }
+        int log2cmax;
+        std::frexp(cmax, &log2cmax);
+        const int shift = std::min(15, int(FLAC_LPC_PRECISION) - 1 - log2cmax);
+        if (shift < 0) {
+            return false;
+        }
+
+        const int32_t qmax = (1 << (FLAC_LPC_PRECISION - 1)) - 1;
+        double carry = 0.0;
+        for (unsigned i = 0; i < bestOrder; i++) {
+            carry += c[i] * (1 << shift);
+            const int32_t q = static_cast<int32_t>(std::max<double>(-qmax - 1, std::min<double>(qmax, std::lround(carry))));
+            carry -= q;
+            predictor.coefficients[i] = q;
+        }
+        predictor.order = bestOrder;
+        predictor.shift = shift;
+        return true;
+    }
+
+    //the prediction of every sample with the order fixed at compile time, so the coefficients sit in registers and
+    //the loop over the samples vectorizes when Sum is 32 bits
+    template <unsigned Order, typename Sum>
+    bool lpcResidual(const int32_t* x, size_t n, const int32_t* q, int shift, uint32_t* residual)
+    {
+        bool fits = true;
+        for (size_t i = Order; i < n; i++) {
+            Sum sum = 0;
+            for (unsigned j = 0; j < Order; j++) {
+                sum += Sum(q[j]) * x[i - 1 - j];
+            }
+            //32-bit sums are bounded well enough that the residual fits too
+            const Sum e = Sum(x[i]) - (sum >> shift);
+            fits &= sizeof(Sum) == 4 || (e >= INT32_MIN && e <= INT32_MAX);
+            residual[i] = sizeof(Sum) == 4 ? fold32(static_cast<int32_t>(e)) : fold(e);
+        }
+        return fits;
+    }
+
+    template <typename Sum>
+    bool lpcResidual(const int32_t* x, size_t n, const int32_t* q, unsigned order, int shift, uint32_t* residual)
+    {
+        static_assert(FLAC_MAX_LPC_ORDER == 8, "one case per order");
+        switch (order) {
+        case 1: return lpcResidual<1, Sum>(x, n, q, shift, residual);
+        case 2: return lpcResidual<2, Sum>(x, n, q, shift, residual);
+        case 3: return lpcResidual<3, Sum>(x, n, q, shift, residual);
+        case 4: return lpcResidual<4, Sum>(x, n, q, shift, residual);
+        case 5: return lpcResidual<5, Sum>(x, n, q, shift, residual);
+        case 6: return lpcResidual<6, Sum>(x, n, q, shift, residual);
+        case 7: return lpcResidual<7, Sum>(x, n, q, shift, residual);
+        default: return lpcResidual<8, Sum>(x, n, q, shift, residual);
+        }
+    }
+
+    //false if a residual doesn't fit 32 bits, the predictor is of no use then. The sums take 32 bits while
+    //samples, coefficients and the number of terms can't overflow them, which covers 16-bit audio
+    bool lpcResidual(const int32_t* x, size_t n, unsigned bitsPerSample, const LpcPredictor& predictor, uint32_t* residual)
+    {
+        unsigned termBits = 0;
+        while ((1u << termBits) < predictor.order) {
+            termBits++;
+        }
+        if (bitsPerSample + FLAC_LPC_PRECISION + termBits <= 32) {
+            return lpcResidual<int32_t>(x, n, predictor.coefficients, predictor.order, predictor.shift, residual);
+        }
+        return lpcResidual<int64_t>(x, n, predictor.coefficients, predictor.order, predictor.shift, residual);
+    }
+
+    //one channel of a frame as whichever of constant, fixed, LPC or verbatim subframe is smallest
+    void encodeSubframe(BitWriter& out, const int32_t* x, size_t n, unsigned bits, EncodeScratch& scratch)
+    {
+        if (std::all_of(x + 1, x + n, [x](int32_t v) { return v == x[0]; })) {
+            out.put(0, 8);
+            out.putSigned(x[0], bits);
+            return;
+        }
+
+        scratch.fixed.resize(n);
+        scratch.lpc.resize(n);
+
+        uint64_t sum;
+        const unsigned fixedOrder = bestFixedOrder(x, n, bits, sum);
+        fixedResidual(x, n, fixedOrder, scratch.fixed.data());
+        const RicePlan fixedPlan = planResidual(scratch.fixed.data(), n, fixedOrder);
+        const uint64_t fixedBits = fixedOrder * bits + fixedPlan.bits;
+
+        LpcPredictor lpc;
+        RicePlan lpcPlan;
+        uint64_t lpcBits = UINT64_MAX;
+        if (n >= MIN_LPC_FRAMES && analyzeLpc(x, n, bits, scratch, lpc) && lpcResidual(x, n, bits, lpc, scratch.lpc.data())) {
+            lpcPlan = planResidual(scratch.lpc.data(), n, lpc.order);
+            lpcBits = lpc.order * (bits + FLAC_LPC_PRECISION) + 4 + 5 + lpcPlan.bits;
+        }
+
+        const uint64_t verbatimBits = uint64_t(n) * bits;
+        if (verbatimBits <= std::min(fixedBits, lpcBits)) {
+            out.put(1 << 1, 8);
+            for (size_t i = 0; i < n; i++) {
+                out.putSigned(x[i], bits);
+            }
+        } else if (fixedBits <= lpcBits) {
+            out.put((8 | fixedOrder) << 1, 8);
+            for (unsigned i = 0; i < fixedOrder; i++) {
+                out.putSigned(x[i], bits);
+            }
+            writeResidual(out, scratch.fixed.data(), n, fixedOrder, fixedPlan);
+        } else {
+            out.put((32 | (lpc.order - 1)) << 1, 8);
+            for (unsigned i = 0; i < lpc.order; i++) {
+                out.putSigned(x[i], bits);
+            }
+            out.put(FLAC_LPC_PRECISION - 1, 4);
+            out.putSigned(lpc.shift, 5);
+            for (unsigned i = 0; i < lpc.order; i++) {
+                out.putSigned(lpc.coefficients[i], FLAC_LPC_PRECISION);
+            }
+            writeResidual(out, scratch.lpc.data(), n, lpc.order, lpcPlan);
+        }
+    }
+
+    //a whole FLAC frame of 'n' interleaved frames at 'pcm', returns its size
+    size_t encodeFrame(const FlacStreamInfo& info, const char* pcm, size_t n, uint64_t index, unsigned char* dst, EncodeScratch& scratch)
+    {
+        const unsigned channels = info.channels;
+        const unsigned bits = info.bitsPerSample;
+
+        //split into planes of plain signed samples, 8-bit wave samples are unsigned
+        scratch.planes.resize((channels + 2) * n);
+        int32_t* planes = scratch.planes.data();
+        for (unsigned c = 0; c < channels; c++) {
+            int32_t* x = planes + c * n;
+            if (bits == 16) {
+                const int16_t* s = reinterpret_cast<const int16_t*>(pcm) + c;
+                for (size_t i = 0; i < n; i++) {
+                    x[i] = s[i * channels];
+                }
+            } else if (bits == 24) {
+                const unsigned char* s = reinterpret_cast<const unsigned char*>(pcm) + 3 * c;
+                for (size_t i = 0; i < n; i++, s += 3 * channels) {
+                    x[i] = static_cast<int32_t>(uint32_t(s[0]) << 8 | uint32_t(s[1]) << 16 | uint32_t(s[2]) << 24) >> 8;
+                }
+            } else {
+                const unsigned char* s = reinterpret_cast<const unsigned char*>(pcm) + c;
+                for (size_t i = 0; i < n; i++) {
+                    x[i] = int32_t(s[i * channels]) - 128;
+                }
+            }
+        }
+
+        //stereo codes whichever pair of left, right, side and mid looks cheapest
+        unsigned assignment = channels - 1;
+        const int32_t* coded[2] = { planes, planes + n };
+        unsigned codedBits[2] = { bits, bits };
+        if (channels == 2) {
+            int32_t* side = planes + 2 * n;
+            int32_t* mid = planes + 3 * n;
+            for (size_t i = 0; i < n; i++) {
+                side[i] = planes[i] - planes[n + i];
+                mid[i] = (planes[i] + planes[n + i]) >> 1;
+            }
+
+            const uint64_t left = estimateBits(planes, n, bits);
+            const uint64_t right = estimateBits(planes + n, n, bits);
+            const uint64_t s = estimateBits(side, n, bits + 1);
+            const uint64_t m = estimateBits(mid, n, bits);
+            const uint64_t costs[4] = { left + right, left + s, s + right, m + s };
+            const unsigned best = static_cast<unsigned>(std::min_element(costs, costs + 4) - costs);
+            switch (best) {
+            case 1: assignment = LEFT_SIDE; coded[1] = side; codedBits[1] = bits + 1; break;
+            case 2: assignment = SIDE_RIGHT; coded[0] = side; codedBits[0] = bits + 1; break;
+            case 3: assignment = MID_SIDE; coded[0] = mid; coded[1] = side; codedBits[1] = bits + 1; break;
+            default: break;
+            }
+        }
+
+        unsigned char* p = dst;
+        *p++ = 0xFF;
+        *p++ = 0xF8;                                                // fixed block size
+        unsigned blockCode;
+        if (n == 192) {
+            blockCode = 1;
+        } else if (n >= 256 && n <= 32768 && (n & (n - 1)) == 0) {
+            blockCode = 8;
+            while ((size_t(256) << (blockCode - 8)) < n) {
+                blockCode++;
+            }
+        } else {
+            blockCode = n <= 256 ? 6 : 7;
+        }
+        *p++ = static_cast<unsigned char>(blockCode << 4 | rateCode(info.sampleRate));
+        *p++ = static_cast<unsigned char>(assignment << 4 | sampleSizeCode(bits) << 1);
+        p = putCodedNumber(p, index);
+        if (blockCode == 6) {
+            p = putBE(p, n - 1, 1);
+        } else if (blockCode == 7) {
+            p = putBE(p, n - 1, 2);
+        }
+        *p = crc8(dst, p - dst);
+        p++;
+
+        BitWriter out(p);
+        for (unsigned c = 0; c < channels; c++) {
+            if (c < 2) {
+                encodeSubframe(out, coded[c], n, codedBits[c], scratch);
+            } else {
+                encodeSubframe(out, planes + c * n, n, bits, scratch);
+            }
+        }
+        p = out.finish();
+
+        p = putBE(p, crc16(dst, p - dst), 2);
+        return p - dst;
+    }
+
+    bool decodeResidual(BitReader& in, int32_t* x, size_t n, unsigned predictor)
+    {
+        const unsigned method = in.get(2);
+        if (method > 1) {
+            return false;
+        }
+        const unsigned parameterBits = method ? 5 : 4;
+        const unsigned escape = method ? 31 : 15;
+        const unsigned order = in.get(4);
+        const size_t length = n >> order;
+        if ((order > 0 && n % (size_t(1) << order) != 0) || length < predictor) {
+            return false;
+        }
+
+        size_t i = predictor;
+        for (size_t p = 0; p < (size_t(1) << order) && !in.overrun(); p++) {
+            const size_t end = (p + 1) * length;
+            const unsigned k = in.get(parameterBits);
+            if (k == escape) {
+                const unsigned raw = in.get(5);
+                for (; i < end; i++) {
+                    x[i] = in.getSigned(raw);
+                }
+                continue;
+            }
+            for (; i < end; i++) {
+                const uint32_t q = in.getUnary();
+                x[i] = unfold(q << k | in.get(k));
+            }
+        }
+        return !in.overrun();
+    }
+
+    bool decodeSubframe(BitReader& in, int32_t* x, size_t n, unsigned bits)
+    {
+        if (in.get(1) != 0) {
+            return false;
+        }
+        const unsigned type = in.get(6);
+        unsigned wasted = 0;
+        if (in.get(1)) {
+            wasted = in.getUnary() + 1;
+        }
+        if (wasted >= bits) {
+            return false;
+        }
+        bits -= wasted;
+
+        if (type == 0) {
+            std::fill(x, x + n, in.getSigned(bits));
+        } else if (type == 1) {
+            for (size_t i = 0; i < n; i++) {
+                x[i] = in.getSigned(bits);
+            }
+        } else if (type >= 8 && type <= 12) {
+            const unsigned order = type - 8;
+            if (order > n) {
+                return false;
+            }
+            for (unsigned i = 0; i < order; i++) {
+                x[i] = in.getSigned(bits);
+            }
+            if (!decodeResidual(in, x, n, order)) {
+                return false;
+            }
+            for (size_t i = order; i < n; i++) {
+                switch (order) {
+                case 0: break;
+                case 1: x[i] += x[i - 1]; break;
+                case 2: x[i] += 2 * x[i - 1] - x[i - 2]; break;
+                case 3: x[i] += 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3]; break;
+                default: x[i] += 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] - x[i - 4]; break;
+                }
+            }
+        } else if (type >= 32) {
+            const unsigned order = (type & 31) + 1;
+            if (order > n) {
+                return false;
+            }
+            for (unsigned i = 0; i < order; i++) {
+                x[i] = in.getSigned(bits);
+            }
+            const unsigned precision = in.get(4) + 1;
+            const int shift = in.getSigned(5);
+            if (precision == 16 || shift < 0) {
+                return false;
+            }
+            int32_t q[32];
+            for (unsigned i = 0; i < order; i++) {
+                q[i] = in.getSigned(precision);
+            }
+            if (!decodeResidual(in, x, n, order)) {
+                return false;
+            }
+            for (size_t i = order; i < n; i++) {
+                int64_t sum = 0;
+                for (unsigned j = 0; j < order; j++) {
+                    sum += int64_t(q[j]) * x[i - 1 - j];
+                }
+                x[i] += static_cast<int32_t>(sum >> shift);
+            }
+        } else {
+            return false;
+        }
+
+        if (wasted) {
+            for (size_t i = 0; i < n; i++) {
+                x[i] = static_cast<int32_t>(static_cast<uint32_t>(x[i]) << wasted);
+            }
+        }
+        return !in.overrun();
+    }
+
+    //one FLAC frame from 'src' into interleaved wave samples, 'used' is its size and 'first' its first frame
+    bool decodeFrame(const FlacStreamInfo& info, const unsigned char* src, size_t bytes, std::vector<int32_t>& scratch, char* pcm,
+        size_t& used, uint64_t& first, size_t& frames)
+    {
+        const unsigned char* end = src + bytes;
+        if (bytes < 6 || src[0] != 0xFF || (src[1] & 0xFE) != 0xF8) {
+            return false;
+        }
+        const bool variable = src[1] & 1;
+        const unsigned blockCode = src[2] >> 4;
+        const unsigned rate = src[2] & 15;
+        const unsigned assignment = src[3] >> 4;
+        const unsigned sizeCode = (src[3] >> 1) & 7;
+
+        uint64_t number;
+        const unsigned char* p = getCodedNumber(src + 4, end, number);
+        if (!p || rate == 15 || blockCode == 0 || assignment > MID_SIDE) {
+            return false;
+        }
+
+        size_t n;
+        if (blockCode == 1) {
+            n = 192;
+        } else if (blockCode <= 5) {
+            n = size_t(576) << (blockCode - 2);
+        } else if (blockCode == 6 || blockCode == 7) {
+            const size_t extra = blockCode - 5;
+            if (end - p < ptrdiff_t(extra)) {
+                return false;
+            }
+            n = static_cast<size_t>(getBE(p, extra)) + 1;
+            p += extra;
+        } else {
+            n = size_t(256) << (blockCode - 8);
+        }
+        p += rate == 12 ? 1 : (rate == 13 || rate == 14) ? 2 : 0;
+        if (end - p < 1 || crc8(src, p - src) != *p) {
+            return false;
+        }
+        p++;
+
+        const unsigned channels = assignment >= LEFT_SIDE ? 2 : assignment + 1;
+        const unsigned sizes[8] = { info.bitsPerSample, 8, 12, 0, 16, 20, 24, 32 };
+        const unsigned bits = sizes[sizeCode];
+        if (channels != info.channels || bits != info.bitsPerSample || n > info.maxBlock) {
+            return false;
+        }
+
+        scratch.resize(size_t(channels) * n);
+        int32_t* planes = scratch.data();
+        BitReader in(p, end - p);
+        for (unsigned c = 0; c < channels; c++) {
+            const bool side = (assignment == LEFT_SIDE && c == 1) || (assignment == SIDE_RIGHT && c == 0) || (assignment == MID_SIDE && c == 1);
+            if (!decodeSubframe(in, planes + c * n, n, bits + (side ? 1 : 0))) {
+                return false;
+            }
+        }
+        in.align();
+        const size_t body = (p - src) + in.position();
+        if (bytes < body + 2 || crc16(src, body) != getBE(src + body, 2)) {
+            return false;
+        }
+        used = body + 2;
+
+        int32_t* a = planes;
+        int32_t* b = planes + n;
+        for (size_t i = 0; assignment >= LEFT_SIDE && i < n; i++) {
+            switch (assignment) {
+            case LEFT_SIDE: b[i] = a[i] - b[i]; break;
+            case SIDE_RIGHT: a[i] += b[i]; break;
+            default: {
+                const int32_t mid = static_cast<int32_t>(static_cast<uint32_t>(a[i]) << 1) | (b[i] & 1);
+                a[i] = (mid + b[i]) >> 1;
+                b[i] = (mid - b[i]) >> 1;
+                break;
+            }
+            }
+        }
+
+        for (unsigned c = 0; c < channels; c++) {
+            const int32_t* x = planes + c * n;
+            if (bits == 16) {
+                int16_t* d = reinterpret_cast<int16_t*>(pcm) + c;
+                for (size_t i = 0; i < n; i++) {
+                    d[i * channels] = static_cast<int16_t>(x[i]);
+                }
+            } else if (bits == 24) {
+                unsigned char* d = reinterpret_cast<unsigned char*>(pcm) + 3 * c;
+                for (size_t i = 0; i < n; i++, d += 3 * channels) {
+                    d[0] = static_cast<unsigned char>(x[i]);
+                    d[1] = static_cast<unsigned char>(x[i] >> 8);
+                    d[2] = static_cast<unsigned char>(x[i] >> 16);
+                }
+            } else {
+                unsigned char* d = reinterpret_cast<unsigned char*>(pcm) + c;
+                for (size_t i = 0; i < n; i++) {
+                    d[i * channels] = static_cast<unsigned char>(x[i] + 128);
+                }
+            }
+        }
+
+        const uint64_t fixedBlock = info.minBlock == info.maxBlock ? info.maxBlock : n;
+        first = variable ? number : number * fixedBlock;
+        frames = n;
+        return true;
+    }
+}
+
+size_t flacFrameBound(unsigned channels, unsigned bitsPerSample, size_t frames)
+{
+    return MAX_HEADER_SIZE + (channels * (8 + frames * (bitsPerSample + 1)) + 7) / 8 + 2;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// FlacEncoder
+
+bool FlacEncoder::init(uint16_t channels, uint16_t bitsPerSample, uint32_t sampleRate)
+{
+    if (channels == 0 || channels > 8 || sampleSizeCode(bitsPerSample) == 0 || sampleRate == 0 || sampleRate >= (1u << 20)) {
+        std::cerr << "Error: FLAC takes 8, 16 or 24-bit integer samples and up to 8 channels" << std::endl;
+        return false;
+    }
+
+    info_ = FlacStreamInfo();
+    info_.minBlock = info_.maxBlock = FLAC_BLOCK_FRAMES;
+    info_.sampleRate = sampleRate;
+    info_.channels = channels;
+    info_.bitsPerSample = bitsPerSample;
+
+    frameSize_ = size_t(channels) * (bitsPerSample / 8);
+    bound_ = flacFrameBound(channels, bitsPerSample, FLAC_BLOCK_FRAMES);
+    pcm_.allocate(FLAC_BATCH_BLOCKS * FLAC_BLOCK_FRAMES * frameSize_);
+    pcmUsed_ = 0;
+    packed_.resize(FLAC_BATCH_BLOCKS * bound_);
+    packedBytes_.assign(FLAC_BATCH_BLOCKS, 0);
+    seekPoints_.clear();
+    seekSpacing_ = FLAC_SEEK_SPACING;
+    encodedBytes_ = 0;
+    frameIndex_ = 0;
+    return true;
+}
+
+char* FlacEncoder::space(size_t& bytes)
+{
+    bytes = FLAC_BATCH_BLOCKS * FLAC_BLOCK_FRAMES * frameSize_ - pcmUsed_;
+    return pcm_.data() + pcmUsed_;
+}
+
+bool FlacEncoder::commit(size_t bytes)
+{
+    pcmUsed_ += bytes;
+    return pcmUsed_ == FLAC_BATCH_BLOCKS * FLAC_BLOCK_FRAMES * frameSize_;
+}
+
+const unsigned char* FlacEncoder::encode(size_t& bytes)
+{
+    const size_t frames = pcmUsed_ / frameSize_;
+    const size_t blocks = (frames + FLAC_BLOCK_FRAMES - 1) / FLAC_BLOCK_FRAMES;
+    bytes = 0;
+    if (blocks == 0) {
+        return packed_.data();
+    }
+
+    //every block into its own slot on the workers
+    ThreadPool::shared().parallelFor(0, blocks, 1, [this, frames](uint64_t begin, uint64_t end) {
+        EncodeScratch scratch;
+        for (uint64_t b = begin; b < end; b++) {
+            const size_t n = std::min(FLAC_BLOCK_FRAMES, frames - b * FLAC_BLOCK_FRAMES);
+            packedBytes_[b] = encodeFrame(info_, pcm_.data() + b * FLAC_BLOCK_FRAMES * frameSize_, n, frameIndex_ + b,
+                packed_.data() + b * bound_, scratch);
+        }
+    });
+
+    //then the slots are closed up in order, noting sizes and seek points on the way
+    size_t out = 0;
+    for (size_t b = 0; b < blocks; b++) {
+        const size_t n = std::min(FLAC_BLOCK_FRAMES, frames - b * FLAC_BLOCK_FRAMES);
+        const uint32_t size = static_cast<uint32_t>(packedBytes_[b]);
+        memmove(packed_.data() + out, packed_.data() + b * bound_, size);
+
+        addSeekPoint(info_.totalFrames, encodedBytes_, static_cast<uint32_t>(n));
+        info_.minFrameBytes = info_.minFrameBytes ? std::min(info_.minFrameBytes, size) : size;
+        info_.maxFrameBytes = std::max(info_.maxFrameBytes, size);
+        info_.totalFrames += n;
+        encodedBytes_ += size;
+        out += size;
+    }
+    frameIndex_ += blocks;
+
+    //a frame split between two writes stays for the next batch
+    const size_t rest = pcmUsed_ - frames * frameSize_;
+    memmove(pcm_.data(), pcm_.data() + frames * frameSize_, rest);
+    pcmUsed_ = rest;
+
+    bytes = out;
+    return packed_.data();
+}
+
+//point i marks the first FLAC frame at or after i * seekSpacing_. When the table is full every other point goes
+//and the spacing doubles, which keeps that true
+void FlacEncoder::addSeekPoint(uint64_t frame, uint64_t offset, uint32_t frames)
+{
+    if (frame < seekPoints_.size() * seekSpacing_) {
+        return;
+    }
+    if (seekPoints_.size() == FLAC_SEEK_POINTS) {
+        size_t kept = 0;
+        for (size_t i = 0; i < seekPoints_.size(); i += 2) {
+            seekPoints_[kept++] = seekPoints_[i];
+        }
+        seekPoints_.resize(kept);
+        seekSpacing_ *= 2;
+        if (frame < kept * seekSpacing_) {
+            return;
+        }
+    }
+    seekPoints_.push_back({ frame, offset, frames });
+}
+
+size_t FlacEncoder::headerSize()
+{
+    return 4 + 4 + STREAMINFO_SIZE + 4 + FLAC_SEEK_POINTS * SEEK_POINT_SIZE;
+}
+
+size_t FlacEncoder::buildHeader(unsigned char* dst) const
+{
+    //a stream shorter than one block has that short block for both sizes
+    const uint32_t block = info_.totalFrames > 0 && info_.totalFrames < FLAC_BLOCK_FRAMES ? static_cast<uint32_t>(info_.totalFrames) : info_.maxBlock;
+
+    unsigned char* p = dst;
+    memcpy(p, "fLaC", 4); p += 4;
+
+    *p++ = 0;                                                       // STREAMINFO, more blocks follow
+    p = putBE(p, STREAMINFO_SIZE, 3);
+    p = putBE(p, block, 2);
+    p = putBE(p, block, 2);
+    p = putBE(p, info_.minFrameBytes, 3);
+    p = putBE(p, info_.maxFrameBytes, 3);
+    p = putBE(p, uint64_t(info_.sampleRate) << 44 | uint64_t(info_.channels - 1) << 41 | uint64_t(info_.bitsPerSample - 1) << 36
+        | (info_.totalFrames & 0xFFFFFFFFFull), 8);
+    memset(p, 0, 16); p += 16;                                      // MD5 not computed
+
+    *p++ = 0x80 | 3;                                                // SEEKTABLE, the last block
+    p = putBE(p, FLAC_SEEK_POINTS * SEEK_POINT_SIZE, 3);
+    for (size_t i = 0; i < FLAC_SEEK_POINTS; i++) {
+        const bool used = i < seekPoints_.size();
+        p = putBE(p, used ? seekPoints_[i].frame : SEEK_PLACEHOLDER, 8);
+        p = putBE(p, used ? seekPoints_[i].offset : 0, 8);
+        p = putBE(p, used ? seekPoints_[i].frames : 0, 2);
+    }
+
+    return p - dst;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// FlacDecoder
+
+bool FlacDecoder::open(std::istream& in, uint64_t fileSize)
+{
+    info_ = FlacStreamInfo();
+    seekPoints_.clear();
+    fileSize_ = fileSize;
+
+    unsigned char magic[4];
+    in.seekg(0);
+    if (!in.read(reinterpret_cast<char*>(magic), 4) || memcmp(magic, "fLaC", 4) != 0) {
+        std::cerr << "Error: not a FLAC stream" << std::endl;
+        return false;
+    }
+
+    bool haveInfo = false;
+    uint64_t offset = 4;
+    for (bool last = false; !last; ) {
+        unsigned char header[4];
+        if (!in.read(reinterpret_cast<char*>(header), 4)) {
+            std::cerr << "Error: truncated FLAC metadata" << std::endl;
+            return false;
+        }
+        last = header[0] & 0x80;
+        const unsigned type = header[0] & 0x7F;
+        const uint64_t size = getBE(header + 1, 3);
+
+        if (type == 0 && size >= STREAMINFO_SIZE) {
+            unsigned char s[STREAMINFO_SIZE];
+            if (!in.read(reinterpret_cast<char*>(s), STREAMINFO_SIZE)) {
+                std::cerr << "Error: truncated FLAC stream info" << std::endl;
+                return false;
+            }
+            const uint64_t packed = getBE(s + 10, 8);
+            info_.minBlock = static_cast<uint32_t>(getBE(s, 2));
+            info_.maxBlock = static_cast<uint32_t>(getBE(s + 2, 2));
+            info_.minFrameBytes = static_cast<uint32_t>(getBE(s + 4, 3));
+            info_.maxFrameBytes = static_cast<uint32_t>(getBE(s + 7, 3));
+            info_.sampleRate = static_cast<uint32_t>(packed >> 44);
+            info_.channels = static_cast<uint16_t>((packed >> 41 & 7) + 1);
+            info_.bitsPerSample = static_cast<uint16_t>((packed >> 36 & 31) + 1);
+            info_.totalFrames = packed & 0xFFFFFFFFFull;
+            haveInfo = true;
+        } else if (type == 3) {
+            for (uint64_t i = 0; i < size / SEEK_POINT_SIZE; i++) {
+                unsigned char s[SEEK_POINT_SIZE];
+                if (!in.read(reinterpret_cast<char*>(s), SEEK_POINT_SIZE)) {
+                    std::cerr << "Error: truncated FLAC seek table" << std::endl;
+                    return false;
+                }
+                const uint64_t frame = getBE(s, 8);
+                if (frame != SEEK_PLACEHOLDER) {
+                    seekPoints_.push_back({ frame, getBE(s + 8, 8), static_cast<uint32_t>(getBE(s + 16, 2)) });
+                }
+            }
+        } else if (type == 127) {
+            std::cerr << "Error: invalid FLAC metadata block" << std::endl;
+            return false;
+        }
+
+        offset += 4 + size;
+        in.seekg(offset);
+    }
+
+    if (!haveInfo || info_.maxBlock == 0 || info_.sampleRate == 0 || sampleSizeCode(info_.bitsPerSample) == 0) {
+        std::cerr << "Error: unsupported FLAC stream, only 8, 16 and 24-bit samples can be read" << std::endl;
+        return false;
+    }
+    if (info_.totalFrames == 0) {
+        std::cerr << "Error: FLAC stream without a sample count" << std::endl;
+        return false;
+    }
+
+    //a table from another encoder may not be sorted
+    std::sort(seekPoints_.begin(), seekPoints_.end(), [](const FlacSeekPoint& a, const FlacSeekPoint& b) { return a.frame < b.frame; });
+
+    firstFrame_ = offset;
+    frameSize_ = size_t(info_.channels) * (info_.bitsPerSample / 8);
+    bound_ = flacFrameBound(info_.channels, info_.bitsPerSample, info_.maxBlock);
+    packed_.resize(FLAC_BATCH_BLOCKS * bound_);
+    decoded_.resize(size_t(info_.maxBlock) * frameSize_);
+    return restart(0);
+}
+
+bool FlacDecoder::restart(uint64_t frame)
+{
+    //the last seek point at or before the frame, or the start
+    FlacSeekPoint start;
+    for (const FlacSeekPoint& point : seekPoints_) {
+        if (point.frame > frame) {
+            break;
+        }
+        start = point;
+    }
+
+    packedBegin_ = packedEnd_ = 0;
+    packedOffset_ = firstFrame_ + start.offset;
+    nextFrame_ = start.frame;
+    decodedFirst_ = decodedBytes_ = 0;
+    return true;
+}
+
+size_t FlacDecoder::read(uint64_t position, void* dst, size_t bytes, const Fetch& fetch)
+{
+    char* out = static_cast<char*>(dst);
+    size_t done = 0;
+    while (done < bytes) {
+        const uint64_t at = position + done;
+        if (at >= decodedFirst_ && at < decodedFirst_ + decodedBytes_) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(bytes - done, decodedFirst_ + decodedBytes_ - at));
+            memcpy(out + done, decoded_.data() + (at - decodedFirst_), n);
+            done += n;
+            continue;
+        }
+
+        //behind the decoder, or far enough ahead to pass a seek point, it starts over at the closest one
+        const uint64_t frame = at / frameSize_;
+        const bool pastPoint = std::any_of(seekPoints_.begin(), seekPoints_.end(),
+            [this, frame](const FlacSeekPoint& point) { return point.frame > nextFrame_ && point.frame <= frame; });
+        if (frame < nextFrame_ || pastPoint) {
+            restart(frame);
+        }
+        if (!decodeNext(fetch)) {
+            break;
+        }
+    }
+    return done;
+}
+
+bool FlacDecoder::decodeNext(const Fetch& fetch)
+{
+    if (nextFrame_ >= info_.totalFrames) {
+        return false;
+    }
+
+    //keep at least a whole frame's worth of compressed bytes at hand unless the file ends first
+    const size_t available = packedEnd_ - packedBegin_;
+    if (available < bound_) {
+        memmove(packed_.data(), packed_.data() + packedBegin_, available);
+        packedBegin_ = 0;
+        packedEnd_ = available;
+        const uint64_t from = packedOffset_ + available;
+        if (from < fileSize_) {
+            packedEnd_ += fetch(from, packed_.data() + available, static_cast<size_t>(std::min<uint64_t>(packed_.size() - available, fileSize_ - from)));
+        }
+    }
+
+    size_t used, frames;
+    uint64_t first;
+    if (!decodeFrame(info_, packed_.data() + packedBegin_, packedEnd_ - packedBegin_, scratch_, decoded_.data(), used, first, frames)) {
+        std::cerr << "Error: corrupt FLAC frame at byte " << packedOffset_ << std::endl;
+        return false;
+    }
+    if (first != nextFrame_) {
+        std::cerr << "Error: FLAC frame at byte " << packedOffset_ << " starts at sample " << first << " instead of " << nextFrame_ << std::endl;
+        return false;
+    }
+
+    packedBegin_ += used;
+    packedOffset_ += used;
+    decodedFirst_ = first * frameSize_;
+    decodedBytes_ = static_cast<size_t>(std::min<uint64_t>(frames, info_.totalFrames - first)) * frameSize_;
+    nextFrame_ = first + frames;
+    return true;
+}
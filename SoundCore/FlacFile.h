@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <vector>
+
+#include "AlignedBuffer.h"
+
+constexpr size_t FLAC_BLOCK_FRAMES = 4096;          // frames per FLAC frame, the reference encoder's default
+constexpr size_t FLAC_BATCH_BLOCKS = 64;            // FLAC frames gathered before they are encoded in parallel
+constexpr unsigned FLAC_MAX_LPC_ORDER = 8;          // longest linear predictor tried
+constexpr unsigned FLAC_LPC_PRECISION = 12;         // bits of the quantized predictor coefficients, sign included
+constexpr unsigned FLAC_MAX_PARTITION_ORDER = 6;    // the residual is split in up to 2^6 partitions with their own Rice parameter
+constexpr uint64_t FLAC_SEEK_SPACING = FLAC_BLOCK_FRAMES * 16; // frames between seek points at first, doubled whenever the table fills up
+constexpr size_t FLAC_SEEK_POINTS = (BUFFER_ALIGNMENT - 4 - 4 - 34 - 4) / 18; // seek table entries, as many as fit the first page with the stream info
+
+// what the STREAMINFO block says, sizes in frames (samples per channel)
+struct FlacStreamInfo
+{
+    uint32_t minBlock = 0;
+    uint32_t maxBlock = 0;
+    uint32_t minFrameBytes = 0;                     // 0 = unknown
+    uint32_t maxFrameBytes = 0;
+    uint32_t sampleRate = 0;
+    uint16_t channels = 0;
+    uint16_t bitsPerSample = 0;
+    uint64_t totalFrames = 0;                       // 0 = unknown
+};
+
+struct FlacSeekPoint
+{
+    uint64_t frame = 0;                             // first frame of the FLAC frame it points at
+    uint64_t offset = 0;                            // its byte offset from the first FLAC frame
+    uint32_t frames = 0;                            // and how many frames it holds
+};
+
+// worst case size of a FLAC frame of 'frames' frames: every subframe verbatim, side channels a bit wider
+size_t flacFrameBound(unsigned channels, unsigned bitsPerSample, size_t frames);
+
+// lossless compressed sample data in the FLAC format: each FLAC frame of FLAC_BLOCK_FRAMES frames is predicted per
+// channel (fixed polynomial or quantized LPC, whichever codes smaller), stereo picks the cheapest of left/right,
+// left/side, side/right and mid/side, and the residual is Rice coded in partitions. Frames don't depend on each other,
+// so FLAC_BATCH_BLOCKS of them are encoded at once on the shared ThreadPool and come out in order.
+// The stream header has a seek table of FLAC_SEEK_POINTS entries that thins itself out as the stream grows,
+// so it keeps its size and can be patched in place on close. The MD5 of the samples is left unset (all zeros),
+// which the format allows and decoders take as unknown
+class FlacEncoder
+{
+public:
+    // interleaved little-endian PCM as wave files store it, 8, 16 or 24 bits and up to 8 channels
+    bool init(uint16_t channels, uint16_t bitsPerSample, uint32_t sampleRate);
+
+    // where the next interleaved samples go and how many bytes fit before encode() has to run
+    char* space(size_t& bytes);
+
+    // 'bytes' were written at space(), true once a whole batch is waiting
+    bool commit(size_t bytes);
+
+    // encodes everything waiting, the last FLAC frame may be short. Returns the compressed frames in stream order,
+    // valid until the next call
+    const unsigned char* encode(size_t& bytes);
+
+    // the metadata that goes before the first frame, always headerSize() bytes with room for the whole seek table
+    size_t buildHeader(unsigned char* dst) const;
+    static size_t headerSize();
+
+    const FlacStreamInfo& info() const { return info_; }
+
+private:
+    void addSeekPoint(uint64_t frame, uint64_t offset, uint32_t frames);
+
+    FlacStreamInfo info_;
+    size_t frameSize_ = 0;                          // bytes per interleaved frame
+    size_t bound_ = 0;                              // flacFrameBound of a full block
+    AlignedBuffer<char> pcm_;                       // samples waiting for the next batch
+    size_t pcmUsed_ = 0;
+    std::vector<unsigned char> packed_;             // a bound_ slot per block of the batch, compacted after encoding
+    std::vector<size_t> packedBytes_;
+    std::vector<FlacSeekPoint> seekPoints_;
+    uint64_t seekSpacing_ = FLAC_SEEK_SPACING;
+    uint64_t encodedBytes_ = 0;                     // compressed bytes so far, the seek points count from the first frame
+    uint64_t frameIndex_ = 0;                       // FLAC frames so far
+};
+
+// decodes FLAC sample data back to interleaved little-endian PCM as wave files store it. Reads are by position in
+// the decoded data, frames are decoded one at a time from compressed bytes the caller fetches (through its own
+// read-ahead), and a read away from the decoding position restarts at the closest seek point before it
+class FlacDecoder
+{
+public:
+    // copies up to 'bytes' of the file from 'offset' into 'dst', returns how many there were
+    using Fetch = std::function<size_t(uint64_t offset, void* dst, size_t bytes)>;
+
+    // parses the metadata blocks from the start of 'in', 8, 16 and 24-bit streams with a known length only
+    bool open(std::istream& in, uint64_t fileSize);
+
+    const FlacStreamInfo& info() const { return info_; }
+    uint64_t firstFrame() const { return firstFrame_; }    // file offset of the first FLAC frame
+    size_t frameSize() const { return frameSize_; }
+
+    // copies up to 'bytes' of decoded sample data from 'position' on into 'dst', returns how many
+    size_t read(uint64_t position, void* dst, size_t bytes, const Fetch& fetch);
+
+private:
+    bool restart(uint64_t frame);
+    bool decodeNext(const Fetch& fetch);
+
+    FlacStreamInfo info_;
+    std::vector<FlacSeekPoint> seekPoints_;
+    uint64_t firstFrame_ = 0;
+    uint64_t fileSize_ = 0;
+    size_t frameSize_ = 0;
+    size_t bound_ = 0;                              // bytes that surely hold a whole FLAC frame
+    std::vector<unsigned char> packed_;             // compressed bytes from file offset packedOffset_ on
+    size_t packedBegin_ = 0;
+    size_t packedEnd_ = 0;
+    uint64_t packedOffset_ = 0;                     // file offset of packed_[packedBegin_], the next FLAC frame
+    uint64_t nextFrame_ = 0;                        // first frame of that FLAC frame
+    std::vector<char> decoded_;                     // the FLAC frame decoded last
+    uint64_t decodedFirst_ = 0;                     // its frames as byte positions in the sample data
+    size_t decodedBytes_ = 0;
+    std::vector<int32_t> scratch_;                  // a plane per channel plus the residual
+};
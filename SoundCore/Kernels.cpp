@@ -0,0 +1,124 @@
+#include <cstdlib>
+#include <cstring>
+
+#include "KernelsInternal.h"
+
+#ifdef SOUND_KERNELS_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#ifdef SOUND_KERNELS_X86
+    struct CpuFeatures
+    {
+        bool sse2 = false;
+        bool avx2 = false;      // AVX2 + FMA with the OS saving the YMM registers
+        bool avx512 = false;    // AVX-512 F + BW with the OS saving the ZMM registers
+    };
+
+    void cpuid(int leaf, int subleaf, unsigned int regs[4])
+    {
+#ifdef _MSC_VER
+        __cpuidex(reinterpret_cast<int*>(regs), leaf, subleaf);
+#else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+    }
+
+    unsigned long long xgetbv0()
+    {
+#ifdef _MSC_VER
+        return _xgetbv(0);
+#else
+        unsigned int lo, hi;
+        __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        return lo | static_cast<unsigned long long>(hi) << 32;
+#endif
+    }
+
+    CpuFeatures detectCpu()
+    {
+        CpuFeatures features;
+        unsigned int regs[4];
+
+        cpuid(0, 0, regs);
+        const unsigned int maxLeaf = regs[0];
+
+        cpuid(1, 0, regs);
+        features.sse2 = (regs[3] & (1u << 26)) != 0;
+        const bool fma = (regs[2] & (1u << 12)) != 0;
+        const bool osxsave = (regs[2] & (1u << 27)) != 0;
+
+        //the instructions exist only if the OS also saves the wider registers on context switches
+        const unsigned long long xcr0 = osxsave ? xgetbv0() : 0;
+        const bool ymm = (xcr0 & 0x06) == 0x06;
+        const bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+        if (maxLeaf >= 7) {
+            cpuid(7, 0, regs);
+            features.avx2 = ymm && fma && (regs[1] & (1u << 5)) != 0;
+            features.avx512 = zmm && features.avx2 && (regs[1] & (1u << 16)) != 0 && (regs[1] & (1u << 30)) != 0;
+        }
+
+        return features;
+    }
+#endif
+
+    const KernelTable* selectKernels()
+    {
+        const char* forced = getenv("SOUND_KERNELS");
+        if (forced && *forced) {
+            if (const KernelTable* table = kernelsFor(forced)) {
+                return table;
+            }
+        }
+
+#ifdef SOUND_KERNELS_X86
+        const CpuFeatures cpu = detectCpu();
+        if (cpu.avx512) {
+            return &AVX512_KERNELS;
+        }
+        if (cpu.avx2) {
+            return &AVX2_KERNELS;
+        }
+        if (cpu.sse2) {
+            return &SSE2_KERNELS;
+        }
+#endif
+        return &SCALAR_KERNELS;
+    }
+}
+
+const KernelTable& kernels()
+{
+    //picked once, thread-safe by the static initialization rules
+    static const KernelTable* selected = selectKernels();
+    return *selected;
+}
+
+const KernelTable* kernelsFor(const char* name)
+{
+    if (strcmp(name, SCALAR_KERNELS.name) == 0) {
+        return &SCALAR_KERNELS;
+    }
+
+#ifdef SOUND_KERNELS_X86
+    const CpuFeatures cpu = detectCpu();
+    if (strcmp(name, SSE2_KERNELS.name) == 0 && cpu.sse2) {
+        return &SSE2_KERNELS;
+    }
+    if (strcmp(name, AVX2_KERNELS.name) == 0 && cpu.avx2) {
+        return &AVX2_KERNELS;
+    }
+    if (strcmp(name, AVX512_KERNELS.name) == 0 && cpu.avx512) {
+        return &AVX512_KERNELS;
+    }
+#endif
+
+    return nullptr;
+}
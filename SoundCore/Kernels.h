@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+constexpr int MIX_GAIN_BITS = 12;                   // mix gains are Q12: 4096 = unity, up to just under 8.0
+constexpr int MIX_ACCUMULATOR_BITS = 4;             // fraction bits kept in the int32 mix accumulators
+
+// hot loops shared by the generators and mixers, one implementation per instruction set picked at runtime
+struct KernelTable
+{
+    const char* name;
+
+    // dst[i] = amplitude * sin(2 pi (phase + i * increment)) truncated to 16 bits, phase and increment are in cycles
+    void (*sineInt16)(short* dst, size_t count, double phase, double increment, float amplitude);
+
+    // same as sineInt16 but keeps the float result
+    void (*sineFloat)(float* dst, size_t count, double phase, double increment, float amplitude);
+
+    // rounds to the nearest integer and saturates to 16 bits
+    void (*packInt16)(const float* src, short* dst, size_t count);
+
+    // dst[i] = (a[i] + b[i]) >> 1
+    void (*mixAverageInt16)(const short* a, const short* b, short* dst, size_t count);
+
+    // dst[i] = a[i] + b[i] saturated to 16 bits
+    void (*mixAddInt16)(const short* a, const short* b, short* dst, size_t count);
+
+    // acc[i] += src[i] * gain, gain in Q12 and acc with MIX_ACCUMULATOR_BITS of fraction
+    void (*accumulateInt16)(const short* src, int32_t* acc, size_t count, short gain);
+
+    // acc[i] += src[i], joins two partial mixes
+    void (*addInt32)(const int32_t* src, int32_t* acc, size_t count);
+
+    // rounds a mix accumulator back to samples and saturates to 16 bits
+    void (*packAccumulatorInt16)(const int32_t* acc, short* dst, size_t count);
+
+    // dst[c][i] = src[i * channels + c], splits interleaved frames into one plane per channel
+    void (*deinterleaveInt16)(const short* src, short* const* dst, size_t channels, size_t frames);
+
+    // dst[i * channels + c] = src[c][i], the inverse of deinterleaveInt16
+    void (*interleaveInt16)(const short* const* src, short* dst, size_t channels, size_t frames);
+
+    // the float bus is full scale at +-1.0
+
+    // acc[i] += src[i] * gain, gain already scaled by 1 / 32768 to bring 16-bit samples onto the bus
+    void (*accumulateInt16Float)(const short* src, float* acc, size_t count, float gain);
+
+    // dst[i * channels + c] = src[c][i] for bus samples
+    void (*interleaveFloat)(const float* const* src, float* dst, size_t channels, size_t frames);
+
+    // bus to 16 bits with TPDF dither of +-1 LSB, rounded and saturated. The noise is a hash of the sample's
+    // index in the stream (position + i), so blocks converted separately or out of order join exactly
+    void (*packInt16Dither)(const float* src, short* dst, size_t count, uint64_t position);
+
+    // bus to packed little-endian 24-bit samples, 3 bytes each, rounded and saturated
+    void (*packInt24)(const float* src, unsigned char* dst, size_t count);
+
+    // bus to 32-bit samples, rounded and saturated
+    void (*packInt32)(const float* src, int32_t* dst, size_t count);
+
+    // resampling works on float samples kept at the 16-bit scale
+
+    // dst[i] = src[i]
+    void (*unpackInt16)(const short* src, float* dst, size_t count);
+
+    // polyphase FIR: dst[i] is the dot product of 'taps' coefficients of 'bank' row 'phase' with the input from src on.
+    // After each output the phase steps by 'decimation', and src moves on one sample every time the phase wraps
+    // past 'interpolation'. Fastest with 'taps' a multiple of 16
+    void (*polyphaseFloat)(const float* src, float* dst, size_t count, const float* bank, size_t taps, uint32_t phase,
+        uint32_t interpolation, uint32_t decimation);
+
+    // additive synthesis: dst[i] += the sum over k of amplitude[k] * sin(2 pi (phase[k] + i * increment[k])), phases
+    // in cycles at dst[0]. Every oscillator runs as a rotating phasor from its phase on, so callers re-anchor
+    // every thousand samples or so to keep the float recurrence from drifting
+    void (*additiveFloat)(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude,
+        size_t numOscillators);
+
+    // dst[i] = amplitude * table at phase + i * increment cycles, linearly interpolated and truncated to 16 bits.
+    // The table is 'size' (a power of two) pairs of a sample and its slope to the next one, so one load has both
+    void (*wavetableInt16)(short* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size);
+
+    // same as wavetableInt16 but keeps the float result
+    void (*wavetableFloat)(float* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size);
+
+    // folds 'count' samples into a running minimum, maximum and sum of squares, what overviews are built from
+    void (*peakInt16)(const short* src, size_t count, short* low, short* high, int64_t* squares);
+
+    // same on the bus. The vector versions sum the squares in float lanes, meant for runs of a few thousand samples
+    void (*peakFloat)(const float* src, size_t count, float* low, float* high, double* squares);
+};
+
+// the best table the running CPU supports, SOUND_KERNELS=scalar|sse2|avx2|avx512 forces one
+const KernelTable& kernels();
+
+// a specific table by name, nullptr if it wasn't built or the CPU can't run it
+const KernelTable* kernelsFor(const char* name);
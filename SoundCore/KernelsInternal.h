@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cmath>
+
+#include "Kernels.h"
+
+// shared by the per instruction set translation units, not part of the library interface
+
+extern const KernelTable SCALAR_KERNELS;
+#ifdef SOUND_KERNELS_X86
+extern const KernelTable SSE2_KERNELS;
+extern const KernelTable AVX2_KERNELS;
+extern const KernelTable AVX512_KERNELS;
+#endif
+
+namespace kernel_detail
+{
+    constexpr double TWO_PI = 6.283185307179586;
+
+    //Taylor coefficients of sin(x) up to x^11, the error stays under 1e-7 on [-pi/2, pi/2]
+    constexpr float SIN_C3 = -1.0f / 6.0f;
+    constexpr float SIN_C5 = 1.0f / 120.0f;
+    constexpr float SIN_C7 = -1.0f / 5040.0f;
+    constexpr float SIN_C9 = 1.0f / 362880.0f;
+    constexpr float SIN_C11 = -1.0f / 39916800.0f;
+
+    //product shift from Q12 gain to the accumulator fraction, and the rounding bias when packing
+    constexpr int MIX_PRODUCT_SHIFT = MIX_GAIN_BITS - MIX_ACCUMULATOR_BITS;
+    constexpr int32_t MIX_ROUNDING = 1 << (MIX_ACCUMULATOR_BITS - 1);
+
+    //bus full scale in each integer format, and the largest float below 2^31 as the int32 ceiling
+    constexpr float INT16_SCALE = 32768.0f;
+    constexpr float INT24_SCALE = 8388608.0f;
+    constexpr float INT32_SCALE = 2147483648.0f;
+    constexpr float INT32_CEILING = 2147483520.0f;
+
+    //dither noise: a 32-bit integer hash (lowbias32) of the sample index, its two 16-bit halves are two
+    //uniform variables and their difference is triangular over (-1, 1) LSB
+    constexpr uint32_t DITHER_MUL1 = 0x7feb352d;
+    constexpr uint32_t DITHER_MUL2 = 0x846ca68b;
+    constexpr float DITHER_SCALE = 1.0f / 65536.0f;
+
+    static inline float ditherNoise(uint64_t index)
+    {
+        uint32_t h = static_cast<uint32_t>(index);
+        h ^= h >> 16;
+        h *= DITHER_MUL1;
+        h ^= h >> 15;
+        h *= DITHER_MUL2;
+        h ^= h >> 16;
+        return static_cast<float>(static_cast<int32_t>(h & 0xFFFF) - static_cast<int32_t>(h >> 16)) * DITHER_SCALE;
+    }
+
+    //phase of sample 'index' wrapped to [0, 1) cycles. The vector kernels call it once per group and step
+    //the lanes in float from there, so the float error never grows with the length of the signal.
+    //static so the copies built with AVX flags can't be picked by the linker for the baseline code
+    static inline double wrapPhase(double phase, double increment, size_t index)
+    {
+        const double p = phase + static_cast<double>(index) * increment;
+        return p - std::floor(p);
+    }
+}
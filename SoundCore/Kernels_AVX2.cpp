@@ -0,0 +1,551 @@
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "KernelsInternal.h"
+
+// built with AVX2 + FMA code generation, only reached through the dispatcher on CPUs that have both.
+// No std:: templates or other inline functions with external linkage here so none leak into baseline code
+
+using namespace kernel_detail;
+
+namespace
+{
+    constexpr size_t LANES = 8;
+    constexpr size_t GROUP = 16;                    // samples stepped in float from one double anchor
+    constexpr size_t OSCILLATOR_GROUP = 4;          // oscillators turned together, enough independent chains to keep the multipliers busy
+
+    //amplitude * sin(2 pi u) for u in cycles
+    inline __m256 sinTurns(__m256 u, __m256 amplitude)
+    {
+        const __m256 signMask = _mm256_set1_ps(-0.0f);
+
+        //wrap to [-0.5, 0.5] and fold onto [-0.25, 0.25] where the polynomial is accurate
+        const __m256 r = _mm256_sub_ps(u, _mm256_round_ps(u, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        const __m256 sign = _mm256_and_ps(r, signMask);
+        __m256 a = _mm256_andnot_ps(signMask, r);
+        a = _mm256_min_ps(a, _mm256_sub_ps(_mm256_set1_ps(0.5f), a));
+
+        const __m256 x = _mm256_mul_ps(_mm256_or_ps(a, sign), _mm256_set1_ps(static_cast<float>(TWO_PI)));
+        const __m256 x2 = _mm256_mul_ps(x, x);
+
+        __m256 p = _mm256_set1_ps(SIN_C11);
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(SIN_C9));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(SIN_C7));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(SIN_C5));
+        p = _mm256_fmadd_ps(p, x2, _mm256_set1_ps(SIN_C3));
+        p = _mm256_fmadd_ps(_mm256_mul_ps(x, x2), p, x);
+
+        return _mm256_mul_ps(p, amplitude);
+    }
+
+    //amplitude * the table of (value, slope) pairs interpolated at u cycles, 'size' pairs and a power of two
+    inline __m256 lookupTurns(__m256 u, const float* table, size_t size, __m256 amplitude)
+    {
+        //wrap to [-0.5, 0.5] and move up a whole cycle so truncation is floor, the mask takes it back into the table
+        const __m256 r = _mm256_sub_ps(u, _mm256_round_ps(u, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        const __m256 x = _mm256_fmadd_ps(r, _mm256_set1_ps(static_cast<float>(size)), _mm256_set1_ps(static_cast<float>(size)));
+        const __m256i whole = _mm256_cvttps_epi32(x);
+        const __m256 fraction = _mm256_sub_ps(x, _mm256_cvtepi32_ps(whole));
+        const __m256i index = _mm256_and_si256(whole, _mm256_set1_epi32(static_cast<int>(size - 1)));
+
+        //one 64-bit gather brings a lane's value and slope together. Lanes 0, 1, 4, 5 go in the first gather and
+        //2, 3, 6, 7 in the second, so the in-lane shuffle that splits values from slopes leaves them in order
+        const __m256i order = _mm256_permutevar8x32_epi32(index, _mm256_set_epi32(7, 6, 3, 2, 5, 4, 1, 0));
+        const __m256 lo = _mm256_castpd_ps(_mm256_i32gather_pd(reinterpret_cast<const double*>(table), _mm256_castsi256_si128(order), 8));
+        const __m256 hi = _mm256_castpd_ps(_mm256_i32gather_pd(reinterpret_cast<const double*>(table), _mm256_extracti128_si256(order, 1), 8));
+        const __m256 value = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(2, 0, 2, 0));
+        const __m256 slope = _mm256_shuffle_ps(lo, hi, _MM_SHUFFLE(3, 1, 3, 1));
+        return _mm256_mul_ps(_mm256_fmadd_ps(fraction, slope, value), amplitude);
+    }
+
+    //calls store(sampleIndex, wave(phase)) for every vector of 'count' (a multiple of GROUP) samples, phases in cycles
+    template <typename Wave, typename Store>
+    void phaseGroups(size_t count, double phase, double increment, Wave wave, Store store)
+    {
+        __m256 offsets[GROUP / LANES];
+        for (size_t v = 0; v < GROUP / LANES; v++) {
+            const float i0 = static_cast<float>(v * LANES);
+            offsets[v] = _mm256_mul_ps(_mm256_set_ps(i0 + 7, i0 + 6, i0 + 5, i0 + 4, i0 + 3, i0 + 2, i0 + 1, i0),
+                _mm256_set1_ps(static_cast<float>(increment)));
+        }
+
+        for (size_t i = 0; i < count; i += GROUP) {
+            const __m256 base = _mm256_set1_ps(static_cast<float>(wrapPhase(phase, increment, i)));
+            for (size_t v = 0; v < GROUP / LANES; v++) {
+                store(i + v * LANES, wave(_mm256_add_ps(base, offsets[v])));
+            }
+        }
+    }
+
+    //ditherNoise for eight consecutive sample indices
+    inline __m256 ditherNoise8(__m256i index)
+    {
+        __m256i h = _mm256_xor_si256(index, _mm256_srli_epi32(index, 16));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(DITHER_MUL1)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int>(DITHER_MUL2)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        const __m256i diff = _mm256_sub_epi32(_mm256_and_si256(h, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(h, 16));
+        return _mm256_mul_ps(_mm256_cvtepi32_ps(diff), _mm256_set1_ps(DITHER_SCALE));
+    }
+
+    inline __m128i truncateInt16(__m256 s)
+    {
+        const __m256i v = _mm256_cvttps_epi32(s);
+        return _mm_packs_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    }
+
+    //dst[i] = wave(phase + i * increment) truncated to 16 bits
+    template <typename Wave>
+    void waveInt16(short* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        const size_t whole = count / GROUP * GROUP;
+
+        phaseGroups(whole, phase, increment, wave, [dst](size_t i, __m256 s) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), truncateInt16(s));
+        });
+
+        if (whole < count) {
+            alignas(32) short tail[GROUP];
+            phaseGroups(GROUP, phase + whole * increment, increment, wave, [&tail](size_t i, __m256 s) {
+                _mm_store_si128(reinterpret_cast<__m128i*>(tail + i), truncateInt16(s));
+            });
+            memcpy(dst + whole, tail, (count - whole) * sizeof(short));
+        }
+    }
+
+    template <typename Wave>
+    void waveFloat(float* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        const size_t whole = count / GROUP * GROUP;
+
+        phaseGroups(whole, phase, increment, wave, [dst](size_t i, __m256 s) {
+            _mm256_storeu_ps(dst + i, s);
+        });
+
+        if (whole < count) {
+            alignas(32) float tail[GROUP];
+            phaseGroups(GROUP, phase + whole * increment, increment, wave, [&tail](size_t i, __m256 s) {
+                _mm256_store_ps(tail + i, s);
+            });
+            memcpy(dst + whole, tail, (count - whole) * sizeof(float));
+        }
+    }
+
+    void sineInt16(short* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m256 amp = _mm256_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [amp](__m256 u) { return sinTurns(u, amp); });
+    }
+
+    void sineFloat(float* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m256 amp = _mm256_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [amp](__m256 u) { return sinTurns(u, amp); });
+    }
+
+    void wavetableInt16(short* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m256 amp = _mm256_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [=](__m256 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void wavetableFloat(float* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m256 amp = _mm256_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [=](__m256 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void packInt16(const float* src, short* dst, size_t count)
+    {
+        const __m256 lo = _mm256_set1_ps(-32768.0f);
+        const __m256 hi = _mm256_set1_ps(32767.0f);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i), lo), hi));
+            const __m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(src + i + 8), lo), hi));
+            //packs works per 128-bit lane, the permute puts the samples back in order
+            const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), packed);
+        }
+        SCALAR_KERNELS.packInt16(src + i, dst + i, count - i);
+    }
+
+    void mixAverageInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        const __m256i one = _mm256_set1_epi16(1);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            //floor((a + b) / 2) without widening: (a >> 1) + (b >> 1) + (a & b & 1)
+            const __m256i half = _mm256_add_epi16(_mm256_srai_epi16(va, 1), _mm256_srai_epi16(vb, 1));
+            const __m256i carry = _mm256_and_si256(_mm256_and_si256(va, vb), one);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_add_epi16(half, carry));
+        }
+        SCALAR_KERNELS.mixAverageInt16(a + i, b + i, dst + i, count - i);
+    }
+
+    void mixAddInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+            const __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_adds_epi16(va, vb));
+        }
+        SCALAR_KERNELS.mixAddInt16(a + i, b + i, dst + i, count - i);
+    }
+
+    void accumulateInt16(const short* src, int32_t* acc, size_t count, short gain)
+    {
+        const __m256i g = _mm256_set1_epi32(gain);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256i s = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)));
+            const __m256i p = _mm256_srai_epi32(_mm256_mullo_epi32(s, g), MIX_PRODUCT_SHIFT);
+
+            __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+            _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), p));
+        }
+        SCALAR_KERNELS.accumulateInt16(src + i, acc + i, count - i, gain);
+    }
+
+    void addInt32(const int32_t* src, int32_t* acc, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            __m256i* a = reinterpret_cast<__m256i*>(acc + i);
+            _mm256_storeu_si256(a, _mm256_add_epi32(_mm256_loadu_si256(a), _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i))));
+        }
+        SCALAR_KERNELS.addInt32(src + i, acc + i, count - i);
+    }
+
+    void packAccumulatorInt16(const int32_t* acc, short* dst, size_t count)
+    {
+        const __m256i rounding = _mm256_set1_epi32(MIX_ROUNDING);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i a = _mm256_srai_epi32(_mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i)), rounding), MIX_ACCUMULATOR_BITS);
+            const __m256i b = _mm256_srai_epi32(_mm256_add_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(acc + i + 8)), rounding), MIX_ACCUMULATOR_BITS);
+            //packs works per 128-bit lane, the permute puts the samples back in order
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+        }
+        SCALAR_KERNELS.packAccumulatorInt16(acc + i, dst + i, count - i);
+    }
+
+    //only stereo has a vector path, other layouts go through the scalar planes
+    void deinterleaveInt16(const short* src, short* const* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.deinterleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 16 <= frames; i += 16) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + 2 * i + 16));
+            //left is the sign extended low half of each 32-bit frame, right the high half, the packs work per lane
+            const __m256i left = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+            const __m256i right = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst[0] + i), _mm256_permute4x64_epi64(left, 0xD8));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst[1] + i), _mm256_permute4x64_epi64(right, 0xD8));
+        }
+        short* const tail[2] = { dst[0] + i, dst[1] + i };
+        SCALAR_KERNELS.deinterleaveInt16(src + 2 * i, tail, 2, frames - i);
+    }
+
+    void interleaveInt16(const short* const* src, short* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 16 <= frames; i += 16) {
+            const __m256i left = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src[0] + i));
+            const __m256i right = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src[1] + i));
+            //the unpacks work per lane, frames 0-3 and 8-11 in lo, 4-7 and 12-15 in hi
+            const __m256i lo = _mm256_unpacklo_epi16(left, right);
+            const __m256i hi = _mm256_unpackhi_epi16(left, right);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i), _mm256_permute2x128_si256(lo, hi, 0x20));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + 2 * i + 16), _mm256_permute2x128_si256(lo, hi, 0x31));
+        }
+        const short* const tail[2] = { src[0] + i, src[1] + i };
+        SCALAR_KERNELS.interleaveInt16(tail, dst + 2 * i, 2, frames - i);
+    }
+
+    void accumulateInt16Float(const short* src, float* acc, size_t count, float gain)
+    {
+        const __m256 g = _mm256_set1_ps(gain);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 s = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+            _mm256_storeu_ps(acc + i, _mm256_fmadd_ps(s, g, _mm256_loadu_ps(acc + i)));
+        }
+        SCALAR_KERNELS.accumulateInt16Float(src + i, acc + i, count - i, gain);
+    }
+
+    void interleaveFloat(const float* const* src, float* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveFloat(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 8 <= frames; i += 8) {
+            const __m256 left = _mm256_loadu_ps(src[0] + i);
+            const __m256 right = _mm256_loadu_ps(src[1] + i);
+            //the unpacks work per lane, frames 0-1 and 4-5 in lo, 2-3 and 6-7 in hi
+            const __m256 lo = _mm256_unpacklo_ps(left, right);
+            const __m256 hi = _mm256_unpackhi_ps(left, right);
+            _mm256_storeu_ps(dst + 2 * i, _mm256_permute2f128_ps(lo, hi, 0x20));
+            _mm256_storeu_ps(dst + 2 * i + 8, _mm256_permute2f128_ps(lo, hi, 0x31));
+        }
+        const float* const tail[2] = { src[0] + i, src[1] + i };
+        SCALAR_KERNELS.interleaveFloat(tail, dst + 2 * i, 2, frames - i);
+    }
+
+    void packInt16Dither(const float* src, short* dst, size_t count, uint64_t position)
+    {
+        const __m256 scale = _mm256_set1_ps(INT16_SCALE);
+        const __m256 lo = _mm256_set1_ps(-32768.0f);
+        const __m256 hi = _mm256_set1_ps(32767.0f);
+        const __m256i step = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i index = _mm256_add_epi32(_mm256_set1_epi32(static_cast<int>(position + i)), step);
+            //the scaling is exact, so a fused multiply-add rounds the same as the scalar code
+            const __m256 va = _mm256_fmadd_ps(_mm256_loadu_ps(src + i), scale, ditherNoise8(index));
+            const __m256 vb = _mm256_fmadd_ps(_mm256_loadu_ps(src + i + 8), scale, ditherNoise8(_mm256_add_epi32(index, _mm256_set1_epi32(8))));
+            const __m256i a = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(va, lo), hi));
+            const __m256i b = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(vb, lo), hi));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), 0xD8));
+        }
+        SCALAR_KERNELS.packInt16Dither(src + i, dst + i, count - i, position + i);
+    }
+
+    void packInt24(const float* src, unsigned char* dst, size_t count)
+    {
+        const __m256 scale = _mm256_set1_ps(INT24_SCALE);
+        const __m256 lo = _mm256_set1_ps(-8388608.0f);
+        const __m256 hi = _mm256_set1_ps(8388607.0f);
+        //the low three bytes of each sample to the front of its 128-bit lane
+        const __m256i pack = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+            0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+        size_t i = 0;
+        //each lane is stored as 16 bytes of which the last 4 are overwritten by the next store,
+        //so the loop stops while at least two samples (6 bytes) are left for the scalar tail
+        for (; i + 10 <= count; i += 8) {
+            const __m256i v = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo), hi));
+            const __m256i packed = _mm256_shuffle_epi8(v, pack);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i), _mm256_castsi256_si128(packed));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i + 12), _mm256_extracti128_si256(packed, 1));
+        }
+        SCALAR_KERNELS.packInt24(src + i, dst + 3 * i, count - i);
+    }
+
+    void packInt32(const float* src, int32_t* dst, size_t count)
+    {
+        const __m256 scale = _mm256_set1_ps(INT32_SCALE);
+        const __m256 lo = _mm256_set1_ps(-INT32_SCALE);
+        const __m256 hi = _mm256_set1_ps(INT32_CEILING);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lo), hi);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), _mm256_cvtps_epi32(v));
+        }
+        SCALAR_KERNELS.packInt32(src + i, dst + i, count - i);
+    }
+
+    void unpackInt16(const short* src, float* dst, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            _mm256_storeu_ps(dst + i, _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)))));
+        }
+        SCALAR_KERNELS.unpackInt16(src + i, dst + i, count - i);
+    }
+
+    void polyphaseFloat(const float* src, float* dst, size_t count, const float* bank, size_t taps, uint32_t phase,
+        uint32_t interpolation, uint32_t decimation)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const float* h = bank + size_t(phase) * taps;
+
+            //two accumulators so the fmas of consecutive groups don't wait on each other
+            __m256 acc0 = _mm256_setzero_ps();
+            __m256 acc1 = _mm256_setzero_ps();
+            size_t k = 0;
+            for (; k + 16 <= taps; k += 16) {
+                acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(h + k), _mm256_loadu_ps(src + k), acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(h + k + 8), _mm256_loadu_ps(src + k + 8), acc1);
+            }
+            const __m256 acc = _mm256_add_ps(acc0, acc1);
+            __m128 sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+            float tail = 0.0f;
+            for (; k < taps; k++) {
+                tail += h[k] * src[k];
+            }
+            dst[i] = _mm_cvtss_f32(sum) + tail;
+
+            phase += decimation;
+            src += phase / interpolation;
+            phase %= interpolation;
+        }
+    }
+
+    //adds G oscillators to dst, each a phasor of LANES consecutive samples turned by LANES samples per step
+    template <size_t G>
+    void oscillatorGroup(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude)
+    {
+        const __m256 lanes = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+        __m256 s[G], c[G], rs[G], rc[G];
+        for (size_t g = 0; g < G; g++) {
+            const __m256 amp = _mm256_set1_ps(amplitude[g]);
+            const __m256 u = _mm256_fmadd_ps(lanes, _mm256_set1_ps(static_cast<float>(increment[g])), _mm256_set1_ps(static_cast<float>(phase[g])));
+            s[g] = sinTurns(u, amp);
+            c[g] = sinTurns(_mm256_add_ps(u, _mm256_set1_ps(0.25f)), amp);
+
+            //the rotation comes from double sin and cos, an error in its angle would add up with every step
+            const double turn = TWO_PI * wrapPhase(0.0, increment[g], LANES);
+            rs[g] = _mm256_set1_ps(static_cast<float>(std::sin(turn)));
+            rc[g] = _mm256_set1_ps(static_cast<float>(std::cos(turn)));
+        }
+
+        size_t i = 0;
+        for (; i + LANES <= count; i += LANES) {
+            __m256 acc = _mm256_loadu_ps(dst + i);
+            for (size_t g = 0; g < G; g++) {
+                acc = _mm256_add_ps(acc, s[g]);
+                const __m256 next = _mm256_fmadd_ps(s[g], rc[g], _mm256_mul_ps(c[g], rs[g]));
+                c[g] = _mm256_fmsub_ps(c[g], rc[g], _mm256_mul_ps(s[g], rs[g]));
+                s[g] = next;
+            }
+            _mm256_storeu_ps(dst + i, acc);
+        }
+
+        if (i < count) {
+            __m256 acc = _mm256_setzero_ps();
+            for (size_t g = 0; g < G; g++) {
+                acc = _mm256_add_ps(acc, s[g]);
+            }
+            alignas(32) float tail[LANES];
+            _mm256_store_ps(tail, acc);
+            for (size_t j = 0; i + j < count; j++) {
+                dst[i + j] += tail[j];
+            }
+        }
+    }
+
+    void additiveFloat(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude, size_t numOscillators)
+    {
+        size_t k = 0;
+        for (; k + OSCILLATOR_GROUP <= numOscillators; k += OSCILLATOR_GROUP) {
+            oscillatorGroup<OSCILLATOR_GROUP>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+        for (; k < numOscillators; k++) {
+            oscillatorGroup<1>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+    }
+
+    void peakInt16(const short* src, size_t count, short* low, short* high, int64_t* squares)
+    {
+        __m256i lo = _mm256_set1_epi16(*low);
+        __m256i hi = _mm256_set1_epi16(*high);
+        __m256i sum = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 16 <= count; i += 16) {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+            lo = _mm256_min_epi16(lo, s);
+            hi = _mm256_max_epi16(hi, s);
+            //a pair of squares fits 32 bits unsigned ((-32768)^2 * 2 is 2^31), widened to 64 before it is summed
+            const __m256i pairs = _mm256_madd_epi16(s, s);
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(pairs)));
+            sum = _mm256_add_epi64(sum, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(pairs, 1)));
+        }
+
+        alignas(32) short lows[16];
+        alignas(32) short highs[16];
+        alignas(32) int64_t sums[4];
+        _mm256_store_si256(reinterpret_cast<__m256i*>(lows), lo);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(highs), hi);
+        _mm256_store_si256(reinterpret_cast<__m256i*>(sums), sum);
+        for (size_t k = 0; k < 16; k++) {
+            *low = lows[k] < *low ? lows[k] : *low;
+            *high = highs[k] > *high ? highs[k] : *high;
+        }
+        *squares += sums[0] + sums[1] + sums[2] + sums[3];
+        SCALAR_KERNELS.peakInt16(src + i, count - i, low, high, squares);
+    }
+
+    void peakFloat(const float* src, size_t count, float* low, float* high, double* squares)
+    {
+        __m256 lo = _mm256_set1_ps(*low);
+        __m256 hi = _mm256_set1_ps(*high);
+        __m256 sum = _mm256_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m256 s = _mm256_loadu_ps(src + i);
+            lo = _mm256_min_ps(lo, s);
+            hi = _mm256_max_ps(hi, s);
+            sum = _mm256_fmadd_ps(s, s, sum);
+        }
+
+        alignas(32) float lows[8];
+        alignas(32) float highs[8];
+        alignas(32) float sums[8];
+        _mm256_store_ps(lows, lo);
+        _mm256_store_ps(highs, hi);
+        _mm256_store_ps(sums, sum);
+        for (size_t k = 0; k < 8; k++) {
+            *low = lows[k] < *low ? lows[k] : *low;
+            *high = highs[k] > *high ? highs[k] : *high;
+            *squares += sums[k];
+        }
+        SCALAR_KERNELS.peakFloat(src + i, count - i, low, high, squares);
+    }
+}
+
+const KernelTable AVX2_KERNELS = {
+    "avx2",
+    sineInt16,
+    sineFloat,
+    packInt16,
+    mixAverageInt16,
+    mixAddInt16,
+    accumulateInt16,
+    addInt32,
+    packAccumulatorInt16,
+    deinterleaveInt16,
+    interleaveInt16,
+    accumulateInt16Float,
+    interleaveFloat,
+    packInt16Dither,
+    packInt24,
+    packInt32,
+    unpackInt16,
+    polyphaseFloat,
+    additiveFloat,
+    wavetableInt16,
+    wavetableFloat,
+    peakInt16,
+    peakFloat,
+};
@@ -0,0 +1,502 @@
+#include <cstring>
+
+#include <immintrin.h>
+
+#include "KernelsInternal.h"
+
+// built with AVX-512 F + BW code generation, only reached through the dispatcher on CPUs that have both.
+// No std:: templates or other inline functions with external linkage here so none leak into baseline code
+
+using namespace kernel_detail;
+
+namespace
+{
+    constexpr size_t LANES = 16;                    // a whole group per vector
+    constexpr size_t OSCILLATOR_GROUP = 4;          // oscillators turned together, enough independent chains to keep the multipliers busy
+
+    //amplitude * sin(2 pi u) for u in cycles
+    inline __m512 sinTurns(__m512 u, __m512 amplitude)
+    {
+        //wrap to [-0.5, 0.5] and fold onto [-0.25, 0.25] where the polynomial is accurate
+        const __m512 r = _mm512_sub_ps(u, _mm512_roundscale_ps(u, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        const __m512 a = _mm512_abs_ps(r);
+        const __m512 folded = _mm512_min_ps(a, _mm512_sub_ps(_mm512_set1_ps(0.5f), a));
+        //copy the sign of r back with a bitwise select (0xCA = (mask & r) | (~mask & folded))
+        const __m512i signMask = _mm512_set1_epi32(static_cast<int>(0x80000000u));
+        const __m512 q = _mm512_castsi512_ps(_mm512_ternarylogic_epi32(signMask, _mm512_castps_si512(r), _mm512_castps_si512(folded), 0xCA));
+
+        const __m512 x = _mm512_mul_ps(q, _mm512_set1_ps(static_cast<float>(TWO_PI)));
+        const __m512 x2 = _mm512_mul_ps(x, x);
+
+        __m512 p = _mm512_set1_ps(SIN_C11);
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(SIN_C9));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(SIN_C7));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(SIN_C5));
+        p = _mm512_fmadd_ps(p, x2, _mm512_set1_ps(SIN_C3));
+        p = _mm512_fmadd_ps(_mm512_mul_ps(x, x2), p, x);
+
+        return _mm512_mul_ps(p, amplitude);
+    }
+
+    //ditherNoise for sixteen consecutive sample indices
+    inline __m512 ditherNoise16(__m512i index)
+    {
+        __m512i h = _mm512_xor_si512(index, _mm512_srli_epi32(index, 16));
+        h = _mm512_mullo_epi32(h, _mm512_set1_epi32(static_cast<int>(DITHER_MUL1)));
+        h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 15));
+        h = _mm512_mullo_epi32(h, _mm512_set1_epi32(static_cast<int>(DITHER_MUL2)));
+        h = _mm512_xor_si512(h, _mm512_srli_epi32(h, 16));
+        const __m512i diff = _mm512_sub_epi32(_mm512_and_si512(h, _mm512_set1_epi32(0xFFFF)), _mm512_srli_epi32(h, 16));
+        return _mm512_mul_ps(_mm512_cvtepi32_ps(diff), _mm512_set1_ps(DITHER_SCALE));
+    }
+
+    //amplitude * the table of (value, slope) pairs interpolated at u cycles, 'size' pairs and a power of two
+    inline __m512 lookupTurns(__m512 u, const float* table, size_t size, __m512 amplitude)
+    {
+        //wrap to [-0.5, 0.5] and move up a whole cycle so truncation is floor, the mask takes it back into the table
+        const __m512 r = _mm512_sub_ps(u, _mm512_roundscale_ps(u, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+        const __m512 x = _mm512_fmadd_ps(r, _mm512_set1_ps(static_cast<float>(size)), _mm512_set1_ps(static_cast<float>(size)));
+        const __m512i whole = _mm512_cvttps_epi32(x);
+        const __m512 fraction = _mm512_sub_ps(x, _mm512_cvtepi32_ps(whole));
+        const __m512i index = _mm512_and_si512(whole, _mm512_set1_epi32(static_cast<int>(size - 1)));
+
+        //one 64-bit gather brings a lane's value and slope together, every index is inside the table even
+        //past the end of a masked vector
+        const __m512 lo = _mm512_castpd_ps(_mm512_i32gather_pd(_mm512_castsi512_si256(index), table, 8));
+        const __m512 hi = _mm512_castpd_ps(_mm512_i32gather_pd(_mm512_extracti64x4_epi64(index, 1), table, 8));
+        const __m512i evens = _mm512_set_epi32(30, 28, 26, 24, 22, 20, 18, 16, 14, 12, 10, 8, 6, 4, 2, 0);
+        const __m512i odds = _mm512_set_epi32(31, 29, 27, 25, 23, 21, 19, 17, 15, 13, 11, 9, 7, 5, 3, 1);
+        const __m512 value = _mm512_permutex2var_ps(lo, evens, hi);
+        const __m512 slope = _mm512_permutex2var_ps(lo, odds, hi);
+        return _mm512_mul_ps(_mm512_fmadd_ps(fraction, slope, value), amplitude);
+    }
+
+    //calls store(sampleIndex, wave(phase), mask) for every vector of 'count' samples, the last one masked
+    template <typename Wave, typename Store>
+    void phaseVectors(size_t count, double phase, double increment, Wave wave, Store store)
+    {
+        const __m512 offsets = _mm512_mul_ps(
+            _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+            _mm512_set1_ps(static_cast<float>(increment)));
+
+        for (size_t i = 0; i < count; i += LANES) {
+            const __m512 base = _mm512_set1_ps(static_cast<float>(wrapPhase(phase, increment, i)));
+            const size_t n = count - i < LANES ? count - i : LANES;
+            store(i, wave(_mm512_add_ps(base, offsets)), static_cast<__mmask16>((1u << n) - 1));
+        }
+    }
+
+    //dst[i] = wave(phase + i * increment) truncated to 16 bits
+    template <typename Wave>
+    void waveInt16(short* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        phaseVectors(count, phase, increment, wave, [dst](size_t i, __m512 s, __mmask16 mask) {
+            _mm512_mask_cvtsepi32_storeu_epi16(dst + i, mask, _mm512_cvttps_epi32(s));
+        });
+    }
+
+    template <typename Wave>
+    void waveFloat(float* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        phaseVectors(count, phase, increment, wave, [dst](size_t i, __m512 s, __mmask16 mask) {
+            _mm512_mask_storeu_ps(dst + i, mask, s);
+        });
+    }
+
+    void sineInt16(short* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m512 amp = _mm512_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [amp](__m512 u) { return sinTurns(u, amp); });
+    }
+
+    void sineFloat(float* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m512 amp = _mm512_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [amp](__m512 u) { return sinTurns(u, amp); });
+    }
+
+    void wavetableInt16(short* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m512 amp = _mm512_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [=](__m512 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void wavetableFloat(float* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m512 amp = _mm512_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [=](__m512 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void packInt16(const float* src, short* dst, size_t count)
+    {
+        const __m512 lo = _mm512_set1_ps(-32768.0f);
+        const __m512 hi = _mm512_set1_ps(32767.0f);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_maskz_loadu_ps(mask, src + i), lo), hi);
+            _mm512_mask_cvtsepi32_storeu_epi16(dst + i, mask, _mm512_cvtps_epi32(v));
+        }
+    }
+
+    void mixAverageInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        const __m512i one = _mm512_set1_epi16(1);
+
+        for (size_t i = 0; i < count; i += 32) {
+            const size_t n = count - i < 32 ? count - i : 32;
+            const __mmask32 mask = n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << n) - 1);
+            const __m512i va = _mm512_maskz_loadu_epi16(mask, a + i);
+            const __m512i vb = _mm512_maskz_loadu_epi16(mask, b + i);
+            //floor((a + b) / 2) without widening: (a >> 1) + (b >> 1) + (a & b & 1)
+            const __m512i half = _mm512_add_epi16(_mm512_srai_epi16(va, 1), _mm512_srai_epi16(vb, 1));
+            const __m512i carry = _mm512_and_si512(_mm512_and_si512(va, vb), one);
+            _mm512_mask_storeu_epi16(dst + i, mask, _mm512_add_epi16(half, carry));
+        }
+    }
+
+    void mixAddInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i += 32) {
+            const size_t n = count - i < 32 ? count - i : 32;
+            const __mmask32 mask = n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << n) - 1);
+            const __m512i va = _mm512_maskz_loadu_epi16(mask, a + i);
+            const __m512i vb = _mm512_maskz_loadu_epi16(mask, b + i);
+            _mm512_mask_storeu_epi16(dst + i, mask, _mm512_adds_epi16(va, vb));
+        }
+    }
+
+    void accumulateInt16(const short* src, int32_t* acc, size_t count, short gain)
+    {
+        const __m512i g = _mm512_set1_epi32(gain);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            //512-bit load so this needs BW only, not VL
+            const __m512i s = _mm512_cvtepi16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16(mask, src + i)));
+            const __m512i p = _mm512_srai_epi32(_mm512_mullo_epi32(s, g), MIX_PRODUCT_SHIFT);
+            _mm512_mask_storeu_epi32(acc + i, mask, _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, acc + i), p));
+        }
+    }
+
+    void addInt32(const int32_t* src, int32_t* acc, size_t count)
+    {
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512i sum = _mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, acc + i), _mm512_maskz_loadu_epi32(mask, src + i));
+            _mm512_mask_storeu_epi32(acc + i, mask, sum);
+        }
+    }
+
+    void packAccumulatorInt16(const int32_t* acc, short* dst, size_t count)
+    {
+        const __m512i rounding = _mm512_set1_epi32(MIX_ROUNDING);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512i a = _mm512_srai_epi32(_mm512_add_epi32(_mm512_maskz_loadu_epi32(mask, acc + i), rounding), MIX_ACCUMULATOR_BITS);
+            _mm512_mask_cvtsepi32_storeu_epi16(dst + i, mask, a);
+        }
+    }
+
+    //only stereo has a vector path, other layouts go through the scalar planes
+    void deinterleaveInt16(const short* src, short* const* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.deinterleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        //word 2k of the pair of registers to plane 0, word 2k + 1 to plane 1
+        alignas(64) short evenIndex[32], oddIndex[32];
+        for (short k = 0; k < 32; k++) {
+            evenIndex[k] = static_cast<short>(2 * k);
+            oddIndex[k] = static_cast<short>(2 * k + 1);
+        }
+        const __m512i even = _mm512_load_si512(evenIndex);
+        const __m512i odd = _mm512_load_si512(oddIndex);
+
+        for (size_t i = 0; i < frames; i += 32) {
+            const size_t n = frames - i < 32 ? frames - i : 32;
+            const __mmask32 mask = n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << n) - 1);
+            //the 2n source words split over two masked loads
+            const __mmask32 maskA = n >= 16 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << (2 * n)) - 1);
+            const __mmask32 maskB = n <= 16 ? 0u : n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << (2 * n - 32)) - 1);
+            const __m512i a = _mm512_maskz_loadu_epi16(maskA, src + 2 * i);
+            const __m512i b = _mm512_maskz_loadu_epi16(maskB, src + 2 * i + 32);
+            _mm512_mask_storeu_epi16(dst[0] + i, mask, _mm512_permutex2var_epi16(a, even, b));
+            _mm512_mask_storeu_epi16(dst[1] + i, mask, _mm512_permutex2var_epi16(a, odd, b));
+        }
+    }
+
+    void interleaveInt16(const short* const* src, short* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        //word 2k of the output is left[k] and word 2k + 1 right[k], indices of 32 and up pick from the right plane
+        alignas(64) short loIndex[32], hiIndex[32];
+        for (short k = 0; k < 32; k++) {
+            loIndex[k] = static_cast<short>((k & 1) * 32 + k / 2);
+            hiIndex[k] = static_cast<short>((k & 1) * 32 + 16 + k / 2);
+        }
+        const __m512i lo = _mm512_load_si512(loIndex);
+        const __m512i hi = _mm512_load_si512(hiIndex);
+
+        for (size_t i = 0; i < frames; i += 32) {
+            const size_t n = frames - i < 32 ? frames - i : 32;
+            const __mmask32 mask = n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << n) - 1);
+            const __mmask32 maskA = n >= 16 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << (2 * n)) - 1);
+            const __mmask32 maskB = n <= 16 ? 0u : n == 32 ? 0xFFFFFFFFu : static_cast<__mmask32>((1u << (2 * n - 32)) - 1);
+            const __m512i left = _mm512_maskz_loadu_epi16(mask, src[0] + i);
+            const __m512i right = _mm512_maskz_loadu_epi16(mask, src[1] + i);
+            _mm512_mask_storeu_epi16(dst + 2 * i, maskA, _mm512_permutex2var_epi16(left, lo, right));
+            _mm512_mask_storeu_epi16(dst + 2 * i + 32, maskB, _mm512_permutex2var_epi16(left, hi, right));
+        }
+    }
+
+    void accumulateInt16Float(const short* src, float* acc, size_t count, float gain)
+    {
+        const __m512 g = _mm512_set1_ps(gain);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512 s = _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16(mask, src + i))));
+            _mm512_mask_storeu_ps(acc + i, mask, _mm512_fmadd_ps(s, g, _mm512_maskz_loadu_ps(mask, acc + i)));
+        }
+    }
+
+    void interleaveFloat(const float* const* src, float* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveFloat(src, dst, channels, frames);
+            return;
+        }
+
+        //element 2k of the output is left[k] and element 2k + 1 right[k], indices of 16 and up pick from the right plane
+        const __m512i lo = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19, 4, 20, 5, 21, 6, 22, 7, 23);
+        const __m512i hi = _mm512_setr_epi32(8, 24, 9, 25, 10, 26, 11, 27, 12, 28, 13, 29, 14, 30, 15, 31);
+
+        for (size_t i = 0; i < frames; i += 16) {
+            const size_t n = frames - i < 16 ? frames - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __mmask16 maskA = n >= 8 ? 0xFFFF : static_cast<__mmask16>((1u << (2 * n)) - 1);
+            const __mmask16 maskB = n <= 8 ? 0 : static_cast<__mmask16>((1u << (2 * n - 16)) - 1);
+            const __m512 left = _mm512_maskz_loadu_ps(mask, src[0] + i);
+            const __m512 right = _mm512_maskz_loadu_ps(mask, src[1] + i);
+            _mm512_mask_storeu_ps(dst + 2 * i, maskA, _mm512_permutex2var_ps(left, lo, right));
+            _mm512_mask_storeu_ps(dst + 2 * i + 16, maskB, _mm512_permutex2var_ps(left, hi, right));
+        }
+    }
+
+    void packInt16Dither(const float* src, short* dst, size_t count, uint64_t position)
+    {
+        const __m512 scale = _mm512_set1_ps(INT16_SCALE);
+        const __m512 lo = _mm512_set1_ps(-32768.0f);
+        const __m512 hi = _mm512_set1_ps(32767.0f);
+        const __m512i step = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512i index = _mm512_add_epi32(_mm512_set1_epi32(static_cast<int>(position + i)), step);
+            //the scaling is exact, so a fused multiply-add rounds the same as the scalar code
+            const __m512 v = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, src + i), scale, ditherNoise16(index));
+            _mm512_mask_cvtsepi32_storeu_epi16(dst + i, mask, _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(v, lo), hi)));
+        }
+    }
+
+    void packInt24(const float* src, unsigned char* dst, size_t count)
+    {
+        const __m512 scale = _mm512_set1_ps(INT24_SCALE);
+        const __m512 lo = _mm512_set1_ps(-8388608.0f);
+        const __m512 hi = _mm512_set1_ps(8388607.0f);
+        //the low three bytes of each sample to the front of its 128-bit lane
+        const __m512i pack = _mm512_broadcast_i32x4(_mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1));
+
+        size_t i = 0;
+        //each lane is stored as 16 bytes of which the last 4 are overwritten by the next store,
+        //so the loop stops while at least two samples (6 bytes) are left for the scalar tail
+        for (; i + 18 <= count; i += 16) {
+            const __m512i v = _mm512_cvtps_epi32(_mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_loadu_ps(src + i), scale), lo), hi));
+            const __m512i packed = _mm512_shuffle_epi8(v, pack);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i), _mm512_castsi512_si128(packed));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i + 12), _mm512_extracti32x4_epi32(packed, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i + 24), _mm512_extracti32x4_epi32(packed, 2));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 3 * i + 36), _mm512_extracti32x4_epi32(packed, 3));
+        }
+        SCALAR_KERNELS.packInt24(src + i, dst + 3 * i, count - i);
+    }
+
+    void packInt32(const float* src, int32_t* dst, size_t count)
+    {
+        const __m512 scale = _mm512_set1_ps(INT32_SCALE);
+        const __m512 lo = _mm512_set1_ps(-INT32_SCALE);
+        const __m512 hi = _mm512_set1_ps(INT32_CEILING);
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512 v = _mm512_min_ps(_mm512_max_ps(_mm512_mul_ps(_mm512_maskz_loadu_ps(mask, src + i), scale), lo), hi);
+            _mm512_mask_storeu_epi32(dst + i, mask, _mm512_cvtps_epi32(v));
+        }
+    }
+
+    void unpackInt16(const short* src, float* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512i s = _mm512_cvtepi16_epi32(_mm512_castsi512_si256(_mm512_maskz_loadu_epi16(mask, src + i)));
+            _mm512_mask_storeu_ps(dst + i, mask, _mm512_cvtepi32_ps(s));
+        }
+    }
+
+    void polyphaseFloat(const float* src, float* dst, size_t count, const float* bank, size_t taps, uint32_t phase,
+        uint32_t interpolation, uint32_t decimation)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const float* h = bank + size_t(phase) * taps;
+
+            //the last group is masked, so any tap count runs without a scalar tail
+            __m512 acc = _mm512_setzero_ps();
+            for (size_t k = 0; k < taps; k += 16) {
+                const size_t n = taps - k < 16 ? taps - k : 16;
+                const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+                acc = _mm512_fmadd_ps(_mm512_maskz_loadu_ps(mask, h + k), _mm512_maskz_loadu_ps(mask, src + k), acc);
+            }
+            dst[i] = _mm512_reduce_add_ps(acc);
+
+            phase += decimation;
+            src += phase / interpolation;
+            phase %= interpolation;
+        }
+    }
+
+    //adds G oscillators to dst, each a phasor of LANES consecutive samples turned by LANES samples per step
+    template <size_t G>
+    void oscillatorGroup(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude)
+    {
+        const __m512 lanes = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+        __m512 s[G], c[G], rs[G], rc[G];
+        for (size_t g = 0; g < G; g++) {
+            const __m512 amp = _mm512_set1_ps(amplitude[g]);
+            const __m512 u = _mm512_fmadd_ps(lanes, _mm512_set1_ps(static_cast<float>(increment[g])), _mm512_set1_ps(static_cast<float>(phase[g])));
+            s[g] = sinTurns(u, amp);
+            c[g] = sinTurns(_mm512_add_ps(u, _mm512_set1_ps(0.25f)), amp);
+
+            //the rotation comes from double sin and cos, an error in its angle would add up with every step
+            const double turn = TWO_PI * wrapPhase(0.0, increment[g], LANES);
+            rs[g] = _mm512_set1_ps(static_cast<float>(std::sin(turn)));
+            rc[g] = _mm512_set1_ps(static_cast<float>(std::cos(turn)));
+        }
+
+        //the last step is masked, the lanes past the end are turned but never stored
+        for (size_t i = 0; i < count; i += LANES) {
+            const size_t n = count - i < LANES ? count - i : LANES;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            __m512 acc = _mm512_maskz_loadu_ps(mask, dst + i);
+            for (size_t g = 0; g < G; g++) {
+                acc = _mm512_add_ps(acc, s[g]);
+                const __m512 next = _mm512_fmadd_ps(s[g], rc[g], _mm512_mul_ps(c[g], rs[g]));
+                c[g] = _mm512_fmsub_ps(c[g], rc[g], _mm512_mul_ps(s[g], rs[g]));
+                s[g] = next;
+            }
+            _mm512_mask_storeu_ps(dst + i, mask, acc);
+        }
+    }
+
+    void additiveFloat(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude, size_t numOscillators)
+    {
+        size_t k = 0;
+        for (; k + OSCILLATOR_GROUP <= numOscillators; k += OSCILLATOR_GROUP) {
+            oscillatorGroup<OSCILLATOR_GROUP>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+        for (; k < numOscillators; k++) {
+            oscillatorGroup<1>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+    }
+
+    void peakInt16(const short* src, size_t count, short* low, short* high, int64_t* squares)
+    {
+        __m512i lo = _mm512_set1_epi16(*low);
+        __m512i hi = _mm512_set1_epi16(*high);
+        __m512i sum = _mm512_setzero_si512();
+
+        //the masked off lanes load as 0, they leave the extremes alone and add no squares
+        for (size_t i = 0; i < count; i += 32) {
+            const size_t n = count - i < 32 ? count - i : 32;
+            const __mmask32 mask = static_cast<__mmask32>(n == 32 ? ~0u : (1u << n) - 1);
+            const __m512i s = _mm512_maskz_loadu_epi16(mask, src + i);
+            lo = _mm512_mask_min_epi16(lo, mask, lo, s);
+            hi = _mm512_mask_max_epi16(hi, mask, hi, s);
+            //a pair of squares fits 32 bits unsigned ((-32768)^2 * 2 is 2^31), widened to 64 before it is summed
+            const __m512i pairs = _mm512_madd_epi16(s, s);
+            sum = _mm512_add_epi64(sum, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(pairs)));
+            sum = _mm512_add_epi64(sum, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(pairs, 1)));
+        }
+
+        alignas(64) short lows[32];
+        alignas(64) short highs[32];
+        _mm512_store_si512(lows, lo);
+        _mm512_store_si512(highs, hi);
+        for (size_t k = 0; k < 32; k++) {
+            *low = lows[k] < *low ? lows[k] : *low;
+            *high = highs[k] > *high ? highs[k] : *high;
+        }
+        *squares += _mm512_reduce_add_epi64(sum);
+    }
+
+    void peakFloat(const float* src, size_t count, float* low, float* high, double* squares)
+    {
+        __m512 lo = _mm512_set1_ps(*low);
+        __m512 hi = _mm512_set1_ps(*high);
+        __m512 sum = _mm512_setzero_ps();
+
+        for (size_t i = 0; i < count; i += 16) {
+            const size_t n = count - i < 16 ? count - i : 16;
+            const __mmask16 mask = static_cast<__mmask16>((1u << n) - 1);
+            const __m512 s = _mm512_maskz_loadu_ps(mask, src + i);
+            lo = _mm512_mask_min_ps(lo, mask, lo, s);
+            hi = _mm512_mask_max_ps(hi, mask, hi, s);
+            sum = _mm512_fmadd_ps(s, s, sum);
+        }
+
+        *low = _mm512_reduce_min_ps(lo);
+        *high = _mm512_reduce_max_ps(hi);
+        *squares += _mm512_reduce_add_ps(sum);
+    }
+}
+
+const KernelTable AVX512_KERNELS = {
+    "avx512",
+    sineInt16,
+    sineFloat,
+    packInt16,
+    mixAverageInt16,
+    mixAddInt16,
+    accumulateInt16,
+    addInt32,
+    packAccumulatorInt16,
+    deinterleaveInt16,
+    interleaveInt16,
+    accumulateInt16Float,
+    interleaveFloat,
+    packInt16Dither,
+    packInt24,
+    packInt32,
+    unpackInt16,
+    polyphaseFloat,
+    additiveFloat,
+    wavetableInt16,
+    wavetableFloat,
+    peakInt16,
+    peakFloat,
+};
@@ -0,0 +1,553 @@
+#include <cstring>
+
+#include <emmintrin.h>
+
+#include "KernelsInternal.h"
+
+using namespace kernel_detail;
+
+namespace
+{
+    constexpr size_t LANES = 4;
+    constexpr size_t GROUP = 16;                    // samples stepped in float from one double anchor
+    constexpr size_t OSCILLATOR_GROUP = 4;          // oscillators turned together, enough independent chains to keep the multipliers busy
+
+    //amplitude * sin(2 pi u) for u in cycles
+    inline __m128 sinTurns(__m128 u, __m128 amplitude)
+    {
+        const __m128 signMask = _mm_set1_ps(-0.0f);
+
+        //wrap to [-0.5, 0.5] and fold onto [-0.25, 0.25] where the polynomial is accurate
+        const __m128 r = _mm_sub_ps(u, _mm_cvtepi32_ps(_mm_cvtps_epi32(u)));
+        const __m128 sign = _mm_and_ps(r, signMask);
+        __m128 a = _mm_andnot_ps(signMask, r);
+        a = _mm_min_ps(a, _mm_sub_ps(_mm_set1_ps(0.5f), a));
+
+        const __m128 x = _mm_mul_ps(_mm_or_ps(a, sign), _mm_set1_ps(static_cast<float>(TWO_PI)));
+        const __m128 x2 = _mm_mul_ps(x, x);
+
+        __m128 p = _mm_set1_ps(SIN_C11);
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C9));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C7));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C5));
+        p = _mm_add_ps(_mm_mul_ps(p, x2), _mm_set1_ps(SIN_C3));
+        p = _mm_add_ps(x, _mm_mul_ps(_mm_mul_ps(x, x2), p));
+
+        return _mm_mul_ps(p, amplitude);
+    }
+
+    //a * b per 32-bit lane, SSE2 only multiplies the even lanes so the odd ones go through a shifted copy
+    inline __m128i mulLo32(__m128i a, __m128i b)
+    {
+        const __m128i even = _mm_mul_epu32(a, b);
+        const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+        return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+    }
+
+    //ditherNoise for four consecutive sample indices
+    inline __m128 ditherNoise4(__m128i index)
+    {
+        __m128i h = _mm_xor_si128(index, _mm_srli_epi32(index, 16));
+        h = mulLo32(h, _mm_set1_epi32(static_cast<int>(DITHER_MUL1)));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        h = mulLo32(h, _mm_set1_epi32(static_cast<int>(DITHER_MUL2)));
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+        const __m128i diff = _mm_sub_epi32(_mm_and_si128(h, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(h, 16));
+        return _mm_mul_ps(_mm_cvtepi32_ps(diff), _mm_set1_ps(DITHER_SCALE));
+    }
+
+    //amplitude * the table of (value, slope) pairs interpolated at u cycles, 'size' pairs and a power of two
+    inline __m128 lookupTurns(__m128 u, const float* table, size_t size, __m128 amplitude)
+    {
+        //wrap to [-0.5, 0.5] and move up a whole cycle so truncation is floor, the mask takes it back into the table
+        const __m128 r = _mm_sub_ps(u, _mm_cvtepi32_ps(_mm_cvtps_epi32(u)));
+        const __m128 x = _mm_add_ps(_mm_mul_ps(r, _mm_set1_ps(static_cast<float>(size))), _mm_set1_ps(static_cast<float>(size)));
+        const __m128i whole = _mm_cvttps_epi32(x);
+        const __m128 fraction = _mm_sub_ps(x, _mm_cvtepi32_ps(whole));
+
+        //no gathers before AVX2, the lanes are loaded one by one
+        alignas(16) int32_t index[LANES];
+        _mm_store_si128(reinterpret_cast<__m128i*>(index), _mm_and_si128(whole, _mm_set1_epi32(static_cast<int>(size - 1))));
+        const float* p0 = table + 2 * index[0];
+        const float* p1 = table + 2 * index[1];
+        const float* p2 = table + 2 * index[2];
+        const float* p3 = table + 2 * index[3];
+        const __m128 value = _mm_set_ps(p3[0], p2[0], p1[0], p0[0]);
+        const __m128 slope = _mm_set_ps(p3[1], p2[1], p1[1], p0[1]);
+        return _mm_mul_ps(_mm_add_ps(value, _mm_mul_ps(fraction, slope)), amplitude);
+    }
+
+    //calls store(sampleIndex, wave(phase)) for every vector of 'count' (a multiple of GROUP) samples, phases in cycles
+    template <typename Wave, typename Store>
+    void phaseGroups(size_t count, double phase, double increment, Wave wave, Store store)
+    {
+        __m128 offsets[GROUP / LANES];
+        for (size_t v = 0; v < GROUP / LANES; v++) {
+            const float i0 = static_cast<float>(v * LANES);
+            offsets[v] = _mm_mul_ps(_mm_set_ps(i0 + 3, i0 + 2, i0 + 1, i0), _mm_set1_ps(static_cast<float>(increment)));
+        }
+
+        for (size_t i = 0; i < count; i += GROUP) {
+            const __m128 base = _mm_set1_ps(static_cast<float>(wrapPhase(phase, increment, i)));
+            for (size_t v = 0; v < GROUP / LANES; v++) {
+                store(i + v * LANES, wave(_mm_add_ps(base, offsets[v])));
+            }
+        }
+    }
+
+    //dst[i] = wave(phase + i * increment) truncated to 16 bits
+    template <typename Wave>
+    void waveInt16(short* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        const size_t whole = count / GROUP * GROUP;
+
+        phaseGroups(whole, phase, increment, wave, [dst](size_t i, __m128 s) {
+            const __m128i v = _mm_cvttps_epi32(s);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(v, v));
+        });
+
+        if (whole < count) {
+            alignas(16) short tail[GROUP];
+            phaseGroups(GROUP, phase + whole * increment, increment, wave, [&tail](size_t i, __m128 s) {
+                const __m128i v = _mm_cvttps_epi32(s);
+                _mm_storel_epi64(reinterpret_cast<__m128i*>(tail + i), _mm_packs_epi32(v, v));
+            });
+            memcpy(dst + whole, tail, (count - whole) * sizeof(short));
+        }
+    }
+
+    template <typename Wave>
+    void waveFloat(float* dst, size_t count, double phase, double increment, Wave wave)
+    {
+        const size_t whole = count / GROUP * GROUP;
+
+        phaseGroups(whole, phase, increment, wave, [dst](size_t i, __m128 s) {
+            _mm_storeu_ps(dst + i, s);
+        });
+
+        if (whole < count) {
+            alignas(16) float tail[GROUP];
+            phaseGroups(GROUP, phase + whole * increment, increment, wave, [&tail](size_t i, __m128 s) {
+                _mm_store_ps(tail + i, s);
+            });
+            memcpy(dst + whole, tail, (count - whole) * sizeof(float));
+        }
+    }
+
+    void sineInt16(short* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m128 amp = _mm_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [amp](__m128 u) { return sinTurns(u, amp); });
+    }
+
+    void sineFloat(float* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        const __m128 amp = _mm_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [amp](__m128 u) { return sinTurns(u, amp); });
+    }
+
+    void wavetableInt16(short* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m128 amp = _mm_set1_ps(amplitude);
+        waveInt16(dst, count, phase, increment, [=](__m128 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void wavetableFloat(float* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        const __m128 amp = _mm_set1_ps(amplitude);
+        waveFloat(dst, count, phase, increment, [=](__m128 u) { return lookupTurns(u, table, size, amp); });
+    }
+
+    void packInt16(const float* src, short* dst, size_t count)
+    {
+        const __m128 lo = _mm_set1_ps(-32768.0f);
+        const __m128 hi = _mm_set1_ps(32767.0f);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i), lo), hi));
+            const __m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(src + i + 4), lo), hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+        }
+        SCALAR_KERNELS.packInt16(src + i, dst + i, count - i);
+    }
+
+    void mixAverageInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        const __m128i one = _mm_set1_epi16(1);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            //floor((a + b) / 2) without widening: (a >> 1) + (b >> 1) + (a & b & 1)
+            const __m128i half = _mm_add_epi16(_mm_srai_epi16(va, 1), _mm_srai_epi16(vb, 1));
+            const __m128i carry = _mm_and_si128(_mm_and_si128(va, vb), one);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_add_epi16(half, carry));
+        }
+        SCALAR_KERNELS.mixAverageInt16(a + i, b + i, dst + i, count - i);
+    }
+
+    void mixAddInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+            const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_adds_epi16(va, vb));
+        }
+        SCALAR_KERNELS.mixAddInt16(a + i, b + i, dst + i, count - i);
+    }
+
+    void accumulateInt16(const short* src, int32_t* acc, size_t count, short gain)
+    {
+        const __m128i g = _mm_set1_epi16(gain);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            //16x16 -> 32 bit products from the low and high halves
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i lo = _mm_mullo_epi16(s, g);
+            const __m128i hi = _mm_mulhi_epi16(s, g);
+            const __m128i p0 = _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), MIX_PRODUCT_SHIFT);
+            const __m128i p1 = _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), MIX_PRODUCT_SHIFT);
+
+            __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+            _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), p0));
+            _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), p1));
+        }
+        SCALAR_KERNELS.accumulateInt16(src + i, acc + i, count - i, gain);
+    }
+
+    void addInt32(const int32_t* src, int32_t* acc, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+            _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i))));
+        }
+        SCALAR_KERNELS.addInt32(src + i, acc + i, count - i);
+    }
+
+    void packAccumulatorInt16(const int32_t* acc, short* dst, size_t count)
+    {
+        const __m128i rounding = _mm_set1_epi32(MIX_ROUNDING);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i a = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i)), rounding), MIX_ACCUMULATOR_BITS);
+            const __m128i b = _mm_srai_epi32(_mm_add_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(acc + i + 4)), rounding), MIX_ACCUMULATOR_BITS);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+        }
+        SCALAR_KERNELS.packAccumulatorInt16(acc + i, dst + i, count - i);
+    }
+
+    //only stereo has a vector path, other layouts go through the scalar planes
+    void deinterleaveInt16(const short* src, short* const* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.deinterleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 8 <= frames; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 2 * i + 8));
+            //left is the sign extended low half of each 32-bit frame, right the high half, both fit the pack
+            const __m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+            const __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[0] + i), left);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst[1] + i), right);
+        }
+        short* const tail[2] = { dst[0] + i, dst[1] + i };
+        SCALAR_KERNELS.deinterleaveInt16(src + 2 * i, tail, 2, frames - i);
+    }
+
+    void interleaveInt16(const short* const* src, short* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveInt16(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 8 <= frames; i += 8) {
+            const __m128i left = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[0] + i));
+            const __m128i right = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src[1] + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i), _mm_unpacklo_epi16(left, right));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 2 * i + 8), _mm_unpackhi_epi16(left, right));
+        }
+        const short* const tail[2] = { src[0] + i, src[1] + i };
+        SCALAR_KERNELS.interleaveInt16(tail, dst + 2 * i, 2, frames - i);
+    }
+
+    void accumulateInt16Float(const short* src, float* acc, size_t count, float gain)
+    {
+        const __m128 g = _mm_set1_ps(gain);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            //sign extend by unpacking the samples into the high halves and shifting them down
+            const __m128 lo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16));
+            const __m128 hi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16));
+            _mm_storeu_ps(acc + i, _mm_add_ps(_mm_loadu_ps(acc + i), _mm_mul_ps(lo, g)));
+            _mm_storeu_ps(acc + i + 4, _mm_add_ps(_mm_loadu_ps(acc + i + 4), _mm_mul_ps(hi, g)));
+        }
+        SCALAR_KERNELS.accumulateInt16Float(src + i, acc + i, count - i, gain);
+    }
+
+    void interleaveFloat(const float* const* src, float* dst, size_t channels, size_t frames)
+    {
+        if (channels != 2) {
+            SCALAR_KERNELS.interleaveFloat(src, dst, channels, frames);
+            return;
+        }
+
+        size_t i = 0;
+        for (; i + 4 <= frames; i += 4) {
+            const __m128 left = _mm_loadu_ps(src[0] + i);
+            const __m128 right = _mm_loadu_ps(src[1] + i);
+            _mm_storeu_ps(dst + 2 * i, _mm_unpacklo_ps(left, right));
+            _mm_storeu_ps(dst + 2 * i + 4, _mm_unpackhi_ps(left, right));
+        }
+        const float* const tail[2] = { src[0] + i, src[1] + i };
+        SCALAR_KERNELS.interleaveFloat(tail, dst + 2 * i, 2, frames - i);
+    }
+
+    void packInt16Dither(const float* src, short* dst, size_t count, uint64_t position)
+    {
+        const __m128 scale = _mm_set1_ps(INT16_SCALE);
+        const __m128 lo = _mm_set1_ps(-32768.0f);
+        const __m128 hi = _mm_set1_ps(32767.0f);
+        const __m128i step = _mm_set_epi32(3, 2, 1, 0);
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i index = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(position + i)), step);
+            const __m128 va = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), ditherNoise4(index));
+            const __m128 vb = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), ditherNoise4(_mm_add_epi32(index, _mm_set1_epi32(4))));
+            const __m128i a = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(va, lo), hi));
+            const __m128i b = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(vb, lo), hi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packs_epi32(a, b));
+        }
+        SCALAR_KERNELS.packInt16Dither(src + i, dst + i, count - i, position + i);
+    }
+
+    //SSE2 has no byte shuffle, the conversion is vectorised and the 3-byte packing done per sample
+    void packInt24(const float* src, unsigned char* dst, size_t count)
+    {
+        const __m128 scale = _mm_set1_ps(INT24_SCALE);
+        const __m128 lo = _mm_set1_ps(-8388608.0f);
+        const __m128 hi = _mm_set1_ps(8388607.0f);
+
+        size_t i = 0;
+        alignas(16) int32_t v[4];
+        for (; i + 4 <= count; i += 4) {
+            _mm_store_si128(reinterpret_cast<__m128i*>(v), _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo), hi)));
+            for (int k = 0; k < 4; k++) {
+                unsigned char* p = dst + 3 * (i + k);
+                p[0] = static_cast<unsigned char>(v[k]);
+                p[1] = static_cast<unsigned char>(v[k] >> 8);
+                p[2] = static_cast<unsigned char>(v[k] >> 16);
+            }
+        }
+        SCALAR_KERNELS.packInt24(src + i, dst + 3 * i, count - i);
+    }
+
+    void packInt32(const float* src, int32_t* dst, size_t count)
+    {
+        const __m128 scale = _mm_set1_ps(INT32_SCALE);
+        const __m128 lo = _mm_set1_ps(-INT32_SCALE);
+        const __m128 hi = _mm_set1_ps(INT32_CEILING);
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 v = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lo), hi);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_cvtps_epi32(v));
+        }
+        SCALAR_KERNELS.packInt32(src + i, dst + i, count - i);
+    }
+
+    void unpackInt16(const short* src, float* dst, size_t count)
+    {
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            _mm_storeu_ps(dst + i, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(s, s), 16)));
+            _mm_storeu_ps(dst + i + 4, _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(s, s), 16)));
+        }
+        SCALAR_KERNELS.unpackInt16(src + i, dst + i, count - i);
+    }
+
+    void polyphaseFloat(const float* src, float* dst, size_t count, const float* bank, size_t taps, uint32_t phase,
+        uint32_t interpolation, uint32_t decimation)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const float* h = bank + size_t(phase) * taps;
+
+            //two accumulators so the adds of consecutive groups don't wait on each other
+            __m128 acc0 = _mm_setzero_ps();
+            __m128 acc1 = _mm_setzero_ps();
+            size_t k = 0;
+            for (; k + 8 <= taps; k += 8) {
+                acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(h + k), _mm_loadu_ps(src + k)));
+                acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(h + k + 4), _mm_loadu_ps(src + k + 4)));
+            }
+            __m128 sum = _mm_add_ps(acc0, acc1);
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+            float tail = 0.0f;
+            for (; k < taps; k++) {
+                tail += h[k] * src[k];
+            }
+            dst[i] = _mm_cvtss_f32(sum) + tail;
+
+            phase += decimation;
+            src += phase / interpolation;
+            phase %= interpolation;
+        }
+    }
+
+    //adds G oscillators to dst, each a phasor of LANES consecutive samples turned by LANES samples per step
+    template <size_t G>
+    void oscillatorGroup(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude)
+    {
+        const __m128 lanes = _mm_set_ps(3, 2, 1, 0);
+        __m128 s[G], c[G], rs[G], rc[G];
+        for (size_t g = 0; g < G; g++) {
+            const __m128 amp = _mm_set1_ps(amplitude[g]);
+            const __m128 u = _mm_add_ps(_mm_set1_ps(static_cast<float>(phase[g])), _mm_mul_ps(lanes, _mm_set1_ps(static_cast<float>(increment[g]))));
+            s[g] = sinTurns(u, amp);
+            c[g] = sinTurns(_mm_add_ps(u, _mm_set1_ps(0.25f)), amp);
+
+            //the rotation comes from double sin and cos, an error in its angle would add up with every step
+            const double turn = TWO_PI * wrapPhase(0.0, increment[g], LANES);
+            rs[g] = _mm_set1_ps(static_cast<float>(std::sin(turn)));
+            rc[g] = _mm_set1_ps(static_cast<float>(std::cos(turn)));
+        }
+
+        size_t i = 0;
+        for (; i + LANES <= count; i += LANES) {
+            __m128 acc = _mm_loadu_ps(dst + i);
+            for (size_t g = 0; g < G; g++) {
+                acc = _mm_add_ps(acc, s[g]);
+                const __m128 next = _mm_add_ps(_mm_mul_ps(s[g], rc[g]), _mm_mul_ps(c[g], rs[g]));
+                c[g] = _mm_sub_ps(_mm_mul_ps(c[g], rc[g]), _mm_mul_ps(s[g], rs[g]));
+                s[g] = next;
+            }
+            _mm_storeu_ps(dst + i, acc);
+        }
+
+        if (i < count) {
+            __m128 acc = _mm_setzero_ps();
+            for (size_t g = 0; g < G; g++) {
+                acc = _mm_add_ps(acc, s[g]);
+            }
+            alignas(16) float tail[LANES];
+            _mm_store_ps(tail, acc);
+            for (size_t j = 0; i + j < count; j++) {
+                dst[i + j] += tail[j];
+            }
+        }
+    }
+
+    void additiveFloat(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude, size_t numOscillators)
+    {
+        size_t k = 0;
+        for (; k + OSCILLATOR_GROUP <= numOscillators; k += OSCILLATOR_GROUP) {
+            oscillatorGroup<OSCILLATOR_GROUP>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+        for (; k < numOscillators; k++) {
+            oscillatorGroup<1>(dst, count, phase + k, increment + k, amplitude + k);
+        }
+    }
+
+    void peakInt16(const short* src, size_t count, short* low, short* high, int64_t* squares)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        __m128i lo = _mm_set1_epi16(*low);
+        __m128i hi = _mm_set1_epi16(*high);
+        __m128i sum = zero;
+
+        size_t i = 0;
+        for (; i + 8 <= count; i += 8) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            lo = _mm_min_epi16(lo, s);
+            hi = _mm_max_epi16(hi, s);
+            //a pair of squares fits 32 bits unsigned ((-32768)^2 * 2 is 2^31), widened to 64 before it is summed
+            const __m128i pairs = _mm_madd_epi16(s, s);
+            sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(pairs, zero));
+            sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(pairs, zero));
+        }
+
+        alignas(16) short lows[8];
+        alignas(16) short highs[8];
+        alignas(16) int64_t sums[2];
+        _mm_store_si128(reinterpret_cast<__m128i*>(lows), lo);
+        _mm_store_si128(reinterpret_cast<__m128i*>(highs), hi);
+        _mm_store_si128(reinterpret_cast<__m128i*>(sums), sum);
+        for (size_t k = 0; k < 8; k++) {
+            *low = lows[k] < *low ? lows[k] : *low;
+            *high = highs[k] > *high ? highs[k] : *high;
+        }
+        *squares += sums[0] + sums[1];
+        SCALAR_KERNELS.peakInt16(src + i, count - i, low, high, squares);
+    }
+
+    void peakFloat(const float* src, size_t count, float* low, float* high, double* squares)
+    {
+        __m128 lo = _mm_set1_ps(*low);
+        __m128 hi = _mm_set1_ps(*high);
+        __m128 sum = _mm_setzero_ps();
+
+        size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            const __m128 s = _mm_loadu_ps(src + i);
+            lo = _mm_min_ps(lo, s);
+            hi = _mm_max_ps(hi, s);
+            sum = _mm_add_ps(sum, _mm_mul_ps(s, s));
+        }
+
+        alignas(16) float lows[4];
+        alignas(16) float highs[4];
+        alignas(16) float sums[4];
+        _mm_store_ps(lows, lo);
+        _mm_store_ps(highs, hi);
+        _mm_store_ps(sums, sum);
+        for (size_t k = 0; k < 4; k++) {
+            *low = lows[k] < *low ? lows[k] : *low;
+            *high = highs[k] > *high ? highs[k] : *high;
+            *squares += sums[k];
+        }
+        SCALAR_KERNELS.peakFloat(src + i, count - i, low, high, squares);
+    }
+}
+
+const KernelTable SSE2_KERNELS = {
+    "sse2",
+    sineInt16,
+    sineFloat,
+    packInt16,
+    mixAverageInt16,
+    mixAddInt16,
+    accumulateInt16,
+    addInt32,
+    packAccumulatorInt16,
+    deinterleaveInt16,
+    interleaveInt16,
+    accumulateInt16Float,
+    interleaveFloat,
+    packInt16Dither,
+    packInt24,
+    packInt32,
+    unpackInt16,
+    polyphaseFloat,
+    additiveFloat,
+    wavetableInt16,
+    wavetableFloat,
+    peakInt16,
+    peakFloat,
+};
@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "KernelsInternal.h"
+
+using namespace kernel_detail;
+
+// reference implementations, also what non-x86 builds run
+
+namespace
+{
+    void sineInt16(short* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>(amplitude * std::sin(TWO_PI * wrapPhase(phase, increment, i)));
+        }
+    }
+
+    void sineFloat(float* dst, size_t count, double phase, double increment, float amplitude)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<float>(amplitude * std::sin(TWO_PI * wrapPhase(phase, increment, i)));
+        }
+    }
+
+    //the table of (value, slope) pairs interpolated at 'phase' cycles, wrapped to [0, 1)
+    double lookup(const float* table, size_t size, double phase)
+    {
+        const double x = phase * size;
+        const size_t whole = static_cast<size_t>(x);
+        const float* pair = table + 2 * (whole & (size - 1));
+        return pair[0] + (x - whole) * pair[1];
+    }
+
+    void wavetableInt16(short* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>(amplitude * lookup(table, size, wrapPhase(phase, increment, i)));
+        }
+    }
+
+    void wavetableFloat(float* dst, size_t count, double phase, double increment, float amplitude, const float* table, size_t size)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<float>(amplitude * lookup(table, size, wrapPhase(phase, increment, i)));
+        }
+    }
+
+    void packInt16(const float* src, short* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>(std::lrint(std::min(std::max(src[i], -32768.0f), 32767.0f)));
+        }
+    }
+
+    void mixAverageInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>((a[i] + b[i]) >> 1);
+        }
+    }
+
+    void mixAddInt16(const short* a, const short* b, short* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>(std::min(std::max(a[i] + b[i], -32768), 32767));
+        }
+    }
+
+    void accumulateInt16(const short* src, int32_t* acc, size_t count, short gain)
+    {
+        for (size_t i = 0; i < count; i++) {
+            acc[i] += (src[i] * gain) >> MIX_PRODUCT_SHIFT;
+        }
+    }
+
+    void addInt32(const int32_t* src, int32_t* acc, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            acc[i] += src[i];
+        }
+    }
+
+    void packAccumulatorInt16(const int32_t* acc, short* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<short>(std::min(std::max((acc[i] + MIX_ROUNDING) >> MIX_ACCUMULATOR_BITS, -32768), 32767));
+        }
+    }
+
+    void deinterleaveInt16(const short* src, short* const* dst, size_t channels, size_t frames)
+    {
+        if (channels == 1) {
+            memcpy(dst[0], src, frames * sizeof(short));
+            return;
+        }
+
+        //one plane at a time so every store stream is sequential
+        for (size_t c = 0; c < channels; c++) {
+            short* plane = dst[c];
+            for (size_t i = 0; i < frames; i++) {
+                plane[i] = src[i * channels + c];
+            }
+        }
+    }
+
+    void interleaveInt16(const short* const* src, short* dst, size_t channels, size_t frames)
+    {
+        if (channels == 1) {
+            memcpy(dst, src[0], frames * sizeof(short));
+            return;
+        }
+
+        for (size_t c = 0; c < channels; c++) {
+            const short* plane = src[c];
+            for (size_t i = 0; i < frames; i++) {
+                dst[i * channels + c] = plane[i];
+            }
+        }
+    }
+
+    void accumulateInt16Float(const short* src, float* acc, size_t count, float gain)
+    {
+        for (size_t i = 0; i < count; i++) {
+            acc[i] += src[i] * gain;
+        }
+    }
+
+    void interleaveFloat(const float* const* src, float* dst, size_t channels, size_t frames)
+    {
+        if (channels == 1) {
+            memcpy(dst, src[0], frames * sizeof(float));
+            return;
+        }
+
+        for (size_t c = 0; c < channels; c++) {
+            const float* plane = src[c];
+            for (size_t i = 0; i < frames; i++) {
+                dst[i * channels + c] = plane[i];
+            }
+        }
+    }
+
+    void packInt16Dither(const float* src, short* dst, size_t count, uint64_t position)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const float v = src[i] * INT16_SCALE + ditherNoise(position + i);
+            dst[i] = static_cast<short>(std::lrint(std::min(std::max(v, -32768.0f), 32767.0f)));
+        }
+    }
+
+    void packInt24(const float* src, unsigned char* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const long v = std::lrint(std::min(std::max(src[i] * INT24_SCALE, -8388608.0f), 8388607.0f));
+            dst[3 * i] = static_cast<unsigned char>(v);
+            dst[3 * i + 1] = static_cast<unsigned char>(v >> 8);
+            dst[3 * i + 2] = static_cast<unsigned char>(v >> 16);
+        }
+    }
+
+    void packInt32(const float* src, int32_t* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = static_cast<int32_t>(std::lrint(std::min(std::max(src[i] * INT32_SCALE, -INT32_SCALE), INT32_CEILING)));
+        }
+    }
+
+    void unpackInt16(const short* src, float* dst, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = src[i];
+        }
+    }
+
+    void polyphaseFloat(const float* src, float* dst, size_t count, const float* bank, size_t taps, uint32_t phase,
+        uint32_t interpolation, uint32_t decimation)
+    {
+        for (size_t i = 0; i < count; i++) {
+            const float* h = bank + size_t(phase) * taps;
+            float sum = 0.0f;
+            for (size_t k = 0; k < taps; k++) {
+                sum += h[k] * src[k];
+            }
+            dst[i] = sum;
+
+            phase += decimation;
+            src += phase / interpolation;
+            phase %= interpolation;
+        }
+    }
+
+    void additiveFloat(float* dst, size_t count, const double* phase, const double* increment, const float* amplitude, size_t numOscillators)
+    {
+        //one rotating phasor per oscillator instead of a sin() per sample
+        for (size_t k = 0; k < numOscillators; k++) {
+            double s = amplitude[k] * std::sin(TWO_PI * phase[k]);
+            double c = amplitude[k] * std::cos(TWO_PI * phase[k]);
+            const double rs = std::sin(TWO_PI * increment[k]);
+            const double rc = std::cos(TWO_PI * increment[k]);
+
+            for (size_t i = 0; i < count; i++) {
+                dst[i] += static_cast<float>(s);
+                const double next = s * rc + c * rs;
+                c = c * rc - s * rs;
+                s = next;
+            }
+        }
+    }
+
+    void peakInt16(const short* src, size_t count, short* low, short* high, int64_t* squares)
+    {
+        short lo = *low;
+        short hi = *high;
+        int64_t sum = 0;
+        for (size_t i = 0; i < count; i++) {
+            lo = std::min(lo, src[i]);
+            hi = std::max(hi, src[i]);
+            sum += int32_t(src[i]) * src[i];
+        }
+        *low = lo;
+        *high = hi;
+        *squares += sum;
+    }
+
+    void peakFloat(const float* src, size_t count, float* low, float* high, double* squares)
+    {
+        float lo = *low;
+        float hi = *high;
+        double sum = 0.0;
+        for (size_t i = 0; i < count; i++) {
+            lo = std::min(lo, src[i]);
+            hi = std::max(hi, src[i]);
+            sum += double(src[i]) * src[i];
+        }
+        *low = lo;
+        *high = hi;
+        *squares += sum;
+    }
+}
+
+const KernelTable SCALAR_KERNELS = {
+    "scalar",
+    sineInt16,
+    sineFloat,
+    packInt16,
+    mixAverageInt16,
+    mixAddInt16,
+    accumulateInt16,
+    addInt32,
+    packAccumulatorInt16,
+    deinterleaveInt16,
+    interleaveInt16,
+    accumulateInt16Float,
+    interleaveFloat,
+    packInt16Dither,
+    packInt24,
+    packInt32,
+    unpackInt16,
+    polyphaseFloat,
+    additiveFloat,
+    wavetableInt16,
+    wavetableFloat,
+    peakInt16,
+    peakFloat,
+};
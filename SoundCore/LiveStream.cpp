@@ -0,0 +1,274 @@
+#include "LiveStream.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#endif
+
+namespace
+{
+    constexpr int HISTOGRAM_BAR = 40;               // characters of the longest bar in a report
+
+    //a side that found the ring full or empty: yield for a while, then sleep so a long wait doesn't burn a core
+    void idle(int& spins)
+    {
+        if (spins < LIVE_SPIN_YIELDS) {
+            spins++;
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(std::chrono::microseconds(LIVE_IDLE_MICROSECONDS));
+        }
+    }
+
+    double microseconds(std::chrono::steady_clock::duration d)
+    {
+        return std::chrono::duration<double, std::micro>(d).count();
+    }
+
+    //bucket 0 is under 1 us, bucket b covers [2^(b-1), 2^b) and the last one everything above
+    double bucketEdge(size_t bucket)
+    {
+        return std::ldexp(1.0, static_cast<int>(bucket));
+    }
+}
+
+bool parseLiveOption(int argc, char* argv[], int& i, LiveOptions& options)
+{
+    if (strcmp(argv[i], "--realtime") == 0) {
+        options.paced = true;
+        return true;
+    }
+    if (i + 1 >= argc) {
+        return false;
+    }
+
+    if (strcmp(argv[i], "--live") == 0) {
+        options.target = argv[++i];
+        return true;
+    }
+    if (strcmp(argv[i], "--block") == 0) {
+        const long frames = atol(argv[i + 1]);
+        if (frames < long(LIVE_MIN_BLOCK_FRAMES) || frames > long(LIVE_MAX_BLOCK_FRAMES)) {
+            std::cerr << "Error: --block takes " << LIVE_MIN_BLOCK_FRAMES << " to " << LIVE_MAX_BLOCK_FRAMES << " frames" << std::endl;
+            return false;
+        }
+        options.blockFrames = static_cast<size_t>(frames);
+        i++;
+        return true;
+    }
+    return false;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// DurationHistogram
+
+void DurationHistogram::add(double microseconds)
+{
+    size_t bucket = 0;
+    if (microseconds >= 1.0) {
+        bucket = std::min<size_t>(static_cast<size_t>(std::ilogb(microseconds)) + 1, LIVE_HISTOGRAM_BUCKETS - 1);
+    }
+    counts[bucket]++;
+    total++;
+    maxMicroseconds = std::max(maxMicroseconds, microseconds);
+}
+
+double DurationHistogram::percentile(double fraction) const
+{
+    const uint64_t rank = static_cast<uint64_t>(std::ceil(fraction * total));
+    uint64_t seen = 0;
+    for (size_t b = 0; b < LIVE_HISTOGRAM_BUCKETS; b++) {
+        seen += counts[b];
+        if (seen >= rank && seen > 0) {
+            return b + 1 == LIVE_HISTOGRAM_BUCKETS ? maxMicroseconds : bucketEdge(b);
+        }
+    }
+    return 0;
+}
+
+void DurationHistogram::print(std::ostream& out, const char* title) const
+{
+    out << title << ": p50 < " << static_cast<uint64_t>(percentile(0.5)) << " us, p99 < " << static_cast<uint64_t>(percentile(0.99))
+        << " us, max " << static_cast<uint64_t>(maxMicroseconds) << " us\n";
+
+    const uint64_t largest = *std::max_element(counts, counts + LIVE_HISTOGRAM_BUCKETS);
+    for (size_t b = 0; b < LIVE_HISTOGRAM_BUCKETS; b++) {
+        if (counts[b] == 0) {
+            continue;
+        }
+        out << "  " << std::setw(8) << (b == 0 ? 0 : static_cast<uint64_t>(bucketEdge(b - 1))) << " - ";
+        if (b + 1 == LIVE_HISTOGRAM_BUCKETS) {
+            out << std::setw(8) << "" << "   ";
+        } else {
+            out << std::setw(8) << static_cast<uint64_t>(bucketEdge(b)) << " us";
+        }
+        out << std::setw(10) << counts[b] << " " << std::string(static_cast<size_t>(HISTOGRAM_BAR * counts[b] / largest), '#') << "\n";
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// LiveStream
+
+LiveStream::LiveStream(const WaveFormat& format, size_t blockFrames, bool paced)
+    : format_(format), blockFrames_(std::min(std::max(blockFrames, LIVE_MIN_BLOCK_FRAMES), LIVE_MAX_BLOCK_FRAMES)), paced_(paced)
+{
+}
+
+LiveStream::~LiveStream()
+{
+    if (ownsOut_) {
+        fclose(out_);
+    }
+}
+
+bool LiveStream::open(const char* target)
+{
+    if (strcmp(target, "-") == 0) {
+        out_ = stdout;
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    } else {
+        out_ = fopen(target, "wb");
+        if (!out_) {
+            std::cerr << "Error: could not open the live stream " << target << std::endl;
+            return false;
+        }
+        ownsOut_ = true;
+    }
+
+#ifndef _WIN32
+    //a reader that goes away should fail the next write, not kill the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    //every block goes out the moment it is written, nothing waits in stdio
+    setvbuf(out_, nullptr, _IONBF, 0);
+
+    unsigned char header[WAVE_STREAM_HEADER_SIZE];
+    return write(header, buildStreamHeader(format_, header));
+}
+
+bool LiveStream::write(const void* data, size_t bytes)
+{
+    if (fwrite(data, 1, bytes, out_) != bytes) {
+        std::cerr << "Error: the live stream reader went away (" << strerror(errno) << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool LiveStream::run(uint64_t numFrames, const Render& render)
+{
+    const size_t frameSize = format_.blockAlign();
+    SpscRing ring(LIVE_RING_BLOCKS, blockFrames_ * frameSize);
+    published_.assign(LIVE_RING_BLOCKS + 1, Clock::time_point());
+    rendered_ = false;
+    failed_ = false;
+
+    std::thread output([this, &ring] { drain(ring); });
+
+    //this is the DSP thread, it only ever waits for a free slot
+    bool ok = true;
+    uint64_t index = 0;
+    for (uint64_t first = 0; first < numFrames; first += blockFrames_, index++) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(blockFrames_, numFrames - first));
+
+        char* block;
+        int spins = 0;
+        while (!(block = ring.acquire()) && !failed_.load(std::memory_order_relaxed)) {
+            idle(spins);
+        }
+        if (!block) {
+            break;
+        }
+
+        const Clock::time_point start = Clock::now();
+        if (!render(first, n, block)) {
+            ok = false;
+            break;
+        }
+        const Clock::time_point end = Clock::now();
+        renderTimes_.add(microseconds(end - start));
+
+        //the ring's release store publishes the time stamp along with the samples
+        published_[index % published_.size()] = end;
+        ring.publish(n * frameSize);
+    }
+
+    rendered_.store(true, std::memory_order_release);
+    output.join();
+
+    return ok && !failed_;
+}
+
+void LiveStream::drain(SpscRing& ring)
+{
+    const Clock::duration blockTime = std::chrono::duration_cast<Clock::duration>(
+        std::chrono::duration<double>(double(blockFrames_) / format_.sampleRate));
+    Clock::time_point origin;
+
+    for (uint64_t index = 0;; index++) {
+        //block i is due i block durations after the first one went out, as a sound card would take it
+        const Clock::time_point due = origin + blockTime * static_cast<Clock::rep>(index);
+        if (paced_ && index > 0) {
+            std::this_thread::sleep_until(due);
+        }
+
+        size_t bytes = 0;
+        const char* block = ring.front(bytes);
+        const bool waited = block == nullptr;
+        if (!block) {
+            int spins = 0;
+            while (!(block = ring.front(bytes))) {
+                if (rendered_.load(std::memory_order_acquire)) {
+                    //the last publish happened before the flag, look once more
+                    block = ring.front(bytes);
+                    break;
+                }
+                idle(spins);
+            }
+            if (!block) {
+                return;
+            }
+        }
+
+        //an underrun is the ring running dry past a block's due time, a reader slower than the clock is not one
+        const Clock::time_point now = Clock::now();
+        if (index == 0) {
+            origin = now;
+        } else if (waited && now > due) {
+            underruns_++;
+            //the schedule moves with the late block, the following ones aren't all late because of it
+            origin = now - blockTime * static_cast<Clock::rep>(index);
+        }
+
+        if (!write(block, bytes)) {
+            failed_ = true;
+            return;
+        }
+        latencies_.add(microseconds(Clock::now() - published_[index % published_.size()]));
+        ring.release();
+    }
+}
+
+void LiveStream::report(std::ostream& out) const
+{
+    out << "Live stream: " << blocks() << " blocks of " << blockFrames_ << " frames ("
+        << 1000.0 * blockFrames_ / format_.sampleRate << " ms), " << underruns_ << " underruns\n";
+    renderTimes_.print(out, "render time per block");
+    latencies_.print(out, "latency per block, rendered to written");
+    out.flush();
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <ostream>
+#include <vector>
+
+#include "SpscRing.h"
+#include "WaveFile.h"
+
+constexpr size_t LIVE_BLOCK_FRAMES = 1024;          // frames per block by default, 23 ms at 44.1 kHz
+constexpr size_t LIVE_MIN_BLOCK_FRAMES = 64;
+constexpr size_t LIVE_MAX_BLOCK_FRAMES = 16384;
+constexpr size_t LIVE_RING_BLOCKS = 8;              // blocks between the DSP and the output thread, the latency bound
+constexpr size_t LIVE_HISTOGRAM_BUCKETS = 22;       // under 1 us, then powers of two up to a second and over
+constexpr int LIVE_SPIN_YIELDS = 64;                // yields of a thread that found the ring full or empty before it sleeps
+constexpr int LIVE_IDLE_MICROSECONDS = 100;         // and its sleeps after that
+
+// what the --live, --block and --realtime options of the programs ask for
+struct LiveOptions
+{
+    const char* target = nullptr;                   // nullptr = write the usual file
+    size_t blockFrames = LIVE_BLOCK_FRAMES;
+    bool paced = false;
+};
+
+// takes argv[i] if it is "--live target" ("-" for stdout), "--block frames" or "--realtime", moving 'i' onto
+// the option's value. False if argv[i] is something else or its value is missing or out of range
+bool parseLiveOption(int argc, char* argv[], int& i, LiveOptions& options);
+
+// power of two histogram of per block durations
+struct DurationHistogram
+{
+    uint64_t counts[LIVE_HISTOGRAM_BUCKETS] = {};
+    uint64_t total = 0;
+    double maxMicroseconds = 0;
+
+    void add(double microseconds);
+
+    // the upper edge of the bucket holding the 'fraction' quantile, in microseconds
+    double percentile(double fraction) const;
+
+    // the quantiles, the maximum and one line per non-empty bucket
+    void print(std::ostream& out, const char* title) const;
+};
+
+// emits a signal in fixed-size blocks to stdout or a FIFO as each one is rendered, instead of a file written
+// at the end. The calling thread renders (the DSP thread) into an SpscRing that an output thread drains with
+// blocking writes, so a slow reader holds the renderer back by at most LIVE_RING_BLOCKS blocks. A slow renderer
+// shows up as underruns: the ring ran dry and a block went out after the sample clock said it was due
+class LiveStream
+{
+public:
+    // renders frames [first, first + frames) as interleaved samples of the stream's format into 'block',
+    // false stops the stream
+    using Render = std::function<bool(uint64_t first, size_t frames, char* block)>;
+
+    // 'paced' writes block i no earlier than i block durations after the first, the way a sound card takes them,
+    // so a reader that takes everything at once still sees real-time delivery
+    LiveStream(const WaveFormat& format, size_t blockFrames = LIVE_BLOCK_FRAMES, bool paced = false);
+    ~LiveStream();
+
+    LiveStream(const LiveStream&) = delete;
+    LiveStream& operator=(const LiveStream&) = delete;
+
+    // "-" is stdout, anything else a path opened for writing (for a FIFO that waits until a reader opens it).
+    // The stream starts with a RIFF header of unknown length (buildStreamHeader)
+    bool open(const char* target);
+
+    // streams 'numFrames' frames, false if rendering stopped it or the reader went away
+    bool run(uint64_t numFrames, const Render& render);
+
+    size_t blockFrames() const { return blockFrames_; }
+    uint64_t blocks() const { return renderTimes_.total; }
+    uint64_t underruns() const { return underruns_; }
+
+    const DurationHistogram& renderTimes() const { return renderTimes_; }   // render callback per block
+    const DurationHistogram& latencies() const { return latencies_; }       // from rendered to written per block
+
+    // block count, underruns and both histograms, meant for stderr since stdout may carry the stream
+    void report(std::ostream& out) const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    void drain(SpscRing& ring);
+    bool write(const void* data, size_t bytes);
+
+    WaveFormat format_;
+    size_t blockFrames_;
+    bool paced_;
+    FILE* out_ = nullptr;
+    bool ownsOut_ = false;
+
+    std::vector<Clock::time_point> published_;      // when each ring slot was handed over, by block index
+    std::atomic<bool> rendered_{ false };           // the DSP thread published its last block
+    std::atomic<bool> failed_{ false };             // a write failed, the DSP thread stops
+    uint64_t underruns_ = 0;
+    DurationHistogram renderTimes_;
+    DurationHistogram latencies_;
+};
@@ -0,0 +1,135 @@
+#include "MappedFile.h"
+
+#include <iostream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+bool MappedFile::open(const char* filename, Access access)
+{
+    close();
+    writable_ = access == Access::ReadWrite;
+
+    file_ = CreateFileA(filename, writable_ ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE) {
+        file_ = nullptr;
+        std::cerr << "Error: could not open " << filename << std::endl;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = static_cast<uint64_t>(size.QuadPart);
+    if (size_ == 0) {
+        return true;
+    }
+
+    mapping_ = CreateFileMappingA(file_, nullptr, writable_ ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (mapping_) {
+        data_ = static_cast<char*>(MapViewOfFile(mapping_, writable_ ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    }
+    if (!data_) {
+        std::cerr << "Error: could not map " << filename << std::endl;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool MappedFile::flush()
+{
+    return !data_ || !writable_ || (FlushViewOfFile(data_, 0) && FlushFileBuffers(file_));
+}
+
+void MappedFile::close()
+{
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mapping_) {
+        CloseHandle(mapping_);
+    }
+    if (file_) {
+        CloseHandle(file_);
+    }
+    data_ = nullptr;
+    mapping_ = nullptr;
+    file_ = nullptr;
+    size_ = 0;
+}
+
+#else
+
+bool MappedFile::open(const char* filename, Access access)
+{
+    close();
+    writable_ = access == Access::ReadWrite;
+
+    fd_ = ::open(filename, writable_ ? O_RDWR : O_RDONLY);
+    if (fd_ < 0) {
+        std::cerr << "Error: could not open " << filename << std::endl;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd_, &info) != 0) {
+        std::cerr << "Error: could not stat " << filename << std::endl;
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(info.st_size);
+    if (size_ == 0) {
+        return true;
+    }
+
+    int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+    //fault every page in now with large reads instead of one fault per page during the mix
+    flags |= MAP_POPULATE;
+#endif
+
+    void* p = mmap(nullptr, size_, writable_ ? PROT_READ | PROT_WRITE : PROT_READ, flags, fd_, 0);
+    if (p == MAP_FAILED) {
+        std::cerr << "Error: could not map " << filename << std::endl;
+        close();
+        return false;
+    }
+    data_ = static_cast<char*>(p);
+
+    //one front to back pass: aggressive read-ahead and pages can be dropped once passed
+    madvise(data_, size_, MADV_SEQUENTIAL);
+
+    return true;
+}
+
+bool MappedFile::flush()
+{
+    return !data_ || !writable_ || msync(data_, size_, MS_SYNC) == 0;
+}
+
+void MappedFile::close()
+{
+    if (data_) {
+        munmap(data_, size_);
+    }
+    if (fd_ >= 0) {
+        ::close(fd_);
+    }
+    data_ = nullptr;
+    fd_ = -1;
+    size_ = 0;
+}
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// maps a whole file into memory so samples can be used in place without read/write copies
+class MappedFile
+{
+public:
+    enum class Access
+    {
+        Read,
+        ReadWrite       // changes go straight to the file, it has to exist with its final size
+    };
+
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // maps the file with its pages faulted in up front (MAP_POPULATE) and tuned for one sequential pass
+    bool open(const char* filename, Access access = Access::Read);
+    void close();
+
+    // forces dirty pages to disk, other readers of the file see the changes without it
+    bool flush();
+
+    char* data() { return data_; }
+    const char* data() const { return data_; }
+    uint64_t size() const { return size_; }
+
+private:
+    char* data_ = nullptr;
+    uint64_t size_ = 0;
+    bool writable_ = false;
+#ifdef _WIN32
+    void* file_ = nullptr;
+    void* mapping_ = nullptr;
+#else
+    int fd_ = -1;
+#endif
+};
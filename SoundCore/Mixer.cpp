@@ -0,0 +1,609 @@
+#include "Mixer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+
+#include "BlockPipeline.h"
+#include "Kernels.h"
+#include "Overview.h"
+#include "Profiler.h"
+
+namespace
+{
+    struct MixJob
+    {
+        const short* const* sources;
+        const short* gains;
+        ThreadPool* pool;
+        bool splitTracks;
+    };
+
+    //acc = mix of tracks [first, last) over samples [begin, begin + count)
+    void mixRange(const MixJob& job, size_t first, size_t last, uint64_t begin, size_t count, int32_t* acc)
+    {
+        const KernelTable& k = kernels();
+
+        if (!job.splitTracks || last - first <= MIX_LEAF_TRACKS) {
+            std::fill(acc, acc + count, 0);
+            for (size_t t = first; t < last; t++) {
+                k.accumulateInt16(job.sources[t] + begin, acc, count, job.gains[t]);
+            }
+            return;
+        }
+
+        //both halves at once, the right one into its own accumulator that is then folded into ours
+        const size_t middle = first + (last - first) / 2;
+        std::vector<int32_t> right(count);
+        job.pool->parallelFor(0, 2, 1, [&](uint64_t half, uint64_t) {
+            if (half == 0) {
+                mixRange(job, first, middle, begin, count, acc);
+            } else {
+                mixRange(job, middle, last, begin, count, right.data());
+            }
+        });
+        k.addInt32(right.data(), acc, count);
+    }
+
+    //the blocks of mixInterleaved, with Channels 0 for a count only known at runtime. A mono track already is its
+    //one plane, it is mixed straight from the source and converted straight from the bus with no (de)interleave
+    template <size_t Channels>
+    void mixInterleavedBlocks(const short* const* sources, const float* gains, size_t numTracks, size_t numChannels, void* dst,
+        SampleFormat format, uint64_t begin, uint64_t end)
+    {
+        ScopedStage stage(Stage::Mix);
+        const size_t channels = Channels ? Channels : numChannels;
+        const size_t frameSize = channels * makeWaveFormat(format, 1, 0).blockAlign();
+        std::vector<const short*> channelSources(numTracks);
+
+        if constexpr (Channels == 1) {
+            AlignedBuffer<float> mixed(MIX_BLOCK_SAMPLES);
+            for (uint64_t block = begin; block < end; block += MIX_BLOCK_SAMPLES) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_BLOCK_SAMPLES, end - block));
+                for (size_t t = 0; t < numTracks; t++) {
+                    channelSources[t] = sources[t] + block;
+                }
+                mixBus(channelSources.data(), gains, numTracks, mixed.data(), n, nullptr);
+                convertSamples(mixed.data(), static_cast<char*>(dst) + block * frameSize, n, format, block);
+            }
+        } else {
+            //plane t * channels + c holds channel c of track t
+            PlanarBuffer planes(numTracks * channels, MIX_BLOCK_SAMPLES);
+            FloatPlanarBuffer mixed(channels, MIX_BLOCK_SAMPLES);
+            AlignedBuffer<float> bus(channels * MIX_BLOCK_SAMPLES);
+
+            for (uint64_t block = begin; block < end; block += MIX_BLOCK_SAMPLES) {
+                const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_BLOCK_SAMPLES, end - block));
+                for (size_t t = 0; t < numTracks; t++) {
+                    kernels().deinterleaveInt16(sources[t] + block * channels, planes.planes() + t * channels, channels, n);
+                }
+                for (size_t c = 0; c < channels; c++) {
+                    for (size_t t = 0; t < numTracks; t++) {
+                        channelSources[t] = planes.channel(t * channels + c);
+                    }
+                    mixBus(channelSources.data(), gains, numTracks, mixed.channel(c), n, nullptr);
+                }
+                kernels().interleaveFloat(mixed.planes(), bus.data(), channels, n);
+                convertSamples(bus.data(), static_cast<char*>(dst) + block * frameSize, n * channels, format, block * channels);
+            }
+        }
+    }
+}
+
+namespace
+{
+    constexpr char PATCH_MAGIC[4] = { 'S', 'B', 'L', 'K' };
+    constexpr uint32_t PATCH_VERSION = 1;
+
+    //the file the block hashes were taken of, any write to it since makes them worthless
+    struct PatchStamp
+    {
+        uint64_t setup;                             // hash of what the mix depends on besides the samples
+        uint64_t size;
+        int64_t time;
+    };
+
+    bool stampOf(const char* filename, uint64_t setup, PatchStamp& stamp)
+    {
+        std::error_code error;
+        stamp.setup = setup;
+        stamp.size = std::filesystem::file_size(filename, error);
+        stamp.time = error ? 0 : static_cast<int64_t>(std::filesystem::last_write_time(filename, error).time_since_epoch().count());
+        return !error;
+    }
+
+    template <typename T>
+    void put(std::ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+
+    template <typename T>
+    bool get(std::ifstream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof value));
+    }
+
+    //"SBLK", the version and block frames (uint32), the stamp and the block count (uint64 each), then one XXH64 per
+    //block. Every hash stays 0 (unknown) unless the file holds hashes taken with this stamp
+    void loadBlockHashes(const std::string& filename, const PatchStamp& stamp, std::vector<uint64_t>& hashes)
+    {
+        std::ifstream in(filename, std::ios::binary);
+        char magic[4];
+        uint32_t version;
+        uint32_t blockFrames;
+        PatchStamp stored;
+        uint64_t count;
+        if (!in.read(magic, sizeof magic) || memcmp(magic, PATCH_MAGIC, sizeof magic) != 0 || !get(in, version) || version != PATCH_VERSION ||
+            !get(in, blockFrames) || blockFrames != MIX_STREAM_BLOCK_SAMPLES || !get(in, stored.setup) || !get(in, stored.size) ||
+            !get(in, stored.time) || !get(in, count) || stored.setup != stamp.setup || stored.size != stamp.size || stored.time != stamp.time ||
+            count != hashes.size() || !in.read(reinterpret_cast<char*>(hashes.data()), static_cast<std::streamsize>(count * sizeof(uint64_t)))) {
+            std::fill(hashes.begin(), hashes.end(), 0);
+        }
+    }
+
+    bool saveBlockHashes(const std::string& filename, const PatchStamp& stamp, const std::vector<uint64_t>& hashes)
+    {
+        std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+        out.write(PATCH_MAGIC, sizeof PATCH_MAGIC);
+        put(out, PATCH_VERSION);
+        put(out, uint32_t(MIX_STREAM_BLOCK_SAMPLES));
+        put(out, stamp.setup);
+        put(out, stamp.size);
+        put(out, stamp.time);
+        put(out, uint64_t(hashes.size()));
+        out.write(reinterpret_cast<const char*>(hashes.data()), static_cast<std::streamsize>(hashes.size() * sizeof(uint64_t)));
+        if (!out) {
+            std::cerr << "Error: could not write the block hashes " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+}
+
+bool parseMixTracks(int argc, char* argv[], int first, const std::vector<std::string>& defaults, std::vector<MixTrack>& tracks)
+{
+    tracks.clear();
+    std::vector<bool> hasGain;
+
+    for (int i = first; i < argc; i++) {
+        MixTrack track;
+        const char* at = strrchr(argv[i], '@');
+        if (at) {
+            char* end;
+            track.gain = strtod(at + 1, &end);
+            if (end == at + 1 || *end != '\0') {
+                std::cerr << "Error: bad gain in " << argv[i] << std::endl;
+                return false;
+            }
+            track.filename.assign(argv[i], at - argv[i]);
+        } else {
+            track.filename = argv[i];
+        }
+        tracks.push_back(track);
+        hasGain.push_back(at != nullptr);
+    }
+
+    if (tracks.empty()) {
+        for (const std::string& filename : defaults) {
+            tracks.push_back({ filename, 0.0 });
+            hasGain.push_back(false);
+        }
+    }
+
+    for (size_t i = 0; i < tracks.size(); i++) {
+        if (!hasGain[i]) {
+            tracks[i].gain = 1.0 / tracks.size();
+        }
+    }
+
+    return !tracks.empty();
+}
+
+bool addMixKey(RenderKey& key, const std::vector<MixTrack>& tracks, uint32_t rate, SampleFormat format, WaveContainer container)
+{
+    key.add("kernels", kernels().name).add("rate", rate).add("format", sampleFormatName(format)).add("container", waveContainerName(container));
+    for (const MixTrack& track : tracks) {
+        if (!key.addFile("track", track.filename.c_str())) {
+            return false;
+        }
+        key.add("gain", track.gain);
+    }
+    return true;
+}
+
+short mixGain(double gain)
+{
+    const long fixed = std::lrint(gain * (1 << MIX_GAIN_BITS));
+    return static_cast<short>(std::min(std::max(fixed, -32768L), 32767L));
+}
+
+float busGain(double gain)
+{
+    return static_cast<float>(gain / 32768.0);
+}
+
+void mixTracks(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count, ThreadPool* pool)
+{
+    const uint64_t numBlocks = (count + MIX_BLOCK_SAMPLES - 1) / MIX_BLOCK_SAMPLES;
+    const MixJob job = { sources, gains, pool, pool && numBlocks < pool->size() };
+
+    auto mixBlocks = [&job, numTracks, dst](uint64_t begin, uint64_t end) {
+        ScopedStage stage(Stage::Mix);
+        std::vector<int32_t> acc(MIX_BLOCK_SAMPLES);
+        for (uint64_t block = begin; block < end; block += MIX_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_BLOCK_SAMPLES, end - block));
+            mixRange(job, 0, numTracks, block, n, acc.data());
+            kernels().packAccumulatorInt16(acc.data(), dst + block, n);
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(0, count, MIX_BLOCK_SAMPLES, mixBlocks);
+    } else {
+        mixBlocks(0, count);
+    }
+}
+
+void mixBus(const short* const* sources, const float* gains, size_t numTracks, float* dst, uint64_t count, ThreadPool* pool)
+{
+    //the bus is its own accumulator, every block is cleared and the tracks added in place
+    auto mixBlocks = [=](uint64_t begin, uint64_t end) {
+        ScopedStage stage(Stage::Mix);
+        for (uint64_t block = begin; block < end; block += MIX_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_BLOCK_SAMPLES, end - block));
+            std::fill(dst + block, dst + block + n, 0.0f);
+            for (size_t t = 0; t < numTracks; t++) {
+                kernels().accumulateInt16Float(sources[t] + block, dst + block, n, gains[t]);
+            }
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(0, count, MIX_BLOCK_SAMPLES, mixBlocks);
+    } else {
+        mixBlocks(0, count);
+    }
+}
+
+void mixPlanar(const std::vector<PlanarBuffer>& tracks, const float* gains, FloatPlanarBuffer& dst, uint64_t frames, ThreadPool* pool)
+{
+    std::vector<const short*> sources(tracks.size());
+    for (size_t c = 0; c < dst.channels(); c++) {
+        for (size_t t = 0; t < tracks.size(); t++) {
+            sources[t] = tracks[t].channel(c);
+        }
+        mixBus(sources.data(), gains, sources.size(), dst.channel(c), frames, pool);
+    }
+}
+
+void mixInterleaved(const short* const* sources, const float* gains, size_t numTracks, size_t channels, void* dst, SampleFormat format,
+    uint64_t frames, ThreadPool* pool)
+{
+    auto mixBlocks = [=](uint64_t begin, uint64_t end) {
+        if (channels == 1) {
+            mixInterleavedBlocks<1>(sources, gains, numTracks, channels, dst, format, begin, end);
+        } else {
+            mixInterleavedBlocks<0>(sources, gains, numTracks, channels, dst, format, begin, end);
+        }
+    };
+
+    if (pool) {
+        pool->parallelFor(0, frames, MIX_BLOCK_SAMPLES, mixBlocks);
+    } else {
+        mixBlocks(0, frames);
+    }
+}
+
+bool streamTracks(std::vector<TrackReader>& inputs, const float* gains, WaveWriter& out, uint64_t count, ThreadPool* pool)
+{
+    const size_t numTracks = inputs.size();
+    const size_t channels = inputs[0].format().numChannels;
+    const size_t outFrameSize = out.format().blockAlign();
+    const uint64_t numBlocks = (count + MIX_STREAM_BLOCK_SAMPLES - 1) / MIX_STREAM_BLOCK_SAMPLES;
+
+    SampleFormat format;
+    if (!sampleFormatOf(out.format(), format)) {
+        std::cerr << "Error: the output file has no bus sample format" << std::endl;
+        return false;
+    }
+
+    //no pool: one block of every track and one of output, reused until the end
+    if (!pool) {
+        std::vector<PlanarBuffer> samples(numTracks);
+        for (PlanarBuffer& track : samples) {
+            track.allocate(channels, MIX_STREAM_BLOCK_SAMPLES);
+        }
+        FloatPlanarBuffer mixed(channels, MIX_STREAM_BLOCK_SAMPLES);
+
+        for (uint64_t block = 0; block < numBlocks; block++) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_STREAM_BLOCK_SAMPLES, count - block * MIX_STREAM_BLOCK_SAMPLES));
+            for (size_t t = 0; t < numTracks; t++) {
+                if (inputs[t].readPlanar(samples[t], n) != n) {
+                    std::cerr << "Error: input track " << t << " ended early" << std::endl;
+                    return false;
+                }
+            }
+            mixPlanar(samples, gains, mixed, n, nullptr);
+            if (!out.writePlanar(mixed, n)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //workers may finish blocks out of order, each reader is seeked under its own lock
+    std::vector<std::mutex> locks(numTracks);
+    std::atomic<bool> readFailed{ false };
+
+    BlockPipeline pipeline(MIX_STREAM_BLOCK_SAMPLES * outFrameSize, 0, *pool);
+
+    //one block of every track, the float planes and the bus per pipeline slot, reused by every block that slot takes
+    struct Scratch
+    {
+        std::vector<PlanarBuffer> samples;
+        FloatPlanarBuffer mixed;
+        AlignedBuffer<float> bus;
+    };
+    std::vector<Scratch> scratch(pipeline.depth());
+    for (Scratch& slot : scratch) {
+        slot.samples.resize(numTracks);
+        for (PlanarBuffer& track : slot.samples) {
+            track.allocate(channels, MIX_STREAM_BLOCK_SAMPLES);
+        }
+        slot.mixed.allocate(channels, MIX_STREAM_BLOCK_SAMPLES);
+        slot.bus.allocate(channels * MIX_STREAM_BLOCK_SAMPLES);
+    }
+
+    const bool ok = pipeline.run(numBlocks,
+        [&](uint64_t index, char* block, size_t) -> size_t {
+            const uint64_t first = index * MIX_STREAM_BLOCK_SAMPLES;
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_STREAM_BLOCK_SAMPLES, count - first));
+            Scratch& slot = scratch[index % scratch.size()];
+
+            for (size_t t = 0; t < numTracks; t++) {
+                std::lock_guard<std::mutex> lock(locks[t]);
+                //blocks mostly come in order, only seek (and drop the read buffer) when one didn't
+                const bool inPlace = inputs[t].position() == first;
+                if ((!inPlace && !inputs[t].seekFrame(first)) || inputs[t].readPlanar(slot.samples[t], n) != n) {
+                    readFailed = true;
+                    return 0;
+                }
+            }
+            mixPlanar(slot.samples, gains, slot.mixed, n, nullptr);
+            kernels().interleaveFloat(slot.mixed.planes(), slot.bus.data(), channels, n);
+            convertSamples(slot.bus.data(), block, n * channels, format, first * channels);
+            return n * outFrameSize;
+        },
+        [&](uint64_t, const char* block, size_t bytes) {
+            return bytes != 0 && out.write(block, bytes);
+        });
+
+    if (readFailed) {
+        std::cerr << "Error: an input track ended early" << std::endl;
+    }
+    return ok && !readFailed;
+}
+
+bool streamTracksLive(std::vector<TrackReader>& inputs, const float* gains, LiveStream& live, SampleFormat format, uint64_t count)
+{
+    const size_t numTracks = inputs.size();
+    const size_t channels = inputs[0].format().numChannels;
+    const size_t blockFrames = live.blockFrames();
+
+    //one block of everything, reused for every render
+    std::vector<PlanarBuffer> samples(numTracks);
+    for (PlanarBuffer& track : samples) {
+        track.allocate(channels, blockFrames);
+    }
+    FloatPlanarBuffer mixed(channels, blockFrames);
+    AlignedBuffer<float> bus(channels * blockFrames);
+
+    return live.run(count, [&](uint64_t first, size_t n, char* block) {
+        for (size_t t = 0; t < numTracks; t++) {
+            if (inputs[t].readPlanar(samples[t], n) != n) {
+                std::cerr << "Error: input track " << t << " ended early" << std::endl;
+                return false;
+            }
+        }
+        mixPlanar(samples, gains, mixed, n, nullptr);
+        kernels().interleaveFloat(mixed.planes(), bus.data(), channels, n);
+        convertSamples(bus.data(), block, n * channels, format, first * channels);
+        return true;
+    });
+}
+
+bool patchTracks(std::vector<TrackReader>& inputs, const float* gains, const char* filename, const WaveFormat& format, WaveContainer container,
+    uint64_t count, uint64_t first, uint64_t last, bool detect, ThreadPool* pool, PatchStats& stats)
+{
+    const size_t numTracks = inputs.size();
+    const size_t channels = format.numChannels;
+    const size_t frameSize = format.blockAlign();
+    const uint64_t numBlocks = (count + MIX_STREAM_BLOCK_SAMPLES - 1) / MIX_STREAM_BLOCK_SAMPLES;
+    stats = PatchStats();
+    stats.blocks = numBlocks;
+
+    SampleFormat sampleFormat;
+    if (container == WaveContainer::FLAC || !sampleFormatOf(format, sampleFormat)) {
+        std::cerr << "Error: only uncompressed files of a bus sample format can be patched" << std::endl;
+        return false;
+    }
+
+    //a block's hash starts from everything else the mix depends on, so a new gain or kernel table changes them all
+    RenderKey setup("patch");
+    setup.add("kernels", kernels().name).add("rate", format.sampleRate).add("format", sampleFormatName(sampleFormat)).add("channels", channels).add("frames", count);
+    for (size_t t = 0; t < numTracks; t++) {
+        setup.add("gain", double(gains[t]));
+    }
+    const uint64_t setupHash = hash64(setup.text().data(), setup.text().size());
+
+    //the file has to hold a mix of this format and length already, else it is sized anew and mixed whole
+    uint64_t dataOffset = 0;
+    std::error_code error;
+    WaveReader existing;
+    if (std::filesystem::exists(filename, error) && existing.open(filename) && !existing.compressed() && existing.numFrames() == count &&
+        existing.format().audioFormat == format.audioFormat && existing.format().bitsPerSample == format.bitsPerSample &&
+        existing.format().numChannels == format.numChannels && existing.format().sampleRate == format.sampleRate) {
+        dataOffset = existing.dataOffset();
+    } else {
+        stats.rebuilt = true;
+        first = 0;
+        last = count;
+        detect = false;
+        if (!WaveWriter::preallocate(filename, format, count * frameSize, dataOffset, container)) {
+            return false;
+        }
+    }
+    existing.close();
+
+    const std::string hashFile = std::string(filename) + MIX_PATCH_EXTENSION;
+    std::vector<uint64_t> hashes(numBlocks, 0);
+    PatchStamp stamp;
+    if (!stats.rebuilt && stampOf(filename, setupHash, stamp)) {
+        loadBlockHashes(hashFile, stamp, hashes);
+    }
+
+    //a valid overview index gets the bins of the blocks mixed written over, else one is built over every block
+    //in order, the ones left alone read back from the file
+    const std::string overviewFile = std::string(filename) + OVERVIEW_EXTENSION;
+    const bool overviews = OverviewBuilder::enabled();
+    Overview index;
+    const bool patchOverview = overviews && !stats.rebuilt && index.load(overviewFile.c_str()) && index.channels() == channels && index.frames() == count;
+    OverviewBuilder overview;
+    const bool buildOverview = overviews && !patchOverview && overview.start(format);
+    WaveReader previous;
+    if (buildOverview && !previous.open(filename)) {
+        return false;
+    }
+
+    //mixed blocks go out from a ring of buffers, one is only reused once its write is done. They are declared
+    //before the file so they outlive it, closing it waits for the writes still in flight
+    std::vector<AlignedBuffer<char>> blocks;
+    for (size_t i = 0; i < WAVE_QUEUE_BLOCKS; i++) {
+        blocks.emplace_back(MIX_STREAM_BLOCK_SAMPLES * frameSize);
+    }
+    std::vector<size_t> blockBytes(WAVE_QUEUE_BLOCKS, 0);
+
+    AsyncFile out;
+    if (!out.open(filename, AsyncFile::Access::Update, WAVE_QUEUE_BLOCKS)) {
+        return false;
+    }
+
+    std::vector<PlanarBuffer> samples(numTracks);
+    for (PlanarBuffer& track : samples) {
+        track.allocate(channels, MIX_STREAM_BLOCK_SAMPLES);
+    }
+    FloatPlanarBuffer mixed(channels, MIX_STREAM_BLOCK_SAMPLES);
+    AlignedBuffer<float> bus(channels * MIX_STREAM_BLOCK_SAMPLES);
+    AlignedBuffer<char> readBack;
+    if (buildOverview) {
+        readBack.allocate(MIX_STREAM_BLOCK_SAMPLES * frameSize);
+    }
+
+    //waits until the slot's write is done, taking whatever other writes complete first, as WaveWriter::settle does
+    bool ok = true;
+    auto settle = [&](size_t slot) {
+        while (blockBytes[slot] != 0) {
+            uint64_t tag;
+            int64_t result;
+            if (!out.wait(tag, result)) {
+                blockBytes[slot] = 0;
+                return false;
+            }
+            if (result < 0) {
+                std::cerr << "Error: could not write to " << filename << " (" << strerror(static_cast<int>(-result)) << ")" << std::endl;
+                ok = false;
+            } else if (result != static_cast<int64_t>(blockBytes[tag])) {
+                std::cerr << "Error: short write to " << filename << ", the disk may be full" << std::endl;
+                ok = false;
+            }
+            blockBytes[tag] = 0;
+        }
+        return ok;
+    };
+
+    for (uint64_t block = 0; block < numBlocks && ok; block++) {
+        const uint64_t start = block * MIX_STREAM_BLOCK_SAMPLES;
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(MIX_STREAM_BLOCK_SAMPLES, count - start));
+        const char* frames = nullptr;
+
+        //blocks outside the range aren't even read
+        if (start < last && start + n > first) {
+            uint64_t hash = setupHash;
+            for (size_t t = 0; t < numTracks; t++) {
+                if ((inputs[t].position() != start && !inputs[t].seekFrame(start)) || inputs[t].readPlanar(samples[t], n) != n) {
+                    std::cerr << "Error: input track " << t << " ended early" << std::endl;
+                    ok = false;
+                    break;
+                }
+                for (size_t c = 0; c < channels; c++) {
+                    hash = hash64(samples[t].channel(c), n * sizeof(short), hash);
+                }
+            }
+            if (!ok) {
+                break;
+            }
+            stats.read++;
+
+            if (!detect || hash != hashes[block]) {
+                const size_t slot = stats.mixed % WAVE_QUEUE_BLOCKS;
+                if (!settle(slot)) {
+                    break;
+                }
+                char* dst = blocks[slot].data();
+                mixPlanar(samples, gains, mixed, n, pool);
+                kernels().interleaveFloat(mixed.planes(), bus.data(), channels, n);
+                convertSamples(bus.data(), dst, n * channels, sampleFormat, start * channels);
+
+                blockBytes[slot] = n * frameSize;
+                ok = out.queueWrite(dst, blockBytes[slot], dataOffset + start * frameSize, slot) && out.submit();
+                stats.mixed++;
+                frames = dst;
+
+                if (patchOverview) {
+                    OverviewBuilder part;
+                    ok = ok && part.start(format);
+                    part.add(dst, n * frameSize);
+                    ok = ok && part.patch(overviewFile.c_str(), start);
+                }
+            }
+            hashes[block] = hash;
+        }
+
+        if (buildOverview) {
+            if (!frames) {
+                if (!previous.seekFrame(start) || previous.readFrames(readBack.data(), n) != n) {
+                    std::cerr << "Error: could not read " << filename << " back for its overview" << std::endl;
+                    ok = false;
+                    break;
+                }
+                frames = readBack.data();
+            }
+            overview.add(frames, n * frameSize);
+        }
+    }
+
+    //every write is waited for before anything returns, the blocks have to stay put until then
+    for (size_t slot = 0; slot < WAVE_QUEUE_BLOCKS; slot++) {
+        ok = settle(slot) && ok;
+    }
+    out.close();
+    previous.close();
+
+    if (!ok) {
+        std::cerr << "Error: could not patch " << filename << std::endl;
+        return false;
+    }
+    if (buildOverview && !overview.write(overviewFile.c_str())) {
+        return false;
+    }
+
+    //the hashes are stamped with the file as the writes left it
+    return stampOf(filename, setupHash, stamp) && saveBlockHashes(hashFile, stamp, hashes);
+}
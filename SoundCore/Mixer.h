@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "LiveStream.h"
+#include "PlanarBuffer.h"
+#include "RenderCache.h"
+#include "Resampler.h"
+#include "SampleFormat.h"
+#include "ThreadPool.h"
+#include "WaveFile.h"
+
+constexpr size_t MIX_BLOCK_SAMPLES = 1 << 14;      // samples per task, its int32 accumulators stay in L2
+constexpr size_t MIX_LEAF_TRACKS = 4;               // tracks one task accumulates before partial mixes are joined
+constexpr size_t MIX_STREAM_BLOCK_SAMPLES = 1 << 18; // frames per track read, mixed and written at a time when streaming
+constexpr const char* MIX_PATCH_EXTENSION = ".blocks"; // the block hashes patchTracks keeps for "name.wav" are in "name.wav.blocks"
+
+struct MixTrack
+{
+    std::string filename;
+    double gain = 0.0;
+};
+
+// parses argv[first, argc) as "name.wav" or "name.wav@gain" and falls back to 'defaults' when there are none.
+// Tracks without a gain get 1 / number of tracks so the default mix can't clip. False on a bad gain
+bool parseMixTracks(int argc, char* argv[], int first, const std::vector<std::string>& defaults, std::vector<MixTrack>& tracks);
+
+// adds what a bus mix depends on to 'key': the content and gain of every track, the mix rate and the output file.
+// The whole-file, streamed and mapped mixes of 04 and 05 come out sample for sample the same, so they can share
+// the key. False if a track can't be read
+bool addMixKey(RenderKey& key, const std::vector<MixTrack>& tracks, uint32_t rate, SampleFormat format, WaveContainer container);
+
+// linear gain to the Q12 fixed point the mix kernels take, saturated to [-8, 8)
+short mixGain(double gain);
+
+// linear gain to what the float bus kernels take, it also brings 16-bit samples to the bus full scale of 1.0
+float busGain(double gain);
+
+// dst[i] = sum of gains[k] * sources[k][i] saturated to 16 bits, with gains in Q12.
+// Time blocks run in parallel on 'pool' (nullptr = the calling thread only), and when there are fewer
+// blocks than workers the tracks of a block are split too and the partial mixes joined as a tree.
+// The int32 accumulators have headroom for 512 tracks at full gain, 4096 at unity
+void mixTracks(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count, ThreadPool* pool);
+
+// dst[i] = sum of gains[k] * sources[k][i] on the float bus, with gains from busGain. Nothing is rounded
+// or clipped until the bus is converted for output. Time blocks run in parallel on 'pool' as in mixTracks
+void mixBus(const short* const* sources, const float* gains, size_t numTracks, float* dst, uint64_t count, ThreadPool* pool);
+
+// mixBus on every channel plane of 'tracks' into the same plane of 'dst', all with the same channel count
+void mixPlanar(const std::vector<PlanarBuffer>& tracks, const float* gains, FloatPlanarBuffer& dst, uint64_t frames, ThreadPool* pool);
+
+// mixes interleaved tracks of 'channels' channels (a memory mapped file) into interleaved 'format' samples at
+// 'dst'. Every block is split into planes, mixed per channel on the bus, interleaved and converted; mono tracks
+// are mixed and converted in place
+void mixInterleaved(const short* const* sources, const float* gains, size_t numTracks, size_t channels, void* dst, SampleFormat format,
+    uint64_t frames, ThreadPool* pool);
+
+// mixes the first 'count' frames of 16-bit 'inputs', all with the same channel count and mix rate, into 'out'
+// a block at a time, so memory stays a few blocks per worker however long the tracks are. Blocks are read into
+// planes (resampled where a file has another rate), mixed on the bus and converted to the sample format of 'out'
+// on the way out. With a pool the blocks are read and mixed on the workers through a BlockPipeline and written
+// in order, without one the calling thread reuses a single block
+bool streamTracks(std::vector<TrackReader>& inputs, const float* gains, WaveWriter& out, uint64_t count, ThreadPool* pool);
+
+// mixes the first 'count' frames of 'inputs' block by block into 'live' as streamTracks does into a file,
+// 'format' being the samples the stream carries. Everything runs on the DSP thread so the blocks stay small
+bool streamTracksLive(std::vector<TrackReader>& inputs, const float* gains, LiveStream& live, SampleFormat format, uint64_t count);
+
+// what patchTracks did, in blocks of MIX_STREAM_BLOCK_SAMPLES frames
+struct PatchStats
+{
+    uint64_t blocks = 0;                            // in the file
+    uint64_t read = 0;                              // whose tracks were read
+    uint64_t mixed = 0;                             // mixed and written back
+    bool rebuilt = false;                           // the file didn't hold this mix and was sized anew, every block mixed
+};
+
+// brings 'filename', the mix of the first 'count' frames of 'inputs' in 'format', up to date by writing only some of its
+// blocks in place, so the cost follows the size of an edit rather than the length of the file. The blocks overlapping
+// frames [first, last) are read; with 'detect' only those whose tracks hash differently from the hashes kept beside the
+// file are mixed again, without it all of them are. A file that doesn't hold a mix of this format and length is sized
+// anew and mixed whole. Blocks come out sample for sample as streamTracks writes them, and an overview index beside
+// the file (SOUND_OVERVIEW=1) is patched along. Not for FLAC
+bool patchTracks(std::vector<TrackReader>& inputs, const float* gains, const char* filename, const WaveFormat& format, WaveContainer container,
+    uint64_t count, uint64_t first, uint64_t last, bool detect, ThreadPool* pool, PatchStats& stats);
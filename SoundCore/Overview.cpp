@@ -0,0 +1,354 @@
+#include "Overview.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "Kernels.h"
+
+namespace
+{
+    constexpr char OVERVIEW_MAGIC[4] = { 'S', 'P', 'K', 'S' };
+    constexpr float INT16_SCALE = 32768.0f;
+
+    int16_t roundOut(float value, bool up)
+    {
+        const float scaled = up ? std::ceil(value * INT16_SCALE) : std::floor(value * INT16_SCALE);
+        return static_cast<int16_t>(std::min(std::max(scaled, -32768.0f), 32767.0f));
+    }
+
+    template <typename T>
+    void put(std::ofstream& out, const T& value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof value);
+    }
+
+    template <typename T>
+    bool get(std::istream& in, T& value)
+    {
+        return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof value));
+    }
+
+    struct Header
+    {
+        uint16_t channels;
+        uint32_t sampleRate;
+        uint64_t frames;
+        uint32_t binFrames[OVERVIEW_LEVELS];
+        uint64_t bins[OVERVIEW_LEVELS];
+    };
+
+    constexpr size_t HEADER_BYTES = 24 + OVERVIEW_LEVELS * (sizeof(uint32_t) + sizeof(uint64_t));
+
+    //false unless it is an index of this version whose bin counts add up
+    bool readHeader(std::istream& in, Header& header)
+    {
+        char magic[4];
+        uint32_t version;
+        uint16_t levels;
+        if (!in.read(magic, sizeof magic) || memcmp(magic, OVERVIEW_MAGIC, sizeof magic) != 0 || !get(in, version) || version != OVERVIEW_VERSION ||
+            !get(in, header.channels) || !get(in, levels) || levels != OVERVIEW_LEVELS || header.channels == 0 || header.channels > MAX_CHANNELS ||
+            !get(in, header.sampleRate) || !get(in, header.frames)) {
+            return false;
+        }
+        for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+            if (!get(in, header.binFrames[l]) || header.binFrames[l] == 0) {
+                return false;
+            }
+        }
+        for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+            if (!get(in, header.bins[l]) || header.bins[l] != (header.frames + header.binFrames[l] - 1) / header.binFrames[l]) {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// OverviewBuilder
+
+bool OverviewBuilder::enabled()
+{
+    const char* value = std::getenv("SOUND_OVERVIEW");
+    return value && strcmp(value, "1") == 0;
+}
+
+bool OverviewBuilder::start(const WaveFormat& format)
+{
+    if (!sampleFormatOf(format, sampleFormat_) || format.numChannels == 0 || format.numChannels > MAX_CHANNELS) {
+        return false;
+    }
+
+    format_ = format;
+    frameSize_ = format.blockAlign();
+    frames_ = 0;
+    carry_.clear();
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        bins_[l].clear();
+        reset(l);
+    }
+    if (sampleFormat_ == SampleFormat::Int16) {
+        planes_.allocate(format.numChannels, OVERVIEW_BIN_FRAMES[0]);
+    } else {
+        bus_.allocate(format.numChannels, OVERVIEW_BIN_FRAMES[0]);
+    }
+    return true;
+}
+
+void OverviewBuilder::reset(size_t level)
+{
+    for (Accumulator& channel : open_[level]) {
+        channel = { INFINITY, -INFINITY, 0.0, 0 };
+    }
+}
+
+void OverviewBuilder::add(const void* data, size_t bytes)
+{
+    const char* src = static_cast<const char*>(data);
+
+    //a frame split over two calls is put together first
+    if (!carry_.empty()) {
+        const size_t n = std::min(bytes, frameSize_ - carry_.size());
+        carry_.insert(carry_.end(), src, src + n);
+        src += n;
+        bytes -= n;
+        if (carry_.size() < frameSize_) {
+            return;
+        }
+        addFrames(carry_.data(), 1);
+        carry_.clear();
+    }
+
+    const size_t frames = bytes / frameSize_;
+    addFrames(src, frames);
+    carry_.assign(src + frames * frameSize_, src + bytes);
+}
+
+//runs that end on the bins of the finest level, each split into planes and reduced per channel
+void OverviewBuilder::addFrames(const char* data, size_t frames)
+{
+    const KernelTable& k = kernels();
+    const size_t channels = format_.numChannels;
+    const size_t sampleSize = frameSize_ / channels;
+
+    while (frames > 0) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(frames, OVERVIEW_BIN_FRAMES[0] - open_[0][0].frames));
+
+        if (sampleFormat_ == SampleFormat::Int16) {
+            const short* samples = reinterpret_cast<const short*>(data);
+            if (channels > 1) {
+                k.deinterleaveInt16(samples, planes_.planes(), channels, n);
+            }
+            for (size_t c = 0; c < channels; c++) {
+                short low = 32767;
+                short high = -32768;
+                int64_t squares = 0;
+                k.peakInt16(channels > 1 ? planes_.channel(c) : samples, n, &low, &high, &squares);
+
+                Accumulator& bin = open_[0][c];
+                bin.min = std::min(bin.min, low / INT16_SCALE);
+                bin.max = std::max(bin.max, high / INT16_SCALE);
+                bin.squares += squares / double(INT16_SCALE * INT16_SCALE);
+            }
+        } else {
+            //the other formats are rare enough to go to the bus sample by sample
+            for (size_t i = 0; i < n; i++) {
+                for (size_t c = 0; c < channels; c++) {
+                    const unsigned char* p = reinterpret_cast<const unsigned char*>(data) + i * frameSize_ + c * sampleSize;
+                    float value;
+                    if (sampleFormat_ == SampleFormat::Float) {
+                        memcpy(&value, p, sizeof value);
+                    } else if (sampleFormat_ == SampleFormat::Int24) {
+                        const int32_t sample = static_cast<int32_t>(uint32_t(p[0]) << 8 | uint32_t(p[1]) << 16 | uint32_t(p[2]) << 24) >> 8;
+                        value = sample / 8388608.0f;
+                    } else {
+                        int32_t sample;
+                        memcpy(&sample, p, sizeof sample);
+                        value = sample / 2147483648.0f;
+                    }
+                    bus_.channel(c)[i] = value;
+                }
+            }
+            for (size_t c = 0; c < channels; c++) {
+                Accumulator& bin = open_[0][c];
+                k.peakFloat(bus_.channel(c), n, &bin.min, &bin.max, &bin.squares);
+            }
+        }
+
+        for (size_t c = 0; c < channels; c++) {
+            open_[0][c].frames += n;
+        }
+        data += n * frameSize_;
+        frames -= n;
+        frames_ += n;
+
+        if (open_[0][0].frames == OVERVIEW_BIN_FRAMES[0]) {
+            closeBin(0);
+        }
+    }
+}
+
+//the bin goes out as a record and into the bin of the next level, which closes in turn once it is full
+void OverviewBuilder::closeBin(size_t level)
+{
+    const size_t channels = format_.numChannels;
+    for (size_t c = 0; c < channels; c++) {
+        const Accumulator& bin = open_[level][c];
+        const OverviewRecord record = { roundOut(bin.min, false), roundOut(bin.max, true), static_cast<float>(bin.squares / bin.frames) };
+        bins_[level].push_back(record);
+
+        if (level + 1 < OVERVIEW_LEVELS) {
+            Accumulator& parent = open_[level + 1][c];
+            parent.min = std::min(parent.min, bin.min);
+            parent.max = std::max(parent.max, bin.max);
+            parent.squares += bin.squares;
+            parent.frames += bin.frames;
+        }
+    }
+    reset(level);
+
+    if (level + 1 < OVERVIEW_LEVELS && open_[level + 1][0].frames == OVERVIEW_BIN_FRAMES[level + 1]) {
+        closeBin(level + 1);
+    }
+}
+
+void OverviewBuilder::finish()
+{
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        if (open_[l][0].frames > 0) {
+            closeBin(l);
+        }
+    }
+}
+
+bool OverviewBuilder::write(const char* filename)
+{
+    finish();
+
+    std::ofstream out(filename, std::ios::binary | std::ios::trunc);
+    out.write(OVERVIEW_MAGIC, sizeof OVERVIEW_MAGIC);
+    put(out, OVERVIEW_VERSION);
+    put(out, uint16_t(format_.numChannels));
+    put(out, uint16_t(OVERVIEW_LEVELS));
+    put(out, format_.sampleRate);
+    put(out, frames_);
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        put(out, OVERVIEW_BIN_FRAMES[l]);
+    }
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        put(out, uint64_t(bins_[l].size() / format_.numChannels));
+    }
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        out.write(reinterpret_cast<const char*>(bins_[l].data()), static_cast<std::streamsize>(bins_[l].size() * sizeof(OverviewRecord)));
+    }
+
+    if (!out) {
+        std::cerr << "Error: could not write the overview " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool OverviewBuilder::patch(const char* filename, uint64_t first)
+{
+    finish();
+
+    std::fstream index(filename, std::ios::binary | std::ios::in | std::ios::out);
+    Header header;
+    if (!readHeader(index, header) || header.channels != format_.numChannels || first % OVERVIEW_BIN_FRAMES[OVERVIEW_LEVELS - 1] != 0 ||
+        first + frames_ > header.frames) {
+        std::cerr << "Error: " << filename << " is not an overview this one can be patched into" << std::endl;
+        return false;
+    }
+
+    //each level's bins go where the range starts in that level
+    uint64_t offset = HEADER_BYTES;
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        if (header.binFrames[l] != OVERVIEW_BIN_FRAMES[l]) {
+            return false;
+        }
+        const uint64_t bin = first / OVERVIEW_BIN_FRAMES[l];
+        index.seekp(static_cast<std::streamoff>(offset + bin * header.channels * sizeof(OverviewRecord)));
+        index.write(reinterpret_cast<const char*>(bins_[l].data()), static_cast<std::streamsize>(bins_[l].size() * sizeof(OverviewRecord)));
+        offset += header.bins[l] * header.channels * sizeof(OverviewRecord);
+    }
+
+    if (!index) {
+        std::cerr << "Error: could not patch the overview " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Overview
+
+bool Overview::load(const char* filename)
+{
+    std::ifstream in(filename, std::ios::binary);
+    Header header;
+    if (!readHeader(in, header)) {
+        return false;
+    }
+    channels_ = header.channels;
+    sampleRate_ = header.sampleRate;
+    frames_ = header.frames;
+
+    for (size_t l = 0; l < OVERVIEW_LEVELS; l++) {
+        binFrames_[l] = header.binFrames[l];
+        bins_[l].resize(header.bins[l] * channels_);
+        if (!in.read(reinterpret_cast<char*>(bins_[l].data()), static_cast<std::streamsize>(bins_[l].size() * sizeof(OverviewRecord)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+OverviewBin Overview::summarize(size_t channel, uint64_t first, uint64_t count) const
+{
+    std::vector<OverviewBin> bin;
+    columns(channel, first, count, 1, bin);
+    return bin[0];
+}
+
+void Overview::columns(size_t channel, uint64_t first, uint64_t count, size_t columns, std::vector<OverviewBin>& dst) const
+{
+    dst.assign(columns, OverviewBin());
+    first = std::min(first, frames_);
+    count = std::min(count, frames_ - first);
+    if (count == 0 || columns == 0 || channel >= channels_) {
+        return;
+    }
+
+    //the coarsest level that still has a bin or more per column
+    size_t level = 0;
+    while (level + 1 < OVERVIEW_LEVELS && binFrames_[level + 1] <= count / columns) {
+        level++;
+    }
+    const uint64_t binFrames = binFrames_[level];
+    const std::vector<OverviewRecord>& bins = bins_[level];
+
+    for (size_t k = 0; k < columns; k++) {
+        const uint64_t begin = first + count * k / columns;
+        const uint64_t end = std::max(first + count * (k + 1) / columns, begin + 1);
+
+        //the bins overlapping the column, their mean squares weighted by the frames they cover
+        float low = INFINITY;
+        float high = -INFINITY;
+        double squares = 0.0;
+        uint64_t frames = 0;
+        for (uint64_t b = begin / binFrames; b <= (end - 1) / binFrames; b++) {
+            const OverviewRecord& record = bins[b * channels_ + channel];
+            const uint64_t width = std::min(binFrames, frames_ - b * binFrames);
+            low = std::min(low, record.min / INT16_SCALE);
+            high = std::max(high, record.max / INT16_SCALE);
+            squares += double(record.meanSquare) * width;
+            frames += width;
+        }
+        dst[k] = { low, high, static_cast<float>(squares / frames) };
+    }
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "PlanarBuffer.h"
+#include "SampleFormat.h"
+#include "WaveFile.h"
+
+constexpr size_t OVERVIEW_LEVELS = 3;
+constexpr uint32_t OVERVIEW_BIN_FRAMES[OVERVIEW_LEVELS] = { 256, 4096, 65536 };   // frames per bin of each zoom level, each a multiple of the one before
+constexpr uint32_t OVERVIEW_VERSION = 1;
+constexpr const char* OVERVIEW_EXTENSION = ".peaks";   // the index of "name.wav" is "name.wav.peaks"
+
+// one bin of one channel on the bus scale, full scale at +-1.0
+struct OverviewBin
+{
+    float min = 0.0f;
+    float max = 0.0f;
+    float meanSquare = 0.0f;                        // the RMS squared, so bins can be averaged
+};
+
+// a bin as the index stores it, 8 bytes: the extremes rounded outwards to 16 bits
+struct OverviewRecord
+{
+    int16_t min;
+    int16_t max;
+    float meanSquare;
+};
+
+// builds the waveform overview of a file from its samples as they are written, so no second pass over the file
+// is needed. Only the finest level is reduced from the samples, with the peak kernels; each coarser level is
+// folded from the bins below it as they fill. Every bin holds the min, max and mean square of each channel
+//
+// The index file is little-endian: "SPKS", the version, the channel count and the number of levels (uint16 each),
+// the sample rate, the frame count (uint64), the bin frames of each level (uint32), the bin count of each
+// level (uint64), then every level's bins from the finest on, each the records of all channels in channel order
+class OverviewBuilder
+{
+public:
+    // whether SOUND_OVERVIEW=1 asks every WaveWriter for an index beside its file
+    static bool enabled();
+
+    // false if the format has no bus sample format
+    bool start(const WaveFormat& format);
+
+    // the next 'bytes' of interleaved samples, split anywhere (a frame may straddle two calls)
+    void add(const void* data, size_t bytes);
+
+    // closes the partly filled last bins and writes the index
+    bool write(const char* filename);
+
+    // closes the last bins the same way and writes them over their places in the index 'filename' of a longer
+    // file, as the overview of its frames from 'first' on. 'first' has to start a bin of the coarsest level
+    bool patch(const char* filename, uint64_t first);
+
+private:
+    struct Accumulator
+    {
+        float min;
+        float max;
+        double squares;
+        uint64_t frames;
+    };
+
+    void addFrames(const char* data, size_t frames);
+    void closeBin(size_t level);
+    void reset(size_t level);
+    void finish();
+
+    WaveFormat format_;
+    SampleFormat sampleFormat_ = SampleFormat::Int16;
+    size_t frameSize_ = 0;
+    uint64_t frames_ = 0;
+    std::vector<char> carry_;                       // the start of a frame the last add() ended in
+    PlanarBuffer planes_;                           // a run of 16-bit frames split per channel
+    FloatPlanarBuffer bus_;                         // a run of frames of any other format on the bus
+    Accumulator open_[OVERVIEW_LEVELS][MAX_CHANNELS];
+    std::vector<OverviewRecord> bins_[OVERVIEW_LEVELS];
+};
+
+// an index loaded whole. A query reads the coarsest level whose bins are no wider than what it asks for, so it
+// costs in bins and not in samples
+class Overview
+{
+public:
+    bool load(const char* filename);
+
+    size_t channels() const { return channels_; }
+    uint32_t sampleRate() const { return sampleRate_; }
+    uint64_t frames() const { return frames_; }
+
+    // frames [first, first + count) of 'channel' in one bin, to within a bin of the chosen level at either end
+    OverviewBin summarize(size_t channel, uint64_t first, uint64_t count) const;
+
+    // the same range in 'columns' bins, one per pixel column of a waveform view
+    void columns(size_t channel, uint64_t first, uint64_t count, size_t columns, std::vector<OverviewBin>& dst) const;
+
+private:
+    size_t channels_ = 0;
+    uint32_t sampleRate_ = 0;
+    uint64_t frames_ = 0;
+    uint32_t binFrames_[OVERVIEW_LEVELS] = {};
+    std::vector<OverviewRecord> bins_[OVERVIEW_LEVELS];
+};
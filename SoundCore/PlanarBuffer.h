@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "AlignedBuffer.h"
+
+constexpr size_t PLANE_ALIGNMENT = 64;              // bytes, every channel plane starts on its own cache line
+constexpr size_t MAX_CHANNELS = 8;                  // up to 7.1
+
+// samples stored one contiguous plane per channel, so the kernels stream each channel on its own.
+// Interleaved frames only exist at the file boundary (WaveReader::readPlanar, WaveWriter::writePlanar)
+template <typename T>
+class BasicPlanarBuffer
+{
+public:
+    BasicPlanarBuffer() = default;
+
+    BasicPlanarBuffer(size_t channels, size_t frames) { allocate(channels, frames); }
+
+    void allocate(size_t channels, size_t frames)
+    {
+        //the stride is rounded up to whole cache lines so no two planes share one
+        const size_t perLine = PLANE_ALIGNMENT / sizeof(T);
+        stride_ = (frames + perLine - 1) / perLine * perLine;
+        frames_ = frames;
+        samples_.allocate(channels * stride_);
+
+        planes_.resize(channels);
+        for (size_t c = 0; c < channels; c++) {
+            planes_[c] = samples_.data() + c * stride_;
+        }
+    }
+
+    size_t channels() const { return planes_.size(); }
+    size_t frames() const { return frames_; }
+    size_t stride() const { return stride_; }
+
+    T* channel(size_t c) { return planes_[c]; }
+    const T* channel(size_t c) const { return planes_[c]; }
+
+    // one pointer per channel, as the interleave kernels take them
+    T* const* planes() { return planes_.data(); }
+    const T* const* planes() const { return planes_.data(); }
+
+private:
+    AlignedBuffer<T> samples_;
+    std::vector<T*> planes_;
+    size_t frames_ = 0;
+    size_t stride_ = 0;
+};
+
+using PlanarBuffer = BasicPlanarBuffer<short>;          // 16-bit samples as read from the files
+using FloatPlanarBuffer = BasicPlanarBuffer<float>;    // the float mix bus
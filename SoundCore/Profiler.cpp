@@ -0,0 +1,480 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    const char* const STAGE_NAMES[STAGE_COUNT] = { "parse", "read", "generate", "mix", "convert", "write" };
+    const char* const COUNTER_NAMES[COUNTER_COUNT] = { "cycles", "instructions", "llc_misses", "page_faults" };
+
+    uint64_t nowNs()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //one scope as the trace shows it, the counters are inclusive there
+    struct TraceEvent
+    {
+        uint64_t start;
+        uint64_t duration;
+        Stage stage;
+        uint64_t counters[COUNTER_COUNT];
+    };
+
+    //the counters of one thread in a single perf group, so one read gets them all at the same instant.
+    //The leader is whichever event opened first, the ones the host refuses are simply not in the group
+    class CounterGroup
+    {
+    public:
+        void open()
+        {
+#ifdef __linux__
+            struct Event
+            {
+                uint32_t type;
+                uint64_t config;
+            };
+            static const Event EVENTS[COUNTER_COUNT] = {
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+                { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+                { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+            };
+
+            for (size_t c = 0; c < COUNTER_COUNT; c++) {
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof attr);
+                attr.type = EVENTS[c].type;
+                attr.size = sizeof attr;
+                attr.config = EVENTS[c].config;
+                attr.read_format = PERF_FORMAT_GROUP;
+                attr.exclude_kernel = 1;            //user space only, which is also all an unprivileged process may count
+                attr.exclude_hv = 1;
+
+                //this thread, on whatever cpu it runs
+                const int fd = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, leader_, 0));
+                if (fd < 0) {
+                    continue;
+                }
+                if (leader_ < 0) {
+                    leader_ = fd;
+                }
+                fds_[numOpen_] = fd;
+                order_[numOpen_++] = c;
+            }
+#endif
+        }
+
+        void close()
+        {
+#ifdef __linux__
+            //the members go before the leader
+            for (size_t i = numOpen_; i-- > 0;) {
+                ::close(fds_[i]);
+            }
+#endif
+            numOpen_ = 0;
+            leader_ = -1;
+        }
+
+        bool isOpen() const { return numOpen_ > 0; }
+
+        uint32_t mask() const
+        {
+            uint32_t bits = 0;
+            for (size_t i = 0; i < numOpen_; i++) {
+                bits |= 1u << order_[i];
+            }
+            return bits;
+        }
+
+        //the events the group lacks stay 0
+        void read(uint64_t (&values)[COUNTER_COUNT]) const
+        {
+#ifdef __linux__
+            //{ number of events, their values in the order they joined the group }
+            uint64_t group[1 + COUNTER_COUNT];
+            if (::read(leader_, group, sizeof group) < static_cast<ssize_t>(sizeof(uint64_t))) {
+                return;
+            }
+            for (size_t i = 0; i < group[0] && i < numOpen_; i++) {
+                values[order_[i]] = group[1 + i];
+            }
+#else
+            (void)values;
+#endif
+        }
+
+    private:
+        int leader_ = -1;
+        int fds_[COUNTER_COUNT] = {};
+        size_t order_[COUNTER_COUNT] = {};
+        size_t numOpen_ = 0;
+    };
+}
+
+struct ThreadProfile
+{
+    std::mutex mutex;                               //the owner records under it, readers take it to copy
+    unsigned index = 0;
+    StageTotals stages[STAGE_COUNT];
+    std::vector<TraceEvent> events;
+    uint64_t dropped = 0;                           //events past PROFILE_TRACE_EVENTS
+    CounterGroup counters;
+    bool countersTried = false;
+    ScopedStage* current = nullptr;                 //innermost open scope, only the owner touches it
+};
+
+namespace
+{
+    struct Registry
+    {
+        std::mutex mutex;
+        std::vector<std::unique_ptr<ThreadProfile>> threads;   //kept after their threads end, for the report
+        uint64_t epoch = nowNs();                   //time 0 of the trace
+        std::atomic<bool> counters{ false };
+        std::atomic<uint32_t> available{ 0 };       //counters some thread could open
+    };
+
+    Registry& registry()
+    {
+        static Registry instance;
+        return instance;
+    }
+
+    //the profile of the calling thread, registered on its first scope. Its counters close with the thread
+    struct ThreadSlot
+    {
+        ThreadProfile* profile = nullptr;
+
+        ~ThreadSlot()
+        {
+            if (profile) {
+                std::lock_guard<std::mutex> lock(profile->mutex);
+                profile->counters.close();
+            }
+        }
+    };
+
+    thread_local ThreadSlot slot;
+
+    ThreadProfile* threadProfile()
+    {
+        Registry& r = registry();
+        if (!slot.profile) {
+            std::lock_guard<std::mutex> lock(r.mutex);
+            r.threads.push_back(std::make_unique<ThreadProfile>());
+            slot.profile = r.threads.back().get();
+            slot.profile->index = static_cast<unsigned>(r.threads.size() - 1);
+        }
+
+        ThreadProfile* profile = slot.profile;
+        if (!profile->countersTried && r.counters.load(std::memory_order_relaxed)) {
+            profile->countersTried = true;
+            std::lock_guard<std::mutex> lock(profile->mutex);
+            profile->counters.open();
+            r.available.fetch_or(profile->counters.mask(), std::memory_order_relaxed);
+        }
+        return profile;
+    }
+
+    void writeStages(std::ostream& out, const StageTotals (&stages)[STAGE_COUNT], uint32_t available)
+    {
+        out << "{";
+        for (size_t s = 0; s < STAGE_COUNT; s++) {
+            const StageTotals& t = stages[s];
+            out << (s ? ", " : "") << "\"" << STAGE_NAMES[s] << "\": {"
+                << "\"calls\": " << t.calls << ", "
+                << "\"total_ms\": " << t.totalNs / 1e6 << ", "
+                << "\"self_ms\": " << t.selfNs / 1e6;
+            for (size_t c = 0; c < COUNTER_COUNT; c++) {
+                if (available & (1u << c)) {
+                    out << ", \"" << COUNTER_NAMES[c] << "\": " << t.counters[c];
+                }
+            }
+            out << "}";
+        }
+        out << "}";
+    }
+
+    void addTotals(StageTotals (&sum)[STAGE_COUNT], const StageTotals (&stages)[STAGE_COUNT])
+    {
+        for (size_t s = 0; s < STAGE_COUNT; s++) {
+            sum[s].calls += stages[s].calls;
+            sum[s].totalNs += stages[s].totalNs;
+            sum[s].selfNs += stages[s].selfNs;
+            for (size_t c = 0; c < COUNTER_COUNT; c++) {
+                sum[s].counters[c] += stages[s].counters[c];
+            }
+        }
+    }
+
+    //SOUND_PROFILE and SOUND_TRACE turn the profiler on before main and get their files when the process exits.
+    //The registry is built first so it outlives this, and the shared pool, built later, is gone before both
+    class Session
+    {
+    public:
+        Session()
+        {
+            registry();
+
+            const char* profile = std::getenv("SOUND_PROFILE");
+            const char* trace = std::getenv("SOUND_TRACE");
+            const char* counters = std::getenv("SOUND_PROFILE_COUNTERS");
+            profile_ = profile ? profile : "";
+            trace_ = trace ? trace : "";
+            if (!profile_.empty() || !trace_.empty()) {
+                Profiler::enable(counters && *counters && strcmp(counters, "0") != 0);
+            }
+        }
+
+        ~Session()
+        {
+            if (!profile_.empty()) {
+                Profiler::writeJson(profile_.c_str());
+            }
+            if (!trace_.empty()) {
+                Profiler::writeTrace(trace_.c_str());
+            }
+        }
+
+    private:
+        std::string profile_;
+        std::string trace_;
+    };
+
+    Session session;
+}
+
+std::atomic<bool> Profiler::active_{ false };
+
+const char* stageName(Stage stage)
+{
+    return STAGE_NAMES[static_cast<size_t>(stage)];
+}
+
+const char* counterName(Counter counter)
+{
+    return COUNTER_NAMES[static_cast<size_t>(counter)];
+}
+
+void Profiler::enable(bool counters)
+{
+    if (counters) {
+        registry().counters.store(true, std::memory_order_relaxed);
+    }
+    active_.store(true, std::memory_order_relaxed);
+}
+
+void Profiler::disable()
+{
+    active_.store(false, std::memory_order_relaxed);
+}
+
+void Profiler::reset()
+{
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const std::unique_ptr<ThreadProfile>& thread : r.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        std::fill(std::begin(thread->stages), std::end(thread->stages), StageTotals());
+        thread->events.clear();
+        thread->dropped = 0;
+    }
+}
+
+bool Profiler::available(Counter counter)
+{
+    return (registry().available.load(std::memory_order_relaxed) >> static_cast<size_t>(counter)) & 1;
+}
+
+void Profiler::totals(StageTotals (&stages)[STAGE_COUNT])
+{
+    std::fill(std::begin(stages), std::end(stages), StageTotals());
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    for (const std::unique_ptr<ThreadProfile>& thread : r.threads) {
+        std::lock_guard<std::mutex> threadLock(thread->mutex);
+        addTotals(stages, thread->stages);
+    }
+}
+
+void Profiler::writeSummary(std::ostream& out, bool perThread)
+{
+    Registry& r = registry();
+    const uint32_t available = r.available.load(std::memory_order_relaxed);
+
+    //a copy per thread first, the threads go on recording
+    std::vector<std::vector<StageTotals>> threads;
+    StageTotals sum[STAGE_COUNT];
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const std::unique_ptr<ThreadProfile>& thread : r.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            threads.emplace_back(std::begin(thread->stages), std::end(thread->stages));
+            addTotals(sum, thread->stages);
+            dropped += thread->dropped;
+        }
+    }
+
+    out << "{\"counters\": [";
+    const char* separator = "";
+    for (size_t c = 0; c < COUNTER_COUNT; c++) {
+        if (available & (1u << c)) {
+            out << separator << "\"" << COUNTER_NAMES[c] << "\"";
+            separator = ", ";
+        }
+    }
+    out << "], \"stages\": ";
+    writeStages(out, sum, available);
+
+    if (perThread) {
+        out << ", \"threads\": [";
+        for (size_t t = 0; t < threads.size(); t++) {
+            StageTotals stages[STAGE_COUNT];
+            std::copy(threads[t].begin(), threads[t].end(), stages);
+            out << (t ? ", " : "") << "{\"thread\": " << t << ", \"stages\": ";
+            writeStages(out, stages, available);
+            out << "}";
+        }
+        out << "], \"dropped_events\": " << dropped;
+    }
+    out << "}";
+}
+
+bool Profiler::writeJson(const char* filename)
+{
+    std::ofstream out(filename);
+    writeSummary(out, true);
+    out << "\n";
+    if (!out) {
+        std::cerr << "Error: could not write the profile to " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Profiler::writeTrace(const char* filename)
+{
+    std::ofstream out(filename);
+    out << std::fixed << std::setprecision(3);
+
+    Registry& r = registry();
+    const uint32_t available = r.available.load(std::memory_order_relaxed);
+
+    //complete events in microseconds, one row per thread
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    const char* separator = "\n";
+    {
+        std::lock_guard<std::mutex> lock(r.mutex);
+        for (const std::unique_ptr<ThreadProfile>& thread : r.threads) {
+            std::lock_guard<std::mutex> threadLock(thread->mutex);
+            out << separator << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << thread->index
+                << ", \"args\": {\"name\": \"thread " << thread->index << "\"}}";
+            separator = ",\n";
+
+            for (const TraceEvent& event : thread->events) {
+                out << separator << "{\"name\": \"" << STAGE_NAMES[static_cast<size_t>(event.stage)] << "\", \"cat\": \"sound\", \"ph\": \"X\""
+                    << ", \"ts\": " << (event.start - r.epoch) / 1e3
+                    << ", \"dur\": " << event.duration / 1e3
+                    << ", \"pid\": 1, \"tid\": " << thread->index << ", \"args\": {";
+                const char* argSeparator = "";
+                for (size_t c = 0; c < COUNTER_COUNT; c++) {
+                    if (available & (1u << c)) {
+                        out << argSeparator << "\"" << COUNTER_NAMES[c] << "\": " << event.counters[c];
+                        argSeparator = ", ";
+                    }
+                }
+                out << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+
+    if (!out) {
+        std::cerr << "Error: could not write the trace to " << filename << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// ScopedStage
+
+void ScopedStage::begin(Stage stage)
+{
+    ThreadProfile* thread = threadProfile();
+    thread_ = thread;
+    stage_ = stage;
+    parent_ = thread->current;
+    thread->current = this;
+    for (const ScopedStage* outer = parent_; outer && !reentered_; outer = outer->parent_) {
+        reentered_ = outer->stage_ == stage;
+    }
+
+    //the counters before the clock and after it at the end, so the reads stay out of the time
+    if (thread->counters.isOpen()) {
+        thread->counters.read(counters_);
+    }
+    start_ = nowNs();
+}
+
+void ScopedStage::end()
+{
+    const uint64_t stop = nowNs();
+    uint64_t deltas[COUNTER_COUNT] = {};
+    if (thread_->counters.isOpen()) {
+        thread_->counters.read(deltas);
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            deltas[c] -= counters_[c];
+        }
+    }
+    const uint64_t duration = stop - start_;
+
+    {
+        std::lock_guard<std::mutex> lock(thread_->mutex);
+        StageTotals& totals = thread_->stages[static_cast<size_t>(stage_)];
+        if (!reentered_) {
+            totals.calls++;
+            totals.totalNs += duration;
+        }
+        totals.selfNs += duration - std::min(childNs_, duration);
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            totals.counters[c] += deltas[c] - std::min(childCounters_[c], deltas[c]);
+        }
+
+        if (thread_->events.size() < PROFILE_TRACE_EVENTS) {
+            TraceEvent event = { start_, duration, stage_, {} };
+            std::copy(std::begin(deltas), std::end(deltas), event.counters);
+            thread_->events.push_back(event);
+        } else {
+            thread_->dropped++;
+        }
+    }
+
+    thread_->current = parent_;
+    if (parent_) {
+        parent_->childNs_ += duration;
+        for (size_t c = 0; c < COUNTER_COUNT; c++) {
+            parent_->childCounters_[c] += deltas[c];
+        }
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+constexpr size_t PROFILE_TRACE_EVENTS = 1 << 18;    // trace events kept per thread, later scopes still add to the totals
+
+// the hot path stages a render is timed in
+enum class Stage
+{
+    Parse,      // reading a file header
+    Read,
+    Generate,
+    Mix,
+    Convert,    // to another sample format or rate
+    Write
+};
+
+constexpr size_t STAGE_COUNT = 6;
+
+// the perf_event_open counters a stage can carry, on Linux when the host exposes them
+enum class Counter
+{
+    Cycles,
+    Instructions,
+    CacheMisses,    // last level cache
+    PageFaults
+};
+
+constexpr size_t COUNTER_COUNT = 4;
+
+// "parse", "read", "generate", "mix", "convert" or "write"
+const char* stageName(Stage stage);
+
+// "cycles", "instructions", "llc_misses" or "page_faults"
+const char* counterName(Counter counter);
+
+// one stage summed over its scopes. Self is the time and counts with the stages nested inside taken out,
+// a read that resamples is all read in total but only the file access in self. A stage nested in itself, a
+// write that flushes a block, is one call
+struct StageTotals
+{
+    uint64_t calls = 0;
+    uint64_t totalNs = 0;
+    uint64_t selfNs = 0;
+    uint64_t counters[COUNTER_COUNT] = {};          // self
+};
+
+// per thread, per stage timing of the hot paths. It is off until enable(), or until SOUND_PROFILE=file.json
+// (the totals per stage and per thread) or SOUND_TRACE=file.json (every scope, for chrome://tracing or Perfetto)
+// turns it on at startup, those files are then written at exit. With SOUND_PROFILE_COUNTERS=1 every thread also
+// opens a group of hardware counters that each scope reads at both ends; the ones the host doesn't expose
+// (most VMs and containers) are left out. Off, a scope costs one relaxed load
+class Profiler
+{
+public:
+    static bool enabled() { return active_.load(std::memory_order_relaxed); }
+
+    // counters opens the perf events on every thread that records
+    static void enable(bool counters = false);
+    static void disable();
+
+    // drops what was recorded so far, the threads stay registered
+    static void reset();
+
+    // whether any thread could open 'counter'
+    static bool available(Counter counter);
+
+    // summed over the threads
+    static void totals(StageTotals (&stages)[STAGE_COUNT]);
+
+    // {"stages": {...}}, with "threads": [...] the same for every thread, on one line
+    static void writeSummary(std::ostream& out, bool perThread);
+
+    static bool writeJson(const char* filename);
+    static bool writeTrace(const char* filename);
+
+private:
+    friend class ScopedStage;
+
+    static std::atomic<bool> active_;
+};
+
+struct ThreadProfile;
+
+// times the enclosing block as 'stage' on the calling thread, scopes nest. Meant for blocks of samples:
+// with counters on, each end reads them with a system call
+class ScopedStage
+{
+public:
+    explicit ScopedStage(Stage stage)
+    {
+        if (Profiler::enabled()) {
+            begin(stage);
+        }
+    }
+
+    ~ScopedStage()
+    {
+        if (thread_) {
+            end();
+        }
+    }
+
+    ScopedStage(const ScopedStage&) = delete;
+    ScopedStage& operator=(const ScopedStage&) = delete;
+
+private:
+    void begin(Stage stage);
+    void end();
+
+    ThreadProfile* thread_ = nullptr;
+    ScopedStage* parent_ = nullptr;
+    Stage stage_ = Stage::Parse;
+    bool reentered_ = false;                        // inside a scope of the same stage
+    uint64_t start_ = 0;
+    uint64_t childNs_ = 0;
+    uint64_t counters_[COUNTER_COUNT] = {};         // at the start
+    uint64_t childCounters_[COUNTER_COUNT] = {};
+};
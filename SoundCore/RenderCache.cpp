@@ -0,0 +1,412 @@
+#include "RenderCache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include "MappedFile.h"
+#include "Overview.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    constexpr uint64_t PRIME64_1 = 0x9E3779B185EBCA87ull;
+    constexpr uint64_t PRIME64_2 = 0xC2B2AE3D27D4EB4Full;
+    constexpr uint64_t PRIME64_3 = 0x165667B19E3779F9ull;
+    constexpr uint64_t PRIME64_4 = 0x85EBCA77C2B2AE63ull;
+    constexpr uint64_t PRIME64_5 = 0x27D4EB2F165667C5ull;
+
+    uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+    uint64_t read64(const unsigned char* p)
+    {
+        uint64_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+
+    uint32_t read32(const unsigned char* p)
+    {
+        uint32_t v;
+        memcpy(&v, p, sizeof v);
+        return v;
+    }
+
+    uint64_t round64(uint64_t acc, uint64_t input)
+    {
+        return rotl(acc + input * PRIME64_2, 31) * PRIME64_1;
+    }
+
+    uint64_t merge64(uint64_t acc, uint64_t lane)
+    {
+        return (acc ^ round64(0, lane)) * PRIME64_1 + PRIME64_4;
+    }
+
+    //a reflink first, the entry and the copy then share their extents until one is written. Else the kernel copies
+    //without the data coming up to user space, and where it can't (another filesystem on an old kernel, no Linux)
+    //the source is mapped and written out
+    bool copyFile(const std::string& from, const std::string& to)
+    {
+#ifdef __linux__
+        const int in = ::open(from.c_str(), O_RDONLY | O_CLOEXEC);
+        if (in < 0) {
+            return false;
+        }
+        struct stat info;
+        const int out = fstat(in, &info) == 0 ? ::open(to.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+        bool copied = false;
+        if (out >= 0) {
+            copied = ioctl(out, FICLONE, in) == 0;
+            for (off_t done = 0; !copied;) {
+                const ssize_t n = copy_file_range(in, nullptr, out, nullptr, static_cast<size_t>(info.st_size - done), 0);
+                if (n <= 0) {
+                    break;
+                }
+                done += n;
+                copied = done == info.st_size;
+            }
+            copied = copied || info.st_size == 0;
+            ::close(out);
+        }
+        ::close(in);
+        if (copied) {
+            return true;
+        }
+#endif
+        MappedFile source;
+        if (!source.open(from.c_str())) {
+            return false;
+        }
+        std::ofstream copy(to, std::ios::binary | std::ios::trunc);
+        copy.write(source.data(), static_cast<std::streamsize>(source.size()));
+        return static_cast<bool>(copy);
+    }
+
+    //written beside the target and renamed over it, a reader never sees half a file
+    bool replaceFile(const std::string& target, const std::string& text)
+    {
+        const std::string temporary = target + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+        {
+            std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+            out << text;
+            if (!out) {
+                return false;
+            }
+        }
+        std::error_code error;
+        fs::rename(temporary, target, error);
+        if (error) {
+            fs::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+    uint64_t parseBudget(const char* text)
+    {
+        char* end;
+        const double value = strtod(text, &end);
+        const char unit = static_cast<char>(toupper(static_cast<unsigned char>(*end)));
+        const double scale = unit == 'K' ? 1 << 10 : unit == 'M' ? 1 << 20 : unit == 'G' ? 1 << 30 : 1;
+        return end == text || value <= 0 ? RENDER_CACHE_BUDGET : static_cast<uint64_t>(value * scale);
+    }
+}
+
+uint64_t hash64(const void* data, size_t bytes, uint64_t seed)
+{
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    const unsigned char* const end = p + bytes;
+    uint64_t h;
+
+    //four lanes over 32 byte stripes, folded into one
+    if (bytes >= 32) {
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        for (; p + 32 <= end; p += 32) {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+        }
+        h = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    } else {
+        h = seed + PRIME64_5;
+    }
+    h += bytes;
+
+    for (; p + 8 <= end; p += 8) {
+        h = rotl(h ^ round64(0, read64(p)), 27) * PRIME64_1 + PRIME64_4;
+    }
+    if (p + 4 <= end) {
+        h = rotl(h ^ (read32(p) * PRIME64_1), 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    for (; p < end; p++) {
+        h = rotl(h ^ (*p * PRIME64_5), 11) * PRIME64_1;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+    return h;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// RenderKey
+
+RenderKey::RenderKey(const char* job)
+    : text_(job)
+{
+    add("version", RENDER_CACHE_VERSION);
+}
+
+RenderKey& RenderKey::add(const char* name, const std::string& value)
+{
+    text_ += ';';
+    text_ += name;
+    text_ += '=';
+    text_ += value;
+    return *this;
+}
+
+RenderKey& RenderKey::add(const char* name, double value)
+{
+    //every bit of the value, so 440.5 and 440.50000001 are different jobs
+    std::ostringstream text;
+    text << std::setprecision(17) << value;
+    return add(name, text.str());
+}
+
+bool RenderKey::addFile(const char* name, const char* filename)
+{
+    MappedFile file;
+    if (!file.open(filename)) {
+        return false;
+    }
+
+    char digest[40];
+    snprintf(digest, sizeof digest, "%016llx:%llu", static_cast<unsigned long long>(hash64(file.data(), static_cast<size_t>(file.size()))),
+        static_cast<unsigned long long>(file.size()));
+    add(name, std::string(digest));
+    return true;
+}
+
+std::string RenderKey::hex() const
+{
+    char digits[17];
+    snprintf(digits, sizeof digits, "%016llx", static_cast<unsigned long long>(hash64(text_.data(), text_.size())));
+    return digits;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// RenderCache
+
+RenderCache::RenderCache()
+{
+    const char* directory = std::getenv("SOUND_CACHE");
+    const char* budget = std::getenv("SOUND_CACHE_BUDGET");
+    if (directory && *directory) {
+        directory_ = directory;
+    }
+    if (budget) {
+        budget_ = parseBudget(budget);
+    }
+}
+
+RenderCache::RenderCache(const std::string& directory, uint64_t budget)
+    : directory_(directory), budget_(budget)
+{
+}
+
+std::string RenderCache::path(const RenderKey& key, const char* extension) const
+{
+    return (fs::path(directory_) / (key.hex() + extension)).string();
+}
+
+bool RenderCache::fetch(const RenderKey& key, const char* filename)
+{
+    if (!enabled()) {
+        return false;
+    }
+
+    //the stored key has to be the same text, a hash alone could belong to another job
+    const std::string data = path(key, ".data");
+    std::ifstream keyFile(path(key, ".key"), std::ios::binary);
+    std::stringstream stored;
+    stored << keyFile.rdbuf();
+
+    Stats delta;
+    std::error_code error;
+    //with overviews asked for, an entry stored without one is no use
+    const std::string overview = std::string(filename) + OVERVIEW_EXTENSION;
+    if (!keyFile || stored.str() != key.text() || !copyFile(data, filename) ||
+        (OverviewBuilder::enabled() && !copyFile(path(key, OVERVIEW_EXTENSION), overview))) {
+        delta.misses = 1;
+        count(delta);
+        return false;
+    }
+
+    //the file time is the entry's last use, what eviction goes by
+    fs::last_write_time(data, fs::file_time_type::clock::now(), error);
+
+    delta.hits = 1;
+    delta.bytesServed = fs::file_size(data, error);
+    count(delta);
+    return true;
+}
+
+bool RenderCache::store(const RenderKey& key, const char* filename)
+{
+    if (!enabled()) {
+        return false;
+    }
+
+    std::error_code error;
+    fs::create_directories(directory_, error);
+
+    //the data lands under its final name last, once the key beside it is complete
+    const std::string data = path(key, ".data");
+    const std::string temporary = data + ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    if (!replaceFile(path(key, ".key"), key.text()) || !copyFile(filename, temporary)) {
+        fs::remove(temporary, error);
+        std::cerr << "Error: could not store " << filename << " in the render cache " << directory_ << std::endl;
+        return false;
+    }
+
+    //the overview the writer left beside the file goes with it
+    const std::string overview = std::string(filename) + OVERVIEW_EXTENSION;
+    if (OverviewBuilder::enabled() && fs::exists(overview, error) && !copyFile(overview, path(key, OVERVIEW_EXTENSION))) {
+        fs::remove(path(key, OVERVIEW_EXTENSION), error);
+    }
+
+    fs::rename(temporary, data, error);
+    if (error) {
+        fs::remove(temporary, error);
+        return false;
+    }
+
+    evict();
+    return true;
+}
+
+void RenderCache::evict()
+{
+    struct Entry
+    {
+        fs::file_time_type used;
+        uint64_t bytes;
+        fs::path data;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t total = 0;
+    std::error_code error;
+    for (const fs::directory_entry& item : fs::directory_iterator(directory_, error)) {
+        if (item.path().extension() == ".data") {
+            const Entry entry = { item.last_write_time(error), item.file_size(error), item.path() };
+            entries.push_back(entry);
+            total += entry.bytes;
+        }
+    }
+
+    std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+
+    Stats delta;
+    for (size_t i = 0; i < entries.size() && total > budget_; i++) {
+        fs::remove(entries[i].data, error);
+        fs::remove(fs::path(entries[i].data).replace_extension(".key"), error);
+        fs::remove(fs::path(entries[i].data).replace_extension(OVERVIEW_EXTENSION), error);
+        total -= entries[i].bytes;
+        delta.evictions++;
+    }
+    if (delta.evictions > 0) {
+        count(delta);
+    }
+}
+
+RenderCache::Stats RenderCache::stats() const
+{
+    Stats stats;
+    std::ifstream in(fs::path(directory_) / "stats");
+    std::string name;
+    uint64_t value;
+    while (in >> name >> value) {
+        if (name == "hits") {
+            stats.hits = value;
+        } else if (name == "misses") {
+            stats.misses = value;
+        } else if (name == "evictions") {
+            stats.evictions = value;
+        } else if (name == "bytes_served") {
+            stats.bytesServed = value;
+        }
+    }
+    return stats;
+}
+
+//processes racing on the file can lose a count, the totals are a guide and not a ledger
+void RenderCache::count(const Stats& delta)
+{
+    Stats stats = this->stats();
+    stats.hits += delta.hits;
+    stats.misses += delta.misses;
+    stats.evictions += delta.evictions;
+    stats.bytesServed += delta.bytesServed;
+
+    std::error_code error;
+    fs::create_directories(directory_, error);
+
+    std::ostringstream text;
+    text << "hits " << stats.hits << "\n"
+        << "misses " << stats.misses << "\n"
+        << "evictions " << stats.evictions << "\n"
+        << "bytes_served " << stats.bytesServed << "\n";
+    replaceFile((fs::path(directory_) / "stats").string(), text.str());
+}
+
+void RenderCache::report(std::ostream& out) const
+{
+    if (!enabled()) {
+        return;
+    }
+
+    uint64_t bytes = 0;
+    size_t entries = 0;
+    std::error_code error;
+    for (const fs::directory_entry& item : fs::directory_iterator(directory_, error)) {
+        if (item.path().extension() == ".data") {
+            bytes += item.file_size(error);
+            entries++;
+        }
+    }
+
+    const Stats stats = this->stats();
+    out << "Render cache: " << stats.hits << " hits, " << stats.misses << " misses, " << stats.evictions << " evicted, "
+        << (bytes >> 20) << " of " << (budget_ >> 20) << " MB in " << entries << " entries" << std::endl;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <type_traits>
+
+constexpr uint64_t RENDER_CACHE_BUDGET = 4ull << 30;        // bytes of entries kept by default, SOUND_CACHE_BUDGET changes it
+constexpr uint32_t RENDER_CACHE_VERSION = 2;                // part of every key, bumped when a render changes its output
+
+// 64-bit XXH64 of a buffer
+uint64_t hash64(const void* data, size_t bytes, uint64_t seed = 0);
+
+// what a render depends on, as "job;name=value;..." text. Its hash names the cache entry and the text itself is
+// stored beside it, so two jobs only share an entry when everything they were keyed on is equal. Input files go
+// in by the hash of their content, not by name
+class RenderKey
+{
+public:
+    explicit RenderKey(const char* job);
+
+    RenderKey& add(const char* name, const std::string& value);
+    RenderKey& add(const char* name, const char* value) { return add(name, std::string(value)); }
+    RenderKey& add(const char* name, double value);
+
+    template <typename T, typename = std::enable_if_t<std::is_integral<T>::value>>
+    RenderKey& add(const char* name, T value) { return add(name, std::to_string(value)); }
+
+    // false if the file can't be read
+    bool addFile(const char* name, const char* filename);
+
+    const std::string& text() const { return text_; }
+
+    // 16 hex digits, the entry's file name
+    std::string hex() const;
+
+private:
+    std::string text_;
+};
+
+// a directory of finished renders keyed by RenderKey, so a repeat job costs a file copy instead of a render.
+// A hit is copied out as a reflink where the filesystem shares extents (btrfs, XFS), else with copy_file_range
+// inside the kernel, else out of a mapping of the entry. Entries are evicted least recently used first once they
+// outgrow the budget, a hit refreshes its entry's time. The hit and miss counters are kept in the directory
+// too, so they add up over every process that used it
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+        uint64_t bytesServed = 0;
+    };
+
+    // the directory from SOUND_CACHE and the budget from SOUND_CACHE_BUDGET (bytes, or with a K, M or G suffix).
+    // Without SOUND_CACHE the cache is off, it never hits and stores nothing
+    RenderCache();
+    RenderCache(const std::string& directory, uint64_t budget);
+
+    bool enabled() const { return !directory_.empty(); }
+
+    // copies the entry for 'key' to 'filename', false on a miss. With SOUND_OVERVIEW=1 its overview index comes
+    // along too, an entry stored without one is a miss
+    bool fetch(const RenderKey& key, const char* filename);
+
+    // copies the finished 'filename' in as the entry for 'key' (with its overview index when SOUND_OVERVIEW=1),
+    // then evicts down to the budget
+    bool store(const RenderKey& key, const char* filename);
+
+    Stats stats() const;
+
+    // one line: the counters and what the entries take
+    void report(std::ostream& out) const;
+
+private:
+    std::string path(const RenderKey& key, const char* extension) const;
+    void count(const Stats& delta);
+    void evict();
+
+    std::string directory_;
+    uint64_t budget_ = RENDER_CACHE_BUDGET;
+};
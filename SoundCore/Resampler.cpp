@@ -0,0 +1,264 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+
+#include "Kernels.h"
+#include "Profiler.h"
+
+namespace
+{
+    constexpr double PI = 3.141592653589793;
+    constexpr int64_t WINDOW_LEAD = RESAMPLER_TAPS / 2 - 1;   // taps before the input frame an output falls on
+
+    //modified Bessel function of the first kind and order 0, its series converges fast for the betas we use
+    double besselI0(double x)
+    {
+        const double q = x * x / 4;
+        double term = 1.0;
+        double sum = 1.0;
+        for (int k = 1; term > sum * 1e-12; k++) {
+            term *= q / (double(k) * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    double sinc(double x)
+    {
+        return x == 0.0 ? 1.0 : std::sin(PI * x) / (PI * x);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Resampler
+
+bool Resampler::init(uint32_t inRate, uint32_t outRate, size_t channels)
+{
+    const uint32_t divisor = std::gcd(inRate, outRate);
+    if (divisor == 0 || outRate / divisor > RESAMPLER_MAX_PHASES) {
+        std::cerr << "Error: can't resample " << inRate << " Hz to " << outRate << " Hz" << std::endl;
+        return false;
+    }
+    interpolation_ = outRate / divisor;
+    decimation_ = inRate / divisor;
+
+    //windowed sinc with its cutoff under the lower of the two Nyquist frequencies, row p holds the taps for
+    //outputs falling p / interpolation of the way from one input frame to the next
+    const double cutoff = RESAMPLER_CUTOFF * std::min(1.0, double(interpolation_) / decimation_);
+    const double half = RESAMPLER_TAPS / 2;
+    const double windowScale = 1.0 / besselI0(RESAMPLER_KAISER_BETA);
+
+    bank_.allocate(size_t(interpolation_) * RESAMPLER_TAPS);
+    for (uint32_t p = 0; p < interpolation_; p++) {
+        float* row = bank_.data() + size_t(p) * RESAMPLER_TAPS;
+        double sum = 0.0;
+        for (size_t k = 0; k < RESAMPLER_TAPS; k++) {
+            const double d = double(k) - WINDOW_LEAD - double(p) / interpolation_;
+            const double x = d / half;
+            const double window = x * x < 1.0 ? besselI0(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - x * x)) * windowScale : 0.0;
+            const double tap = cutoff * sinc(cutoff * d) * window;
+            row[k] = static_cast<float>(tap);
+            sum += tap;
+        }
+
+        //every row passes DC at unity, so a constant input stays exactly that constant
+        for (size_t k = 0; k < RESAMPLER_TAPS; k++) {
+            row[k] = static_cast<float>(row[k] / sum);
+        }
+    }
+
+    //a drained history keeps less than one window and one step of input, a whole block always fits after it
+    history_.allocate(channels, RESAMPLER_BLOCK_FRAMES + RESAMPLER_TAPS + decimation_ / interpolation_ + 1);
+    output_.allocate(channels, RESAMPLER_BLOCK_FRAMES);
+    reset(0);
+
+    return true;
+}
+
+uint64_t Resampler::outputFrames(uint64_t inFrames) const
+{
+    return (inFrames * interpolation_ + decimation_ - 1) / decimation_;
+}
+
+int64_t Resampler::windowStart(uint64_t frame) const
+{
+    return static_cast<int64_t>(frame * decimation_ / interpolation_) - WINDOW_LEAD;
+}
+
+uint64_t Resampler::reset(uint64_t frame)
+{
+    next_ = frame;
+    base_ = windowStart(frame);
+    held_ = 0;
+
+    //the window of the first outputs reaches before the start of the input, that is silence
+    if (base_ < 0) {
+        pushSilence(static_cast<size_t>(-base_));
+        return 0;
+    }
+    return static_cast<uint64_t>(base_);
+}
+
+size_t Resampler::wanted(size_t frames) const
+{
+    if (frames == 0) {
+        return 0;
+    }
+
+    const int64_t needed = windowStart(next_ + frames - 1) + static_cast<int64_t>(RESAMPLER_TAPS) - (base_ + static_cast<int64_t>(held_));
+    return std::min(static_cast<size_t>(std::max<int64_t>(needed, 0)), room());
+}
+
+size_t Resampler::room() const
+{
+    const int64_t end = base_ + static_cast<int64_t>(held_);
+    const int64_t keep = std::min(std::max(windowStart(next_), base_), end);
+    return history_.frames() - static_cast<size_t>(end - keep);
+}
+
+void Resampler::compact()
+{
+    //everything before the window of the next output has been used up
+    const int64_t keep = std::min(std::max(windowStart(next_), base_), base_ + static_cast<int64_t>(held_));
+    const size_t drop = static_cast<size_t>(keep - base_);
+    if (drop == 0) {
+        return;
+    }
+
+    for (size_t c = 0; c < history_.channels(); c++) {
+        float* plane = history_.channel(c);
+        memmove(plane, plane + drop, (held_ - drop) * sizeof(float));
+    }
+    base_ = keep;
+    held_ -= drop;
+}
+
+void Resampler::push(const PlanarBuffer& src, size_t frames, size_t offset)
+{
+    compact();
+    for (size_t c = 0; c < history_.channels(); c++) {
+        kernels().unpackInt16(src.channel(c) + offset, history_.channel(c) + held_, frames);
+    }
+    held_ += frames;
+}
+
+void Resampler::pushSilence(size_t frames)
+{
+    compact();
+    for (size_t c = 0; c < history_.channels(); c++) {
+        std::fill(history_.channel(c) + held_, history_.channel(c) + held_ + frames, 0.0f);
+    }
+    held_ += frames;
+}
+
+size_t Resampler::pull(PlanarBuffer& dst, size_t frames, size_t offset)
+{
+    const KernelTable& k = kernels();
+
+    //the last output whose whole window is in the history
+    const int64_t limit = base_ + static_cast<int64_t>(held_) - static_cast<int64_t>(RESAMPLER_TAPS) + WINDOW_LEAD;
+    if (limit < 0) {
+        return 0;
+    }
+    const uint64_t last = ((uint64_t(limit) + 1) * interpolation_ - 1) / decimation_;
+    if (last < next_) {
+        return 0;
+    }
+    frames = static_cast<size_t>(std::min<uint64_t>(frames, last - next_ + 1));
+
+    size_t done = 0;
+    while (done < frames) {
+        const size_t n = std::min(frames - done, output_.frames());
+        const size_t start = static_cast<size_t>(windowStart(next_) - base_);
+        const uint32_t phase = static_cast<uint32_t>(next_ * decimation_ % interpolation_);
+
+        for (size_t c = 0; c < history_.channels(); c++) {
+            k.polyphaseFloat(history_.channel(c) + start, output_.channel(c), n, bank_.data(), RESAMPLER_TAPS, phase, interpolation_, decimation_);
+            k.packInt16(output_.channel(c), dst.channel(c) + offset + done, n);
+        }
+        next_ += n;
+        done += n;
+    }
+
+    return done;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// TrackReader
+
+bool TrackReader::open(const char* filename, uint32_t rate)
+{
+    if (!file_.open(filename)) {
+        return false;
+    }
+
+    const WaveFormat& format = file_.format();
+    rate_ = rate ? rate : format.sampleRate;
+    resampled_ = rate_ != format.sampleRate;
+    position_ = 0;
+
+    if (!resampled_) {
+        numFrames_ = file_.numFrames();
+        return true;
+    }
+
+    if (format.bitsPerSample != 16) {
+        std::cerr << "Error: " << filename << " needs resampling and only 16-bit files can be" << std::endl;
+        return false;
+    }
+    if (!resampler_.init(format.sampleRate, rate_, format.numChannels)) {
+        return false;
+    }
+    input_.allocate(format.numChannels, RESAMPLER_BLOCK_FRAMES);
+    numFrames_ = resampler_.outputFrames(file_.numFrames());
+
+    return true;
+}
+
+size_t TrackReader::readPlanar(PlanarBuffer& dst, size_t frames, size_t offset)
+{
+    ScopedStage stage(Stage::Read);
+    frames = static_cast<size_t>(std::min<uint64_t>(frames, numFrames_ - std::min(position_, numFrames_)));
+
+    if (!resampled_) {
+        const size_t got = file_.readPlanar(dst, frames, offset);
+        position_ += got;
+        return got;
+    }
+
+    //convert what the history allows, then top it up with just the input the rest needs
+    size_t done = 0;
+    while (done < frames) {
+        {
+            ScopedStage convert(Stage::Convert);
+            done += resampler_.pull(dst, frames - done, offset + done);
+        }
+        if (done == frames) {
+            break;
+        }
+
+        const size_t wanted = std::min(resampler_.wanted(frames - done), input_.frames());
+        const size_t got = file_.readPlanar(input_, wanted);
+        resampler_.push(input_, got);
+        if (got < wanted) {
+            //the last windows reach past the end of the file
+            resampler_.pushSilence(wanted - got);
+        }
+    }
+    position_ += done;
+
+    return done;
+}
+
+bool TrackReader::seekFrame(uint64_t frame)
+{
+    position_ = frame;
+    if (!resampled_) {
+        return file_.seekFrame(frame);
+    }
+    return file_.seekFrame(resampler_.reset(frame));
+}
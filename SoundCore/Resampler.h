@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "AlignedBuffer.h"
+#include "PlanarBuffer.h"
+#include "WaveFile.h"
+
+constexpr size_t RESAMPLER_TAPS = 64;               // input samples under each output, a multiple of every SIMD width
+constexpr uint32_t RESAMPLER_MAX_PHASES = 1024;     // largest reduced output rate, 22.05 -> 48 kHz takes 320
+constexpr double RESAMPLER_CUTOFF = 0.9;            // middle of the transition band, as a fraction of the lower Nyquist
+constexpr double RESAMPLER_KAISER_BETA = 8.0;       // window shape, about 80 dB of stopband
+constexpr size_t RESAMPLER_BLOCK_FRAMES = 1 << 14;  // input frames taken in at a time, the history stays in L2
+
+// streaming polyphase sample-rate converter for 16-bit planes. The rate ratio is reduced to
+// interpolation / decimation and the windowed-sinc prototype is precomputed as one row of taps per phase,
+// so every output frame is a single dot product over RESAMPLER_TAPS input frames (KernelTable::polyphaseFloat).
+// The input history is carried from one block to the next, blocks of any size join seamlessly
+class Resampler
+{
+public:
+    // false if the reduced ratio needs more than RESAMPLER_MAX_PHASES phases
+    bool init(uint32_t inRate, uint32_t outRate, size_t channels);
+
+    uint32_t interpolation() const { return interpolation_; }
+    uint32_t decimation() const { return decimation_; }
+
+    // output frames 'inFrames' input frames give, the last one sits at or before the last input frame
+    uint64_t outputFrames(uint64_t inFrames) const;
+
+    // starts again at output frame 'frame' with an empty history, returns the input frame the next push has to start at
+    uint64_t reset(uint64_t frame);
+
+    // input frames still to push before 'frames' more output frames can be pulled, at most room()
+    size_t wanted(size_t frames) const;
+
+    // input frames the history can take in one push
+    size_t room() const;
+
+    // appends 'frames' input frames from frame 'offset' of 'src', at most room()
+    void push(const PlanarBuffer& src, size_t frames, size_t offset = 0);
+
+    // appends silence, past the end of the input
+    void pushSilence(size_t frames);
+
+    // converts up to 'frames' output frames into 'dst' from frame 'offset' on, rounded and saturated to 16 bits.
+    // Returns how many the history allowed
+    size_t pull(PlanarBuffer& dst, size_t frames, size_t offset = 0);
+
+private:
+    int64_t windowStart(uint64_t frame) const;
+    void compact();
+
+    uint32_t interpolation_ = 1;
+    uint32_t decimation_ = 1;
+    AlignedBuffer<float> bank_;                     // interpolation_ rows of RESAMPLER_TAPS coefficients
+    FloatPlanarBuffer history_;                     // input frames from base_ on, at the 16-bit scale
+    FloatPlanarBuffer output_;                      // converted frames on their way to 16 bits
+    int64_t base_ = 0;                              // input frame held at history_ index 0, negative before the start
+    size_t held_ = 0;
+    uint64_t next_ = 0;                             // next output frame
+};
+
+// an input track as the mixer sees it: 16-bit planes at the mix rate. A file at another rate goes through
+// a Resampler on the way in, one at the mix rate is read as is
+class TrackReader
+{
+public:
+    // 'rate' is the mix rate, 0 keeps the file's own
+    bool open(const char* filename, uint32_t rate = 0);
+
+    const WaveFormat& format() const { return file_.format(); }  // of the file, not of the frames read
+    const WaveReader& file() const { return file_; }
+    uint32_t rate() const { return rate_; }
+    bool resampled() const { return resampled_; }
+
+    uint64_t numFrames() const { return numFrames_; }   // at the mix rate
+    uint64_t position() const { return position_; }     // frames at the mix rate already read
+
+    // reads up to 'frames' frames into the planes of 'dst' from frame 'offset' on, as WaveReader::readPlanar
+    size_t readPlanar(PlanarBuffer& dst, size_t frames, size_t offset = 0);
+
+    bool seekFrame(uint64_t frame);
+
+private:
+    WaveReader file_;
+    Resampler resampler_;
+    PlanarBuffer input_;                            // file frames on their way to the resampler
+    uint32_t rate_ = 0;
+    bool resampled_ = false;
+    uint64_t numFrames_ = 0;
+    uint64_t position_ = 0;
+};
@@ -0,0 +1,85 @@
+#include "SampleFormat.h"
+
+#include <cstring>
+
+#include "Kernels.h"
+#include "Profiler.h"
+
+namespace
+{
+    struct FormatInfo
+    {
+        SampleFormat format;
+        const char* name;
+        uint16_t audioFormat;
+        uint16_t bitsPerSample;
+    };
+
+    const FormatInfo FORMATS[] = {
+        { SampleFormat::Int16, "int16", WAVE_FORMAT_PCM, 16 },
+        { SampleFormat::Int24, "int24", WAVE_FORMAT_PCM, 24 },
+        { SampleFormat::Int32, "int32", WAVE_FORMAT_PCM, 32 },
+        { SampleFormat::Float, "float", WAVE_FORMAT_IEEE_FLOAT, 32 },
+    };
+
+    const FormatInfo& info(SampleFormat format)
+    {
+        return FORMATS[static_cast<int>(format)];
+    }
+}
+
+bool parseSampleFormat(const char* name, SampleFormat& format)
+{
+    for (const FormatInfo& f : FORMATS) {
+        if (strcmp(name, f.name) == 0) {
+            format = f.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* sampleFormatName(SampleFormat format)
+{
+    return info(format).name;
+}
+
+WaveFormat makeWaveFormat(SampleFormat format, uint16_t numChannels, uint32_t sampleRate)
+{
+    WaveFormat wave;
+    wave.audioFormat = info(format).audioFormat;
+    wave.numChannels = numChannels;
+    wave.sampleRate = sampleRate;
+    wave.bitsPerSample = info(format).bitsPerSample;
+    return wave;
+}
+
+bool sampleFormatOf(const WaveFormat& wave, SampleFormat& format)
+{
+    for (const FormatInfo& f : FORMATS) {
+        if (wave.audioFormat == f.audioFormat && wave.bitsPerSample == f.bitsPerSample) {
+            format = f.format;
+            return true;
+        }
+    }
+    return false;
+}
+
+void convertSamples(const float* src, void* dst, size_t count, SampleFormat format, uint64_t position)
+{
+    ScopedStage stage(Stage::Convert);
+    switch (format) {
+    case SampleFormat::Int16:
+        kernels().packInt16Dither(src, static_cast<short*>(dst), count, position);
+        break;
+    case SampleFormat::Int24:
+        kernels().packInt24(src, static_cast<unsigned char*>(dst), count);
+        break;
+    case SampleFormat::Int32:
+        kernels().packInt32(src, static_cast<int32_t*>(dst), count);
+        break;
+    case SampleFormat::Float:
+        memcpy(dst, src, count * sizeof(float));
+        break;
+    }
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "WaveFile.h"
+
+// what the float bus is written out as
+enum class SampleFormat
+{
+    Int16,  // 16-bit PCM with TPDF dither
+    Int24,  // packed 24-bit PCM
+    Int32,  // 32-bit PCM
+    Float   // 32-bit IEEE float, the bus as is
+};
+
+// "int16", "int24", "int32" or "float", false for anything else
+bool parseSampleFormat(const char* name, SampleFormat& format);
+
+const char* sampleFormatName(SampleFormat format);
+
+// the wave format that stores 'format' samples
+WaveFormat makeWaveFormat(SampleFormat format, uint16_t numChannels, uint32_t sampleRate);
+
+// the SampleFormat a wave format stores, false if it isn't one of them
+bool sampleFormatOf(const WaveFormat& wave, SampleFormat& format);
+
+// converts 'count' interleaved bus samples to the sample layout of 'format' at 'dst'. 'position' is the index
+// of src[0] among all the samples of the stream, the int16 dither follows it so separately converted blocks join exactly
+void convertSamples(const float* src, void* dst, size_t count, SampleFormat format, uint64_t position);
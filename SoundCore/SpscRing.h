@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "AlignedBuffer.h"
+
+constexpr size_t CACHE_LINE_SIZE = 64;              // keeps the two ends of a ring off each other's line
+
+// lock-free ring of fixed-size blocks between exactly one producer thread and one consumer thread.
+// The producer fills the slot from acquire() and hands it over with publish(), the consumer reads the one
+// from front() and gives it back with release(). Neither side ever blocks, an empty or full ring returns nullptr
+class SpscRing
+{
+public:
+    SpscRing(size_t numBlocks, size_t blockBytes)
+        : slots_(numBlocks + 1)
+    {
+        //one slot always stays empty so full and empty can be told apart from the indices alone
+        for (Slot& slot : slots_) {
+            slot.buffer.allocate(blockBytes);
+        }
+    }
+
+    SpscRing(const SpscRing&) = delete;
+    SpscRing& operator=(const SpscRing&) = delete;
+
+    size_t blockBytes() const { return slots_[0].buffer.size(); }
+
+    // producer: the next free slot, nullptr while the ring is full
+    char* acquire()
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        if (next(head) == tail_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return slots_[head].buffer.data();
+    }
+
+    // producer: hands the acquired slot over with 'bytes' of it filled
+    void publish(size_t bytes)
+    {
+        const size_t head = head_.load(std::memory_order_relaxed);
+        slots_[head].bytes = bytes;
+        head_.store(next(head), std::memory_order_release);
+    }
+
+    // consumer: the oldest published slot, nullptr while the ring is empty
+    const char* front(size_t& bytes)
+    {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail == head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        bytes = slots_[tail].bytes;
+        return slots_[tail].buffer.data();
+    }
+
+    // consumer: gives the front slot back to the producer
+    void release()
+    {
+        tail_.store(next(tail_.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+private:
+    struct Slot
+    {
+        AlignedBuffer<char> buffer;
+        size_t bytes = 0;
+    };
+
+    size_t next(size_t index) const { return index + 1 == slots_.size() ? 0 : index + 1; }
+
+    std::vector<Slot> slots_;
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> head_{ 0 };    // written by the producer only
+    alignas(CACHE_LINE_SIZE) std::atomic<size_t> tail_{ 0 };    // written by the consumer only
+};
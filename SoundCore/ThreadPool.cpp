@@ -0,0 +1,212 @@
+#include "ThreadPool.h"
+
+#include <chrono>
+
+namespace
+{
+    //which pool and queue the running thread works for, so nested submissions stay local
+    thread_local const ThreadPool* currentPool = nullptr;
+    thread_local unsigned currentQueue = 0;
+}
+
+struct ThreadPool::Job
+{
+    std::function<void(uint64_t, uint64_t)> fn;
+    uint64_t grain;
+    std::atomic<uint64_t> remaining;                // elements not processed yet
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+    if (numThreads == 0) {
+        numThreads = std::thread::hardware_concurrency();
+    }
+    if (numThreads == 0) {
+        numThreads = 1;
+    }
+
+    for (unsigned i = 0; i < numThreads; i++) {
+        queues_.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < numThreads; i++) {
+        threads_.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+
+    for (std::thread& thread : threads_) {
+        thread.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+void ThreadPool::submit(Task task)
+{
+    push(std::move(task), nullptr);
+}
+
+void ThreadPool::push(Task task, const Job* job)
+{
+    //workers push onto their own queue, everybody else spreads the tasks round robin
+    const unsigned index = currentPool == this ? currentQueue : nextQueue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lock(queues_[index]->mutex);
+        queues_[index]->tasks.push_back({ std::move(task), job });
+    }
+    queued_++;
+
+    //taking the lock orders us against a worker that is about to sleep
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex_);
+    }
+    wake_.notify_one();
+}
+
+namespace
+{
+    //any task, or only those of 'job' when it is set
+    template <typename Iterator>
+    Iterator findTask(Iterator first, Iterator last, const void* job)
+    {
+        if (!job) {
+            return first;
+        }
+        for (; first != last; ++first) {
+            if (first->job == job) {
+                break;
+            }
+        }
+        return first;
+    }
+}
+
+bool ThreadPool::tryPop(unsigned index, Task& task, const Job* job)
+{
+    Queue& queue = *queues_[index];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+
+    //newest first, it is the one whose data is still in cache
+    auto it = findTask(queue.tasks.rbegin(), queue.tasks.rend(), job);
+    if (it == queue.tasks.rend()) {
+        return false;
+    }
+
+    task = std::move(it->task);
+    queue.tasks.erase(std::next(it).base());
+    queued_--;
+
+    return true;
+}
+
+bool ThreadPool::trySteal(unsigned start, Task& task, const Job* job)
+{
+    for (size_t n = 0; n < queues_.size(); n++) {
+        Queue& queue = *queues_[(start + n) % queues_.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+
+        //oldest first, for split ranges that is the biggest piece
+        auto it = findTask(queue.tasks.begin(), queue.tasks.end(), job);
+        if (it != queue.tasks.end()) {
+            task = std::move(it->task);
+            queue.tasks.erase(it);
+            queued_--;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ThreadPool::runPending()
+{
+    Task task;
+    const bool found = currentPool == this
+        ? tryPop(currentQueue, task, nullptr) || trySteal(currentQueue + 1, task, nullptr)
+        : trySteal(nextQueue_++, task, nullptr);
+
+    if (found) {
+        task();
+    }
+
+    return found;
+}
+
+void ThreadPool::workerLoop(unsigned index)
+{
+    currentPool = this;
+    currentQueue = index;
+
+    for (;;) {
+        Task task;
+        if (tryPop(index, task, nullptr) || trySteal(index + 1, task, nullptr)) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+        if (stop_ && queued_ == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::splitRange(uint64_t begin, uint64_t end, const std::shared_ptr<Job>& job)
+{
+    //keep the first half and offer the second one to thieves until we are down to one block
+    while (end - begin > job->grain) {
+        const uint64_t blocks = (end - begin + job->grain - 1) / job->grain;
+        const uint64_t mid = begin + blocks / 2 * job->grain;
+
+        push([this, mid, end, job] { splitRange(mid, end, job); }, job.get());
+        end = mid;
+    }
+
+    job->fn(begin, end);
+
+    if (job->remaining.fetch_sub(end - begin) == end - begin) {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done.notify_all();
+    }
+}
+
+void ThreadPool::parallelFor(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& fn)
+{
+    if (begin >= end) {
+        return;
+    }
+
+    auto job = std::make_shared<Job>();
+    job->fn = fn;
+    job->grain = grain > 0 ? grain : 1;
+    job->remaining = end - begin;
+
+    splitRange(begin, end, job);
+
+    //help with the blocks of this job until it is complete
+    const unsigned home = currentPool == this ? currentQueue : 0;
+    while (job->remaining > 0) {
+        Task task;
+        if ((currentPool == this && tryPop(home, task, job.get())) || trySteal(home, task, job.get())) {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(job->mutex);
+        job->done.wait_for(lock, std::chrono::milliseconds(1), [&job] { return job->remaining == 0; });
+    }
+}
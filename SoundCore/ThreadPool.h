@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// persistent pool of workers, each with its own deque. A worker takes its newest task first and,
+// when it runs dry, steals the oldest task of another worker, so a descheduled thread only delays
+// the block it is on while the others drain its queue
+class ThreadPool
+{
+public:
+    using Task = std::function<void()>;
+
+    // 0 threads = one per hardware thread
+    explicit ThreadPool(unsigned numThreads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return static_cast<unsigned>(threads_.size()); }
+
+    // queues a task, there is no completion signal so the task has to publish its own
+    void submit(Task task);
+
+    // runs fn(blockBegin, blockEnd) over [begin, end) in blocks of 'grain' and returns when all are done.
+    // The range is split in halves on demand so idle workers steal big pieces first.
+    // The calling thread runs blocks of this same call while it waits, never unrelated tasks,
+    // so nesting parallelFor can't pile up frames on the stack
+    void parallelFor(uint64_t begin, uint64_t end, uint64_t grain, const std::function<void(uint64_t, uint64_t)>& fn);
+
+    // runs one queued task on the calling thread, false if there was none
+    bool runPending();
+
+    // pool shared by the whole process, sized from hardware_concurrency()
+    static ThreadPool& shared();
+
+private:
+    struct Job;
+
+    struct Entry
+    {
+        Task task;
+        const Job* job;                             // the parallelFor it belongs to, nullptr for submit()
+    };
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<Entry> tasks;
+    };
+
+    void push(Task task, const Job* job);
+    void workerLoop(unsigned index);
+    bool tryPop(unsigned index, Task& task, const Job* job);
+    bool trySteal(unsigned start, Task& task, const Job* job);
+    void splitRange(uint64_t begin, uint64_t end, const std::shared_ptr<Job>& job);
+
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::vector<std::thread> threads_;
+    std::atomic<size_t> queued_{ 0 };
+    std::atomic<unsigned> nextQueue_{ 0 };
+    std::mutex wakeMutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+};
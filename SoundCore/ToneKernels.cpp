@@ -0,0 +1,143 @@
+#include "ToneKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "AlignedBuffer.h"
+#include "Kernels.h"
+#include "Profiler.h"
+
+namespace
+{
+    template <SampleFormat Format>
+    constexpr size_t SAMPLE_BYTES = Format == SampleFormat::Int16 ? 2 : Format == SampleFormat::Int24 ? 3 : 4;
+
+    //one channel of the chunk on the bus, the sine from its kernel and the others from their wavetable level
+    template <bool Sine>
+    void oscillate(const KernelTable& k, float* dst, size_t count, double phase, double increment, float amplitude, const float* table)
+    {
+        if constexpr (Sine) {
+            k.sineFloat(dst, count, phase, increment, amplitude);
+        } else {
+            k.wavetableFloat(dst, count, phase, increment, amplitude, table, WAVETABLE_SIZE);
+        }
+    }
+
+    //what convertSamples does, with the format known at compile time
+    template <SampleFormat Format>
+    void pack(const KernelTable& k, const float* src, char* dst, size_t count, uint64_t position)
+    {
+        if constexpr (Format == SampleFormat::Int16) {
+            k.packInt16Dither(src, reinterpret_cast<short*>(dst), count, position);
+        } else if constexpr (Format == SampleFormat::Int24) {
+            k.packInt24(src, reinterpret_cast<unsigned char*>(dst), count);
+        } else if constexpr (Format == SampleFormat::Int32) {
+            k.packInt32(src, reinterpret_cast<int32_t*>(dst), count);
+        } else {
+            memcpy(dst, src, count * sizeof(float));
+        }
+    }
+
+    struct ToneEntry
+    {
+        SampleFormat format;
+        size_t channels;
+        bool sine;
+        ToneRenderer render;
+    };
+
+    const ToneEntry TONE_RENDERERS[] = {
+        { SampleFormat::Int16, 1, true, renderTone<SampleFormat::Int16, 1, true> },
+        { SampleFormat::Int16, 1, false, renderTone<SampleFormat::Int16, 1, false> },
+        { SampleFormat::Int16, 2, true, renderTone<SampleFormat::Int16, 2, true> },
+        { SampleFormat::Int16, 2, false, renderTone<SampleFormat::Int16, 2, false> },
+        { SampleFormat::Float, 1, true, renderTone<SampleFormat::Float, 1, true> },
+        { SampleFormat::Float, 1, false, renderTone<SampleFormat::Float, 1, false> },
+        { SampleFormat::Float, 2, true, renderTone<SampleFormat::Float, 2, true> },
+        { SampleFormat::Float, 2, false, renderTone<SampleFormat::Float, 2, false> },
+    };
+}
+
+template <SampleFormat Format, size_t Channels, bool Sine>
+void renderTone(const ToneBlock& tone, void* dst, size_t frames, uint64_t position)
+{
+    ScopedStage stage(Stage::Generate);
+    const KernelTable& k = kernels();
+    constexpr size_t FRAME_BYTES = SAMPLE_BYTES<Format> * Channels;
+    constexpr bool IN_PLACE = Format == SampleFormat::Float && Channels == 1;
+
+    const float* tables[Channels] = {};
+    if constexpr (!Sine) {
+        for (size_t c = 0; c < Channels; c++) {
+            tables[c] = Wavetable::get(tone.waveform).level(Wavetable::levelFor(tone.increment[c]));
+        }
+    }
+
+    alignas(PLANE_ALIGNMENT) float planes[Channels][TONE_CHUNK_FRAMES];
+    char* out = static_cast<char*>(dst);
+    for (size_t done = 0; done < frames; done += TONE_CHUNK_FRAMES) {
+        const size_t n = std::min(TONE_CHUNK_FRAMES, frames - done);
+
+        //the kernels wrap the phase themselves, it only moves on by the chunk
+        for (size_t c = 0; c < Channels; c++) {
+            float* plane = IN_PLACE ? reinterpret_cast<float*>(out + done * FRAME_BYTES) : planes[c];
+            oscillate<Sine>(k, plane, n, tone.phase[c] + done * tone.increment[c], tone.increment[c], tone.amplitude, tables[c]);
+        }
+
+        if constexpr (IN_PLACE) {
+            continue;
+        } else if constexpr (Channels == 1) {
+            pack<Format>(k, planes[0], out + done * FRAME_BYTES, n, position + done);
+        } else {
+            alignas(PLANE_ALIGNMENT) float bus[Channels * TONE_CHUNK_FRAMES];
+            const float* sources[Channels];
+            for (size_t c = 0; c < Channels; c++) {
+                sources[c] = planes[c];
+            }
+            k.interleaveFloat(sources, bus, Channels, n);
+            pack<Format>(k, bus, out + done * FRAME_BYTES, n * Channels, (position + done) * Channels);
+        }
+    }
+}
+
+template void renderTone<SampleFormat::Int16, 1, true>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Int16, 1, false>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Int16, 2, true>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Int16, 2, false>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Float, 1, true>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Float, 1, false>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Float, 2, true>(const ToneBlock&, void*, size_t, uint64_t);
+template void renderTone<SampleFormat::Float, 2, false>(const ToneBlock&, void*, size_t, uint64_t);
+
+ToneRenderer toneRenderer(SampleFormat format, size_t channels, Waveform waveform)
+{
+    const bool sine = waveform == Waveform::Sine;
+    for (const ToneEntry& entry : TONE_RENDERERS) {
+        if (entry.format == format && entry.channels == channels && entry.sine == sine) {
+            return entry.render;
+        }
+    }
+    return nullptr;
+}
+
+void renderToneGeneric(const ToneBlock& tone, SampleFormat format, void* dst, size_t frames, uint64_t position)
+{
+    FloatPlanarBuffer planes(tone.channels, frames);
+    for (size_t c = 0; c < tone.channels; c++) {
+        generateWaveform(tone.waveform, planes.channel(c), frames, tone.phase[c], tone.increment[c], tone.amplitude);
+    }
+
+    AlignedBuffer<float> bus(frames * tone.channels);
+    kernels().interleaveFloat(planes.planes(), bus.data(), tone.channels, frames);
+    convertSamples(bus.data(), dst, frames * tone.channels, format, position * tone.channels);
+}
+
+void renderToneBlock(const ToneBlock& tone, SampleFormat format, void* dst, size_t frames, uint64_t position)
+{
+    const ToneRenderer render = toneRenderer(format, tone.channels, tone.waveform);
+    if (render) {
+        render(tone, dst, frames, position);
+    } else {
+        renderToneGeneric(tone, format, dst, frames, position);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "PlanarBuffer.h"
+#include "SampleFormat.h"
+#include "Wavetable.h"
+
+constexpr size_t TONE_CHUNK_FRAMES = 2048;          // frames generated and converted at a time, their bus stays in L1
+
+// one block of a tone, every channel with its own pitch
+struct ToneBlock
+{
+    Waveform waveform = Waveform::Sine;
+    float amplitude = 1.0f;                         // peak on the float bus
+    size_t channels = 1;
+    double phase[MAX_CHANNELS] = {};                // cycles at the block's first frame
+    double increment[MAX_CHANNELS] = {};            // cycles per frame
+};
+
+// renders 'frames' interleaved frames of 'tone' into 'dst' in the output sample format. 'position' is the index
+// of the block's first frame in the stream, the int16 dither follows it
+using ToneRenderer = void (*)(const ToneBlock& tone, void* dst, size_t frames, uint64_t position);
+
+// a tone renderer with the sample format, the channel count and the kind of oscillator fixed at compile time.
+// Each chunk of TONE_CHUNK_FRAMES goes from the oscillator kernels through the interleave (none for mono) into
+// the pack kernel of the format while it is still in L1, with no per block switches on the way and a mono float
+// tone rendered straight into the output. Explicitly instantiated in ToneKernels.cpp for int16 and float,
+// mono and stereo, sine and wavetable; those are all that exist
+template <SampleFormat Format, size_t Channels, bool Sine>
+void renderTone(const ToneBlock& tone, void* dst, size_t frames, uint64_t position);
+
+// the instantiation for 'format', 'channels' and 'waveform', nullptr when there is none
+ToneRenderer toneRenderer(SampleFormat format, size_t channels, Waveform waveform);
+
+// any format and channel count the long way: the whole block generated into planes, interleaved and converted
+void renderToneGeneric(const ToneBlock& tone, SampleFormat format, void* dst, size_t frames, uint64_t position);
+
+// the specialized renderer when there is one, else the generic path
+void renderToneBlock(const ToneBlock& tone, SampleFormat format, void* dst, size_t frames, uint64_t position);
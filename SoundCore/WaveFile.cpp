@@ -0,0 +1,957 @@
+#include "WaveFile.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include "Kernels.h"
+#include "Overview.h"
+#include "Profiler.h"
+#include "SampleFormat.h"
+
+namespace
+{
+    //Wave64 chunk ids, every chunk header is a 16 byte GUID followed by a 64-bit size
+    const unsigned char W64_RIFF[16] = { 'r', 'i', 'f', 'f', 0x2E, 0x91, 0xCF, 0x11, 0xA5, 0xD6, 0x28, 0xDB, 0x04, 0xC1, 0x00, 0x00 };
+    const unsigned char W64_WAVE[16] = { 'w', 'a', 'v', 'e', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const unsigned char W64_FMT[16]  = { 'f', 'm', 't', ' ', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+    const unsigned char W64_DATA[16] = { 'd', 'a', 't', 'a', 0xF3, 0xAC, 0xD3, 0x11, 0x8C, 0xD1, 0x00, 0xC0, 0x4F, 0x8E, 0xDB, 0x8A };
+
+    const char* const CONTAINER_NAMES[] = { "riff", "rf64", "w64", "flac" };   // in WaveContainer order
+
+    constexpr uint64_t RIFF_MAX_SIZE = 0xFFFFFFFFull;
+    constexpr int64_t BLOCK_LOADING = INT64_MIN;    // a read-ahead slot whose read hasn't completed
+    constexpr uint32_t DS64_SIZE = 28;              // riff size, data size, sample count and an empty table
+
+    uint16_t getLE16(const unsigned char* p) { return static_cast<uint16_t>(p[0] | p[1] << 8); }
+    uint32_t getLE32(const unsigned char* p) { return getLE16(p) | static_cast<uint32_t>(getLE16(p + 2)) << 16; }
+    uint64_t getLE64(const unsigned char* p) { return getLE32(p) | static_cast<uint64_t>(getLE32(p + 4)) << 32; }
+
+    unsigned char* putLE16(unsigned char* p, uint16_t v) { p[0] = v & 0xFF; p[1] = v >> 8; return p + 2; }
+    unsigned char* putLE32(unsigned char* p, uint32_t v) { putLE16(p, v & 0xFFFF); return putLE16(p + 2, v >> 16); }
+    unsigned char* putLE64(unsigned char* p, uint64_t v) { putLE32(p, v & 0xFFFFFFFF); return putLE32(p + 4, v >> 32); }
+    unsigned char* putTag(unsigned char* p, const char* tag) { memcpy(p, tag, 4); return p + 4; }
+
+    //speaker positions of the usual layouts (mono, stereo, quad, 5.1, 7.1), 0 = unassigned for the rest
+    uint32_t channelMask(uint16_t numChannels)
+    {
+        switch (numChannels) {
+        case 1: return 0x4;                                         // FC
+        case 2: return 0x3;                                         // FL FR
+        case 4: return 0x33;                                        // FL FR BL BR
+        case 6: return 0x3F;                                        // FL FR FC LFE BL BR
+        case 8: return 0x63F;                                       // FL FR FC LFE BL BR SL SR
+        default: return 0;
+        }
+    }
+
+    //the fmt body we write, plain PCM when possible and EXTENSIBLE when the spec requires it
+    size_t buildFmt(unsigned char* p, const WaveFormat& format)
+    {
+        const bool extensible = format.numChannels > 2 || (format.bitsPerSample > 16 && format.audioFormat == WAVE_FORMAT_PCM);
+        const bool isFloat = format.audioFormat == WAVE_FORMAT_IEEE_FLOAT;
+
+        unsigned char* q = p;
+        q = putLE16(q, extensible ? WAVE_FORMAT_EXTENSIBLE : format.audioFormat);
+        q = putLE16(q, format.numChannels);
+        q = putLE32(q, format.sampleRate);
+        q = putLE32(q, format.byteRate());
+        q = putLE16(q, format.blockAlign());
+        q = putLE16(q, format.bitsPerSample);
+
+        if (extensible) {
+            q = putLE16(q, 22);                                     // cbSize
+            q = putLE16(q, format.bitsPerSample);                   // valid bits
+            q = putLE32(q, channelMask(format.numChannels));
+            //KSDATAFORMAT_SUBTYPE_PCM / _IEEE_FLOAT share everything but the first two bytes
+            const unsigned char subFormat[14] = { 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0x80, 0x00, 0x00, 0xAA, 0x00, 0x38, 0x9B, 0x71 };
+            q = putLE16(q, format.audioFormat);
+            memcpy(q, subFormat, sizeof subFormat);
+            q += sizeof subFormat;
+        }
+        else if (isFloat) {
+            q = putLE16(q, 0);                                      // cbSize
+        }
+
+        return q - p;
+    }
+}
+
+bool parseWaveContainer(const char* name, WaveContainer& container)
+{
+    for (size_t i = 0; i < sizeof CONTAINER_NAMES / sizeof CONTAINER_NAMES[0]; i++) {
+        if (strcmp(name, CONTAINER_NAMES[i]) == 0) {
+            container = static_cast<WaveContainer>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* waveContainerName(WaveContainer container)
+{
+    return CONTAINER_NAMES[static_cast<int>(container)];
+}
+
+const char* waveContainerExtension(WaveContainer container)
+{
+    switch (container) {
+    case WaveContainer::W64: return ".w64";
+    case WaveContainer::FLAC: return ".flac";
+    default: return ".wav";
+    }
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// WaveReader
+
+bool WaveReader::open(const char* filename)
+{
+    ScopedStage stage(Stage::Parse);
+    close();
+
+    file_.open(filename, std::ios::binary);
+    if (!file_) {
+        std::cerr << "Error: could not open input file " << filename << std::endl;
+        return false;
+    }
+
+    file_.seekg(0, std::ios::end);
+    fileSize_ = static_cast<uint64_t>(file_.tellg());
+    file_.seekg(0, std::ios::beg);
+
+    unsigned char id[16];
+    if (!file_.read(reinterpret_cast<char*>(id), sizeof id)) {
+        std::cerr << "Error: " << filename << " is too short to be a wave file" << std::endl;
+        return false;
+    }
+
+    bool ok;
+    if (memcmp(id, W64_RIFF, 16) == 0) {
+        ok = parseW64();
+    }
+    else if (memcmp(id + 8, "WAVE", 4) == 0 && (memcmp(id, "RIFF", 4) == 0 || memcmp(id, "RF64", 4) == 0 || memcmp(id, "BW64", 4) == 0)) {
+        ok = parseRiff(memcmp(id, "RIFF", 4) != 0);
+    }
+    else if (memcmp(id, "fLaC", 4) == 0) {
+        ok = parseFlac();
+    }
+    else {
+        std::cerr << "Error: " << filename << " is not a RIFF, RF64, W64 or FLAC file" << std::endl;
+        ok = false;
+    }
+
+    //the samples come through the async file from here on
+    file_.close();
+    if (!ok || !data_.open(filename, AsyncFile::Access::Read, WAVE_QUEUE_BLOCKS)) {
+        close();
+        return false;
+    }
+
+    if (blocks_.empty()) {
+        for (size_t i = 0; i < WAVE_QUEUE_BLOCKS; i++) {
+            blocks_.emplace_back(WAVE_BLOCK_SIZE);
+        }
+    }
+    blockBytes_.assign(WAVE_QUEUE_BLOCKS, 0);
+    //FLAC frames run to the end of the file
+    const uint64_t end = compressed_ ? fileSize_ : dataOffset_ + dataSize_;
+    lastBlock_ = end > 0 ? (end - 1) / WAVE_BLOCK_SIZE : 0;
+    primed_ = false;
+
+    return seekFrame(0);
+}
+
+bool WaveReader::parseRiff(bool rf64)
+{
+    uint64_t ds64DataSize = 0;
+    bool haveFmt = false, haveData = false;
+
+    uint64_t offset = 12;
+    while (offset + 8 <= fileSize_ && !(haveFmt && haveData)) {
+        unsigned char header[8];
+        file_.seekg(offset);
+        if (!file_.read(reinterpret_cast<char*>(header), 8)) {
+            break;
+        }
+        uint64_t size = getLE32(header + 4);
+        const uint64_t body = offset + 8;
+
+        if (memcmp(header, "ds64", 4) == 0) {
+            unsigned char ds64[DS64_SIZE];
+            if (size < 24 || !file_.read(reinterpret_cast<char*>(ds64), 24)) {
+                std::cerr << "Error: truncated ds64 chunk" << std::endl;
+                return false;
+            }
+            ds64DataSize = getLE64(ds64 + 8);
+        }
+        else if (memcmp(header, "fmt ", 4) == 0) {
+            if (!parseFmt(size)) {
+                return false;
+            }
+            haveFmt = true;
+        }
+        else if (memcmp(header, "data", 4) == 0) {
+            if (rf64 && size == RIFF_MAX_SIZE) {
+                size = ds64DataSize;
+            }
+            //a writer that died before patching the header leaves 0 (a stream header 0xFFFFFFFF), the samples then
+            //run to the end of the file. Sizes past the end are cut to it
+            if (size == 0 || size == RIFF_MAX_SIZE) {
+                size = fileSize_ - body;
+            }
+            dataOffset_ = body;
+            dataSize_ = std::min(size, fileSize_ - body);
+            haveData = true;
+        }
+
+        //chunks are word aligned, odd sizes carry a pad byte
+        offset = body + size + (size & 1);
+    }
+
+    if (!haveFmt || !haveData) {
+        std::cerr << "Error: wave file without " << (haveFmt ? "data" : "fmt ") << " chunk" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool WaveReader::parseW64()
+{
+    bool haveFmt = false, haveData = false;
+
+    //riff GUID + size + wave GUID
+    uint64_t offset = 40;
+    while (offset + 24 <= fileSize_ && !(haveFmt && haveData)) {
+        unsigned char header[24];
+        file_.seekg(offset);
+        if (!file_.read(reinterpret_cast<char*>(header), 24)) {
+            break;
+        }
+        const uint64_t size = getLE64(header + 16);         // includes the 24 byte header
+        if (size < 24) {
+            std::cerr << "Error: corrupt Wave64 chunk" << std::endl;
+            return false;
+        }
+
+        if (memcmp(header, W64_FMT, 16) == 0) {
+            if (!parseFmt(size - 24)) {
+                return false;
+            }
+            haveFmt = true;
+        }
+        else if (memcmp(header, W64_DATA, 16) == 0) {
+            dataOffset_ = offset + 24;
+            dataSize_ = std::min(size - 24, fileSize_ - dataOffset_);
+            haveData = true;
+        }
+
+        //Wave64 chunks are 8 byte aligned
+        offset += (size + 7) & ~7ull;
+    }
+
+    if (!haveFmt || !haveData) {
+        std::cerr << "Error: wave file without " << (haveFmt ? "data" : "fmt ") << " chunk" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool WaveReader::parseFmt(uint64_t size)
+{
+    unsigned char fmt[40] = {};
+    if (size < 16 || !file_.read(reinterpret_cast<char*>(fmt), std::min<uint64_t>(size, sizeof fmt))) {
+        std::cerr << "Error: truncated fmt chunk" << std::endl;
+        return false;
+    }
+
+    format_.audioFormat = getLE16(fmt);
+    format_.numChannels = getLE16(fmt + 2);
+    format_.sampleRate = getLE32(fmt + 4);
+    format_.bitsPerSample = getLE16(fmt + 14);
+
+    //for EXTENSIBLE the real format is in the first two bytes of the sub-format GUID
+    if (format_.audioFormat == WAVE_FORMAT_EXTENSIBLE && size >= 40) {
+        format_.audioFormat = getLE16(fmt + 24);
+    }
+
+    if (format_.numChannels == 0 || format_.bitsPerSample % 8 != 0 || format_.bitsPerSample == 0) {
+        std::cerr << "Error: unsupported fmt chunk (" << format_.numChannels << " channels, "
+            << format_.bitsPerSample << " bits)" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool WaveReader::parseFlac()
+{
+    if (!flac_.open(file_, fileSize_)) {
+        return false;
+    }
+
+    //decoded the samples are plain PCM, and what the reads count in
+    const FlacStreamInfo& info = flac_.info();
+    format_.audioFormat = WAVE_FORMAT_PCM;
+    format_.numChannels = info.channels;
+    format_.sampleRate = info.sampleRate;
+    format_.bitsPerSample = info.bitsPerSample;
+    compressed_ = true;
+    dataOffset_ = flac_.firstFrame();
+    dataSize_ = info.totalFrames * format_.blockAlign();
+
+    return true;
+}
+
+void WaveReader::close()
+{
+    if (file_.is_open()) {
+        file_.close();
+    }
+    file_.clear();
+    data_.close();
+    primed_ = false;
+    compressed_ = false;
+    format_ = WaveFormat();
+    fileSize_ = dataOffset_ = dataSize_ = position_ = 0;
+}
+
+size_t WaveReader::read(void* dst, size_t bytes)
+{
+    ScopedStage stage(Stage::Read);
+    bytes = static_cast<size_t>(std::min<uint64_t>(bytes, dataSize_ - position_));
+    if (bytes == 0) {
+        return 0;
+    }
+
+    const size_t done = compressed_
+        ? flac_.read(position_, dst, bytes, [this](uint64_t offset, void* packed, size_t n) { return fetch(offset, packed, n); })
+        : fetch(dataOffset_ + position_, dst, bytes);
+    position_ += done;
+
+    return done;
+}
+
+size_t WaveReader::fetch(uint64_t offset, void* dst, size_t bytes)
+{
+    char* out = static_cast<char*>(dst);
+    size_t done = 0;
+    while (done < bytes) {
+        const size_t at = static_cast<size_t>(offset % WAVE_BLOCK_SIZE);
+        size_t got;
+        const char* block = blockAt(offset / WAVE_BLOCK_SIZE, got);
+        //a file cut short since it was opened ends the read there
+        if (!block || got <= at) {
+            break;
+        }
+
+        const size_t n = std::min(bytes - done, got - at);
+        memcpy(out + done, block + at, n);
+        done += n;
+        offset += n;
+    }
+
+    return done;
+}
+
+const char* WaveReader::blockAt(uint64_t index, size_t& bytes)
+{
+    const size_t depth = blocks_.size();
+
+    if (!primed_ || index < firstBlock_ || index >= firstBlock_ + depth) {
+        //a jump: what is loading now is of no use, the read-ahead starts over here in one batch
+        for (size_t slot = 0; slot < depth; slot++) {
+            settle(slot);
+        }
+        firstBlock_ = index;
+        for (uint64_t b = index; b < index + depth && b <= lastBlock_; b++) {
+            load(b);
+        }
+        primed_ = true;
+    } else {
+        //the blocks before this one are done with, their slots load the next ones
+        for (uint64_t b = firstBlock_; b < index; b++) {
+            settle(b % depth);
+            if (b + depth <= lastBlock_) {
+                load(b + depth);
+            }
+        }
+        firstBlock_ = index;
+    }
+    data_.submit();
+
+    const size_t slot = index % depth;
+    if (!settle(slot)) {
+        return nullptr;
+    }
+    bytes = static_cast<size_t>(blockBytes_[slot]);
+    return blocks_[slot].data();
+}
+
+void WaveReader::load(uint64_t index)
+{
+    const size_t slot = index % blocks_.size();
+    blockBytes_[slot] = BLOCK_LOADING;
+    data_.queueRead(blocks_[slot].data(), WAVE_BLOCK_SIZE, index * WAVE_BLOCK_SIZE, index);
+}
+
+//waits until the slot's read is in, taking whatever other reads complete first. False if it failed
+bool WaveReader::settle(size_t slot)
+{
+    while (blockBytes_[slot] == BLOCK_LOADING) {
+        uint64_t index;
+        int64_t result;
+        if (!data_.wait(index, result)) {
+            blockBytes_[slot] = 0;
+            break;
+        }
+        if (result < 0) {
+            std::cerr << "Error: could not read block " << index << " of the input file (" << strerror(static_cast<int>(-result)) << ")" << std::endl;
+        }
+        blockBytes_[index % blocks_.size()] = result;
+    }
+    return blockBytes_[slot] >= 0;
+}
+
+size_t WaveReader::readFrames(void* dst, size_t frames)
+{
+    const size_t frameSize = format_.blockAlign();
+    return read(dst, frames * frameSize) / frameSize;
+}
+
+size_t WaveReader::readPlanar(PlanarBuffer& dst, size_t frames, size_t offset)
+{
+    ScopedStage stage(Stage::Read);
+    const size_t channels = format_.numChannels;
+    if (format_.bitsPerSample != 16 || dst.channels() != channels) {
+        std::cerr << "Error: planar reads need 16-bit samples and a buffer with " << channels << " channels" << std::endl;
+        return 0;
+    }
+
+    //a mono plane is already the file layout
+    if (channels == 1) {
+        return readFrames(dst.channel(0) + offset, frames);
+    }
+
+    if (interleaved_.size() == 0) {
+        interleaved_.allocate(WAVE_BLOCK_SIZE / sizeof(short));
+    }
+    const size_t chunk = interleaved_.size() / channels;
+
+    std::vector<short*> planes(channels);
+    size_t done = 0;
+    while (done < frames) {
+        const size_t got = readFrames(interleaved_.data(), std::min(chunk, frames - done));
+        if (got == 0) {
+            break;
+        }
+        for (size_t c = 0; c < channels; c++) {
+            planes[c] = dst.channel(c) + offset + done;
+        }
+        kernels().deinterleaveInt16(interleaved_.data(), planes.data(), channels, got);
+        done += got;
+    }
+
+    return done;
+}
+
+bool WaveReader::seekFrame(uint64_t frame)
+{
+    //the next read finds out whether the blocks it needs are loading already
+    position_ = std::min(frame * format_.blockAlign(), dataSize_);
+    return data_.isOpen();
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// WaveWriter
+
+WaveWriter::WaveWriter() = default;
+
+WaveWriter::~WaveWriter()
+{
+    if (file_.isOpen()) {
+        close();
+    }
+}
+
+bool WaveWriter::open(const char* filename, const WaveFormat& format, WaveContainer container)
+{
+    if (file_.isOpen()) {
+        close();
+    }
+
+    if (container == WaveContainer::FLAC && (format.audioFormat != WAVE_FORMAT_PCM || !flac_.init(format.numChannels, format.bitsPerSample, format.sampleRate))) {
+        return false;
+    }
+
+    if (!file_.open(filename, AsyncFile::Access::Write, WAVE_QUEUE_BLOCKS)) {
+        return false;
+    }
+
+    if (blocks_.empty()) {
+        for (size_t i = 0; i < WAVE_QUEUE_BLOCKS; i++) {
+            blocks_.emplace_back(WAVE_BLOCK_SIZE);
+        }
+        firstPage_.allocate(BUFFER_ALIGNMENT);
+    }
+    blockBytes_.assign(WAVE_QUEUE_BLOCKS, 0);
+
+    format_ = format;
+    container_ = container;
+    dataSize_ = 0;
+    current_ = 0;
+    blockOffset_ = 0;
+    failed_ = false;
+    filename_ = filename;
+
+    overview_.reset();
+    if (OverviewBuilder::enabled()) {
+        overview_ = std::make_unique<OverviewBuilder>();
+        if (!overview_->start(format)) {
+            overview_.reset();
+        }
+    }
+
+    //the first block starts with a provisional header, the sizes are patched on close
+    if (!writeHeader(false)) {
+        return false;
+    }
+    blockUsed_ = headerSize_;
+    return true;
+}
+
+bool WaveWriter::writeHeader(bool final)
+{
+    unsigned char header[BUFFER_ALIGNMENT];
+    unsigned char fmt[40];
+    const size_t fmtSize = buildFmt(fmt, format_);
+    unsigned char* p = header;
+
+    if (container_ == WaveContainer::W64) {
+        const uint64_t fmtChunk = (24 + fmtSize + 7) & ~7ull;
+        const uint64_t headerSize = 40 + fmtChunk + 24;
+        const uint64_t pad = (8 - (dataSize_ & 7)) & 7;
+
+        memcpy(p, W64_RIFF, 16); p += 16;
+        p = putLE64(p, headerSize + dataSize_ + pad);
+        memcpy(p, W64_WAVE, 16); p += 16;
+        memcpy(p, W64_FMT, 16); p += 16;
+        p = putLE64(p, 24 + fmtSize);
+        memcpy(p, fmt, fmtSize); p += fmtSize;
+        while ((p - header) % 8) {
+            *p++ = 0;
+        }
+        memcpy(p, W64_DATA, 16); p += 16;
+        p = putLE64(p, 24 + dataSize_);
+    }
+    else if (container_ == WaveContainer::FLAC) {
+        //always the same size, the seek table has its full length from the start
+        p += flac_.buildHeader(p);
+    }
+    else {
+        //the JUNK chunk reserves room for ds64 so a RIFF file can become RF64 without moving the data
+        const uint64_t headerSize = 12 + 8 + DS64_SIZE + 8 + fmtSize + 8;
+        const uint64_t riffSize = headerSize - 8 + dataSize_ + (dataSize_ & 1);
+        const bool rf64 = container_ == WaveContainer::RF64 || (final && riffSize > RIFF_MAX_SIZE);
+
+        p = putTag(p, rf64 ? "RF64" : "RIFF");
+        p = putLE32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(riffSize));
+        p = putTag(p, "WAVE");
+        p = putTag(p, rf64 ? "ds64" : "JUNK");
+        p = putLE32(p, DS64_SIZE);
+        memset(p, 0, DS64_SIZE);
+        if (rf64) {
+            putLE64(p, riffSize);
+            putLE64(p + 8, dataSize_);
+            putLE64(p + 16, format_.blockAlign() ? dataSize_ / format_.blockAlign() : 0);
+        }
+        p += DS64_SIZE;
+        p = putTag(p, "fmt ");
+        p = putLE32(p, static_cast<uint32_t>(fmtSize));
+        memcpy(p, fmt, fmtSize); p += fmtSize;
+        p = putTag(p, "data");
+        p = putLE32(p, rf64 ? 0xFFFFFFFF : static_cast<uint32_t>(dataSize_));
+    }
+
+    headerSize_ = p - header;
+
+    //still filling the first block, the header goes in place
+    if (blockOffset_ == 0) {
+        memcpy(blocks_[0].data(), header, headerSize_);
+        return true;
+    }
+
+    //otherwise into the first page as it went out, written again once everything else is on disk
+    memcpy(firstPage_.data(), header, headerSize_);
+    uint64_t tag;
+    int64_t result;
+    if (!drain() || !file_.queueWrite(firstPage_.data(), BUFFER_ALIGNMENT, 0, 0) || !file_.wait(tag, result) || result != int64_t(BUFFER_ALIGNMENT)) {
+        std::cerr << "Error: could not write the wave header" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool WaveWriter::write(const void* data, size_t bytes)
+{
+    ScopedStage stage(Stage::Write);
+    const char* src = static_cast<const char*>(data);
+
+    while (bytes > 0) {
+        size_t room;
+        char* dst = space(room);
+        const size_t n = std::min(bytes, room);
+        memcpy(dst, src, n);
+        src += n;
+        bytes -= n;
+
+        if (!commit(n)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+char* WaveWriter::space(size_t& bytes)
+{
+    if (container_ == WaveContainer::FLAC) {
+        return flac_.space(bytes);
+    }
+    bytes = WAVE_BLOCK_SIZE - blockUsed_;
+    return blocks_[current_].data() + blockUsed_;
+}
+
+//a full write block goes to disk, a full encoder batch is compressed into the write blocks
+bool WaveWriter::commit(size_t bytes)
+{
+    //the samples are still where space() put them, the overview takes them from there
+    if (overview_) {
+        size_t room;
+        overview_->add(space(room), bytes);
+    }
+    dataSize_ += bytes;
+    if (container_ == WaveContainer::FLAC) {
+        return !flac_.commit(bytes) || encode();
+    }
+    blockUsed_ += bytes;
+    return blockUsed_ < WAVE_BLOCK_SIZE || flush();
+}
+
+bool WaveWriter::encode()
+{
+    ScopedStage stage(Stage::Write);
+    size_t bytes;
+    const unsigned char* packed = flac_.encode(bytes);
+    return append(packed, bytes);
+}
+
+//every byte goes through the blocks, even from big writes: they go out asynchronously so the caller's memory
+//can't be used in place, and direct I/O needs aligned buffers anyway
+bool WaveWriter::append(const void* data, size_t bytes)
+{
+    const char* src = static_cast<const char*>(data);
+
+    while (bytes > 0) {
+        const size_t n = std::min(bytes, WAVE_BLOCK_SIZE - blockUsed_);
+        memcpy(blocks_[current_].data() + blockUsed_, src, n);
+        blockUsed_ += n;
+        src += n;
+        bytes -= n;
+
+        if (blockUsed_ == WAVE_BLOCK_SIZE && !flush()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WaveWriter::writePlanar(const PlanarBuffer& src, size_t frames, size_t offset)
+{
+    ScopedStage stage(Stage::Write);
+    const size_t channels = format_.numChannels;
+    const size_t frameSize = format_.blockAlign();
+    if (format_.bitsPerSample != 16 || src.channels() != channels) {
+        std::cerr << "Error: planar writes need 16-bit samples and a buffer with " << channels << " channels" << std::endl;
+        return false;
+    }
+
+    std::vector<const short*> planes(channels);
+    std::vector<short> frame;
+    size_t done = 0;
+    while (done < frames) {
+        for (size_t c = 0; c < channels; c++) {
+            planes[c] = src.channel(c) + offset + done;
+        }
+
+        //the header shifts the frames off the block edges, the one frame that straddles two blocks is copied in
+        size_t bytes;
+        char* dst = space(bytes);
+        const size_t room = bytes / frameSize;
+        if (room == 0) {
+            frame.resize(channels);
+            kernels().interleaveInt16(planes.data(), frame.data(), channels, 1);
+            if (!write(frame.data(), frameSize)) {
+                return false;
+            }
+            done++;
+            continue;
+        }
+
+        const size_t n = std::min(room, frames - done);
+        kernels().interleaveInt16(planes.data(), reinterpret_cast<short*>(dst), channels, n);
+        done += n;
+
+        if (!commit(n * frameSize)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WaveWriter::writePlanar(const FloatPlanarBuffer& src, size_t frames, size_t offset)
+{
+    ScopedStage stage(Stage::Write);
+    const size_t channels = format_.numChannels;
+    const size_t frameSize = format_.blockAlign();
+    const size_t sampleSize = format_.bitsPerSample / 8;
+    SampleFormat sampleFormat;
+    if (!sampleFormatOf(format_, sampleFormat) || src.channels() != channels) {
+        std::cerr << "Error: the output format can't take bus samples or the buffer hasn't " << channels << " channels" << std::endl;
+        return false;
+    }
+
+    if (bus_.size() == 0) {
+        bus_.allocate(WAVE_BLOCK_SIZE / sizeof(float));
+    }
+
+    std::vector<const float*> planes(channels);
+    std::vector<char> frame;
+    size_t done = 0;
+    while (done < frames) {
+        for (size_t c = 0; c < channels; c++) {
+            planes[c] = src.channel(c) + offset + done;
+        }
+
+        //a frame straddling two blocks is converted on its own and copied in, as for 16-bit planes
+        size_t bytes;
+        char* dst = space(bytes);
+        const size_t room = std::min(bytes / frameSize, bus_.size() / channels);
+        if (room == 0) {
+            frame.resize(frameSize);
+            kernels().interleaveFloat(planes.data(), bus_.data(), channels, 1);
+            convertSamples(bus_.data(), frame.data(), channels, sampleFormat, dataSize_ / sampleSize);
+            if (!write(frame.data(), frameSize)) {
+                return false;
+            }
+            done++;
+            continue;
+        }
+
+        //interleave while still float, then convert the whole run, the dither follows the sample count
+        const size_t n = std::min(room, frames - done);
+        kernels().interleaveFloat(planes.data(), bus_.data(), channels, n);
+        convertSamples(bus_.data(), dst, n * channels, sampleFormat, dataSize_ / sampleSize);
+        done += n;
+
+        if (!commit(n * frameSize)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+//hands the block being filled to the file and moves on to the next one once its previous write is done.
+//Only the last block can be short: direct I/O takes whole pages, so it goes out padded with zeros that close() cuts off
+bool WaveWriter::flush()
+{
+    ScopedStage stage(Stage::Write);
+    if (blockUsed_ == 0) {
+        return true;
+    }
+
+    char* block = blocks_[current_].data();
+    const size_t bytes = (blockUsed_ + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT;
+    memset(block + blockUsed_, 0, bytes - blockUsed_);
+    if (blockOffset_ == 0) {
+        memcpy(firstPage_.data(), block, BUFFER_ALIGNMENT);
+    }
+
+    blockBytes_[current_] = bytes;
+    if (!file_.queueWrite(block, bytes, blockOffset_, current_) || !file_.submit()) {
+        std::cerr << "Error: could not write to the output file" << std::endl;
+        blockBytes_[current_] = 0;
+        failed_ = true;
+        return false;
+    }
+    blockOffset_ += blockUsed_;
+    blockUsed_ = 0;
+
+    current_ = (current_ + 1) % blocks_.size();
+    return settle(current_);
+}
+
+//waits until the block's write is done, taking whatever other writes complete first
+bool WaveWriter::settle(size_t slot)
+{
+    bool ok = true;
+    while (blockBytes_[slot] != 0) {
+        uint64_t tag;
+        int64_t result;
+        if (!file_.wait(tag, result)) {
+            blockBytes_[slot] = 0;
+            failed_ = true;
+            return false;
+        }
+        if (result < 0) {
+            std::cerr << "Error: could not write to the output file (" << strerror(static_cast<int>(-result)) << ")" << std::endl;
+            ok = false;
+        } else if (result != static_cast<int64_t>(blockBytes_[tag])) {
+            std::cerr << "Error: short write to the output file, the disk may be full" << std::endl;
+            ok = false;
+        }
+        blockBytes_[tag] = 0;
+    }
+    failed_ = failed_ || !ok;
+    return ok;
+}
+
+bool WaveWriter::drain()
+{
+    bool ok = true;
+    for (size_t slot = 0; slot < blocks_.size(); slot++) {
+        ok = settle(slot) && ok;
+    }
+    return ok;
+}
+
+bool WaveWriter::close()
+{
+    ScopedStage stage(Stage::Write);
+    if (!file_.isOpen()) {
+        return false;
+    }
+
+    //the overview ends with the samples, before any padding. It is only a sidecar, the file is finished whatever happens to it
+    bool indexed = true;
+    if (overview_) {
+        indexed = overview_->write((filename_ + OVERVIEW_EXTENSION).c_str());
+        overview_.reset();
+    }
+
+    //pad the data chunk to the container alignment, FLAC encodes what is left of the last batch instead
+    const size_t pad = container_ == WaveContainer::W64 ? (8 - (dataSize_ & 7)) & 7 : container_ == WaveContainer::FLAC ? 0 : dataSize_ & 1;
+    const char zeros[8] = {};
+    bool ok = (container_ != WaveContainer::FLAC || encode()) && append(zeros, pad) && flush() && drain();
+
+    //the last block went out in whole pages, the file ends where its data does
+    ok = ok && writeHeader(true) && file_.truncate(blockOffset_) && !failed_;
+
+    file_.close();
+
+    return ok && indexed;
+}
+
+bool WaveWriter::preallocate(const char* filename, const WaveFormat& format, uint64_t bytes, uint64_t& dataOffset, WaveContainer container)
+{
+    if (container == WaveContainer::FLAC) {
+        std::cerr << "Error: " << filename << " can't be sized up front, FLAC is only known once encoded" << std::endl;
+        return false;
+    }
+
+    WaveWriter writer;
+    if (!writer.open(filename, format, container)) {
+        return false;
+    }
+
+    //the header with its final sizes is all that gets written, then the file is extended to its full length with its
+    //blocks reserved, so a mapping of it can't run out of disk halfway
+    writer.dataSize_ = bytes;
+    const uint64_t pad = container == WaveContainer::W64 ? (8 - (bytes & 7)) & 7 : bytes & 1;
+    const bool ok = writer.writeHeader(true) && writer.flush() && writer.drain() && writer.file_.reserve(writer.headerSize_ + bytes + pad);
+
+    dataOffset = writer.headerSize_;
+    writer.file_.close();
+
+    if (!ok) {
+        std::cerr << "Error: could not size " << filename << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+
+bool saveWave(const char* filename, const WaveFormat& format, const void* data, uint64_t bytes)
+{
+    WaveWriter writer;
+    if (!writer.open(filename, format)) {
+        return false;
+    }
+
+    //write() takes a size_t, we go in blocks so 32-bit builds can still save huge signals
+    const char* src = static_cast<const char*>(data);
+    while (bytes > 0) {
+        const size_t n = static_cast<size_t>(std::min<uint64_t>(bytes, 1u << 30));
+        if (!writer.write(src, n)) {
+            return false;
+        }
+        src += n;
+        bytes -= n;
+    }
+
+    return writer.close();
+}
+
+bool loadWave(const char* filename, WaveFormat& format, void* data, uint64_t bytes)
+{
+    WaveReader reader;
+    if (!reader.open(filename)) {
+        return false;
+    }
+    format = reader.format();
+    if (reader.dataSize() > bytes) {
+        std::cerr << "Error: " << filename << " holds " << reader.dataSize() << " bytes of samples, only " << bytes << " fit" << std::endl;
+        return false;
+    }
+
+    char* dst = static_cast<char*>(data);
+    uint64_t left = reader.dataSize();
+    while (left > 0) {
+        const size_t n = reader.read(dst, static_cast<size_t>(std::min<uint64_t>(left, 1u << 30)));
+        if (n == 0) {
+            std::cerr << "Error: " << filename << " ended " << left << " bytes before its sample data did" << std::endl;
+            return false;
+        }
+        dst += n;
+        left -= n;
+    }
+
+    return true;
+}
+
+size_t buildStreamHeader(const WaveFormat& format, unsigned char* dst)
+{
+    unsigned char fmt[40];
+    const size_t fmtSize = buildFmt(fmt, format);
+
+    unsigned char* p = dst;
+    p = putTag(p, "RIFF");
+    p = putLE32(p, 0xFFFFFFFF);
+    p = putTag(p, "WAVE");
+    p = putTag(p, "fmt ");
+    p = putLE32(p, static_cast<uint32_t>(fmtSize));
+    memcpy(p, fmt, fmtSize); p += fmtSize;
+    p = putTag(p, "data");
+    p = putLE32(p, 0xFFFFFFFF);
+
+    return p - dst;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "AlignedBuffer.h"
+#include "AsyncFile.h"
+#include "FlacFile.h"
+#include "PlanarBuffer.h"
+
+constexpr size_t WAVE_BLOCK_SIZE = 4 << 20;         // bytes moved to/from disk at a time (4 MiB)
+constexpr size_t WAVE_QUEUE_BLOCKS = 4;             // blocks per file read ahead or on their way to disk while the caller computes
+
+constexpr uint16_t WAVE_FORMAT_PCM = 1;
+constexpr uint16_t WAVE_FORMAT_IEEE_FLOAT = 3;
+constexpr uint16_t WAVE_FORMAT_EXTENSIBLE = 0xFFFE;
+
+constexpr size_t WAVE_STREAM_HEADER_SIZE = 128;     // room buildStreamHeader needs
+
+class OverviewBuilder;
+
+// container used for the output file
+enum class WaveContainer
+{
+    RIFF,   // classic RIFF/WAVE, promoted to RF64 on close if the data doesn't fit 32 bits
+    RF64,   // always RF64 (EBU Tech 3306)
+    W64,    // Sony Wave64, 64-bit sizes and GUID chunk ids
+    FLAC    // lossless compressed, see FlacEncoder. 8, 16 or 24-bit PCM only
+};
+
+// "riff", "rf64", "w64" or "flac", false for anything else
+bool parseWaveContainer(const char* name, WaveContainer& container);
+
+const char* waveContainerName(WaveContainer container);
+
+// the usual file extension, ".wav", ".w64" or ".flac"
+const char* waveContainerExtension(WaveContainer container);
+
+struct WaveFormat
+{
+    uint16_t audioFormat = WAVE_FORMAT_PCM;         // PCM or IEEE float, never EXTENSIBLE (that is resolved on read)
+    uint16_t numChannels = 1;
+    uint32_t sampleRate = 44100;
+    uint16_t bitsPerSample = 16;
+
+    uint16_t blockAlign() const { return static_cast<uint16_t>(numChannels * (bitsPerSample / 8)); }
+    uint32_t byteRate() const { return sampleRate * blockAlign(); }
+};
+
+// streams the sample data of a RIFF, RF64 or W64 file walking its chunk list. The header is parsed through
+// a plain stream, the samples then come in whole file blocks through an AsyncFile that keeps WAVE_QUEUE_BLOCKS
+// of them loading ahead of the read position. A FLAC file reads the same, its frames are decoded from those
+// blocks as the reads reach them
+class WaveReader
+{
+public:
+    bool open(const char* filename);
+    void close();
+
+    const WaveFormat& format() const { return format_; }
+    bool compressed() const { return compressed_; }         // FLAC, the samples aren't in the file as they are read
+    uint64_t dataOffset() const { return dataOffset_; }     // file offset of the first sample (of the first FLAC frame)
+    uint64_t dataSize() const { return dataSize_; }         // bytes of sample data, decoded
+    uint64_t numFrames() const { return format_.blockAlign() ? dataSize_ / format_.blockAlign() : 0; }
+    uint64_t position() const { return position_; }         // bytes of sample data already consumed
+
+    // reads up to 'bytes' of sample data, returns how many were read
+    size_t read(void* dst, size_t bytes);
+
+    // reads up to 'frames' whole frames, returns how many were read
+    size_t readFrames(void* dst, size_t frames);
+
+    // reads up to 'frames' 16-bit frames split into the planes of 'dst' from frame 'offset' on,
+    // returns how many were read. 'dst' must have this file's channel count
+    size_t readPlanar(PlanarBuffer& dst, size_t frames, size_t offset = 0);
+
+    // moves the read position, the read-ahead only starts over if the frame isn't in the blocks already loading
+    bool seekFrame(uint64_t frame);
+
+private:
+    bool parseRiff(bool rf64);
+    bool parseW64();
+    bool parseFmt(uint64_t size);
+    bool parseFlac();
+
+    // copies up to 'bytes' of the file from 'offset' on through the read-ahead, returns how many there were
+    size_t fetch(uint64_t offset, void* dst, size_t bytes);
+
+    // file block 'index' once it is loaded and how many bytes it got, nullptr if it couldn't be read
+    const char* blockAt(uint64_t index, size_t& bytes);
+    void load(uint64_t index);
+    bool settle(size_t slot);
+
+    std::ifstream file_;                            // the header only
+    AsyncFile data_;
+    std::vector<AlignedBuffer<char>> blocks_;       // file block b loads into slot b % WAVE_QUEUE_BLOCKS
+    std::vector<int64_t> blockBytes_;               // what each slot got, BLOCK_LOADING while it is on its way
+    uint64_t firstBlock_ = 0;                       // the slots hold blocks [firstBlock_, firstBlock_ + WAVE_QUEUE_BLOCKS)
+    uint64_t lastBlock_ = 0;                        // the one holding the end of the sample data
+    bool primed_ = false;                           // false until the first read starts the read-ahead
+    AlignedBuffer<short> interleaved_;              // frames on their way to the planes, allocated on first use
+    FlacDecoder flac_;
+    bool compressed_ = false;
+    WaveFormat format_;
+    uint64_t fileSize_ = 0;
+    uint64_t dataOffset_ = 0;
+    uint64_t dataSize_ = 0;
+    uint64_t position_ = 0;
+};
+
+// writes a wave file streaming the sample data through WAVE_QUEUE_BLOCKS aligned blocks: one is filled while
+// the others are on their way to disk through an AsyncFile. The header goes at the start of the first block,
+// the sizes are patched into its first page on close. With the FLAC container the samples gather in the
+// encoder instead, whole batches of FLAC frames go through the blocks once they are encoded
+class WaveWriter
+{
+public:
+    WaveWriter();
+    ~WaveWriter();
+
+    bool open(const char* filename, const WaveFormat& format, WaveContainer container = WaveContainer::RIFF);
+    bool write(const void* data, size_t bytes);
+
+    // interleaves 'frames' frames of the planes of 'src' from frame 'offset' on straight into the write block,
+    // 16-bit only and 'src' must have this file's channel count
+    bool writePlanar(const PlanarBuffer& src, size_t frames, size_t offset = 0);
+
+    // same for float bus planes, converted on the way to this file's sample format (see SampleFormat)
+    bool writePlanar(const FloatPlanarBuffer& src, size_t frames, size_t offset = 0);
+    bool close();
+
+    // writes the final header for 'bytes' of sample data and extends the file to its full size,
+    // the data is then filled in place (through a mapping or positioned writes) from dataOffset on. Not for FLAC
+    static bool preallocate(const char* filename, const WaveFormat& format, uint64_t bytes, uint64_t& dataOffset,
+        WaveContainer container = WaveContainer::RIFF);
+
+    const WaveFormat& format() const { return format_; }
+    uint64_t dataOffset() const { return headerSize_; }
+    uint64_t dataSize() const { return dataSize_; }         // bytes of samples taken, before any compression
+
+private:
+    // where the next samples go (the write block or the encoder) and how many bytes fit there
+    char* space(size_t& bytes);
+    bool commit(size_t bytes);
+    bool encode();
+
+    bool append(const void* data, size_t bytes);
+    bool flush();
+    bool settle(size_t slot);
+    bool drain();
+    bool writeHeader(bool final);
+
+    AsyncFile file_;
+    std::vector<AlignedBuffer<char>> blocks_;
+    std::vector<size_t> blockBytes_;                // bytes each block has in flight, 0 once it is free
+    AlignedBuffer<char> firstPage_;                 // the first page as it went out, where the final header goes
+    AlignedBuffer<float> bus_;                      // interleaved bus samples waiting for conversion, allocated on first use
+    FlacEncoder flac_;
+    size_t current_ = 0;                            // the block being filled
+    size_t blockUsed_ = 0;
+    uint64_t blockOffset_ = 0;                      // file offset of the block being filled
+    WaveFormat format_;
+    WaveContainer container_ = WaveContainer::RIFF;
+    uint64_t headerSize_ = 0;
+    uint64_t dataSize_ = 0;
+    bool failed_ = false;                           // a write went wrong, close() reports it however the rest goes
+    std::unique_ptr<OverviewBuilder> overview_;     // fed every committed sample when SOUND_OVERVIEW=1 (see Overview.h)
+    std::string filename_;
+};
+
+// writes a whole in-memory signal in one go
+bool saveWave(const char* filename, const WaveFormat& format, const void* data, uint64_t bytes);
+
+// reads the whole sample data of a file, 'bytes' tells how much the caller can take.
+// False if the data doesn't fit or the file ends before it does
+bool loadWave(const char* filename, WaveFormat& format, void* data, uint64_t bytes);
+
+// a RIFF header for a stream whose length isn't known up front (a pipe), both sizes set to 0xFFFFFFFF
+// as stream readers expect. Writes up to WAVE_STREAM_HEADER_SIZE bytes to 'dst' and returns how many
+size_t buildStreamHeader(const WaveFormat& format, unsigned char* dst);
@@ -0,0 +1,196 @@
+#include "Wavetable.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "Kernels.h"
+#include "Profiler.h"
+
+namespace
+{
+    constexpr double PI = 3.141592653589793;
+
+    //one cycle of sine, evaluated by the compiler. The first quadrant is a Taylor series that has converged to the
+    //last bit well before its 30th term at pi / 2, the others mirror it so the cycle is exactly symmetric
+    struct SineCycle
+    {
+        double samples[WAVETABLE_SIZE] = {};
+    };
+
+    constexpr SineCycle makeSineCycle()
+    {
+        constexpr size_t QUARTER = WAVETABLE_SIZE / 4;
+        SineCycle cycle;
+        for (size_t k = 0; k <= QUARTER; k++) {
+            const double x = 2.0 * PI * double(k) / WAVETABLE_SIZE;
+            double term = x;
+            double sum = x;
+            for (int n = 2; n < 60; n += 2) {
+                term *= -x * x / (double(n) * (n + 1));
+                sum += term;
+            }
+            cycle.samples[k] = sum;
+        }
+        for (size_t k = 1; k < QUARTER; k++) {
+            cycle.samples[2 * QUARTER - k] = cycle.samples[k];
+        }
+        for (size_t k = 0; k < 2 * QUARTER; k++) {
+            cycle.samples[2 * QUARTER + k] = -cycle.samples[k];
+        }
+        return cycle;
+    }
+
+    constexpr SineCycle SINE_CYCLE = makeSineCycle();
+
+    const char* const WAVEFORM_NAMES[WAVEFORM_COUNT] = { "sine", "saw", "square", "triangle", "pulse" };
+
+    //sine and cosine coefficients of harmonic h, from the Fourier series of each shape at a peak of 1
+    void harmonic(Waveform waveform, size_t h, double& a, double& b)
+    {
+        const double k = 2.0 / (PI * h);
+        a = 0.0;
+        b = 0.0;
+
+        switch (waveform) {
+        case Waveform::Sine:
+            a = h == 1 ? 1.0 : 0.0;
+            break;
+        case Waveform::Saw:
+            a = h % 2 ? k : -k;
+            break;
+        case Waveform::Square:
+            a = h % 2 ? 2.0 * k : 0.0;
+            break;
+        case Waveform::Triangle:
+            a = h % 2 ? (h % 4 == 1 ? 1.0 : -1.0) * 8.0 / (PI * PI * double(h) * h) : 0.0;
+            break;
+        case Waveform::Pulse:
+            //a saw minus the same saw delayed by the width
+            a = k * (1.0 - std::cos(2.0 * PI * h * WAVETABLE_PULSE_WIDTH));
+            b = k * std::sin(2.0 * PI * h * WAVETABLE_PULSE_WIDTH);
+            break;
+        }
+    }
+}
+
+bool parseWaveform(const char* name, Waveform& waveform)
+{
+    for (size_t i = 0; i < WAVEFORM_COUNT; i++) {
+        if (strcmp(name, WAVEFORM_NAMES[i]) == 0) {
+            waveform = static_cast<Waveform>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+const char* waveformName(Waveform waveform)
+{
+    return WAVEFORM_NAMES[static_cast<int>(waveform)];
+}
+
+// ---------------------------------------------------------------------------------------------------------------------
+// Wavetable
+
+Wavetable::Wavetable(Waveform waveform)
+    : levels_(2 * WAVETABLE_SIZE * WAVETABLE_LEVELS)
+{
+    //every harmonic is looked up in the one cycle of sine, harmonic h of sample k is at h * k mod WAVETABLE_SIZE
+    constexpr size_t MASK = WAVETABLE_SIZE - 1;
+    constexpr size_t QUARTER = WAVETABLE_SIZE / 4;
+    const double* sine = SINE_CYCLE.samples;
+
+    //from the emptiest level up, each one is the last plus the harmonics of its octave
+    std::vector<double> sum(WAVETABLE_SIZE, 0.0);
+    std::vector<std::vector<double>> levels;
+    size_t done = 0;
+    double peak = 0.0;
+    for (size_t l = WAVETABLE_LEVELS; l-- > 0;) {
+        const size_t top = (WAVETABLE_SIZE / 2) >> l;
+        for (size_t h = done + 1; h <= top; h++) {
+            double a, b;
+            harmonic(waveform, h, a, b);
+            for (size_t k = 0; k < WAVETABLE_SIZE; k++) {
+                sum[k] += a * sine[(h * k) & MASK] + b * sine[(h * k + QUARTER) & MASK];
+            }
+        }
+        done = top;
+
+        for (size_t k = 0; k < WAVETABLE_SIZE; k++) {
+            peak = std::max(peak, std::fabs(sum[k]));
+        }
+        levels.emplace_back(sum);
+    }
+
+    const double scale = 1.0 / peak;
+    for (size_t l = 0; l < WAVETABLE_LEVELS; l++) {
+        const std::vector<double>& samples = levels[WAVETABLE_LEVELS - 1 - l];
+        float* pairs = levels_.data() + l * 2 * WAVETABLE_SIZE;
+        for (size_t k = 0; k < WAVETABLE_SIZE; k++) {
+            pairs[2 * k] = static_cast<float>(samples[k] * scale);
+            pairs[2 * k + 1] = static_cast<float>((samples[(k + 1) & MASK] - samples[k]) * scale);
+        }
+    }
+}
+
+const Wavetable& Wavetable::get(Waveform waveform)
+{
+    //function statics, so the first caller builds them and any others wait for it
+    switch (waveform) {
+    case Waveform::Saw: {
+        static const Wavetable saw(Waveform::Saw);
+        return saw;
+    }
+    case Waveform::Square: {
+        static const Wavetable square(Waveform::Square);
+        return square;
+    }
+    case Waveform::Triangle: {
+        static const Wavetable triangle(Waveform::Triangle);
+        return triangle;
+    }
+    case Waveform::Pulse: {
+        static const Wavetable pulse(Waveform::Pulse);
+        return pulse;
+    }
+    default: {
+        static const Wavetable sine(Waveform::Sine);
+        return sine;
+    }
+    }
+}
+
+size_t Wavetable::levelFor(double increment)
+{
+    //level l is band-limited for increments up to 2^l / WAVETABLE_SIZE
+    const double reach = std::fabs(increment) * WAVETABLE_SIZE;
+    size_t l = 0;
+    while (l + 1 < WAVETABLE_LEVELS && reach > double(size_t(1) << l)) {
+        l++;
+    }
+    return l;
+}
+
+void generateWaveform(Waveform waveform, short* dst, size_t count, double phase, double increment, float amplitude)
+{
+    ScopedStage stage(Stage::Generate);
+    if (waveform == Waveform::Sine) {
+        kernels().sineInt16(dst, count, phase, increment, amplitude);
+        return;
+    }
+    const float* table = Wavetable::get(waveform).level(Wavetable::levelFor(increment));
+    kernels().wavetableInt16(dst, count, phase, increment, amplitude, table, WAVETABLE_SIZE);
+}
+
+void generateWaveform(Waveform waveform, float* dst, size_t count, double phase, double increment, float amplitude)
+{
+    ScopedStage stage(Stage::Generate);
+    if (waveform == Waveform::Sine) {
+        kernels().sineFloat(dst, count, phase, increment, amplitude);
+        return;
+    }
+    const float* table = Wavetable::get(waveform).level(Wavetable::levelFor(increment));
+    kernels().wavetableFloat(dst, count, phase, increment, amplitude, table, WAVETABLE_SIZE);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "AlignedBuffer.h"
+
+constexpr size_t WAVETABLE_SIZE = 2048;             // samples per cycle in every level, a power of two
+constexpr size_t WAVETABLE_LEVELS = 11;             // one per octave, from WAVETABLE_SIZE / 2 harmonics down to 1
+constexpr double WAVETABLE_PULSE_WIDTH = 0.25;      // fraction of a pulse cycle spent high
+
+// what the generators can play
+enum class Waveform
+{
+    Sine,
+    Saw,        // rising, zero at phase 0
+    Square,
+    Triangle,
+    Pulse       // WAVETABLE_PULSE_WIDTH duty cycle, without its DC
+};
+
+constexpr size_t WAVEFORM_COUNT = 5;
+
+// "sine", "saw", "square", "triangle" or "pulse", false for anything else
+bool parseWaveform(const char* name, Waveform& waveform);
+
+const char* waveformName(Waveform waveform);
+
+// one cycle of a waveform band-limited WAVETABLE_LEVELS ways, mipmap style: level l holds the harmonics up to
+// WAVETABLE_SIZE / 2 >> l, so it plays without aliasing up to 2^l / WAVETABLE_SIZE cycles per sample. The
+// levels are in cycles per sample, one set of tables serves every sample rate. All levels share one scale
+// that makes the peak of the fullest one 1.0, Gibbs overshoot included, so an amplitude is a true peak
+class Wavetable
+{
+public:
+    // the tables of 'waveform', built on first use and then shared by every thread
+    static const Wavetable& get(Waveform waveform);
+
+    // the level to play at 'increment' cycles per sample: the fullest one whose harmonics all stay under Nyquist
+    static size_t levelFor(double increment);
+
+    // WAVETABLE_SIZE pairs of a sample and its slope to the next, the layout KernelTable::wavetableInt16 takes
+    const float* level(size_t level) const { return levels_.data() + level * 2 * WAVETABLE_SIZE; }
+
+private:
+    explicit Wavetable(Waveform waveform);
+
+    AlignedBuffer<float> levels_;
+};
+
+// dst[i] = amplitude * waveform at phase + i * increment cycles truncated to 16 bits, the sine from
+// KernelTable::sineInt16 and the others from the wavetable level that suits the increment
+void generateWaveform(Waveform waveform, short* dst, size_t count, double phase, double increment, float amplitude);
+
+// same on the float bus
+void generateWaveform(Waveform waveform, float* dst, size_t count, double phase, double increment, float amplitude);
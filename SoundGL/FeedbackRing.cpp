@@ -0,0 +1,100 @@
+#include "FeedbackRing.h"
+
+namespace
+{
+    constexpr GLuint64 FENCE_TIMEOUT = 100000000;   // ns per glClientWaitSync call, it is retried until the fence signals
+
+    //read by the CPU only once the fence has signalled, so the mapping can be coherent and stay for good
+    constexpr GLbitfield MAPPING_FLAGS = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+}
+
+FeedbackRing::~FeedbackRing()
+{
+    //deleting a buffer unmaps it
+    for (Slot& slot : slots_) {
+        if (slot.fence) {
+            glDeleteSync(slot.fence);
+        }
+        if (slot.buffer) {
+            glDeleteBuffers(1, &slot.buffer);
+        }
+    }
+}
+
+bool FeedbackRing::init(size_t chunkBytes, bool persistent)
+{
+    chunkBytes_ = chunkBytes;
+    persistent_ = persistent;
+
+    for (Slot& slot : slots_) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+        if (persistent_) {
+            //client storage asks for memory the CPU reads fast
+            glBufferStorage(GL_COPY_READ_BUFFER, chunkBytes_, nullptr, MAPPING_FLAGS | GL_CLIENT_STORAGE_BIT);
+            slot.mapped = glMapBufferRange(GL_COPY_READ_BUFFER, 0, chunkBytes_, MAPPING_FLAGS);
+            if (!slot.mapped) {
+                return false;
+            }
+        } else {
+            glBufferData(GL_COPY_READ_BUFFER, chunkBytes_, nullptr, GL_STREAM_READ);
+        }
+    }
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+    if (!persistent_) {
+        staging_.resize(chunkBytes_);
+    }
+    return glGetError() == GL_NO_ERROR;
+}
+
+void FeedbackRing::draw(GLsizei points, size_t bytes)
+{
+    Slot& slot = slots_[(oldest_ + inFlight_) % GL_RING_DEPTH];
+    inFlight_++;
+    slot.bytes = bytes;
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, slot.buffer);
+
+    //we disable the raster stage as we only want the vertex results
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, points);
+    glEndTransformFeedback();
+    glDisable(GL_RASTERIZER_DISCARD);
+
+    //the flush gets the GPU going now instead of at the first wait
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+}
+
+const void* FeedbackRing::retire(size_t& bytes)
+{
+    if (inFlight_ == 0) {
+        return nullptr;
+    }
+
+    Slot& slot = slots_[oldest_];
+    oldest_ = (oldest_ + 1) % GL_RING_DEPTH;
+    inFlight_--;
+
+    GLenum status;
+    do {
+        status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_TIMEOUT);
+    } while (status == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(slot.fence);
+    slot.fence = nullptr;
+    if (status == GL_WAIT_FAILED) {
+        return nullptr;
+    }
+
+    bytes = slot.bytes;
+    if (persistent_) {
+        return slot.mapped;
+    }
+
+    glBindBuffer(GL_COPY_READ_BUFFER, slot.buffer);
+    glGetBufferSubData(GL_COPY_READ_BUFFER, 0, bytes, staging_.data());
+    glBindBuffer(GL_COPY_READ_BUFFER, 0);
+    return staging_.data();
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include <GL/glew.h>
+
+constexpr size_t GL_RING_DEPTH = 3;                 // chunks in flight: one computed, one read back, one written out
+
+// transform feedback output through a ring of GL_RING_DEPTH buffers, so the GPU computes the next chunks while the
+// caller reads back the oldest one and hands the one before to the disk. With buffer storage the buffers are mapped
+// once, persistent and coherent, and the fence after each draw says when its chunk can be read straight from the
+// mapping. Without it the fenced chunk is copied out with glGetBufferSubData, which doesn't stall by then either
+class FeedbackRing
+{
+public:
+    FeedbackRing() = default;
+    ~FeedbackRing();
+
+    FeedbackRing(const FeedbackRing&) = delete;
+    FeedbackRing& operator=(const FeedbackRing&) = delete;
+
+    // buffers of 'chunkBytes', needs a current context
+    bool init(size_t chunkBytes, bool persistent);
+
+    bool persistent() const { return persistent_; }
+    size_t inFlight() const { return inFlight_; }
+    bool full() const { return inFlight_ == GL_RING_DEPTH; }
+
+    // captures 'points' points of the current program into the next buffer and fences them, the first 'bytes' of the
+    // output make the chunk. Not while full()
+    void draw(GLsizei points, size_t bytes);
+
+    // waits for the oldest chunk in flight and returns its bytes, valid until the next draw().
+    // nullptr if nothing is in flight or the wait failed
+    const void* retire(size_t& bytes);
+
+private:
+    struct Slot
+    {
+        GLuint buffer = 0;
+        const void* mapped = nullptr;
+        GLsync fence = nullptr;
+        size_t bytes = 0;
+    };
+
+    Slot slots_[GL_RING_DEPTH];
+    size_t chunkBytes_ = 0;
+    size_t oldest_ = 0;
+    size_t inFlight_ = 0;
+    bool persistent_ = false;
+    std::vector<char> staging_;                     // the read back chunk when the buffers aren't mapped
+};
@@ -0,0 +1,488 @@
+#include "GLBackend.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "FeedbackRing.h"
+#include "GLContext.h"
+#include "Kernels.h"
+#include "Profiler.h"
+#include "SampleFormat.h"
+#include "Wavetable.h"
+
+namespace
+{
+    constexpr int BYTES_PER_SAMPLE = 2;
+    constexpr int NUM_CHUNKS = GL_BLOCK_SAMPLES / GL_CHUNK_SAMPLES;
+    constexpr int BUS_BLOCK_SAMPLES = GL_BLOCK_SAMPLES / 2; // float samples per draw, they fill the ring buffers as well
+
+    //every point of the shaders carries a pair of samples: 16-bit ones packed in one int with the even sample in the
+    //low half, or two floats on the bus (BUS_OUTPUT)
+    const char* generateShaderSource = R"(
+        uniform vec4 chunk_phase[NUM_CHUNKS / 4];   // phase in cycles of the first sample of each chunk, wrapped
+        uniform float increment;                    // cycles per sample
+        uniform float amplitude;
+        uniform int table_level;                    // level of the wavetable to play, -1 for the sine
+        uniform sampler2D wavetable;                // a row of (value, slope) pairs per level
+
+        float tone(int i)
+        {
+            //the offset inside a chunk stays small enough for a float, the chunk anchors were computed in double
+            int chunk = i / CHUNK_SAMPLES;
+            float u = chunk_phase[chunk / 4][chunk % 4] + float(i % CHUNK_SAMPLES) * increment;
+            float r = u - floor(u + 0.5);           // wrap to [-0.5, 0.5)
+            if (table_level < 0) {
+                return amplitude * sin(6.28318530718 * r);
+            }
+
+            //the same interpolation as the CPU wavetable kernels
+            float x = r * TABLE_SIZE + TABLE_SIZE;
+            int whole = int(x);
+            vec2 pair = texelFetch(wavetable, ivec2(whole & (TABLE_SIZE - 1), table_level), 0).xy;
+            return amplitude * (pair.x + (x - float(whole)) * pair.y);
+        }
+
+        #ifdef BUS_OUTPUT
+        out vec2 wave_output;
+
+        void main()
+        {
+            int i = gl_VertexID * 2;
+            wave_output = vec2(tone(i), tone(i + 1));
+        }
+        #else
+        out int wave_output;
+
+        void main()
+        {
+            int i = gl_VertexID * 2;
+            wave_output = (int(tone(i + 1)) << 16) | (0x0000FFFF & int(tone(i)));
+        }
+        #endif
+    )";
+
+    //same fixed point as the CPU mix kernels so both give the same bits
+    const char* mixShaderSource = R"(
+        uniform int gains[MAX_TRACKS];              // Q12, 0 for the tracks not in this mix
+
+        layout (location = 0) in int tracks[MAX_TRACKS];
+
+        out int wave_mix;
+
+        int pack(int acc)
+        {
+            return clamp((acc + ROUNDING) >> ACCUMULATOR_BITS, -32768, 32767);
+        }
+
+        void main()
+        {
+            int lo = 0;
+            int hi = 0;
+            for (int t = 0; t < MAX_TRACKS; t++) {
+                lo += (((tracks[t] << 16) >> 16) * gains[t]) >> PRODUCT_SHIFT;  //we bring the sign down with the low sample
+                hi += ((tracks[t] >> 16) * gains[t]) >> PRODUCT_SHIFT;
+            }
+            wave_mix = (pack(hi) << 16) | (0x0000FFFF & pack(lo));
+        }
+    )";
+
+    //the bus mix in float, the tracks are added in order as the accumulate kernels do
+    const char* busMixShaderSource = R"(
+        uniform float gains[MAX_TRACKS];            // from busGain, 0 for the tracks not in this mix
+
+        layout (location = 0) in int tracks[MAX_TRACKS];
+
+        out vec2 bus_mix;
+
+        void main()
+        {
+            vec2 acc = vec2(0.0);
+            for (int t = 0; t < MAX_TRACKS; t++) {
+                acc += vec2(float((tracks[t] << 16) >> 16), float(tracks[t] >> 16)) * gains[t];
+            }
+            bus_mix = acc;
+        }
+    )";
+
+    //the constants both sides have to agree on, ahead of the shader body
+    std::string shaderHeader()
+    {
+        return "#version 330 core\n"
+            "#define NUM_CHUNKS " + std::to_string(NUM_CHUNKS) + "\n"
+            "#define CHUNK_SAMPLES " + std::to_string(GL_CHUNK_SAMPLES) + "\n"
+            "#define TABLE_SIZE " + std::to_string(WAVETABLE_SIZE) + "\n"
+            "#define MAX_TRACKS " + std::to_string(GL_MAX_TRACKS) + "\n"
+            "#define PRODUCT_SHIFT " + std::to_string(MIX_GAIN_BITS - MIX_ACCUMULATOR_BITS) + "\n"
+            "#define ACCUMULATOR_BITS " + std::to_string(MIX_ACCUMULATOR_BITS) + "\n"
+            "#define ROUNDING " + std::to_string(1 << (MIX_ACCUMULATOR_BITS - 1)) + "\n";
+    }
+
+    GLuint createProgram(const char* body, const char* varying, const char* defines = "")
+    {
+        GLint success;
+        GLchar infoLog[512];
+
+        const std::string source = shaderHeader() + defines + body;
+        const GLchar* text = source.c_str();
+
+        GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &text, NULL);
+        glCompileShader(vertexShader);
+
+        glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            glGetShaderInfoLog(vertexShader, sizeof infoLog, NULL, infoLog);
+            std::cerr << "Error: vertex shader compilation failed:\n" << infoLog << std::endl;
+            glDeleteShader(vertexShader);
+            return 0;
+        }
+
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vertexShader);
+
+        //we capture the output varying
+        glTransformFeedbackVaryings(program, 1, &varying, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(program);
+        glDeleteShader(vertexShader);
+
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            glGetProgramInfoLog(program, sizeof infoLog, NULL, infoLog);
+            std::cerr << "Error: linking shader program failed:\n" << infoLog << std::endl;
+            glDeleteProgram(program);
+            return 0;
+        }
+
+        return program;
+    }
+
+    //a build of the generate shader and its uniforms
+    struct ToneProgram
+    {
+        GLuint program = 0;
+        GLint chunkPhase = -1;
+        GLint increment = -1;
+        GLint amplitude = -1;
+        GLint tableLevel = -1;
+
+        bool create(const char* defines)
+        {
+            program = createProgram(generateShaderSource, "wave_output", defines);
+            if (!program) {
+                return false;
+            }
+            chunkPhase = glGetUniformLocation(program, "chunk_phase");
+            increment = glGetUniformLocation(program, "increment");
+            amplitude = glGetUniformLocation(program, "amplitude");
+            tableLevel = glGetUniformLocation(program, "table_level");
+            glUseProgram(program);
+            glUniform1i(glGetUniformLocation(program, "wavetable"), 0);
+            return true;
+        }
+    };
+
+    class GLBackend : public Backend
+    {
+    public:
+        ~GLBackend() override;
+
+        bool init();
+
+        const char* name() const override { return "gl"; }
+
+        bool generate(Waveform waveform, short* dst, uint64_t count, double phase, double increment, float amplitude) override;
+        bool mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count) override;
+        bool generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position) override;
+        bool mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+            uint64_t position) override;
+
+    private:
+        template <typename Take>
+        bool collect(size_t keep, Take take);
+        void bindWavetable(Waveform waveform);
+        void useTone(const ToneProgram& tone, Waveform waveform, double increment, float amplitude);
+        void drawTone(const ToneProgram& tone, double phase, double increment, uint64_t first, size_t n, size_t bytes);
+        void bindTracks(size_t numTracks);
+        void uploadTracks(const short* const* sources, size_t numTracks, uint64_t first, size_t n);
+
+        GLContext context_;                         // first in, last out
+        FeedbackRing ring_;
+        ToneProgram generateProgram_;               // 16-bit samples
+        ToneProgram busGenerateProgram_;            // float bus samples
+        GLuint mixProgram_ = 0;
+        GLuint busMixProgram_ = 0;
+        GLint gainsLocation_ = -1;
+        GLint busGainsLocation_ = -1;
+        GLuint vao_ = 0;
+        GLuint trackBuffers_[GL_MAX_TRACKS] = {};
+        GLuint wavetables_[WAVEFORM_COUNT] = {};   // uploaded the first time a waveform is played
+    };
+
+    GLBackend::~GLBackend()
+    {
+        if (!context_.isCurrent()) {
+            return;
+        }
+
+        glDeleteTextures(WAVEFORM_COUNT, wavetables_);
+        glDeleteBuffers(GL_MAX_TRACKS, trackBuffers_);
+        glDeleteVertexArrays(1, &vao_);
+        glDeleteProgram(busMixProgram_);
+        glDeleteProgram(mixProgram_);
+        glDeleteProgram(busGenerateProgram_.program);
+        glDeleteProgram(generateProgram_.program);
+    }
+
+    bool GLBackend::init()
+    {
+        if (!context_.create()) {
+            return false;
+        }
+
+        if (!generateProgram_.create("") || !busGenerateProgram_.create("#define BUS_OUTPUT\n")) {
+            return false;
+        }
+        mixProgram_ = createProgram(mixShaderSource, "wave_mix");
+        busMixProgram_ = createProgram(busMixShaderSource, "bus_mix");
+        if (!mixProgram_ || !busMixProgram_) {
+            return false;
+        }
+        gainsLocation_ = glGetUniformLocation(mixProgram_, "gains");
+        busGainsLocation_ = glGetUniformLocation(busMixProgram_, "gains");
+
+        //one block per track, attribute t reads track t
+        glGenVertexArrays(1, &vao_);
+        glBindVertexArray(vao_);
+        glGenBuffers(GL_MAX_TRACKS, trackBuffers_);
+        for (GLuint t = 0; t < GL_MAX_TRACKS; t++) {
+            glBindBuffer(GL_ARRAY_BUFFER, trackBuffers_[t]);
+            glBufferData(GL_ARRAY_BUFFER, GL_BLOCK_SAMPLES * BYTES_PER_SAMPLE, nullptr, GL_STREAM_DRAW);
+            glVertexAttribIPointer(t, 1, GL_INT, 0, 0);
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        //the blocks come back through the ring, so a block is drawn while the one before is copied out
+        return ring_.init(GL_BLOCK_SAMPLES * BYTES_PER_SAMPLE, context_.bufferStorage());
+    }
+
+    //hands the oldest blocks in flight to take(block, bytes) until 'keep' are left. On a failed wait the rest is
+    //dropped too, so the next job doesn't get them
+    template <typename Take>
+    bool GLBackend::collect(size_t keep, Take take)
+    {
+        while (ring_.inFlight() > keep) {
+            size_t bytes;
+            const void* block = ring_.retire(bytes);
+            if (!block) {
+                while (ring_.inFlight() > 0) {
+                    ring_.retire(bytes);
+                }
+                return false;
+            }
+            take(block, bytes);
+        }
+        return true;
+    }
+
+    void GLBackend::bindWavetable(Waveform waveform)
+    {
+        GLuint& texture = wavetables_[static_cast<size_t>(waveform)];
+        if (!texture) {
+            //one row per level, fetched texel by texel so no filtering or mipmaps of its own
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, WAVETABLE_SIZE, WAVETABLE_LEVELS, 0, GL_RG, GL_FLOAT,
+                Wavetable::get(waveform).level(0));
+        }
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, texture);
+    }
+
+    void GLBackend::useTone(const ToneProgram& tone, Waveform waveform, double increment, float amplitude)
+    {
+        glUseProgram(tone.program);
+        glBindVertexArray(vao_);
+        glUniform1f(tone.increment, static_cast<GLfloat>(increment));
+        glUniform1f(tone.amplitude, amplitude);
+
+        if (waveform == Waveform::Sine) {
+            glUniform1i(tone.tableLevel, -1);
+        } else {
+            bindWavetable(waveform);
+            glUniform1i(tone.tableLevel, static_cast<GLint>(Wavetable::levelFor(increment)));
+        }
+    }
+
+    //draws the 'n' samples from 'first' on, a point per pair
+    void GLBackend::drawTone(const ToneProgram& tone, double phase, double increment, uint64_t first, size_t n, size_t bytes)
+    {
+        GLfloat chunkPhase[NUM_CHUNKS];
+        for (int c = 0; c < NUM_CHUNKS; c++) {
+            const double u = phase + (first + uint64_t(c) * GL_CHUNK_SAMPLES) * increment;
+            chunkPhase[c] = static_cast<GLfloat>(u - std::floor(u));
+        }
+        glUniform4fv(tone.chunkPhase, NUM_CHUNKS / 4, chunkPhase);
+
+        ring_.draw(static_cast<GLsizei>((n + 1) / 2), bytes);
+    }
+
+    void GLBackend::bindTracks(size_t numTracks)
+    {
+        glBindVertexArray(vao_);
+        for (size_t t = 0; t < GL_MAX_TRACKS; t++) {
+            if (t < numTracks) {
+                glEnableVertexAttribArray(static_cast<GLuint>(t));
+            } else {
+                glDisableVertexAttribArray(static_cast<GLuint>(t));
+                glVertexAttribI1i(static_cast<GLuint>(t), 0);
+            }
+        }
+    }
+
+    void GLBackend::uploadTracks(const short* const* sources, size_t numTracks, uint64_t first, size_t n)
+    {
+        const size_t even = n & ~size_t(1);
+        for (size_t t = 0; t < numTracks; t++) {
+            glBindBuffer(GL_ARRAY_BUFFER, trackBuffers_[t]);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, even * BYTES_PER_SAMPLE, sources[t] + first);
+
+            //an odd block ends on half a pair, we pad it with silence instead of reading past the track
+            if (even < n) {
+                const short pair[2] = { sources[t][first + even], 0 };
+                glBufferSubData(GL_ARRAY_BUFFER, even * BYTES_PER_SAMPLE, sizeof pair, pair);
+            }
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    bool GLBackend::generate(Waveform waveform, short* dst, uint64_t count, double phase, double increment, float amplitude)
+    {
+        ScopedStage stage(Stage::Generate);
+        useTone(generateProgram_, waveform, increment, amplitude);
+
+        uint64_t done = 0;
+        auto take = [dst, &done](const void* block, size_t bytes) {
+            memcpy(dst + done, block, bytes);
+            done += bytes / BYTES_PER_SAMPLE;
+        };
+        for (uint64_t first = 0; first < count; first += GL_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(GL_BLOCK_SAMPLES, count - first));
+            if (!collect(GL_RING_DEPTH - 1, take)) {
+                return false;
+            }
+            drawTone(generateProgram_, phase, increment, first, n, n * BYTES_PER_SAMPLE);
+        }
+
+        return collect(0, take) && glGetError() == GL_NO_ERROR;
+    }
+
+    bool GLBackend::mix(const short* const* sources, const short* gains, size_t numTracks, short* dst, uint64_t count)
+    {
+        ScopedStage stage(Stage::Mix);
+        if (numTracks > GL_MAX_TRACKS) {
+            return false;
+        }
+
+        glUseProgram(mixProgram_);
+        bindTracks(numTracks);
+        GLint fixedGains[GL_MAX_TRACKS] = {};
+        std::copy(gains, gains + numTracks, fixedGains);
+        glUniform1iv(gainsLocation_, GL_MAX_TRACKS, fixedGains);
+
+        uint64_t done = 0;
+        auto take = [dst, &done](const void* block, size_t bytes) {
+            memcpy(dst + done, block, bytes);
+            done += bytes / BYTES_PER_SAMPLE;
+        };
+        for (uint64_t first = 0; first < count; first += GL_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(GL_BLOCK_SAMPLES, count - first));
+            if (!collect(GL_RING_DEPTH - 1, take)) {
+                return false;
+            }
+            uploadTracks(sources, numTracks, first, n);
+            ring_.draw(static_cast<GLsizei>((n + 1) / 2), n * BYTES_PER_SAMPLE);
+        }
+
+        return collect(0, take) && glGetError() == GL_NO_ERROR;
+    }
+
+    bool GLBackend::generate(const ToneBlock& tone, SampleFormat format, void* dst, uint64_t frames, uint64_t position)
+    {
+        //the shader plays a single pitch, tones of several channels stay on the CPU
+        if (tone.channels != 1) {
+            return false;
+        }
+
+        ScopedStage stage(Stage::Generate);
+        useTone(busGenerateProgram_, tone.waveform, tone.increment[0], tone.amplitude);
+
+        //the bus comes back as floats and is converted on the way out, the dither going by the sample's place in the stream
+        const size_t sampleSize = makeWaveFormat(format, 1, 0).blockAlign();
+        uint64_t done = 0;
+        auto take = [&](const void* block, size_t bytes) {
+            const size_t n = bytes / sizeof(float);
+            convertSamples(static_cast<const float*>(block), static_cast<char*>(dst) + done * sampleSize, n, format, position + done);
+            done += n;
+        };
+        for (uint64_t first = 0; first < frames; first += BUS_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(BUS_BLOCK_SAMPLES, frames - first));
+            if (!collect(GL_RING_DEPTH - 1, take)) {
+                return false;
+            }
+            drawTone(busGenerateProgram_, tone.phase[0], tone.increment[0], first, n, n * sizeof(float));
+        }
+
+        return collect(0, take) && glGetError() == GL_NO_ERROR;
+    }
+
+    bool GLBackend::mix(const short* const* sources, const float* gains, size_t numTracks, SampleFormat format, void* dst, uint64_t count,
+        uint64_t position)
+    {
+        ScopedStage stage(Stage::Mix);
+        if (numTracks > GL_MAX_TRACKS) {
+            return false;
+        }
+
+        glUseProgram(busMixProgram_);
+        bindTracks(numTracks);
+        GLfloat busGains[GL_MAX_TRACKS] = {};
+        std::copy(gains, gains + numTracks, busGains);
+        glUniform1fv(busGainsLocation_, GL_MAX_TRACKS, busGains);
+
+        const size_t sampleSize = makeWaveFormat(format, 1, 0).blockAlign();
+        uint64_t done = 0;
+        auto take = [&](const void* block, size_t bytes) {
+            const size_t n = bytes / sizeof(float);
+            convertSamples(static_cast<const float*>(block), static_cast<char*>(dst) + done * sampleSize, n, format, position + done);
+            done += n;
+        };
+        for (uint64_t first = 0; first < count; first += BUS_BLOCK_SAMPLES) {
+            const size_t n = static_cast<size_t>(std::min<uint64_t>(BUS_BLOCK_SAMPLES, count - first));
+            if (!collect(GL_RING_DEPTH - 1, take)) {
+                return false;
+            }
+            uploadTracks(sources, numTracks, first, n);
+            ring_.draw(static_cast<GLsizei>((n + 1) / 2), n * sizeof(float));
+        }
+
+        return collect(0, take) && glGetError() == GL_NO_ERROR;
+    }
+}
+
+std::unique_ptr<Backend> createGLBackend()
+{
+    std::unique_ptr<GLBackend> backend(new GLBackend);
+    if (!backend->init()) {
+        std::cerr << "GL backend unavailable, using the CPU backends" << std::endl;
+        return nullptr;
+    }
+    return backend;
+}
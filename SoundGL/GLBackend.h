@@ -0,0 +1,15 @@
+#pragma once
+
+#include <memory>
+
+#include "Backend.h"
+
+constexpr int GL_BLOCK_SAMPLES = 1 << 20;           // samples per draw, the GPU buffers hold one block each
+constexpr int GL_CHUNK_SAMPLES = 1 << 12;           // samples sharing one float phase anchor in the generator
+constexpr int GL_MAX_TRACKS = 8;                    // tracks one mix draw takes, bigger mixes are declined
+
+// transform feedback backend: the vertex shaders of 03 and 06 generalised to any phase, gain and
+// up to GL_MAX_TRACKS tracks, fed one block at a time with the blocks read back through a FeedbackRing.
+// It owns a headless GLContext current on the creating thread, so it must stay on that thread.
+// nullptr when the host has no usable GL 3.3 context (no driver, GLEW failure)
+std::unique_ptr<Backend> createGLBackend();
@@ -0,0 +1,210 @@
+#include "GLContext.h"
+
+#include <cstring>
+#include <iostream>
+
+#include <GL/glew.h>
+
+#ifdef SOUND_GL_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#else
+#include <GLFW/glfw3.h>
+#endif
+
+namespace
+{
+    struct ContextVersion
+    {
+        int major;
+        int minor;
+    };
+
+    //buffer storage first, then what the shaders need
+    constexpr ContextVersion CONTEXT_VERSIONS[] = { { 4, 4 }, { 3, 3 } };
+
+#ifdef SOUND_GL_EGL
+    bool hasExtension(const char* extensions, const char* name)
+    {
+        const size_t length = strlen(name);
+        for (const char* p = extensions; p && (p = strstr(p, name)) != nullptr; p += length) {
+            if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+                return true;
+            }
+        }
+        return false;
+    }
+#endif
+}
+
+GLContext::~GLContext()
+{
+    destroyPlatform();
+}
+
+bool GLContext::create()
+{
+    if (!createPlatform()) {
+        destroyPlatform();
+        return false;
+    }
+
+    //core profile entry points are only loaded with glewExperimental. A GLEW built for GLX loads them all and then
+    //fails on the missing GLX display under EGL, which costs us nothing
+    glewExperimental = GL_TRUE;
+    const GLenum status = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    const bool loaded = status == GLEW_OK || status == GLEW_ERROR_NO_GLX_DISPLAY;
+#else
+    const bool loaded = status == GLEW_OK;
+#endif
+    if (!loaded) {
+        std::cerr << "Error: GLEW could not load the GL entry points: " << glewGetErrorString(status) << std::endl;
+        destroyPlatform();
+        return false;
+    }
+
+    //glewInit asks a core context for the old extension string, we drop the error that leaves behind
+    glGetError();
+
+    //without a surface there is no default framebuffer, and draws need a complete one even with the rasterizer off
+    glGenRenderbuffers(1, &renderbuffer_);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer_);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, 1, 1);
+    glGenFramebuffers(1, &framebuffer_);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer_);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffer_);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        destroyPlatform();
+        return false;
+    }
+
+    bufferStorage_ = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+    return true;
+}
+
+void GLContext::destroyFramebuffer()
+{
+    if (framebuffer_) {
+        glDeleteFramebuffers(1, &framebuffer_);
+        framebuffer_ = 0;
+    }
+    if (renderbuffer_) {
+        glDeleteRenderbuffers(1, &renderbuffer_);
+        renderbuffer_ = 0;
+    }
+}
+
+#ifdef SOUND_GL_EGL
+
+bool GLContext::createPlatform()
+{
+    //the client extensions say whether Mesa's surfaceless platform is there
+    const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    EGLDisplay display = EGL_NO_DISPLAY;
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        const auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            platform_ = "egl-surfaceless";
+        }
+    }
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        platform_ = "egl";
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+        return false;
+    }
+    display_ = display;
+
+    const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if (!eglBindAPI(EGL_OPENGL_API) || !hasExtension(extensions, "EGL_KHR_surfaceless_context")) {
+        return false;
+    }
+
+    //nothing is ever drawn to a surface, so any config will do where a context can't go without one
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    if (!hasExtension(extensions, "EGL_KHR_no_config_context") && !hasExtension(extensions, "EGL_MESA_configless_context")) {
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLint numConfigs = 0;
+        if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+            return false;
+        }
+    }
+
+    for (const ContextVersion& version : CONTEXT_VERSIONS) {
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION_KHR, version.major,
+            EGL_CONTEXT_MINOR_VERSION_KHR, version.minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+            EGL_NONE
+        };
+        EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context != EGL_NO_CONTEXT) {
+            context_ = context;
+            break;
+        }
+    }
+
+    return context_ && eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, static_cast<EGLContext>(context_));
+}
+
+void GLContext::destroyPlatform()
+{
+    if (!display_) {
+        return;
+    }
+
+    if (context_) {
+        destroyFramebuffer();
+        eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display_, static_cast<EGLContext>(context_));
+        context_ = nullptr;
+    }
+    eglTerminate(display_);
+    display_ = nullptr;
+}
+
+#else
+
+bool GLContext::createPlatform()
+{
+    if (!glfwInit()) {
+        return false;
+    }
+    display_ = this;                                //we only need to remember to terminate GLFW
+    platform_ = "glfw";
+
+    //a hidden 1x1 window, we only want its context
+    for (const ContextVersion& version : CONTEXT_VERSIONS) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, version.major);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, version.minor);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        GLFWwindow* window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+        if (window) {
+            glfwMakeContextCurrent(window);
+            context_ = window;
+            return true;
+        }
+    }
+    return false;
+}
+
+void GLContext::destroyPlatform()
+{
+    if (!display_) {
+        return;
+    }
+
+    if (context_) {
+        destroyFramebuffer();
+        glfwDestroyWindow(static_cast<GLFWwindow*>(context_));
+        context_ = nullptr;
+    }
+    glfwTerminate();
+    display_ = nullptr;
+}
+
+#endif
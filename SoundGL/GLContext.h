@@ -0,0 +1,36 @@
+#pragma once
+
+// an OpenGL context without a window, current on the thread that created it. On Linux it comes from EGL, on Mesa's
+// surfaceless platform when there is one (no display server or GPU needed, llvmpipe does), else on the default
+// display with no surface bound. Elsewhere it is the context of a hidden 1x1 GLFW window.
+// A 4.4 core profile is asked for first for buffer storage, then 3.3 core. The GL entry points are loaded by GLEW
+// and a 1x1 framebuffer stays bound, as draws need one even when nothing is rasterized
+class GLContext
+{
+public:
+    GLContext() = default;
+    ~GLContext();
+
+    GLContext(const GLContext&) = delete;
+    GLContext& operator=(const GLContext&) = delete;
+
+    bool create();
+
+    bool isCurrent() const { return context_ != nullptr; }
+    const char* platform() const { return platform_; }         // "egl-surfaceless", "egl" or "glfw"
+
+    // persistently mapped buffers (GL 4.4 or ARB_buffer_storage)
+    bool bufferStorage() const { return bufferStorage_; }
+
+private:
+    bool createPlatform();
+    void destroyPlatform();
+    void destroyFramebuffer();
+
+    void* display_ = nullptr;                       // the EGLDisplay
+    void* context_ = nullptr;                       // the EGLContext, or the GLFWwindow that owns the context
+    unsigned framebuffer_ = 0;                      // the 1x1 framebuffer draws go to, a surfaceless context has none
+    unsigned renderbuffer_ = 0;
+    const char* platform_ = "";
+    bool bufferStorage_ = false;
+};